@@ -2,13 +2,17 @@ const args = process.argv.slice(2);
 
 const blockchainUri = 'ws://localhost:' + args[0];
 const contractAddr = args[1];
-const sharedAccount = args[2];
+// Comma-separated accounts to send transactions from, round-robin.
+const accounts = args[2].split(',');
 const port = args[3];
+// Most transactions sent but not mined yet at once.
+const maxInFlight = args.length > 4 ? parseInt(args[4]) : 64;
 
 console.log('Blockchain URI', blockchainUri);
 console.log('Contract Address', contractAddr);
-console.log('Shared Account', sharedAccount);
+console.log('Accounts', accounts);
 console.log('Port', port);
+console.log('Max In Flight', maxInFlight);
 
 const PROTO_PATH = __dirname + '/../proto/two_phase_commit_adapter.proto';
 
@@ -27,70 +31,211 @@ var twoPhaseCommitAdapterProto =
 var TwoPhaseCommitClient = require('./contract_client.js');
 var contractClient = new TwoPhaseCommitClient(
     'src/blockchain/build/contracts/TwoPhaseCommit.json', blockchainUri,
-    contractAddr);
+    contractAddr, accounts, maxInFlight);
+contractClient.pipeline.reportEvery(10000);
+
+// Converts an error of a contract call to a gRPC error: rejected by the
+// contract (reverted), blockchain unreachable, or anything else.
+function toGrpcError(e) {
+  const message = String(e && e.message ? e.message : e);
+  let code = grpc.status.INTERNAL;
+  if (/revert/i.test(message)) {
+    code = grpc.status.FAILED_PRECONDITION;
+  } else if (/connection|timeout|not mined|disconnected/i.test(message)) {
+    code = grpc.status.UNAVAILABLE;
+  }
+  return {code: code, details: message};
+}
+
+// Returns a callback replying to a unary call with the error.
+function onError(callback, label) {
+  return (e) => {
+    console.log('Failed: ' + label);
+    callback(toGrpcError(e));
+  };
+}
 
 function startVoting(call, callback) {
   console.log('Received: startVoting', call.request);
+  if (call.request.signers.length > 0) {
+    contractClient.startVotingWithSigners(
+        call.request.transaction_id, call.request.signers,
+        call.request.timeout_time.seconds, () => {
+          console.log('Done: startVoting');
+          callback(null, {});
+        }, onError(callback, 'startVoting'));
+    return;
+  }
   contractClient.startVoting(
-      sharedAccount, call.request.transaction_id, call.request.cohorts,
+      call.request.transaction_id, call.request.cohorts,
       call.request.timeout_time.seconds, () => {
         console.log('Done: startVoting');
         callback(null, {});
-      });
+      }, onError(callback, 'startVoting'));
+}
+
+function startVotingBatch(call, callback) {
+  const transactions = call.request.transactions;
+  console.log('Received: startVotingBatch of', transactions.length,
+              'transactions');
+  if (transactions.some(request => request.signers.length > 0)) {
+    callback({
+      code: grpc.status.INVALID_ARGUMENT,
+      details: 'startVotingBatch does not support signers'
+    });
+    return;
+  }
+  contractClient.startVotingBatch(
+      transactions.map(request => request.transaction_id),
+      transactions.map(request => request.cohorts),
+      transactions.map(request => request.timeout_time.seconds),
+      (skipped_indices) => {
+        console.log('Done: startVotingBatch, skipped', skipped_indices.length);
+        callback(null, {skipped_indices: skipped_indices});
+      }, onError(callback, 'startVotingBatch'));
+}
+
+// Converts a ballot to the int (enum-based) defined in the smart contract
+// (sol).
+function toBallotInt(ballot) {
+  if (ballot == 'BALLOT_COMMIT') {
+    return 1;
+  } else if (ballot == 'BALLOT_ABORT') {
+    return 2;
+  }
+  return 0;
 }
 
 function vote(call, callback) {
   console.log('Received: vote', call.request);
-  // Convert to int (enum-based) defined in the smart contract (sol).
-  var ballot_int = 0;
-  if (call.request.ballot == 'BALLOT_COMMIT') {
-    ballot_int = 1;
-  } else if (call.request.ballot == 'BALLOT_ABORT') {
-    ballot_int = 2;
-  }
   contractClient.vote(
-      sharedAccount, call.request.transaction_id, call.request.cohort_id,
-      ballot_int, () => {
+      call.request.transaction_id, call.request.cohort_id,
+      toBallotInt(call.request.ballot), () => {
         console.log('Done: vote');
         callback(null, {});
-      });
+      }, onError(callback, 'vote'));
+}
+
+function voteBatch(call, callback) {
+  console.log('Received: voteBatch of', call.request.votes.length, 'votes');
+  const votes = call.request.votes;
+  contractClient.voteBatch(
+      votes.map(request => request.transaction_id),
+      votes.map(request => request.cohort_id),
+      votes.map(request => toBallotInt(request.ballot)), () => {
+        console.log('Done: voteBatch');
+        callback(null, {});
+      }, onError(callback, 'voteBatch'));
+}
+
+function signCommitVote(call, callback) {
+  console.log('Received: signCommitVote', call.request);
+  contractClient.signCommitVote(
+      call.request.transaction_id, call.request.cohort_id, (signature) => {
+        console.log('Done: signCommitVote');
+        callback(null, {signature: Buffer.from(signature.slice(2), 'hex')});
+      }, onError(callback, 'signCommitVote'));
+}
+
+function commitWithVotes(call, callback) {
+  console.log('Received: commitWithVotes', call.request.transaction_id);
+  contractClient.commitWithVotes(
+      call.request.transaction_id, call.request.signers,
+      call.request.signatures.map(
+          signature => '0x' + signature.toString('hex')),
+      () => {
+        console.log('Done: commitWithVotes');
+        callback(null, {});
+      }, onError(callback, 'commitWithVotes'));
+}
+
+// Converts a VotingDecisionOption of the contract to a VotingDecision.
+function toVotingDecision(option) {
+  switch (String(option)) {
+    case '1':
+      return 'VOTING_DECISION_PENDING';
+    case '2':
+      return 'VOTING_DECISION_COMMIT';
+    case '3':
+      return 'VOTING_DECISION_ABORT';
+  };
+  return 'VOTING_DECISION_UNKNOWN';
+}
+
+// Parses a decision serialized by the contract as '<option>:<reason>', read
+// at block_number.
+function parseVotingDecision(result, block_number) {
+  return {
+    decision: toVotingDecision(result.charAt(0)),
+    reason: result.substring(2),
+    block_number: block_number
+  };
 }
 
 function getVotingDecision(call, callback) {
   console.log('Received: getVotingDecision', call.request);
-  contractClient.getVotingDecision(call.request.transaction_id, (result) => {
-    console.log('Decision', result);
-    var decision = 'VOTING_DECISION_UNKNOWN';
-    switch (result.charAt(0)) {
-      case '1':
-        decision = 'VOTING_DECISION_PENDING';
-        break;
-      case '2':
-        decision = 'VOTING_DECISION_COMMIT';
-        break;
-      case '3':
-        decision = 'VOTING_DECISION_ABORT';
-        break;
-    };
-    callback(null, {decision: decision, reason: result.substring(2)});
-  });
+  contractClient.getVotingDecision(
+      call.request.transaction_id, (result, block_number) => {
+        console.log('Decision', result);
+        callback(null, parseVotingDecision(result, block_number));
+      }, onError(callback, 'getVotingDecision'));
   console.log('Done: getVotingDecision');
 }
 
+function getVotingDecisions(call, callback) {
+  console.log(
+      'Received: getVotingDecisions of', call.request.transaction_ids.length,
+      'transactions');
+  contractClient.getVotingDecisions(
+      call.request.transaction_ids, (results, block_number) => {
+        callback(null, {
+          decisions: results.map(
+              (result) => parseVotingDecision(result, block_number))
+        });
+        console.log('Done: getVotingDecisions');
+      }, onError(callback, 'getVotingDecisions'));
+}
+
+function watchDecisions(call) {
+  console.log('Received: watchDecisions');
+  const subscription = contractClient.watchDecisions(
+      (transaction_id, decision, block_number) => {
+        call.write({
+          transaction_id: transaction_id,
+          decision: toVotingDecision(decision),
+          block_number: block_number
+        });
+      },
+      (e) => {
+        console.log('Failed: watchDecisions');
+        call.emit('error', toGrpcError(e));
+      });
+  call.on('cancelled', () => {
+    subscription.unsubscribe();
+    console.log('Done: watchDecisions');
+  });
+}
+
 function getHeartBeat(call, callback) {
   console.log('Received: getHeartBeat', call.request);
   contractClient.getHeartBeat((result) => {
     callback(null, {is_ok: result});
     console.log('Done: getHeartBeat');
-  });
+  }, onError(callback, 'getHeartBeat'));
 }
 
 function main() {
   var server = new grpc.Server();
   server.addService(twoPhaseCommitAdapterProto.TwoPhaseCommitAdapter.service, {
     startVoting: startVoting,
+    startVotingBatch: startVotingBatch,
     vote: vote,
+    voteBatch: voteBatch,
+    signCommitVote: signCommitVote,
+    commitWithVotes: commitWithVotes,
     getVotingDecision: getVotingDecision,
+    getVotingDecisions: getVotingDecisions,
+    watchDecisions: watchDecisions,
     getHeartBeat: getHeartBeat
   });
   console.log('Starting server')
@@ -1,61 +1,180 @@
 const fs = require('fs');
 
+var TransactionPipeline = require('./transaction_pipeline.js');
+
 /*
  * TwoPhaseCommitClient is the client of TwoPhaseCommit smart contract.
+ *
+ * Transactions are sent from `accounts` round-robin, with up to
+ * `max_in_flight` of them not mined yet at once. Every call takes an
+ * on_error_callback, which gets the error of a failed call.
  */
 module.exports = class TwoPhaseCommitClient {
-  constructor(contract_json_file, contract_provider, contract_address) {
+  constructor(
+      contract_json_file, contract_provider, contract_address, accounts,
+      max_in_flight = 64) {
     var Contract = require('web3-eth-contract');
     Contract.setProvider(contract_provider);
     this.contract = new Contract(
         JSON.parse(fs.readFileSync(contract_json_file)).abi, contract_address);
+    var Web3 = require('web3');
+    this.web3 = new Web3(contract_provider);
+    this.accounts = accounts;
+    this.pipeline = new TransactionPipeline(this.web3, accounts, max_in_flight);
   }
 
   startVoting(
-      from_addr, transaction_id, cohorts, vote_timeout_time,
-      on_success_callback) {
-    this.contract.methods
-        .startVoting(transaction_id, cohorts, vote_timeout_time)
-        .send({from: from_addr})
-        .then(function(receipt) {
-          console.log('StartVoting Receipt', receipt);
-          on_success_callback();
-        })
-        .catch(function(e) {
-          console.log('StartVoting Error', e);
+      transaction_id, cohorts, vote_timeout_time, on_success_callback,
+      on_error_callback) {
+    this.send(
+        'StartVoting',
+        this.contract.methods.startVoting(
+            transaction_id, cohorts, vote_timeout_time),
+        on_success_callback, on_error_callback);
+  }
+
+  // Calls on_success_callback with the indices of the transactions the
+  // contract skipped, e.g. because their timeout passed.
+  startVotingBatch(
+      transaction_ids, cohorts, vote_timeout_times, on_success_callback,
+      on_error_callback) {
+    this.send(
+        'StartVotingBatch',
+        this.contract.methods.startVotingBatch(
+            transaction_ids, cohorts, vote_timeout_times),
+        (receipt) => {
+          // web3 sets a single event, or an array of them if repeated.
+          const skipped = receipt.events.StartVotingSkipped || [];
+          on_success_callback(
+              [].concat(skipped).map(
+                  (event) => Number(event.returnValues.index)));
+        },
+        on_error_callback);
+  }
+
+  startVotingWithSigners(
+      transaction_id, signers, vote_timeout_time, on_success_callback,
+      on_error_callback) {
+    this.send(
+        'StartVotingWithSigners',
+        this.contract.methods.startVotingWithSigners(
+            transaction_id, signers, vote_timeout_time),
+        on_success_callback, on_error_callback);
+  }
+
+  vote(
+      transaction_id, cohort_id, ballot, on_success_callback,
+      on_error_callback) {
+    this.send(
+        'Vote', this.contract.methods.vote(transaction_id, cohort_id, ballot),
+        on_success_callback, on_error_callback);
+  }
+
+  voteBatch(
+      transaction_ids, cohort_ids, ballots, on_success_callback,
+      on_error_callback) {
+    this.send(
+        'VoteBatch',
+        this.contract.methods.voteBatch(transaction_ids, cohort_ids, ballots),
+        on_success_callback, on_error_callback);
+  }
+
+  // Signs the commit vote of a cohort with the first account's key, and calls
+  // on_success_callback with the '0x'-prefixed signature.
+  signCommitVote(
+      transaction_id, cohort_id, on_success_callback, on_error_callback) {
+    this.contract.methods.getCommitVoteHash(transaction_id, cohort_id)
+        .call()
+        .then((hash) => this.web3.eth.sign(hash, this.accounts[0]))
+        .then(on_success_callback, function(e) {
+          console.log('SignCommitVote Error', e);
+          on_error_callback(e);
         });
   }
 
-  vote(from_addr, transaction_id, cohort_id, ballot, on_success_callback) {
-    this.contract.methods.vote(transaction_id, cohort_id, ballot)
-        .send({from: from_addr})
-        .then(function(receipt) {
-          console.log('Vote Receipt', receipt);
-          on_success_callback();
-        })
-        .catch(function(e) {
-          console.log('Vote Error', e);
+  commitWithVotes(
+      transaction_id, signers, signatures, on_success_callback,
+      on_error_callback) {
+    this.send(
+        'CommitWithVotes',
+        this.contract.methods.commitWithVotes(
+            transaction_id, signers, signatures),
+        on_success_callback, on_error_callback);
+  }
+
+  // Calls on_success_callback(result, block_number) with the decision at the
+  // latest block.
+  getVotingDecision(transaction_id, on_success_callback, on_error_callback) {
+    this.callAtLatestBlock(
+        this.contract.methods.getVotingDecision(transaction_id),
+        on_success_callback, function(e) {
+          console.log('Get Voting Decision Error', e);
+          on_error_callback(e);
+        });
+  }
+
+  getVotingDecisions(transaction_ids, on_success_callback, on_error_callback) {
+    this.callAtLatestBlock(
+        this.contract.methods.getVotingDecisions(transaction_ids),
+        on_success_callback, function(e) {
+          console.log('Get Voting Decisions Error', e);
+          on_error_callback(e);
         });
   }
 
-  getVotingDecision(transaction_id, on_success_callback) {
-    this.contract.methods.getVotingDecision(transaction_id)
-        .call((e, result) => {
-          if (e) {
-            console.log('Get Voting Decision Error', e);
-          } else {
-            on_success_callback(result);
-          }
+  // Calls a view method pinned to the latest block, since another one may be
+  // mined while reading the block number.
+  callAtLatestBlock(method, on_success_callback, on_error_callback) {
+    this.web3.eth.getBlockNumber()
+        .then((block_number) => method.call({}, block_number)
+                                    .then((result) => [result, block_number]))
+        .then(
+            ([result, block_number]) =>
+                on_success_callback(result, block_number),
+            on_error_callback);
+  }
+
+  // Calls on_decision(transaction_id, decision_option, block_number) for every
+  // VotingDecided event from now on, and on_error(e) if the subscription
+  // fails. Returns the subscription, which stops with unsubscribe().
+  watchDecisions(on_decision, on_error) {
+    return this.contract.events.VotingDecided()
+        .on('data',
+            (event) => {
+              on_decision(
+                  event.returnValues.transaction_id,
+                  event.returnValues.decision, event.blockNumber);
+            })
+        .on('error', (e) => {
+          console.log('Watch Decisions Error', e);
+          on_error(e);
         });
   }
 
-  getHeartBeat(on_success_callback) {
+  getHeartBeat(on_success_callback, on_error_callback) {
     this.contract.methods.getHeartBeat().call((e, result) => {
       if (e) {
         console.log('Get HeartBeat Error', e);
+        on_error_callback(e);
       } else {
         on_success_callback(result);
       }
     });
   }
+
+  // Sends the transaction of a contract method call through the pipeline, and
+  // calls on_success_callback with its receipt. Receipts are logged by hash
+  // only, since logging whole receipts slows the server down at high
+  // throughput.
+  send(label, method, on_success_callback, on_error_callback) {
+    this.pipeline.send(method).then(
+        function(receipt) {
+          console.log(label + ' Receipt', receipt.transactionHash);
+          on_success_callback(receipt);
+        },
+        function(e) {
+          console.log(label + ' Error', e);
+          on_error_callback(e);
+        });
+  }
 };
@@ -11,21 +11,27 @@ const transaction_id =
 
 var TwoPhaseCommitClient = require('./contract_client.js');
 var client = new TwoPhaseCommitClient(
-    '../build/contracts/TwoPhaseCommit.json', blockchain_uri, contract_addr);
-client.getHeartBeat(console.log);
-client.startVoting(shared_account, transaction_id, 2, timeout_time, () => {
-  client.vote(shared_account, transaction_id, 0, 1, () => {
+    '../build/contracts/TwoPhaseCommit.json', blockchain_uri, contract_addr,
+    [shared_account]);
+function fail(e) {
+  console.log('Failed.', e);
+  process.exit(1);
+}
+client.getHeartBeat(console.log, fail);
+client.startVoting(transaction_id, 2, timeout_time, () => {
+  client.vote(transaction_id, 0, 1, () => {
     console.log('Client 1st Voted.');
     client.getVotingDecision(
         transaction_id,
         (result) => {
-            console.log('Got Voting Decision (Expect PENDING).', result)});
-    client.vote(shared_account, transaction_id, 1, 1, () => {
+            console.log('Got Voting Decision (Expect PENDING).', result)},
+        fail);
+    client.vote(transaction_id, 1, 1, () => {
       console.log('Client 2nd Voted!');
       client.getVotingDecision(transaction_id, (result) => {
         console.log('Got Voting Decision (Expect COMMIT).', result);
         process.exit();
-      });
-    });
-  });
-});
+      }, fail);
+    }, fail);
+  }, fail);
+}, fail);
@@ -30,6 +30,7 @@ adapter_server_port=61362
 # Don't change this since it's the first one in the deterministic ganache client.
 account='0x90F8bf6A479f320ead074411a4B0e7944Ea8c9C1'
 blockchain_port=7545
+max_in_flight=64
 extra_args=(" ")
 while [ $# -gt 0 ]
 do
@@ -40,8 +41,9 @@ do
     --adapter_server_port*) adapter_server_port="$value";;
     --account*) account="$value";;
     --blockchain_port*) blockchain_port="$value";;
+    --max_in_flight*) max_in_flight="$value";;
     *) extra_args+=" $1";;
   esac
   shift
 done
-$adapter_server $blockchain_port $contract_address $account $adapter_server_port $extra_args{@} &
+$adapter_server $blockchain_port $contract_address $account $adapter_server_port $max_in_flight $extra_args{@} &
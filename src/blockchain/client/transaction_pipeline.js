@@ -0,0 +1,143 @@
+/*
+ * TransactionPipeline sends contract transactions from a pool of unlocked
+ * accounts, round-robin. It assigns nonces locally instead of letting web3 look
+ * one up per transaction, so many transactions of the same account can be in
+ * flight at once without racing on the same nonce.
+ */
+module.exports = class TransactionPipeline {
+  // max_in_flight caps the transactions sent but not mined yet, across all
+  // accounts. Later ones wait in a queue.
+  constructor(web3, accounts, max_in_flight) {
+    if (accounts.length == 0) {
+      throw new Error('TransactionPipeline needs at least one account');
+    }
+    this.web3 = web3;
+    this.senders = accounts.map(
+        address => ({
+          address: address,
+          nonce: null,
+          nonce_lookup: null,
+          // Nonces taken by transactions the node never gave a hash for,
+          // which later transactions reuse so they don't leave a gap.
+          free_nonces: []
+        }));
+    this.next_sender = 0;
+    this.max_in_flight = max_in_flight;
+    this.in_flight = 0;
+    this.queue = [];
+    this.confirmed = 0;
+    this.failed = 0;
+  }
+
+  // Sends the transaction of a contract method call, e.g.
+  // contract.methods.vote(...), and returns a promise of its receipt.
+  send(method) {
+    return new Promise((resolve, reject) => {
+      this.queue.push({method: method, resolve: resolve, reject: reject});
+      this.pump();
+    });
+  }
+
+  // Logs the throughput and backlog every interval_ms while there's activity.
+  reportEvery(interval_ms) {
+    let last_time = Date.now();
+    const timer = setInterval(() => {
+      const now = Date.now();
+      if (this.confirmed + this.failed + this.in_flight + this.queue.length >
+          0) {
+        console.log(
+            'Pipeline:',
+            (this.confirmed * 1000 / (now - last_time)).toFixed(1),
+            'tx/s confirmed,', this.failed, 'failed,', this.in_flight,
+            'in flight,', this.queue.length, 'queued');
+      }
+      this.confirmed = 0;
+      this.failed = 0;
+      last_time = now;
+    }, interval_ms);
+    timer.unref();
+  }
+
+  pump() {
+    while (this.in_flight < this.max_in_flight && this.queue.length > 0) {
+      const request = this.queue.shift();
+      const sender = this.senders[this.next_sender];
+      this.next_sender = (this.next_sender + 1) % this.senders.length;
+      this.in_flight++;
+      this.sendFrom(sender, request.method)
+          .then(
+              (receipt) => {
+                this.confirmed++;
+                request.resolve(receipt);
+              },
+              (e) => {
+                this.failed++;
+                request.reject(e);
+              })
+          .finally(() => {
+            this.in_flight--;
+            this.pump();
+          });
+    }
+  }
+
+  async sendFrom(sender, method) {
+    // Transactions that would revert fail here, before taking a nonce. A
+    // nonce that's never sent would stall every later transaction of the
+    // account.
+    const gas = await method.estimateGas({from: sender.address});
+    const nonce = await this.takeNonce(sender);
+    let sent = false;
+    try {
+      return await method
+          .send({from: sender.address, gas: gas, nonce: nonce})
+          .on('transactionHash', () => {
+            sent = true;
+          });
+    } catch (e) {
+      // A transaction with a receipt was mined (and reverted), so it used
+      // its nonce.
+      if (!e.receipt) {
+        if (!sent && !/nonce/i.test(String(e.message))) {
+          // The node never accepted the transaction, so its nonce is free.
+          sender.free_nonces.push(nonce);
+          sender.free_nonces.sort((a, b) => a - b);
+        } else {
+          // Either the node disagrees with the nonces assigned so far (e.g.
+          // another client sent from the account), or it has the transaction
+          // and may still mine it (e.g. it wasn't mined in time), so reusing
+          // its nonce could replace it. Look the next one up again.
+          sender.nonce = null;
+          sender.free_nonces = [];
+        }
+      }
+      throw e;
+    }
+  }
+
+  async takeNonce(sender) {
+    if (sender.free_nonces.length > 0) {
+      return sender.free_nonces.shift();
+    }
+    if (sender.nonce === null) {
+      // Sends waiting for the same lookup share it.
+      if (sender.nonce_lookup === null) {
+        sender.nonce_lookup =
+            this.web3.eth.getTransactionCount(sender.address, 'pending');
+      }
+      const lookup = sender.nonce_lookup;
+      let count;
+      try {
+        count = await lookup;
+      } finally {
+        if (sender.nonce_lookup === lookup) {
+          sender.nonce_lookup = null;
+        }
+      }
+      if (sender.nonce === null) {
+        sender.nonce = count;
+      }
+    }
+    return sender.nonce++;
+  }
+};
@@ -3,7 +3,8 @@ pragma solidity >=0.4.22 <0.9.0;
 pragma experimental ABIEncoderV2;
 
 contract TwoPhaseCommit {
-    uint256 private ballot_base = 3;
+    // Ballots are encoded in 2 bits each, so a word holds 128 of them.
+    uint256 private constant BALLOTS_PER_WORD = 128;
     enum Ballot {
         UNKNOWN,
         COMMIT,
@@ -13,12 +14,28 @@ contract TwoPhaseCommit {
     struct TransactionConfig {
         uint32 cohorts;
         uint256 vote_timeout_time;
+        // Number of cohorts whose current ballot is COMMIT (or ABORT), so
+        // deciding takes O(1) however many cohorts vote.
+        uint32 commit_votes;
+        uint32 abort_votes;
+        // Incremented each time voting starts, so restarting voting on a
+        // transaction doesn't have to clear every word of its ballots.
+        uint32 round;
+        // keccak256 of the addresses the cohorts sign their commit votes
+        // with, in cohort_id order. 0 unless voting started with signers.
+        bytes32 signers_hash;
+        // Set once every cohort's signed commit vote has been submitted, which
+        // decides to commit for good.
+        bool committed_with_votes;
     }
 
     // Voting states of each transaction.
-    // Mapping: transaction_id -> encoded(ballot[cohort_id]).
-    // We encode ballot[] into an uint256 as dynamic allocation is unsupported.
-    mapping(string => uint256) private transaction_states;
+    // Mapping: transaction_id -> round -> word index -> encoded(ballot[])
+    // where cohort_id's ballot is in word cohort_id / BALLOTS_PER_WORD.
+    // Words are only written once a cohort in them votes, so transactions
+    // can span any number of cohorts.
+    mapping(string => mapping(uint32 => mapping(uint256 => uint256)))
+        private transaction_ballots;
 
     // Configurations of each transaction.
     mapping(string => TransactionConfig) private transaction_configs;
@@ -36,13 +53,49 @@ contract TwoPhaseCommit {
         // Format: unix timestamp.
         uint256 vote_timeout_time
     ) public {
-        require(cohorts > 0);
-        require(cohorts <= 120); // Otherwise, we can't encode votes into uint256.
-        require(getNow() < vote_timeout_time);
-        transaction_configs[transaction_id].cohorts = cohorts;
-        transaction_configs[transaction_id]
-            .vote_timeout_time = vote_timeout_time;
-        transaction_states[transaction_id] = 0;
+        require(canStartVoting(cohorts, vote_timeout_time));
+        resetVoting(transaction_id, cohorts, vote_timeout_time);
+    }
+
+    // Starts voting on a new transaction whose cohorts may sign their commit
+    // votes off-chain for `commitWithVotes`, instead of each sending its own
+    // `vote`. Cohort i signs with signers[i]. Cohorts may still `vote`, e.g.
+    // to abort.
+    function startVotingWithSigners(
+        string memory transaction_id,
+        address[] memory signers,
+        // Format: unix timestamp.
+        uint256 vote_timeout_time
+    ) public {
+        require(canStartVoting(uint32(signers.length), vote_timeout_time));
+        resetVoting(transaction_id, uint32(signers.length), vote_timeout_time);
+        transaction_configs[transaction_id].signers_hash = keccak256(
+            abi.encodePacked(signers)
+        );
+    }
+
+    // Starts voting on many transactions in one blockchain transaction.
+    // Transactions that `startVoting` would reject are skipped instead of
+    // reverting the batch, emitting StartVotingSkipped so the sender can fail
+    // them. Their votes are then rejected too, so they never commit.
+    function startVotingBatch(
+        string[] memory transaction_ids,
+        uint32[] memory cohorts,
+        uint256[] memory vote_timeout_times
+    ) public {
+        require(transaction_ids.length == cohorts.length);
+        require(transaction_ids.length == vote_timeout_times.length);
+        for (uint256 i = 0; i < transaction_ids.length; i++) {
+            if (!canStartVoting(cohorts[i], vote_timeout_times[i])) {
+                emit StartVotingSkipped(i);
+                continue;
+            }
+            resetVoting(
+                transaction_ids[i],
+                cohorts[i],
+                vote_timeout_times[i]
+            );
+        }
     }
 
     // Votes if a cohort can commit a transaction.
@@ -51,16 +104,78 @@ contract TwoPhaseCommit {
         uint32 cohort_id,
         Ballot ballot
     ) public {
-        require(
-            getNow() < transaction_configs[transaction_id].vote_timeout_time
-        );
-        require(transaction_configs[transaction_id].cohorts > cohort_id);
-        require(ballot != Ballot.UNKNOWN);
-        transaction_states[transaction_id] = getNewCohortBallot(
-            transaction_states[transaction_id],
-            cohort_id,
-            ballot
-        );
+        require(canVote(transaction_id, cohort_id, ballot));
+        recordVote(transaction_id, cohort_id, ballot);
+    }
+
+    // Casts many votes in one blockchain transaction, so cohorts aren't
+    // limited by how fast the chain accepts transactions from one account.
+    // Votes that `vote` would reject (e.g. after the timeout) are skipped
+    // instead of reverting the batch, so one late transaction doesn't lose
+    // the others' votes. A skipped vote is the same as a missing one, so its
+    // transaction aborts at the timeout.
+    function voteBatch(
+        string[] memory transaction_ids,
+        uint32[] memory cohort_ids,
+        Ballot[] memory ballots
+    ) public {
+        require(transaction_ids.length == cohort_ids.length);
+        require(transaction_ids.length == ballots.length);
+        for (uint256 i = 0; i < transaction_ids.length; i++) {
+            if (!canVote(transaction_ids[i], cohort_ids[i], ballots[i])) {
+                continue;
+            }
+            recordVote(transaction_ids[i], cohort_ids[i], ballots[i]);
+        }
+    }
+
+    // Commits a transaction started with `startVotingWithSigners` in one
+    // blockchain transaction, given every cohort's signed commit vote in
+    // cohort_id order. Reverts if any signature is invalid, a cohort already
+    // voted to abort, or the timeout passed.
+    function commitWithVotes(
+        string memory transaction_id,
+        // Same as given to `startVotingWithSigners`, which only keeps their
+        // hash.
+        address[] memory signers,
+        bytes[] memory signatures
+    ) public {
+        TransactionConfig storage config = transaction_configs[transaction_id];
+        require(config.signers_hash != 0);
+        require(keccak256(abi.encodePacked(signers)) == config.signers_hash);
+        require(signatures.length == signers.length);
+        require(getNow() < config.vote_timeout_time);
+        require(config.abort_votes == 0);
+        for (uint32 i = 0; i < signatures.length; i++) {
+            require(
+                recoverSigner(
+                    getCommitVoteHash(transaction_id, i),
+                    signatures[i]
+                ) == signers[i]
+            );
+        }
+        config.committed_with_votes = true;
+        emit VotingDecided(transaction_id, VotingDecisionOption.COMMIT);
+    }
+
+    // Gets the hash a cohort signs (with eth_sign) as its commit vote for
+    // `commitWithVotes`. It covers the contract and the voting round, so the
+    // vote can't be replayed elsewhere or after voting restarts.
+    function getCommitVoteHash(string memory transaction_id, uint32 cohort_id)
+        public
+        view
+        returns (bytes32)
+    {
+        return
+            keccak256(
+                abi.encodePacked(
+                    address(this),
+                    transaction_id,
+                    transaction_configs[transaction_id].round,
+                    cohort_id,
+                    uint8(Ballot.COMMIT)
+                )
+            );
     }
 
     enum VotingDecisionOption {
@@ -75,6 +190,17 @@ contract TwoPhaseCommit {
         string reason;
     }
 
+    // Emitted by the vote that decides a transaction, so listeners learn the
+    // decision without polling. Votes on an already decided transaction emit
+    // it again, so listeners must ignore repeats. Transactions that abort
+    // because the timeout passed don't emit it, since no blockchain
+    // transaction happens then.
+    event VotingDecided(string transaction_id, VotingDecisionOption decision);
+
+    // Emitted by startVotingBatch for each transaction it skips, with the
+    // transaction's index in the batch.
+    event StartVotingSkipped(uint256 index);
+
     // Gets the voting decision of a transaction.
     // As client can't parse `VotingDecision`, we serialize it into a string.
     function getVotingDecision(string memory transaction_id)
@@ -83,58 +209,78 @@ contract TwoPhaseCommit {
         returns (string memory)
     {
         require(transaction_configs[transaction_id].cohorts > 0);
+        return serializeVotingDecision(computeVotingDecision(transaction_id));
+    }
 
-        uint32 cohorts = transaction_configs[transaction_id].cohorts;
-        uint32 votes = 0;
-        for (uint32 i = 0; i < cohorts; i++) {
-            if (
-                getCohortBallot(transaction_states[transaction_id], i) ==
-                Ballot.COMMIT
-            ) {
-                votes++;
-            }
-            if (
-                getCohortBallot(transaction_states[transaction_id], i) ==
-                Ballot.ABORT
-            ) {
-                return
-                    serializeVotingDecision(
-                        VotingDecision({
-                            option: VotingDecisionOption.ABORT,
-                            reason: "Cohort voted to abort."
-                        })
-                    );
+    // Gets the voting decisions of many transactions in one call, in the
+    // same order as `transaction_ids`. Unlike `getVotingDecision`, unknown
+    // transactions don't revert the call; their decision is UNKNOWN.
+    function getVotingDecisions(string[] memory transaction_ids)
+        public
+        view
+        returns (string[] memory)
+    {
+        string[] memory decisions = new string[](transaction_ids.length);
+        for (uint256 i = 0; i < transaction_ids.length; i++) {
+            if (transaction_configs[transaction_ids[i]].cohorts == 0) {
+                decisions[i] = serializeVotingDecision(
+                    VotingDecision({
+                        option: VotingDecisionOption.UNKNOWN,
+                        reason: "Voting has not started."
+                    })
+                );
+            } else {
+                decisions[i] = serializeVotingDecision(
+                    computeVotingDecision(transaction_ids[i])
+                );
             }
         }
+        return decisions;
+    }
 
-        if (cohorts == votes) {
+    function computeVotingDecision(string memory transaction_id)
+        private
+        view
+        returns (VotingDecision memory)
+    {
+        TransactionConfig storage config = transaction_configs[transaction_id];
+        if (config.committed_with_votes) {
             return
-                serializeVotingDecision(
-                    VotingDecision({
-                        option: VotingDecisionOption.COMMIT,
-                        reason: "Sufficient vote collected before timeout."
-                    })
-                );
+                VotingDecision({
+                    option: VotingDecisionOption.COMMIT,
+                    reason: "Signed votes collected before timeout."
+                });
+        }
+        if (config.abort_votes > 0) {
+            return
+                VotingDecision({
+                    option: VotingDecisionOption.ABORT,
+                    reason: "Cohort voted to abort."
+                });
+        }
+
+        if (config.cohorts == config.commit_votes) {
+            return
+                VotingDecision({
+                    option: VotingDecisionOption.COMMIT,
+                    reason: "Sufficient vote collected before timeout."
+                });
         }
 
         // As this point, we have insufficient votes to make a decision, so we
         // check if we've timed out.
-        if (getNow() >= transaction_configs[transaction_id].vote_timeout_time) {
+        if (getNow() >= config.vote_timeout_time) {
             return
-                serializeVotingDecision(
-                    VotingDecision({
-                        option: VotingDecisionOption.ABORT,
-                        reason: "Insufficient vote after timeout."
-                    })
-                );
+                VotingDecision({
+                    option: VotingDecisionOption.ABORT,
+                    reason: "Insufficient vote after timeout."
+                });
         }
         return
-            serializeVotingDecision(
-                VotingDecision({
-                    option: VotingDecisionOption.PENDING,
-                    reason: "Insufficient vote before timeout."
-                })
-            );
+            VotingDecision({
+                option: VotingDecisionOption.PENDING,
+                reason: "Insufficient vote before timeout."
+            });
     }
 
     // Called by test only - sets the mock time for now.
@@ -142,26 +288,130 @@ contract TwoPhaseCommit {
         mock_now = new_mock_now;
     }
 
+    function canStartVoting(uint32 cohorts, uint256 vote_timeout_time)
+        private
+        view
+        returns (bool)
+    {
+        return cohorts > 0 && getNow() < vote_timeout_time;
+    }
+
+    function resetVoting(
+        string memory transaction_id,
+        uint32 cohorts,
+        uint256 vote_timeout_time
+    ) private {
+        TransactionConfig storage config = transaction_configs[transaction_id];
+        config.cohorts = cohorts;
+        config.vote_timeout_time = vote_timeout_time;
+        config.commit_votes = 0;
+        config.abort_votes = 0;
+        config.round++;
+        config.signers_hash = 0;
+        config.committed_with_votes = false;
+    }
+
+    function recordVote(
+        string memory transaction_id,
+        uint32 cohort_id,
+        Ballot ballot
+    ) private {
+        TransactionConfig storage config = transaction_configs[transaction_id];
+        mapping(uint256 => uint256) storage words = transaction_ballots[
+            transaction_id
+        ][config.round];
+        uint256 word_index = cohort_id / BALLOTS_PER_WORD;
+        uint256 word = words[word_index];
+        uint256 position = cohort_id % BALLOTS_PER_WORD;
+
+        // A cohort may change its ballot, so it no longer counts towards
+        // the original one.
+        Ballot original = getCohortBallot(word, position);
+        if (original == Ballot.COMMIT) {
+            config.commit_votes--;
+        } else if (original == Ballot.ABORT) {
+            config.abort_votes--;
+        }
+        if (ballot == Ballot.COMMIT) {
+            config.commit_votes++;
+        } else {
+            config.abort_votes++;
+        }
+        words[word_index] = getNewCohortBallot(word, position, ballot);
+
+        VotingDecisionOption decision = computeVotingDecision(transaction_id)
+            .option;
+        if (
+            decision == VotingDecisionOption.COMMIT ||
+            decision == VotingDecisionOption.ABORT
+        ) {
+            emit VotingDecided(transaction_id, decision);
+        }
+    }
+
+    function canVote(
+        string memory transaction_id,
+        uint32 cohort_id,
+        Ballot ballot
+    ) private view returns (bool) {
+        return
+            getNow() < transaction_configs[transaction_id].vote_timeout_time &&
+            transaction_configs[transaction_id].cohorts > cohort_id &&
+            ballot != Ballot.UNKNOWN &&
+            // Signed commit votes decide for good.
+            !transaction_configs[transaction_id].committed_with_votes;
+    }
+
+    // Recovers the address that signed `hash` with eth_sign, or 0 if the
+    // signature is malformed.
+    function recoverSigner(bytes32 hash, bytes memory signature)
+        private
+        pure
+        returns (address)
+    {
+        if (signature.length != 65) {
+            return address(0);
+        }
+        bytes32 r;
+        bytes32 s;
+        uint8 v;
+        assembly {
+            r := mload(add(signature, 32))
+            s := mload(add(signature, 64))
+            v := byte(0, mload(add(signature, 96)))
+        }
+        if (v < 27) {
+            v += 27;
+        }
+        return
+            ecrecover(
+                keccak256(
+                    abi.encodePacked("\x19Ethereum Signed Message:\n32", hash)
+                ),
+                v,
+                r,
+                s
+            );
+    }
+
     function getNewCohortBallot(
         uint256 encoded,
-        uint32 cohort_id,
+        uint256 position,
         Ballot ballot
-    ) private view returns (uint256) {
-        Ballot original = getCohortBallot(encoded, cohort_id);
+    ) private pure returns (uint256) {
         // Resets the ballot.
-        encoded -= uint32(original) * (ballot_base**cohort_id);
+        encoded &= ~(uint256(3) << (2 * position));
         // Fills the new ballot.
-        encoded += uint32(ballot) * (ballot_base**cohort_id);
+        encoded |= uint256(ballot) << (2 * position);
         return encoded;
     }
 
-    function getCohortBallot(uint256 encoded, uint32 cohort_id)
+    function getCohortBallot(uint256 encoded, uint256 position)
         private
-        view
+        pure
         returns (Ballot)
     {
-        encoded /= ballot_base**cohort_id;
-        return Ballot(encoded % ballot_base);
+        return Ballot((encoded >> (2 * position)) & 3);
     }
 
     function serializeVotingDecision(VotingDecision memory voting_decision)
@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: MIT
+pragma solidity >=0.4.22 <0.9.0;
+
+// Gas-optimized version of TwoPhaseCommit. It differs from TwoPhaseCommit in
+// two ways: decisions are final (votes after the decision are accepted but
+// ignored, so a cohort can't abort a committed transaction and a retried vote
+// doesn't revert), and a voting can have at most MAX_COHORTS (120) cohorts.
+// The gas savings come from:
+// - Transactions are identified by a bytes32 (e.g. the keccak256 of the
+//   transaction id), so calls don't pay for or hash a string id.
+// - The voting state of each transaction is packed in one storage slot, so a
+//   vote reads and writes one slot.
+// - Decisions are read in O(1) from a commit counter and an abort flag instead
+//   of decoding every cohort's ballot, and are returned as an enum instead of
+//   a serialized string.
+contract TwoPhaseCommitOptimized {
+    // Same values as TwoPhaseCommit.
+    enum Ballot {
+        UNKNOWN,
+        COMMIT,
+        ABORT
+    }
+
+    enum VotingDecisionOption {
+        UNKNOWN, // Voting has not started.
+        PENDING,
+        COMMIT,
+        ABORT
+    }
+
+    // Fits in one storage slot (128 + 64 + 8 + 8 + 8 bits).
+    struct Voting {
+        // Bit i is set once cohort i voted to commit, so repeated votes are
+        // counted once. Two bits per ballot wouldn't fit 120 cohorts in the
+        // slot, and the abort flag covers the other ballot.
+        uint128 commit_bitmap;
+        // Format: unix timestamp.
+        uint64 vote_timeout_time;
+        // 0 means voting has not started.
+        uint8 cohorts;
+        uint8 commit_votes;
+        bool aborted;
+    }
+
+    // Same limit as TwoPhaseCommit, which fits the commit bitmap.
+    uint8 private constant MAX_COHORTS = 120;
+
+    mapping(bytes32 => Voting) private votings;
+
+    // Used by test only - mocked time for now. 0 means unset and should be
+    // no-op to any contract behavior.
+    uint256 private mock_now = 0;
+
+    // Emitted once per transaction, by the vote that decides it. Transactions
+    // that abort because the timeout passed don't emit it.
+    event VotingDecided(
+        bytes32 indexed transaction_id,
+        VotingDecisionOption decision
+    );
+
+    // Emitted by startVotingBatch for each transaction it skips, with the
+    // transaction's index in the batch.
+    event StartVotingSkipped(uint256 index);
+
+    // Starts voting on a new transaction with cohorts identified with
+    // cohort_id = 0, 1, ..., (cohorts - 1).
+    function startVoting(
+        bytes32 transaction_id,
+        uint8 cohorts,
+        uint64 vote_timeout_time
+    ) external {
+        require(canStartVoting(cohorts, vote_timeout_time));
+        votings[transaction_id] = Voting(
+            0,
+            vote_timeout_time,
+            cohorts,
+            0,
+            false
+        );
+    }
+
+    // Starts voting on many transactions in one blockchain transaction,
+    // skipping the ones `startVoting` would reject with StartVotingSkipped.
+    function startVotingBatch(
+        bytes32[] calldata transaction_ids,
+        uint8[] calldata cohorts,
+        uint64[] calldata vote_timeout_times
+    ) external {
+        require(transaction_ids.length == cohorts.length);
+        require(transaction_ids.length == vote_timeout_times.length);
+        for (uint256 i = 0; i < transaction_ids.length; i++) {
+            if (canStartVoting(cohorts[i], vote_timeout_times[i])) {
+                votings[transaction_ids[i]] = Voting(
+                    0,
+                    vote_timeout_times[i],
+                    cohorts[i],
+                    0,
+                    false
+                );
+            } else {
+                emit StartVotingSkipped(i);
+            }
+        }
+    }
+
+    // Votes if a cohort can commit a transaction.
+    function vote(
+        bytes32 transaction_id,
+        uint8 cohort_id,
+        Ballot ballot
+    ) external {
+        Voting memory voting = votings[transaction_id];
+        require(canVote(voting, cohort_id, ballot));
+        recordVote(transaction_id, voting, cohort_id, ballot);
+    }
+
+    // Casts many votes in one blockchain transaction, skipping the ones
+    // `vote` would reject.
+    function voteBatch(
+        bytes32[] calldata transaction_ids,
+        uint8[] calldata cohort_ids,
+        Ballot[] calldata ballots
+    ) external {
+        require(transaction_ids.length == cohort_ids.length);
+        require(transaction_ids.length == ballots.length);
+        for (uint256 i = 0; i < transaction_ids.length; i++) {
+            Voting memory voting = votings[transaction_ids[i]];
+            if (canVote(voting, cohort_ids[i], ballots[i])) {
+                recordVote(
+                    transaction_ids[i],
+                    voting,
+                    cohort_ids[i],
+                    ballots[i]
+                );
+            }
+        }
+    }
+
+    function getVotingDecision(bytes32 transaction_id)
+        external
+        view
+        returns (VotingDecisionOption)
+    {
+        return computeVotingDecision(votings[transaction_id]);
+    }
+
+    // Gets the voting decisions of many transactions in one call, in the same
+    // order as `transaction_ids`.
+    function getVotingDecisions(bytes32[] calldata transaction_ids)
+        external
+        view
+        returns (VotingDecisionOption[] memory)
+    {
+        VotingDecisionOption[] memory decisions = new VotingDecisionOption[](
+            transaction_ids.length
+        );
+        for (uint256 i = 0; i < transaction_ids.length; i++) {
+            decisions[i] = computeVotingDecision(votings[transaction_ids[i]]);
+        }
+        return decisions;
+    }
+
+    // Called by test only - sets the mock time for now.
+    function setMockNow(uint256 new_mock_now) external {
+        mock_now = new_mock_now;
+    }
+
+    function getHeartBeat() external pure returns (bool) {
+        return true;
+    }
+
+    function computeVotingDecision(Voting memory voting)
+        private
+        view
+        returns (VotingDecisionOption)
+    {
+        if (voting.cohorts == 0) {
+            return VotingDecisionOption.UNKNOWN;
+        }
+        if (voting.aborted) {
+            return VotingDecisionOption.ABORT;
+        }
+        if (voting.commit_votes == voting.cohorts) {
+            return VotingDecisionOption.COMMIT;
+        }
+        if (getNow() >= voting.vote_timeout_time) {
+            return VotingDecisionOption.ABORT;
+        }
+        return VotingDecisionOption.PENDING;
+    }
+
+    function canStartVoting(uint8 cohorts, uint64 vote_timeout_time)
+        private
+        view
+        returns (bool)
+    {
+        return
+            cohorts > 0 &&
+            cohorts <= MAX_COHORTS &&
+            getNow() < vote_timeout_time;
+    }
+
+    function canVote(
+        Voting memory voting,
+        uint8 cohort_id,
+        Ballot ballot
+    ) private view returns (bool) {
+        return
+            getNow() < voting.vote_timeout_time &&
+            cohort_id < voting.cohorts &&
+            ballot != Ballot.UNKNOWN;
+    }
+
+    // Records a valid vote, unless the transaction is already decided.
+    function recordVote(
+        bytes32 transaction_id,
+        Voting memory voting,
+        uint8 cohort_id,
+        Ballot ballot
+    ) private {
+        if (voting.aborted || voting.commit_votes == voting.cohorts) {
+            return;
+        }
+        if (ballot == Ballot.ABORT) {
+            votings[transaction_id].aborted = true;
+            emit VotingDecided(transaction_id, VotingDecisionOption.ABORT);
+            return;
+        }
+        uint128 cohort_bit = uint128(1) << cohort_id;
+        if ((voting.commit_bitmap & cohort_bit) != 0) {
+            return;
+        }
+        voting.commit_bitmap |= cohort_bit;
+        voting.commit_votes++;
+        votings[transaction_id] = voting;
+        if (voting.commit_votes == voting.cohorts) {
+            emit VotingDecided(transaction_id, VotingDecisionOption.COMMIT);
+        }
+    }
+
+    function getNow() private view returns (uint256) {
+        if (mock_now > 0) {
+            return mock_now;
+        }
+        return block.timestamp;
+    }
+}
@@ -0,0 +1,99 @@
+#include "src/blockchain/decision_cache.h"
+
+#include <algorithm>
+
+namespace blockchain {
+
+namespace {
+
+bool IsFinal(VotingDecision decision) {
+  return decision == VotingDecision::VOTING_DECISION_COMMIT ||
+         decision == VotingDecision::VOTING_DECISION_ABORT;
+}
+
+}  // namespace
+
+std::optional<VotingDecision> DecisionCache::Get(
+    const std::string& transaction_id) {
+  absl::MutexLock lock(&mutex_);
+  const auto it = entries_.find(transaction_id);
+  if (it == entries_.end() || !it->second.confirmed) {
+    return std::nullopt;
+  }
+  return it->second.decision;
+}
+
+VotingDecision DecisionCache::Update(const std::string& transaction_id,
+                                     VotingDecision decision,
+                                     uint64_t block_number) {
+  if (capacity_ == 0) {
+    return decision;
+  }
+  absl::MutexLock lock(&mutex_);
+  auto it = entries_.find(transaction_id);
+  if (!IsFinal(decision)) {
+    // A reorg reverted the decision seen before, if any.
+    if (it != entries_.end() && !it->second.confirmed) {
+      entries_.erase(it);
+    }
+    return decision;
+  }
+  if (it == entries_.end() || it->second.decision != decision) {
+    if (it == entries_.end() && entries_.size() >= capacity_) {
+      EvictOldest();
+    }
+    Entry& entry = entries_[transaction_id];
+    entry.decision = decision;
+    entry.block_number = block_number;
+    entry.confirmed = false;
+    entry.sequence = next_sequence_++;
+    insertion_order_.emplace_back(transaction_id, entry.sequence);
+    if (insertion_order_.size() > 2 * capacity_) {
+      DropStaleInsertions();
+    }
+    it = entries_.find(transaction_id);
+  }
+  Entry& entry = it->second;
+  if (!entry.confirmed) {
+    entry.confirmed = entry.block_number == 0 || block_number == 0 ||
+                      block_number >= entry.block_number + confirmations_;
+  }
+  return entry.confirmed ? entry.decision
+                         : VotingDecision::VOTING_DECISION_PENDING;
+}
+
+void DecisionCache::Erase(const std::string& transaction_id) {
+  absl::MutexLock lock(&mutex_);
+  entries_.erase(transaction_id);
+}
+
+bool DecisionCache::IsStale(
+    const std::pair<std::string, uint64_t>& insertion) const {
+  const auto it = entries_.find(insertion.first);
+  return it == entries_.end() || it->second.sequence != insertion.second;
+}
+
+void DecisionCache::DropStaleInsertions() {
+  insertion_order_.erase(
+      std::remove_if(insertion_order_.begin(), insertion_order_.end(),
+                     [this](const std::pair<std::string, uint64_t>& insertion)
+                         ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+                           return IsStale(insertion);
+                         }),
+      insertion_order_.end());
+}
+
+void DecisionCache::EvictOldest() {
+  while (!insertion_order_.empty()) {
+    const bool stale = IsStale(insertion_order_.front());
+    if (!stale) {
+      entries_.erase(insertion_order_.front().first);
+    }
+    insertion_order_.pop_front();
+    if (!stale) {
+      return;
+    }
+  }
+}
+
+}  // namespace blockchain
@@ -0,0 +1,72 @@
+#ifndef SRC_BLOCKCHAIN_DECISION_CACHE_H_
+
+#define SRC_BLOCKCHAIN_DECISION_CACHE_H_
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "src/blockchain/proto/two_phase_commit_adapter.grpc.pb.h"
+
+namespace blockchain {
+
+// Remembers the final (COMMIT or ABORT) voting decisions read from the
+// blockchain, so they're only read once. A final decision is only reported
+// once |confirmations| blocks are mined on top of the block it was first seen
+// at, in case a reorg reverts it; until then it's reported as PENDING.
+// Decisions read from an unknown block (0) are confirmed right away.
+// Thread-safe.
+class DecisionCache {
+ public:
+  // Keeps at most |capacity| transactions, evicting the oldest.
+  DecisionCache(int confirmations, size_t capacity)
+      : confirmations_(confirmations), capacity_(capacity) {}
+
+  DecisionCache(const DecisionCache&) = delete;
+  DecisionCache& operator=(const DecisionCache&) = delete;
+
+  // Returns the confirmed final decision of the transaction, if cached.
+  std::optional<VotingDecision> Get(const std::string& transaction_id);
+
+  // Records |decision| read from the blockchain when |block_number| was the
+  // latest block, and returns the decision to report.
+  VotingDecision Update(const std::string& transaction_id,
+                        VotingDecision decision, uint64_t block_number);
+
+  // Forgets the transaction, e.g. because its voting restarted.
+  void Erase(const std::string& transaction_id);
+
+ private:
+  struct Entry {
+    VotingDecision decision;
+    // First block the decision was seen at.
+    uint64_t block_number;
+    bool confirmed;
+    // Position in |insertion_order_|.
+    uint64_t sequence;
+  };
+
+  // Whether the insertion's entry was erased or replaced since.
+  bool IsStale(const std::pair<std::string, uint64_t>& insertion) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DropStaleInsertions() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void EvictOldest() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const int confirmations_;
+  const size_t capacity_;
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  // Transaction ids in insertion order, with the sequence of their entry.
+  // Stale insertions are skipped when evicting.
+  std::deque<std::pair<std::string, uint64_t>> insertion_order_
+      ABSL_GUARDED_BY(mutex_);
+  uint64_t next_sequence_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_DECISION_CACHE_H_
@@ -0,0 +1,75 @@
+#include "src/blockchain/decision_cache.h"
+
+#include <optional>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace blockchain {
+
+namespace {
+
+using ::testing::Optional;
+
+constexpr VotingDecision kPending = VotingDecision::VOTING_DECISION_PENDING;
+constexpr VotingDecision kCommit = VotingDecision::VOTING_DECISION_COMMIT;
+constexpr VotingDecision kAbort = VotingDecision::VOTING_DECISION_ABORT;
+
+TEST(DecisionCacheTest, CachesOnlyFinalDecisions) {
+  DecisionCache cache(/*confirmations=*/0, /*capacity=*/10);
+  EXPECT_EQ(cache.Update("t1", kPending, 1), kPending);
+  EXPECT_EQ(cache.Get("t1"), std::nullopt);
+  EXPECT_EQ(cache.Update("t1", kCommit, 2), kCommit);
+  EXPECT_THAT(cache.Get("t1"), Optional(kCommit));
+  EXPECT_EQ(cache.Update("t2", kAbort, 2), kAbort);
+  EXPECT_THAT(cache.Get("t2"), Optional(kAbort));
+}
+
+TEST(DecisionCacheTest, ReportsDecisionsOnceConfirmed) {
+  DecisionCache cache(/*confirmations=*/3, /*capacity=*/10);
+  EXPECT_EQ(cache.Update("t1", kCommit, 5), kPending);
+  EXPECT_EQ(cache.Update("t1", kCommit, 7), kPending);
+  EXPECT_EQ(cache.Get("t1"), std::nullopt);
+  EXPECT_EQ(cache.Update("t1", kCommit, 8), kCommit);
+  EXPECT_THAT(cache.Get("t1"), Optional(kCommit));
+}
+
+TEST(DecisionCacheTest, RestartsConfirmationsIfTheDecisionIsReverted) {
+  DecisionCache cache(/*confirmations=*/2, /*capacity=*/10);
+  EXPECT_EQ(cache.Update("t1", kCommit, 5), kPending);
+  // A reorg dropped the deciding vote.
+  EXPECT_EQ(cache.Update("t1", kPending, 6), kPending);
+  EXPECT_EQ(cache.Update("t1", kCommit, 7), kPending);
+  EXPECT_EQ(cache.Update("t1", kAbort, 8), kPending);
+  EXPECT_EQ(cache.Update("t1", kAbort, 9), kPending);
+  EXPECT_EQ(cache.Update("t1", kAbort, 10), kAbort);
+}
+
+TEST(DecisionCacheTest, ConfirmsDecisionsFromUnknownBlocksRightAway) {
+  DecisionCache cache(/*confirmations=*/3, /*capacity=*/10);
+  EXPECT_EQ(cache.Update("t1", kCommit, 0), kCommit);
+}
+
+TEST(DecisionCacheTest, EvictsTheOldestTransactions) {
+  DecisionCache cache(/*confirmations=*/0, /*capacity=*/2);
+  cache.Update("t1", kCommit, 1);
+  cache.Update("t2", kCommit, 1);
+  cache.Erase("t2");
+  cache.Update("t2", kAbort, 2);
+  cache.Update("t3", kCommit, 3);
+  EXPECT_EQ(cache.Get("t1"), std::nullopt);
+  EXPECT_THAT(cache.Get("t2"), Optional(kAbort));
+  EXPECT_THAT(cache.Get("t3"), Optional(kCommit));
+  cache.Update("t4", kCommit, 4);
+  EXPECT_EQ(cache.Get("t2"), std::nullopt);
+}
+
+TEST(DecisionCacheTest, DoesNothingWithoutCapacity) {
+  DecisionCache cache(/*confirmations=*/3, /*capacity=*/0);
+  EXPECT_EQ(cache.Update("t1", kCommit, 1), kCommit);
+  EXPECT_EQ(cache.Get("t1"), std::nullopt);
+}
+
+}  // namespace
+
+}  // namespace blockchain
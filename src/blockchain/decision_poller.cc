@@ -0,0 +1,115 @@
+#include "src/blockchain/decision_poller.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "glog/logging.h"
+
+namespace blockchain {
+
+namespace {
+
+bool IsFinal(VotingDecision decision) {
+  return decision == VotingDecision::VOTING_DECISION_COMMIT ||
+         decision == VotingDecision::VOTING_DECISION_ABORT;
+}
+
+}  // namespace
+
+DecisionPoller::DecisionPoller(TwoPhaseCommit* blockchain,
+                               const DecisionPollerOptions& options)
+    : blockchain_(blockchain),
+      options_(options),
+      poll_thread_([this]() { PollUntilStopped(); }) {
+  if (options.watch_decisions) {
+    subscription_ = blockchain_->WatchDecisions(
+        [this](const VotingDecidedEvent& event) { OnDecision(event); });
+  }
+}
+
+DecisionPoller::~DecisionPoller() {
+  subscription_.reset();
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+  }
+  poll_thread_.join();
+}
+
+VotingDecision DecisionPoller::WaitForDecision(
+    const std::string& transaction_id, absl::Time deadline,
+    absl::Time timeout_time) {
+  absl::MutexLock lock(&mutex_);
+  // Stays valid while it has waiters, since only the last waiter erases it.
+  InFlightTransaction& transaction = in_flight_[transaction_id];
+  ++transaction.num_waiters;
+  transaction.timeout_time = std::min(transaction.timeout_time, timeout_time);
+  const auto decided = [this, &transaction]() {
+    mutex_.AssertReaderHeld();
+    return IsFinal(transaction.decision);
+  };
+  mutex_.AwaitWithDeadline(absl::Condition(&decided), deadline);
+  const VotingDecision decision = transaction.decision;
+  if (--transaction.num_waiters == 0) {
+    in_flight_.erase(transaction_id);
+  }
+  return IsFinal(decision) ? decision
+                           : VotingDecision::VOTING_DECISION_PENDING;
+}
+
+void DecisionPoller::OnDecision(const VotingDecidedEvent& event) {
+  if (!IsFinal(event.decision())) {
+    return;
+  }
+  absl::MutexLock lock(&mutex_);
+  // Decisions of transactions nobody waits for are dropped. If a waiter
+  // arrives later, polling finds the decision.
+  auto it = in_flight_.find(event.transaction_id());
+  if (it != in_flight_.end()) {
+    it->second.decision = event.decision();
+  }
+}
+
+void DecisionPoller::PollUntilStopped() {
+  std::vector<std::string> transaction_ids;
+  absl::MutexLock lock(&mutex_);
+  while (!mutex_.AwaitWithTimeout(absl::Condition(&stopped_),
+                                  options_.poll_interval)) {
+    transaction_ids.clear();
+    for (const auto& [transaction_id, transaction] : in_flight_) {
+      if (!IsFinal(transaction.decision)) {
+        transaction_ids.push_back(transaction_id);
+      }
+    }
+    if (transaction_ids.empty()) {
+      continue;
+    }
+    const absl::Time poll_time = absl::Now();
+    mutex_.Unlock();
+    const absl::StatusOr<absl::flat_hash_map<std::string, VotingDecision>>
+        decisions = blockchain_->GetVotingDecisions(transaction_ids);
+    mutex_.Lock();
+    if (!decisions.ok()) {
+      // Waiters keep waiting until the next poll succeeds or they time out.
+      LOG(WARNING) << "Failed to poll voting decisions: " << decisions.status();
+      continue;
+    }
+    for (const auto& [transaction_id, decision] : *decisions) {
+      auto it = in_flight_.find(transaction_id);
+      // The transaction's waiters may have timed out while polling.
+      if (it == in_flight_.end()) {
+        continue;
+      }
+      if (decision == VotingDecision::VOTING_DECISION_UNKNOWN &&
+          poll_time >= it->second.timeout_time) {
+        // E.g. the coordinator failed to start the voting in time.
+        it->second.decision = VotingDecision::VOTING_DECISION_ABORT;
+      } else {
+        it->second.decision = decision;
+      }
+    }
+  }
+}
+
+}  // namespace blockchain
@@ -0,0 +1,76 @@
+#ifndef SRC_BLOCKCHAIN_DECISION_POLLER_H_
+
+#define SRC_BLOCKCHAIN_DECISION_POLLER_H_
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "src/blockchain/two_phase_commit.h"
+
+namespace blockchain {
+
+struct DecisionPollerOptions {
+  // How often the decisions of the in-flight transactions are fetched.
+  absl::Duration poll_interval = absl::Seconds(1);
+  // Whether to also subscribe to the decisions, so waiters learn them as
+  // soon as they're in a block. Polling is still needed for transactions
+  // that abort at their timeout or are decided while the stream is down.
+  bool watch_decisions = false;
+};
+
+// Waits for the voting decisions of many transactions with one
+// GetVotingDecisions call per poll for all of them, rather than one
+// GetVotingDecision call per transaction. Thread-safe.
+class DecisionPoller {
+ public:
+  DecisionPoller(
+      TwoPhaseCommit* blockchain,
+      const DecisionPollerOptions& options = DecisionPollerOptions());
+
+  // Stops polling. There must be no threads waiting for a decision.
+  ~DecisionPoller();
+
+  DecisionPoller(const DecisionPoller&) = delete;
+  DecisionPoller& operator=(const DecisionPoller&) = delete;
+
+  // Blocks until the blockchain decides to commit or abort |transaction_id|.
+  // Returns VOTING_DECISION_PENDING if |deadline| passes first. Since the
+  // contract can't start a voting past its timeout, a transaction whose voting
+  // a poll started after |timeout_time| finds unknown is never decided and
+  // returned as aborted.
+  VotingDecision WaitForDecision(
+      const std::string& transaction_id, absl::Time deadline,
+      absl::Time timeout_time = absl::InfiniteFuture());
+
+ private:
+  struct InFlightTransaction {
+    VotingDecision decision = VotingDecision::VOTING_DECISION_PENDING;
+    // The earliest timeout_time of its waiters.
+    absl::Time timeout_time = absl::InfiniteFuture();
+    int num_waiters = 0;
+  };
+
+  void PollUntilStopped();
+
+  // Records a decision streamed by the subscription.
+  void OnDecision(const VotingDecidedEvent& event);
+
+  TwoPhaseCommit* const blockchain_;
+  const DecisionPollerOptions options_;
+  absl::Mutex mutex_;
+  // Node based so waiters can hold references to their transaction.
+  absl::node_hash_map<std::string, InFlightTransaction> in_flight_
+      ABSL_GUARDED_BY(mutex_);
+  bool stopped_ ABSL_GUARDED_BY(mutex_) = false;
+  std::thread poll_thread_;
+  // Null unless watching decisions.
+  std::unique_ptr<DecisionSubscription> subscription_;
+};
+
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_DECISION_POLLER_H_
@@ -0,0 +1,149 @@
+#include "src/blockchain/decision_poller.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/blockchain/proto/two_phase_commit_adapter_mock.grpc.pb.h"
+
+namespace {
+
+using ::blockchain::DecisionPoller;
+using ::blockchain::DecisionPollerOptions;
+using ::blockchain::GetVotingDecisionsRequest;
+using ::blockchain::GetVotingDecisionsResponse;
+using ::blockchain::MockTwoPhaseCommitAdapterStub;
+using ::blockchain::TwoPhaseCommit;
+using ::blockchain::VotingDecision;
+using ::testing::_;
+
+DecisionPollerOptions FastPolling() {
+  DecisionPollerOptions options;
+  options.poll_interval = absl::Milliseconds(5);
+  return options;
+}
+
+TEST(DecisionPollerTest, PollsAllWaitingTransactionsTogether) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  std::atomic<int> max_ids_per_poll = 0;
+  // "commit" commits and "abort" aborts once both are being waited for.
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _))
+      .WillRepeatedly([&max_ids_per_poll](
+                          grpc::ClientContext*,
+                          const GetVotingDecisionsRequest& request,
+                          GetVotingDecisionsResponse* response) {
+        const bool both_waiting = request.transaction_ids_size() == 2;
+        if (both_waiting) {
+          max_ids_per_poll = 2;
+        }
+        for (const std::string& transaction_id : request.transaction_ids()) {
+          VotingDecision decision = VotingDecision::VOTING_DECISION_PENDING;
+          if (both_waiting) {
+            decision = transaction_id == "commit"
+                           ? VotingDecision::VOTING_DECISION_COMMIT
+                           : VotingDecision::VOTING_DECISION_ABORT;
+          }
+          response->add_decisions()->set_decision(decision);
+        }
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit blockchain(std::move(stub));
+  DecisionPoller poller(&blockchain, FastPolling());
+
+  VotingDecision commit_decision;
+  std::thread commit_thread([&poller, &commit_decision]() {
+    commit_decision = poller.WaitForDecision("commit", absl::InfiniteFuture());
+  });
+  EXPECT_EQ(poller.WaitForDecision("abort", absl::InfiniteFuture()),
+            VotingDecision::VOTING_DECISION_ABORT);
+  commit_thread.join();
+  EXPECT_EQ(commit_decision, VotingDecision::VOTING_DECISION_COMMIT);
+  EXPECT_EQ(max_ids_per_poll, 2);
+}
+
+// Streams one commit decision for "t1" once, then nothing.
+class OneDecisionReader
+    : public grpc::ClientReaderInterface<blockchain::VotingDecidedEvent> {
+ public:
+  grpc::Status Finish() override { return grpc::Status::OK; }
+  bool NextMessageSize(uint32_t* size) override {
+    *size = 0;
+    return !sent_;
+  }
+  bool Read(blockchain::VotingDecidedEvent* event) override {
+    if (sent_) {
+      return false;
+    }
+    // Gives the waiter time to register.
+    absl::SleepFor(absl::Milliseconds(50));
+    event->set_transaction_id("t1");
+    event->set_decision(VotingDecision::VOTING_DECISION_COMMIT);
+    sent_ = true;
+    return true;
+  }
+  void WaitForInitialMetadata() override {}
+
+ private:
+  bool sent_ = false;
+};
+
+TEST(DecisionPollerTest, WatchedDecisionsWakeWaitersBeforeThePoll) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, WatchDecisionsRaw(_, _))
+      .WillOnce(::testing::Return(new OneDecisionReader()))
+      .WillRepeatedly([](grpc::ClientContext*,
+                         const blockchain::WatchDecisionsRequest&) {
+        return new OneDecisionReader();
+      });
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _)).Times(0);
+  TwoPhaseCommit blockchain(std::move(stub));
+  DecisionPollerOptions options;
+  options.poll_interval = absl::Hours(1);
+  options.watch_decisions = true;
+  DecisionPoller poller(&blockchain, options);
+
+  EXPECT_EQ(poller.WaitForDecision("t1", absl::Now() + absl::Seconds(10)),
+            VotingDecision::VOTING_DECISION_COMMIT);
+}
+
+TEST(DecisionPollerTest, ReturnsPendingAtTheDeadline) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _))
+      .WillRepeatedly(
+          ::testing::Return(grpc::Status(grpc::UNAVAILABLE, "down")));
+  TwoPhaseCommit blockchain(std::move(stub));
+  DecisionPoller poller(&blockchain, FastPolling());
+
+  EXPECT_EQ(poller.WaitForDecision("t1", absl::Now() + absl::Milliseconds(30)),
+            VotingDecision::VOTING_DECISION_PENDING);
+}
+
+TEST(DecisionPollerTest, AbortsTransactionsUnknownPastTheirTimeout) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _))
+      .WillRepeatedly([](grpc::ClientContext*,
+                         const GetVotingDecisionsRequest& request,
+                         GetVotingDecisionsResponse* response) {
+        for (int i = 0; i < request.transaction_ids_size(); ++i) {
+          response->add_decisions()->set_decision(
+              VotingDecision::VOTING_DECISION_UNKNOWN);
+        }
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit blockchain(std::move(stub));
+  DecisionPoller poller(&blockchain, FastPolling());
+
+  // Unknown before the timeout, since the voting may still start.
+  EXPECT_EQ(poller.WaitForDecision("t1", absl::Now() + absl::Milliseconds(30),
+                                   absl::InfiniteFuture()),
+            VotingDecision::VOTING_DECISION_PENDING);
+  EXPECT_EQ(poller.WaitForDecision("t1", absl::Now() + absl::Seconds(10),
+                                   absl::Now() + absl::Milliseconds(20)),
+            VotingDecision::VOTING_DECISION_ABORT);
+}
+
+}  // namespace
@@ -0,0 +1,322 @@
+#include "src/blockchain/ethereum_abi.h"
+
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/strip.h"
+#include "absl/strings/str_cat.h"
+
+namespace blockchain {
+namespace abi {
+
+namespace {
+
+constexpr size_t kWordSize = 32;
+// Bytes absorbed per Keccak-f permutation for a 256-bit output.
+constexpr size_t kKeccakRate = 136;
+
+constexpr uint64_t kKeccakRoundConstants[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a,
+    0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a,
+    0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089,
+    0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081,
+    0x8000000000008080, 0x0000000080000001, 0x8000000080008008};
+constexpr int kKeccakRotations[24] = {1,  3,  6,  10, 15, 21, 28, 36,
+                                      45, 55, 2,  14, 27, 41, 56, 8,
+                                      25, 43, 62, 18, 39, 61, 20, 44};
+constexpr int kKeccakPiLanes[24] = {10, 7,  11, 17, 18, 3, 5,  16,
+                                    8,  21, 24, 4,  15, 23, 19, 13,
+                                    12, 2,  20, 14, 22, 9,  6,  1};
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+void KeccakF(uint64_t state[25]) {
+  for (const uint64_t round_constant : kKeccakRoundConstants) {
+    // Theta.
+    uint64_t columns[5];
+    for (int i = 0; i < 5; ++i) {
+      columns[i] = state[i] ^ state[i + 5] ^ state[i + 10] ^ state[i + 15] ^
+                   state[i + 20];
+    }
+    for (int i = 0; i < 5; ++i) {
+      const uint64_t t =
+          columns[(i + 4) % 5] ^ RotateLeft(columns[(i + 1) % 5], 1);
+      for (int j = 0; j < 25; j += 5) {
+        state[j + i] ^= t;
+      }
+    }
+    // Rho and pi.
+    uint64_t t = state[1];
+    for (int i = 0; i < 24; ++i) {
+      const int lane = kKeccakPiLanes[i];
+      const uint64_t next = state[lane];
+      state[lane] = RotateLeft(t, kKeccakRotations[i]);
+      t = next;
+    }
+    // Chi.
+    for (int j = 0; j < 25; j += 5) {
+      uint64_t row[5];
+      for (int i = 0; i < 5; ++i) {
+        row[i] = state[j + i];
+      }
+      for (int i = 0; i < 5; ++i) {
+        state[j + i] ^= ~row[(i + 1) % 5] & row[(i + 2) % 5];
+      }
+    }
+    // Iota.
+    state[0] ^= round_constant;
+  }
+}
+
+// XORs |block| (at most kKeccakRate bytes) into the state's little-endian
+// lanes.
+void Absorb(absl::string_view block, uint64_t state[25]) {
+  for (size_t i = 0; i < block.size(); ++i) {
+    state[i / 8] ^= static_cast<uint64_t>(static_cast<uint8_t>(block[i]))
+                    << (8 * (i % 8));
+  }
+}
+
+std::string Word(uint64_t value) {
+  std::string word(kWordSize, '\0');
+  for (int i = 0; i < 8; ++i) {
+    word[kWordSize - 1 - i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+  return word;
+}
+
+void AppendPadded(absl::string_view data, std::string& out) {
+  out.append(data.data(), data.size());
+  out.append((kWordSize - data.size() % kWordSize) % kWordSize, '\0');
+}
+
+// Reads the word at |offset| as an integer, failing if it's out of range or
+// doesn't fit in 64 bits.
+absl::StatusOr<uint64_t> ReadWord(absl::string_view output, uint64_t offset) {
+  if (offset > output.size() || output.size() - offset < kWordSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("ABI output too short for a word at ", offset));
+  }
+  uint64_t value = 0;
+  for (size_t i = 0; i < kWordSize; ++i) {
+    const uint8_t byte = output[offset + i];
+    if (i < kWordSize - 8) {
+      if (byte != 0) {
+        return absl::OutOfRangeError("ABI word doesn't fit in 64 bits");
+      }
+    } else {
+      value = (value << 8) | byte;
+    }
+  }
+  return value;
+}
+
+// Reads the bytes/string whose length word is at |offset|.
+absl::StatusOr<std::string> ReadBytes(absl::string_view output,
+                                      uint64_t offset) {
+  absl::StatusOr<uint64_t> size = ReadWord(output, offset);
+  if (!size.ok()) {
+    return size.status();
+  }
+  const uint64_t start = offset + kWordSize;
+  if (output.size() - start < *size) {
+    return absl::InvalidArgumentError("ABI output too short for its bytes");
+  }
+  return std::string(output.substr(start, *size));
+}
+
+}  // namespace
+
+std::string Keccak256(absl::string_view data) {
+  uint64_t state[25] = {};
+  while (data.size() >= kKeccakRate) {
+    Absorb(data.substr(0, kKeccakRate), state);
+    KeccakF(state);
+    data.remove_prefix(kKeccakRate);
+  }
+  std::string last_block(kKeccakRate, '\0');
+  std::memcpy(&last_block[0], data.data(), data.size());
+  last_block[data.size()] ^= 0x01;
+  last_block[kKeccakRate - 1] ^= static_cast<char>(0x80);
+  Absorb(last_block, state);
+  KeccakF(state);
+
+  std::string hash(32, '\0');
+  for (size_t i = 0; i < hash.size(); ++i) {
+    hash[i] = static_cast<char>((state[i / 8] >> (8 * (i % 8))) & 0xff);
+  }
+  return hash;
+}
+
+std::string ToHex(absl::string_view bytes) {
+  return absl::StrCat("0x", absl::BytesToHexString(bytes));
+}
+
+absl::StatusOr<std::string> FromHex(absl::string_view hex) {
+  absl::ConsumePrefix(&hex, "0x");
+  if (hex.size() % 2 != 0 ||
+      hex.find_first_not_of("0123456789abcdefABCDEF") != hex.npos) {
+    return absl::InvalidArgumentError(absl::StrCat("Invalid hex: ", hex));
+  }
+  return absl::HexStringToBytes(hex);
+}
+
+std::string ToQuantity(uint64_t value) {
+  return absl::StrCat("0x", absl::Hex(value));
+}
+
+absl::StatusOr<uint64_t> FromQuantity(absl::string_view quantity) {
+  const absl::Status error =
+      absl::InvalidArgumentError(absl::StrCat("Invalid quantity: ", quantity));
+  if (!absl::ConsumePrefix(&quantity, "0x") || quantity.empty() ||
+      quantity.size() > 16) {
+    return error;
+  }
+  uint64_t value = 0;
+  for (const char c : quantity) {
+    if (!absl::ascii_isxdigit(c)) {
+      return error;
+    }
+    value = (value << 4) | (absl::ascii_isdigit(c)
+                                ? c - '0'
+                                : absl::ascii_tolower(c) - 'a' + 10);
+  }
+  return value;
+}
+
+Value Value::Uint(uint64_t value) { return Value(Type::kWord, Word(value)); }
+
+absl::StatusOr<Value> Value::Address(absl::string_view hex) {
+  absl::StatusOr<std::string> address = FromHex(hex);
+  if (!address.ok()) {
+    return address.status();
+  }
+  if (address->size() != 20) {
+    return absl::InvalidArgumentError(absl::StrCat("Invalid address: ", hex));
+  }
+  return Value(Type::kWord,
+               std::string(kWordSize - address->size(), '\0') + *address);
+}
+
+Value Value::String(std::string value) {
+  return Value(Type::kBytes, std::move(value));
+}
+
+Value Value::Bytes(std::string value) {
+  return Value(Type::kBytes, std::move(value));
+}
+
+Value Value::Array(std::vector<Value> elements) {
+  return Value(Type::kArray, "", std::move(elements));
+}
+
+void Value::EncodeTuple(const std::vector<Value>& values, std::string& out) {
+  // Dynamic values are encoded after every value's head, which is their
+  // offset from the start of the tuple.
+  std::string tail;
+  for (const Value& value : values) {
+    if (value.IsDynamic()) {
+      out += Word(kWordSize * values.size() + tail.size());
+      value.Encode(tail);
+    } else {
+      value.Encode(out);
+    }
+  }
+  out += tail;
+}
+
+void Value::Encode(std::string& out) const {
+  switch (type_) {
+    case Type::kWord:
+      out += data_;
+      break;
+    case Type::kBytes:
+      out += Word(data_.size());
+      AppendPadded(data_, out);
+      break;
+    case Type::kArray:
+      out += Word(elements_.size());
+      EncodeTuple(elements_, out);
+      break;
+  }
+}
+
+std::string EncodeCall(absl::string_view signature,
+                       const std::vector<Value>& args) {
+  std::string calldata = Keccak256(signature).substr(0, 4);
+  Value::EncodeTuple(args, calldata);
+  return calldata;
+}
+
+absl::StatusOr<bool> DecodeBool(absl::string_view output) {
+  absl::StatusOr<uint64_t> value = ReadWord(output, 0);
+  if (!value.ok()) {
+    return value.status();
+  }
+  return *value != 0;
+}
+
+absl::StatusOr<uint64_t> DecodeUint(absl::string_view output) {
+  return ReadWord(output, 0);
+}
+
+absl::StatusOr<std::string> DecodeBytes32(absl::string_view output) {
+  if (output.size() < kWordSize) {
+    return absl::InvalidArgumentError("ABI output too short for bytes32");
+  }
+  return std::string(output.substr(0, kWordSize));
+}
+
+absl::StatusOr<std::string> DecodeString(absl::string_view output) {
+  absl::StatusOr<uint64_t> offset = ReadWord(output, 0);
+  if (!offset.ok()) {
+    return offset.status();
+  }
+  return ReadBytes(output, *offset);
+}
+
+absl::StatusOr<std::vector<std::string>> DecodeStringArray(
+    absl::string_view output) {
+  absl::StatusOr<uint64_t> offset = ReadWord(output, 0);
+  if (!offset.ok()) {
+    return offset.status();
+  }
+  absl::StatusOr<uint64_t> size = ReadWord(output, *offset);
+  if (!size.ok()) {
+    return size.status();
+  }
+  // The strings' offsets are relative to the first one's.
+  const uint64_t elements = *offset + kWordSize;
+  if ((output.size() - elements) / kWordSize < *size) {
+    return absl::InvalidArgumentError("ABI output too short for its array");
+  }
+  std::vector<std::string> strings;
+  strings.reserve(*size);
+  for (uint64_t i = 0; i < *size; ++i) {
+    absl::StatusOr<uint64_t> string_offset =
+        ReadWord(output, elements + kWordSize * i);
+    if (!string_offset.ok()) {
+      return string_offset.status();
+    }
+    if (*string_offset > output.size() - elements) {
+      return absl::InvalidArgumentError("ABI string offset out of range");
+    }
+    absl::StatusOr<std::string> string =
+        ReadBytes(output, elements + *string_offset);
+    if (!string.ok()) {
+      return string.status();
+    }
+    strings.push_back(*std::move(string));
+  }
+  return strings;
+}
+
+}  // namespace abi
+}  // namespace blockchain
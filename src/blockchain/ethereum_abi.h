@@ -0,0 +1,80 @@
+#ifndef SRC_BLOCKCHAIN_ETHEREUM_ABI_H_
+
+#define SRC_BLOCKCHAIN_ETHEREUM_ABI_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace blockchain {
+namespace abi {
+
+// Keccak-256 of |data| as Ethereum uses it (the original Keccak padding, not
+// the SHA3-256 one), as 32 raw bytes.
+std::string Keccak256(absl::string_view data);
+
+// Returns "0x" followed by the lowercase hex of |bytes|.
+std::string ToHex(absl::string_view bytes);
+
+// Parses hex with or without the "0x" prefix.
+absl::StatusOr<std::string> FromHex(absl::string_view hex);
+
+// Returns the "0x"-prefixed minimal hex of |value|, as JSON-RPC quantities
+// are encoded.
+std::string ToQuantity(uint64_t value);
+
+// Parses a JSON-RPC quantity, failing if it doesn't fit in 64 bits.
+absl::StatusOr<uint64_t> FromQuantity(absl::string_view quantity);
+
+// An argument of one of the ABI types the TwoPhaseCommit contract takes.
+class Value {
+ public:
+  // Any uintN, including enums.
+  static Value Uint(uint64_t value);
+  // Fails unless |hex| is a 20-byte address.
+  static absl::StatusOr<Value> Address(absl::string_view hex);
+  static Value String(std::string value);
+  static Value Bytes(std::string value);
+  // A dynamic-length array (T[]) of values of the same type.
+  static Value Array(std::vector<Value> elements);
+
+  // Appends the encoding of the values as a tuple, e.g. function arguments.
+  static void EncodeTuple(const std::vector<Value>& values, std::string& out);
+
+ private:
+  enum class Type { kWord, kBytes, kArray };
+
+  Value(Type type, std::string data, std::vector<Value> elements = {})
+      : type_(type), data_(std::move(data)), elements_(std::move(elements)) {}
+
+  bool IsDynamic() const { return type_ != Type::kWord; }
+  void Encode(std::string& out) const;
+
+  Type type_;
+  // The 32-byte word of kWord, and the unpadded content of kBytes.
+  std::string data_;
+  std::vector<Value> elements_;
+};
+
+// Returns the calldata of calling the function with |signature|, e.g.
+// "vote(string,uint32,uint8)", with |args|.
+std::string EncodeCall(absl::string_view signature,
+                       const std::vector<Value>& args);
+
+// Decode the return value of a function returning a single value of the type.
+absl::StatusOr<bool> DecodeBool(absl::string_view output);
+// Fails if the value doesn't fit in 64 bits.
+absl::StatusOr<uint64_t> DecodeUint(absl::string_view output);
+absl::StatusOr<std::string> DecodeBytes32(absl::string_view output);
+absl::StatusOr<std::string> DecodeString(absl::string_view output);
+absl::StatusOr<std::vector<std::string>> DecodeStringArray(
+    absl::string_view output);
+
+}  // namespace abi
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_ETHEREUM_ABI_H_
@@ -0,0 +1,169 @@
+#include "src/blockchain/ethereum_abi.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/escaping.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace {
+using ::blockchain::abi::Value;
+using ::testing::ElementsAre;
+
+// Expected values are from the eth-abi and eth-hash Python packages.
+
+std::string Bytes(const std::string& hex) {
+  return absl::HexStringToBytes(hex);
+}
+
+TEST(EthereumAbiTest, HashesWithKeccak256) {
+  EXPECT_EQ(blockchain::abi::ToHex(blockchain::abi::Keccak256("")),
+            "0xc5d2460186f7233c927e7db2dcc703"
+            "c0e500b653ca82273b7bfad8045d85a470");
+  // One byte short of a block, exactly a block, and more than one block.
+  EXPECT_EQ(blockchain::abi::ToHex(
+                blockchain::abi::Keccak256(std::string(135, 'a'))),
+            "0x34367dc248bbd832f4e3e69dfaac2f"
+            "92638bd0bbd18f2912ba4ef454919cf446");
+  EXPECT_EQ(blockchain::abi::ToHex(
+                blockchain::abi::Keccak256(std::string(136, 'a'))),
+            "0xa6c4d403279fe3e0af03729caada83"
+            "74b5ca54d8065329a3ebcaeb4b60aa386e");
+  EXPECT_EQ(blockchain::abi::ToHex(
+                blockchain::abi::Keccak256(std::string(200, 'a'))),
+            "0x96ea54061def936c4be90b518992fd"
+            "c6f12f535068a256229aca54267b4d084d");
+}
+
+TEST(EthereumAbiTest, ConvertsHexAndQuantities) {
+  EXPECT_EQ(blockchain::abi::ToHex("\x01\xab"), "0x01ab");
+  EXPECT_EQ(*blockchain::abi::FromHex("0x01AB"), "\x01\xab");
+  EXPECT_EQ(*blockchain::abi::FromHex("01ab"), "\x01\xab");
+  EXPECT_EQ(blockchain::abi::FromHex("0x1ab").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(blockchain::abi::ToQuantity(0), "0x0");
+  EXPECT_EQ(blockchain::abi::ToQuantity(1000), "0x3e8");
+  EXPECT_EQ(*blockchain::abi::FromQuantity("0x3E8"), 1000);
+  EXPECT_EQ(*blockchain::abi::FromQuantity("0xffffffffffffffff"), UINT64_MAX);
+  EXPECT_FALSE(blockchain::abi::FromQuantity("3e8").ok());
+  EXPECT_FALSE(blockchain::abi::FromQuantity("0x").ok());
+  EXPECT_FALSE(blockchain::abi::FromQuantity("0x10000000000000000").ok());
+  EXPECT_FALSE(blockchain::abi::FromQuantity("0xg").ok());
+}
+
+TEST(EthereumAbiTest, EncodesStaticAndDynamicArguments) {
+  EXPECT_EQ(
+      blockchain::abi::EncodeCall("vote(string,uint32,uint8)",
+                                  {Value::String("t1"), Value::Uint(2),
+                                   Value::Uint(1)}),
+      Bytes(
+          "296e4f58"
+          "0000000000000000000000000000000000000000000000000000000000000060"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "0000000000000000000000000000000000000000000000000000000000000001"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "7431000000000000000000000000000000000000000000000000000000000000"));
+}
+
+TEST(EthereumAbiTest, EncodesArrays) {
+  EXPECT_EQ(
+      blockchain::abi::EncodeCall(
+          "startVotingBatch(string[],uint32[],uint256[])",
+          {Value::Array({Value::String("t1"), Value::String("t2")}),
+           Value::Array({Value::Uint(1), Value::Uint(2)}),
+           Value::Array({Value::Uint(3), Value::Uint(4)})}),
+      Bytes(
+          "91ed7334"
+          "0000000000000000000000000000000000000000000000000000000000000060"
+          "0000000000000000000000000000000000000000000000000000000000000140"
+          "00000000000000000000000000000000000000000000000000000000000001a0"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "0000000000000000000000000000000000000000000000000000000000000040"
+          "0000000000000000000000000000000000000000000000000000000000000080"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "7431000000000000000000000000000000000000000000000000000000000000"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "7432000000000000000000000000000000000000000000000000000000000000"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "0000000000000000000000000000000000000000000000000000000000000001"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "0000000000000000000000000000000000000000000000000000000000000003"
+          "0000000000000000000000000000000000000000000000000000000000000004"));
+}
+
+TEST(EthereumAbiTest, EncodesAddressesAndBytes) {
+  absl::StatusOr<Value> signer =
+      Value::Address("0x90F8bf6A479f320ead074411a4B0e7944Ea8c9C1");
+  ASSERT_TRUE(signer.ok()) << signer.status();
+  EXPECT_EQ(
+      blockchain::abi::EncodeCall(
+          "commitWithVotes(string,address[],bytes[])",
+          {Value::String("t1"), Value::Array({*signer}),
+           Value::Array({Value::Bytes(std::string(65, '\x01'))})}),
+      Bytes(
+          "0fc8b3d9"
+          "0000000000000000000000000000000000000000000000000000000000000060"
+          "00000000000000000000000000000000000000000000000000000000000000a0"
+          "00000000000000000000000000000000000000000000000000000000000000e0"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "7431000000000000000000000000000000000000000000000000000000000000"
+          "0000000000000000000000000000000000000000000000000000000000000001"
+          "00000000000000000000000090f8bf6a479f320ead074411a4b0e7944ea8c9c1"
+          "0000000000000000000000000000000000000000000000000000000000000001"
+          "0000000000000000000000000000000000000000000000000000000000000020"
+          "0000000000000000000000000000000000000000000000000000000000000041"
+          "0101010101010101010101010101010101010101010101010101010101010101"
+          "0101010101010101010101010101010101010101010101010101010101010101"
+          "0100000000000000000000000000000000000000000000000000000000000000"));
+  EXPECT_FALSE(Value::Address("0x90F8bf6A479f320ead074411a4B0e7944Ea8c9").ok());
+}
+
+TEST(EthereumAbiTest, DecodesOutputs) {
+  EXPECT_EQ(*blockchain::abi::DecodeString(Bytes(
+          "0000000000000000000000000000000000000000000000000000000000000020"
+          "0000000000000000000000000000000000000000000000000000000000000018"
+          "333a436f686f727420766f74656420746f2061626f72742e0000000000000000")),
+            "3:Cohort voted to abort.");
+  EXPECT_THAT(*blockchain::abi::DecodeStringArray(Bytes(
+          "0000000000000000000000000000000000000000000000000000000000000020"
+          "0000000000000000000000000000000000000000000000000000000000000002"
+          "0000000000000000000000000000000000000000000000000000000000000040"
+          "0000000000000000000000000000000000000000000000000000000000000080"
+          "0000000000000000000000000000000000000000000000000000000000000004"
+          "323a6f6b00000000000000000000000000000000000000000000000000000000"
+          "0000000000000000000000000000000000000000000000000000000000000000")),
+              ElementsAre("2:ok", ""));
+  EXPECT_TRUE(*blockchain::abi::DecodeBool(Bytes(
+      "0000000000000000000000000000000000000000000000000000000000000001")));
+  EXPECT_EQ(blockchain::abi::DecodeBytes32(std::string(32, 'x')).value(),
+            std::string(32, 'x'));
+  EXPECT_EQ(blockchain::abi::DecodeUint(Bytes(
+                "000000000000000000000000000000000000000000000000000000000000"
+                "0102"))
+                .value(),
+            0x102);
+}
+
+TEST(EthereumAbiTest, RejectsMalformedOutputs) {
+  EXPECT_FALSE(blockchain::abi::DecodeBool("").ok());
+  EXPECT_FALSE(blockchain::abi::DecodeUint(Bytes(
+                   "01000000000000000000000000000000000000000000000000000000"
+                   "00000000"))
+                   .ok());
+  EXPECT_FALSE(blockchain::abi::DecodeBytes32(std::string(31, 'x')).ok());
+  // The string's length is past the end of the output.
+  EXPECT_FALSE(blockchain::abi::DecodeString(Bytes(
+      "0000000000000000000000000000000000000000000000000000000000000020"
+      "0000000000000000000000000000000000000000000000000000000000000040"))
+                   .ok());
+  // The offset doesn't fit in 64 bits.
+  EXPECT_FALSE(blockchain::abi::DecodeStringArray(Bytes(
+      "0100000000000000000000000000000000000000000000000000000000000020"))
+                   .ok());
+}
+
+}  // namespace
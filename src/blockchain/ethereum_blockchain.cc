@@ -0,0 +1,739 @@
+#include "src/blockchain/ethereum_blockchain.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/struct.pb.h"
+#include "src/blockchain/ethereum_abi.h"
+#include "src/utils/status_utils.h"
+
+namespace blockchain {
+
+namespace {
+
+// Extra gas over the node's estimate, in case the state the blockchain
+// transaction runs on changes before it's mined, e.g. a vote decides the
+// transaction and emits VotingDecided.
+constexpr uint64_t kGasMarginDivisor = 4;
+
+google::protobuf::Value StringValue(std::string value) {
+  google::protobuf::Value json;
+  json.set_string_value(std::move(value));
+  return json;
+}
+
+// The JSON-RPC transaction object calling |to| with |calldata|.
+google::protobuf::Value CallObject(const std::string& from,
+                                   const std::string& to,
+                                   const std::string& calldata) {
+  google::protobuf::Value json;
+  auto& fields = *json.mutable_struct_value()->mutable_fields();
+  if (!from.empty()) {
+    fields["from"] = StringValue(from);
+  }
+  fields["to"] = StringValue(to);
+  fields["data"] = StringValue(abi::ToHex(calldata));
+  return json;
+}
+
+google::protobuf::ListValue Params(
+    std::vector<google::protobuf::Value> values) {
+  google::protobuf::ListValue params;
+  for (google::protobuf::Value& value : values) {
+    *params.add_values() = std::move(value);
+  }
+  return params;
+}
+
+// Parses a decision serialized by the contract as "<option>:<reason>".
+void ParseVotingDecision(absl::string_view serialized,
+                         GetVotingDecisionResponse& response) {
+  switch (serialized.empty() ? '0' : serialized[0]) {
+    case '1':
+      response.set_decision(VotingDecision::VOTING_DECISION_PENDING);
+      break;
+    case '2':
+      response.set_decision(VotingDecision::VOTING_DECISION_COMMIT);
+      break;
+    case '3':
+      response.set_decision(VotingDecision::VOTING_DECISION_ABORT);
+      break;
+    default:
+      response.set_decision(VotingDecision::VOTING_DECISION_UNKNOWN);
+  }
+  response.set_reason(
+      std::string(serialized.substr(std::min<size_t>(2, serialized.size()))));
+}
+
+std::vector<abi::Value> TransactionIds(
+    const google::protobuf::RepeatedPtrField<std::string>& transaction_ids) {
+  std::vector<abi::Value> values;
+  values.reserve(transaction_ids.size());
+  for (const std::string& transaction_id : transaction_ids) {
+    values.push_back(abi::Value::String(transaction_id));
+  }
+  return values;
+}
+
+absl::StatusOr<abi::Value> Addresses(
+    const google::protobuf::RepeatedPtrField<std::string>& addresses) {
+  std::vector<abi::Value> values;
+  values.reserve(addresses.size());
+  for (const std::string& address : addresses) {
+    absl::StatusOr<abi::Value> value = abi::Value::Address(address);
+    if (!value.ok()) {
+      return value.status();
+    }
+    values.push_back(*std::move(value));
+  }
+  return abi::Value::Array(std::move(values));
+}
+
+}  // namespace
+
+EthereumBlockchain::EthereumBlockchain(
+    std::unique_ptr<JsonRpcTransport> transport,
+    const EthereumBlockchainOptions& options)
+    : options_(options),
+      client_(std::move(transport)),
+      receipt_poller_([this]() { PollReceiptsUntilStopped(); }),
+      thread_pool_(options.num_threads) {
+  for (const std::string& address : options_.accounts) {
+    accounts_.push_back(std::make_unique<Account>());
+    accounts_.back()->address = address;
+  }
+}
+
+EthereumBlockchain::~EthereumBlockchain() {
+  thread_pool_.wait_for_tasks();
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+  }
+  receipt_poller_.join();
+}
+
+grpc::Status EthereumBlockchain::StartVoting(grpc::ClientContext* context,
+                                             const StartVotingRequest& request,
+                                             StartVotingResponse*) {
+  return CallAndWait([&](Callback done) {
+    Submit(absl::FromChrono(context->deadline()),
+           StartVotingCalldata(request), std::move(done));
+  });
+}
+
+grpc::Status EthereumBlockchain::StartVotingBatch(
+    grpc::ClientContext* context, const StartVotingBatchRequest& request,
+    StartVotingBatchResponse* response) {
+  return CallAndWait([&](Callback done) {
+    Submit(absl::FromChrono(context->deadline()),
+           StartVotingBatchCalldata(request), std::move(done),
+           [this, response](const google::protobuf::Struct& receipt) {
+             return utils::FromAbslStatus(
+                 SetSkippedIndices(receipt, *response), "StartVotingBatch:");
+           });
+  });
+}
+
+grpc::Status EthereumBlockchain::Vote(grpc::ClientContext* context,
+                                      const VoteRequest& request,
+                                      VoteResponse*) {
+  return CallAndWait([&](Callback done) {
+    Submit(absl::FromChrono(context->deadline()), VoteCalldata(request),
+           std::move(done));
+  });
+}
+
+grpc::Status EthereumBlockchain::VoteBatch(grpc::ClientContext* context,
+                                           const VoteBatchRequest& request,
+                                           VoteBatchResponse*) {
+  return CallAndWait([&](Callback done) {
+    Submit(absl::FromChrono(context->deadline()), VoteBatchCalldata(request),
+           std::move(done));
+  });
+}
+
+grpc::Status EthereumBlockchain::SignCommitVote(
+    grpc::ClientContext*, const SignCommitVoteRequest& request,
+    SignCommitVoteResponse* response) {
+  return utils::FromAbslStatus(SignCommitVote(request, *response),
+                               "SignCommitVote:");
+}
+
+grpc::Status EthereumBlockchain::CommitWithVotes(
+    grpc::ClientContext* context, const CommitWithVotesRequest& request,
+    CommitWithVotesResponse*) {
+  return CallAndWait([&](Callback done) {
+    Submit(absl::FromChrono(context->deadline()),
+           CommitWithVotesCalldata(request), std::move(done));
+  });
+}
+
+grpc::Status EthereumBlockchain::GetVotingDecision(
+    grpc::ClientContext*, const GetVotingDecisionRequest& request,
+    GetVotingDecisionResponse* response) {
+  return utils::FromAbslStatus(GetVotingDecision(request, *response),
+                               "GetVotingDecision:");
+}
+
+grpc::Status EthereumBlockchain::GetVotingDecisions(
+    grpc::ClientContext*, const GetVotingDecisionsRequest& request,
+    GetVotingDecisionsResponse* response) {
+  return utils::FromAbslStatus(GetVotingDecisions(request, *response),
+                               "GetVotingDecisions:");
+}
+
+grpc::Status EthereumBlockchain::GetHeartBeat(grpc::ClientContext*,
+                                              const GetHeartBeatRequest&,
+                                              GetHeartBeatResponse* response) {
+  return utils::FromAbslStatus(GetHeartBeat(*response), "GetHeartBeat:");
+}
+
+// The callbacks run on the thread pool, since each call blocks on at least
+// one round trip to the node.
+void EthereumBlockchain::AsyncApi::StartVoting(
+    grpc::ClientContext* context, const StartVotingRequest* request,
+    StartVotingResponse*, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_,
+       deadline = absl::FromChrono(context->deadline()),
+       calldata = StartVotingCalldata(*request), done = std::move(done)]() {
+        blockchain->Submit(deadline, calldata, done);
+      });
+}
+
+void EthereumBlockchain::AsyncApi::StartVotingBatch(
+    grpc::ClientContext* context, const StartVotingBatchRequest* request,
+    StartVotingBatchResponse* response, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_,
+       deadline = absl::FromChrono(context->deadline()),
+       calldata = StartVotingBatchCalldata(*request), response,
+       done = std::move(done)]() {
+        blockchain->Submit(
+            deadline, calldata, done,
+            [blockchain, response](const google::protobuf::Struct& receipt) {
+              return utils::FromAbslStatus(
+                  blockchain->SetSkippedIndices(receipt, *response),
+                  "StartVotingBatch:");
+            });
+      });
+}
+
+void EthereumBlockchain::AsyncApi::Vote(grpc::ClientContext* context,
+                                        const VoteRequest* request,
+                                        VoteResponse*, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_,
+       deadline = absl::FromChrono(context->deadline()),
+       calldata = VoteCalldata(*request), done = std::move(done)]() {
+        blockchain->Submit(deadline, calldata, done);
+      });
+}
+
+void EthereumBlockchain::AsyncApi::VoteBatch(grpc::ClientContext* context,
+                                             const VoteBatchRequest* request,
+                                             VoteBatchResponse*,
+                                             Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_,
+       deadline = absl::FromChrono(context->deadline()),
+       calldata = VoteBatchCalldata(*request), done = std::move(done)]() {
+        blockchain->Submit(deadline, calldata, done);
+      });
+}
+
+void EthereumBlockchain::AsyncApi::SignCommitVote(
+    grpc::ClientContext*, const SignCommitVoteRequest* request,
+    SignCommitVoteResponse* response, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_, request, response, done = std::move(done)]() {
+        done(utils::FromAbslStatus(
+            blockchain->SignCommitVote(*request, *response),
+            "SignCommitVote:"));
+      });
+}
+
+void EthereumBlockchain::AsyncApi::CommitWithVotes(
+    grpc::ClientContext* context, const CommitWithVotesRequest* request,
+    CommitWithVotesResponse*, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_,
+       deadline = absl::FromChrono(context->deadline()),
+       calldata = CommitWithVotesCalldata(*request), done = std::move(done)]() {
+        blockchain->Submit(deadline, calldata, done);
+      });
+}
+
+void EthereumBlockchain::AsyncApi::GetVotingDecision(
+    grpc::ClientContext*, const GetVotingDecisionRequest* request,
+    GetVotingDecisionResponse* response, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_, request, response, done = std::move(done)]() {
+        done(utils::FromAbslStatus(
+            blockchain->GetVotingDecision(*request, *response),
+            "GetVotingDecision:"));
+      });
+}
+
+void EthereumBlockchain::AsyncApi::GetVotingDecisions(
+    grpc::ClientContext*, const GetVotingDecisionsRequest* request,
+    GetVotingDecisionsResponse* response, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_, request, response, done = std::move(done)]() {
+        done(utils::FromAbslStatus(
+            blockchain->GetVotingDecisions(*request, *response),
+            "GetVotingDecisions:"));
+      });
+}
+
+void EthereumBlockchain::AsyncApi::GetHeartBeat(
+    grpc::ClientContext*, const GetHeartBeatRequest*,
+    GetHeartBeatResponse* response, Callback done) {
+  blockchain_->thread_pool_.push_task(
+      [blockchain = blockchain_, response, done = std::move(done)]() {
+        done(utils::FromAbslStatus(blockchain->GetHeartBeat(*response),
+                                   "GetHeartBeat:"));
+      });
+}
+
+void EthereumBlockchain::Submit(absl::Time deadline,
+                                const absl::StatusOr<std::string>& calldata,
+                                Callback done, ReceiptCallback on_receipt) {
+  if (!calldata.ok()) {
+    done(utils::FromAbslStatus(calldata.status(), "Invalid request:"));
+    return;
+  }
+  Account& account = *accounts_[next_account_++ % accounts_.size()];
+  absl::StatusOr<std::string> hash = Send(account, *calldata);
+  if (!hash.ok()) {
+    done(utils::FromAbslStatus(hash.status(),
+                               "Failed to send the blockchain transaction:"));
+    return;
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!stopped_) {
+      pending_.push_back(PendingTransaction{*std::move(hash), std::move(done),
+                                            deadline, std::move(on_receipt)});
+      return;
+    }
+  }
+  done(grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                    "The blockchain client is shutting down"));
+}
+
+grpc::Status EthereumBlockchain::CallAndWait(
+    const std::function<void(Callback)>& call) {
+  struct Result {
+    absl::Mutex mutex;
+    bool done ABSL_GUARDED_BY(mutex) = false;
+    grpc::Status status ABSL_GUARDED_BY(mutex);
+  };
+  // Shared with the callback, which may still be returning after the wait.
+  auto result = std::make_shared<Result>();
+  call([result](grpc::Status status) {
+    absl::MutexLock lock(&result->mutex);
+    result->status = std::move(status);
+    result->done = true;
+  });
+  absl::MutexLock lock(&result->mutex);
+  result->mutex.Await(absl::Condition(&result->done));
+  return result->status;
+}
+
+absl::StatusOr<std::string> EthereumBlockchain::Send(
+    Account& account, const std::string& calldata) {
+  google::protobuf::Value transaction =
+      CallObject(account.address, options_.contract_address, calldata);
+  // Estimated before taking a nonce, so that a call the contract rejects
+  // fails here without using one.
+  absl::StatusOr<google::protobuf::Value> gas =
+      client_.Call("eth_estimateGas", Params({transaction}));
+  if (!gas.ok()) {
+    return gas.status();
+  }
+  absl::StatusOr<uint64_t> gas_limit = abi::FromQuantity(gas->string_value());
+  if (!gas_limit.ok()) {
+    return gas_limit.status();
+  }
+  absl::StatusOr<int64_t> nonce = TakeNonce(account);
+  if (!nonce.ok()) {
+    return nonce.status();
+  }
+  auto& fields = *transaction.mutable_struct_value()->mutable_fields();
+  fields["gas"] = StringValue(
+      abi::ToQuantity(*gas_limit + *gas_limit / kGasMarginDivisor));
+  fields["nonce"] = StringValue(abi::ToQuantity(*nonce));
+  absl::StatusOr<google::protobuf::Value> hash =
+      client_.Call("eth_sendTransaction", Params({std::move(transaction)}));
+  if (hash.ok()) {
+    return hash->string_value();
+  }
+  absl::MutexLock lock(&account.mutex);
+  if (absl::IsUnavailable(hash.status())) {
+    // The transport only fails with Unavailable error if the request never
+    // reached the node, so the nonce is still unused.
+    account.free_nonces.push_back(*nonce);
+  } else {
+    // The node may have used the nonce (e.g. a reverted or timed out send) or
+    // rejected it (e.g. "nonce too low" or "replacement transaction
+    // underpriced" because the local nonce went out of sync with the node's),
+    // so it's looked up again rather than guessed.
+    account.next_nonce = -1;
+    account.free_nonces.clear();
+  }
+  return hash.status();
+}
+
+absl::StatusOr<int64_t> EthereumBlockchain::TakeNonce(Account& account) {
+  absl::MutexLock lock(&account.mutex);
+  if (!account.free_nonces.empty()) {
+    const auto lowest = std::min_element(account.free_nonces.begin(),
+                                         account.free_nonces.end());
+    const int64_t nonce = *lowest;
+    account.free_nonces.erase(lowest);
+    return nonce;
+  }
+  if (account.next_nonce < 0) {
+    // Looked up under the lock, so that concurrent sends wait for it instead
+    // of all looking it up.
+    absl::StatusOr<google::protobuf::Value> count =
+        client_.Call("eth_getTransactionCount",
+                     Params({StringValue(account.address),
+                             StringValue("pending")}));
+    if (!count.ok()) {
+      return count.status();
+    }
+    absl::StatusOr<uint64_t> nonce = abi::FromQuantity(count->string_value());
+    if (!nonce.ok()) {
+      return nonce.status();
+    }
+    account.next_nonce = *nonce;
+  }
+  return account.next_nonce++;
+}
+
+absl::StatusOr<std::string> EthereumBlockchain::CallAtLatestBlock(
+    const std::string& calldata, uint64_t& block_number) {
+  // Pinned to the block, since another one may be mined between the two
+  // requests.
+  absl::StatusOr<google::protobuf::Value> latest =
+      client_.Call("eth_blockNumber", google::protobuf::ListValue());
+  if (!latest.ok()) {
+    return latest.status();
+  }
+  absl::StatusOr<uint64_t> block = abi::FromQuantity(latest->string_value());
+  if (!block.ok()) {
+    return block.status();
+  }
+  block_number = *block;
+  return Call(calldata, abi::ToQuantity(*block));
+}
+
+absl::StatusOr<std::string> EthereumBlockchain::Call(
+    const std::string& calldata, const std::string& block) {
+  absl::StatusOr<google::protobuf::Value> output = client_.Call(
+      "eth_call", Params({CallObject("", options_.contract_address, calldata),
+                          StringValue(block)}));
+  if (!output.ok()) {
+    return output.status();
+  }
+  return abi::FromHex(output->string_value());
+}
+
+void EthereumBlockchain::PollReceiptsUntilStopped() {
+  bool stopped = false;
+  while (!stopped) {
+    std::vector<PendingTransaction> transactions;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.AwaitWithTimeout(absl::Condition(&stopped_),
+                              options_.receipt_poll_interval);
+      stopped = stopped_;
+      transactions.swap(pending_);
+    }
+    std::vector<std::pair<Callback, grpc::Status>> callbacks;
+    std::vector<PendingTransaction> still_pending;
+    if (stopped) {
+      for (PendingTransaction& transaction : transactions) {
+        callbacks.emplace_back(
+            std::move(transaction.done),
+            grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                         "The blockchain client is shutting down"));
+      }
+    } else if (!transactions.empty()) {
+      std::vector<JsonRpcClient::Request> requests;
+      requests.reserve(transactions.size());
+      for (const PendingTransaction& transaction : transactions) {
+        requests.push_back(JsonRpcClient::Request{
+            "eth_getTransactionReceipt",
+            Params({StringValue(transaction.hash)})});
+      }
+      const std::vector<absl::StatusOr<google::protobuf::Value>> receipts =
+          client_.CallBatch(requests);
+      const absl::Time now = absl::Now();
+      for (size_t i = 0; i < transactions.size(); ++i) {
+        PendingTransaction& transaction = transactions[i];
+        // Failed polls and receipts not there yet are polled again.
+        if (receipts[i].ok() && receipts[i]->has_struct_value()) {
+          const auto& fields = receipts[i]->struct_value().fields();
+          const auto status = fields.find("status");
+          const bool succeeded =
+              status != fields.end() &&
+              abi::FromQuantity(status->second.string_value()).value_or(0) ==
+                  1;
+          grpc::Status result = grpc::Status::OK;
+          if (!succeeded) {
+            result = grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                  "The contract reverted the blockchain "
+                                  "transaction");
+          } else if (transaction.on_receipt != nullptr) {
+            result = transaction.on_receipt(receipts[i]->struct_value());
+          }
+          callbacks.emplace_back(std::move(transaction.done),
+                                 std::move(result));
+        } else if (transaction.deadline <= now) {
+          callbacks.emplace_back(
+              std::move(transaction.done),
+              grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                           "The blockchain transaction wasn't mined before "
+                           "the deadline"));
+        } else {
+          still_pending.push_back(std::move(transaction));
+        }
+      }
+    }
+    if (!still_pending.empty()) {
+      absl::MutexLock lock(&mutex_);
+      // Kept ahead of the ones sent meanwhile.
+      pending_.insert(pending_.begin(),
+                      std::make_move_iterator(still_pending.begin()),
+                      std::make_move_iterator(still_pending.end()));
+    }
+    for (auto& [done, status] : callbacks) {
+      done(std::move(status));
+    }
+  }
+}
+
+absl::Status EthereumBlockchain::SetSkippedIndices(
+    const google::protobuf::Struct& receipt,
+    StartVotingBatchResponse& response) const {
+  static const std::string* const kSkippedTopic = new std::string(
+      abi::ToHex(abi::Keccak256("StartVotingSkipped(uint256)")));
+  const auto logs = receipt.fields().find("logs");
+  if (logs == receipt.fields().end()) {
+    return absl::InternalError("The receipt has no logs");
+  }
+  for (const google::protobuf::Value& log :
+       logs->second.list_value().values()) {
+    const auto& fields = log.struct_value().fields();
+    const auto address = fields.find("address");
+    const auto topics = fields.find("topics");
+    const auto data = fields.find("data");
+    if (address == fields.end() || topics == fields.end() ||
+        data == fields.end() ||
+        !absl::EqualsIgnoreCase(address->second.string_value(),
+                                options_.contract_address) ||
+        topics->second.list_value().values_size() == 0 ||
+        !absl::EqualsIgnoreCase(
+            topics->second.list_value().values(0).string_value(),
+            *kSkippedTopic)) {
+      continue;
+    }
+    // A skipped transaction that can't be read would be taken as started,
+    // so the whole batch fails instead.
+    absl::StatusOr<std::string> output =
+        abi::FromHex(data->second.string_value());
+    if (!output.ok()) {
+      return output.status();
+    }
+    absl::StatusOr<uint64_t> index = abi::DecodeUint(*output);
+    if (!index.ok()) {
+      return index.status();
+    }
+    response.add_skipped_indices(*index);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> EthereumBlockchain::StartVotingCalldata(
+    const StartVotingRequest& request) {
+  const uint64_t timeout_time = request.timeout_time().seconds();
+  if (request.signers().empty()) {
+    return abi::EncodeCall("startVoting(string,uint32,uint256)",
+                           {abi::Value::String(request.transaction_id()),
+                            abi::Value::Uint(request.cohorts()),
+                            abi::Value::Uint(timeout_time)});
+  }
+  absl::StatusOr<abi::Value> signers = Addresses(request.signers());
+  if (!signers.ok()) {
+    return signers.status();
+  }
+  return abi::EncodeCall("startVotingWithSigners(string,address[],uint256)",
+                         {abi::Value::String(request.transaction_id()),
+                          *std::move(signers),
+                          abi::Value::Uint(timeout_time)});
+}
+
+absl::StatusOr<std::string> EthereumBlockchain::StartVotingBatchCalldata(
+    const StartVotingBatchRequest& request) {
+  std::vector<abi::Value> transaction_ids;
+  std::vector<abi::Value> cohorts;
+  std::vector<abi::Value> timeout_times;
+  for (const StartVotingRequest& transaction : request.transactions()) {
+    if (!transaction.signers().empty()) {
+      return absl::InvalidArgumentError(
+          "StartVotingBatch doesn't support signers");
+    }
+    transaction_ids.push_back(
+        abi::Value::String(transaction.transaction_id()));
+    cohorts.push_back(abi::Value::Uint(transaction.cohorts()));
+    timeout_times.push_back(
+        abi::Value::Uint(transaction.timeout_time().seconds()));
+  }
+  return abi::EncodeCall("startVotingBatch(string[],uint32[],uint256[])",
+                         {abi::Value::Array(std::move(transaction_ids)),
+                          abi::Value::Array(std::move(cohorts)),
+                          abi::Value::Array(std::move(timeout_times))});
+}
+
+std::string EthereumBlockchain::VoteCalldata(const VoteRequest& request) {
+  return abi::EncodeCall("vote(string,uint32,uint8)",
+                         {abi::Value::String(request.transaction_id()),
+                          abi::Value::Uint(request.cohort_id()),
+                          abi::Value::Uint(request.ballot())});
+}
+
+std::string EthereumBlockchain::VoteBatchCalldata(
+    const VoteBatchRequest& request) {
+  std::vector<abi::Value> transaction_ids;
+  std::vector<abi::Value> cohort_ids;
+  std::vector<abi::Value> ballots;
+  for (const VoteRequest& vote : request.votes()) {
+    transaction_ids.push_back(abi::Value::String(vote.transaction_id()));
+    cohort_ids.push_back(abi::Value::Uint(vote.cohort_id()));
+    ballots.push_back(abi::Value::Uint(vote.ballot()));
+  }
+  return abi::EncodeCall("voteBatch(string[],uint32[],uint8[])",
+                         {abi::Value::Array(std::move(transaction_ids)),
+                          abi::Value::Array(std::move(cohort_ids)),
+                          abi::Value::Array(std::move(ballots))});
+}
+
+absl::StatusOr<std::string> EthereumBlockchain::CommitWithVotesCalldata(
+    const CommitWithVotesRequest& request) {
+  absl::StatusOr<abi::Value> signers = Addresses(request.signers());
+  if (!signers.ok()) {
+    return signers.status();
+  }
+  std::vector<abi::Value> signatures;
+  for (const std::string& signature : request.signatures()) {
+    signatures.push_back(abi::Value::Bytes(signature));
+  }
+  return abi::EncodeCall("commitWithVotes(string,address[],bytes[])",
+                         {abi::Value::String(request.transaction_id()),
+                          *std::move(signers),
+                          abi::Value::Array(std::move(signatures))});
+}
+
+absl::Status EthereumBlockchain::SignCommitVote(
+    const SignCommitVoteRequest& request, SignCommitVoteResponse& response) {
+  absl::StatusOr<std::string> output = Call(
+      abi::EncodeCall("getCommitVoteHash(string,uint32)",
+                      {abi::Value::String(request.transaction_id()),
+                       abi::Value::Uint(request.cohort_id())}));
+  if (!output.ok()) {
+    return output.status();
+  }
+  absl::StatusOr<std::string> hash = abi::DecodeBytes32(*output);
+  if (!hash.ok()) {
+    return hash.status();
+  }
+  absl::StatusOr<google::protobuf::Value> signature = client_.Call(
+      "eth_sign", Params({StringValue(options_.accounts.front()),
+                          StringValue(abi::ToHex(*hash))}));
+  if (!signature.ok()) {
+    return signature.status();
+  }
+  absl::StatusOr<std::string> bytes = abi::FromHex(signature->string_value());
+  if (!bytes.ok()) {
+    return bytes.status();
+  }
+  response.set_signature(*std::move(bytes));
+  return absl::OkStatus();
+}
+
+absl::Status EthereumBlockchain::GetVotingDecision(
+    const GetVotingDecisionRequest& request,
+    GetVotingDecisionResponse& response) {
+  // Fails with FailedPrecondition error if voting hasn't started, since the
+  // contract reverts.
+  uint64_t block_number = 0;
+  absl::StatusOr<std::string> output = CallAtLatestBlock(
+      abi::EncodeCall("getVotingDecision(string)",
+                      {abi::Value::String(request.transaction_id())}),
+      block_number);
+  if (!output.ok()) {
+    return output.status();
+  }
+  absl::StatusOr<std::string> decision = abi::DecodeString(*output);
+  if (!decision.ok()) {
+    return decision.status();
+  }
+  ParseVotingDecision(*decision, response);
+  response.set_block_number(block_number);
+  return absl::OkStatus();
+}
+
+absl::Status EthereumBlockchain::GetVotingDecisions(
+    const GetVotingDecisionsRequest& request,
+    GetVotingDecisionsResponse& response) {
+  uint64_t block_number = 0;
+  absl::StatusOr<std::string> output = CallAtLatestBlock(
+      abi::EncodeCall(
+          "getVotingDecisions(string[])",
+          {abi::Value::Array(TransactionIds(request.transaction_ids()))}),
+      block_number);
+  if (!output.ok()) {
+    return output.status();
+  }
+  absl::StatusOr<std::vector<std::string>> decisions =
+      abi::DecodeStringArray(*output);
+  if (!decisions.ok()) {
+    return decisions.status();
+  }
+  for (const std::string& decision : *decisions) {
+    GetVotingDecisionResponse& parsed = *response.add_decisions();
+    ParseVotingDecision(decision, parsed);
+    parsed.set_block_number(block_number);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status EthereumBlockchain::GetHeartBeat(GetHeartBeatResponse& response) {
+  absl::StatusOr<std::string> output =
+      Call(abi::EncodeCall("getHeartBeat()", {}));
+  if (!output.ok()) {
+    return output.status();
+  }
+  absl::StatusOr<bool> is_ok = abi::DecodeBool(*output);
+  if (!is_ok.ok()) {
+    return is_ok.status();
+  }
+  response.set_is_ok(*is_ok);
+  return absl::OkStatus();
+}
+
+// Ends right away, since decisions are polled instead of watched.
+grpc::ClientReaderInterface<VotingDecidedEvent>*
+EthereumBlockchain::WatchDecisionsRaw(grpc::ClientContext*,
+                                      const WatchDecisionsRequest&) {
+  return new UnimplementedDecisionReader(
+      "The Ethereum JSON-RPC backend doesn't stream decisions");
+}
+
+}  // namespace blockchain
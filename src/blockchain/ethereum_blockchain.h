@@ -0,0 +1,232 @@
+#ifndef SRC_BLOCKCHAIN_ETHEREUM_BLOCKCHAIN_H_
+
+#define SRC_BLOCKCHAIN_ETHEREUM_BLOCKCHAIN_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "google/protobuf/struct.pb.h"
+#include "grpcpp/client_context.h"
+#include "src/blockchain/json_rpc_client.h"
+#include "src/blockchain/local_adapter_stub.h"
+#include "src/blockchain/proto/two_phase_commit_adapter.grpc.pb.h"
+#include "thread_pool.hpp"
+
+namespace blockchain {
+
+struct EthereumBlockchainOptions {
+  // Address of the deployed TwoPhaseCommit contract.
+  std::string contract_address;
+  // Unlocked accounts of the node (e.g. Ganache's) to send blockchain
+  // transactions from, round-robin. The first one signs commit votes. Must
+  // not be empty.
+  std::vector<std::string> accounts;
+  // Threads sending requests to the node. Should match the transport's
+  // connections.
+  int num_threads = 8;
+  // Time between polls for the receipts of the blockchain transactions
+  // waiting to be mined. All of them are polled in one batch request.
+  absl::Duration receipt_poll_interval = absl::Milliseconds(50);
+};
+
+// Calls the TwoPhaseCommit contract through the node's Ethereum JSON-RPC API
+// instead of the adapter server, so calls skip a process hop and the
+// JavaScript client. Plugs into TwoPhaseCommit through its stub constructor,
+// e.g.
+//   TwoPhaseCommit(std::make_unique<EthereumBlockchain>(
+//       std::make_unique<HttpJsonRpcTransport>("localhost", 7545, 8),
+//       options))
+// Supports the blocking and callback APIs of every call except
+// WatchDecisions, which always fails with Unimplemented error, so decisions
+// must be polled.
+//
+// Nonces are assigned locally like the adapter server's pipeline, so many
+// blockchain transactions of each account can wait to be mined at once.
+// Calls the contract rejects fail with FailedPrecondition error. Calls whose
+// deadline passes before they're mined fail with DeadlineExceeded error but
+// may still take effect.
+class EthereumBlockchain : public LocalAdapterStub {
+ public:
+  EthereumBlockchain(std::unique_ptr<JsonRpcTransport> transport,
+                     const EthereumBlockchainOptions& options);
+
+  // Fails the calls still waiting to be mined with Unavailable error.
+  ~EthereumBlockchain() override;
+
+  EthereumBlockchain(const EthereumBlockchain&) = delete;
+  EthereumBlockchain& operator=(const EthereumBlockchain&) = delete;
+
+  grpc::Status StartVoting(grpc::ClientContext* context,
+                           const StartVotingRequest& request,
+                           StartVotingResponse* response) override;
+  grpc::Status StartVotingBatch(grpc::ClientContext* context,
+                                const StartVotingBatchRequest& request,
+                                StartVotingBatchResponse* response) override;
+  grpc::Status Vote(grpc::ClientContext* context, const VoteRequest& request,
+                    VoteResponse* response) override;
+  grpc::Status VoteBatch(grpc::ClientContext* context,
+                         const VoteBatchRequest& request,
+                         VoteBatchResponse* response) override;
+  grpc::Status SignCommitVote(grpc::ClientContext* context,
+                              const SignCommitVoteRequest& request,
+                              SignCommitVoteResponse* response) override;
+  grpc::Status CommitWithVotes(grpc::ClientContext* context,
+                               const CommitWithVotesRequest& request,
+                               CommitWithVotesResponse* response) override;
+  grpc::Status GetVotingDecision(grpc::ClientContext* context,
+                                 const GetVotingDecisionRequest& request,
+                                 GetVotingDecisionResponse* response) override;
+  grpc::Status GetVotingDecisions(
+      grpc::ClientContext* context, const GetVotingDecisionsRequest& request,
+      GetVotingDecisionsResponse* response) override;
+  grpc::Status GetHeartBeat(grpc::ClientContext* context,
+                            const GetHeartBeatRequest& request,
+                            GetHeartBeatResponse* response) override;
+
+  async_interface* async() override { return &async_; }
+
+ private:
+  using Callback = std::function<void(grpc::Status)>;
+  // Called with the receipt of a successful blockchain transaction, before
+  // its Callback, which gets the status it returns.
+  using ReceiptCallback =
+      std::function<grpc::Status(const google::protobuf::Struct& receipt)>;
+
+  class AsyncApi : public async_interface {
+   public:
+    explicit AsyncApi(EthereumBlockchain* blockchain)
+        : blockchain_(blockchain) {}
+
+    void StartVoting(grpc::ClientContext* context,
+                     const StartVotingRequest* request,
+                     StartVotingResponse* response, Callback done) override;
+    void StartVotingBatch(grpc::ClientContext* context,
+                          const StartVotingBatchRequest* request,
+                          StartVotingBatchResponse* response,
+                          Callback done) override;
+    void Vote(grpc::ClientContext* context, const VoteRequest* request,
+              VoteResponse* response, Callback done) override;
+    void VoteBatch(grpc::ClientContext* context,
+                   const VoteBatchRequest* request, VoteBatchResponse* response,
+                   Callback done) override;
+    void SignCommitVote(grpc::ClientContext* context,
+                        const SignCommitVoteRequest* request,
+                        SignCommitVoteResponse* response,
+                        Callback done) override;
+    void CommitWithVotes(grpc::ClientContext* context,
+                         const CommitWithVotesRequest* request,
+                         CommitWithVotesResponse* response,
+                         Callback done) override;
+    void GetVotingDecision(grpc::ClientContext* context,
+                           const GetVotingDecisionRequest* request,
+                           GetVotingDecisionResponse* response,
+                           Callback done) override;
+    void GetVotingDecisions(grpc::ClientContext* context,
+                            const GetVotingDecisionsRequest* request,
+                            GetVotingDecisionsResponse* response,
+                            Callback done) override;
+    void GetHeartBeat(grpc::ClientContext* context,
+                      const GetHeartBeatRequest* request,
+                      GetHeartBeatResponse* response, Callback done) override;
+
+   private:
+    EthereumBlockchain* const blockchain_;
+  };
+
+  struct Account {
+    std::string address;
+    absl::Mutex mutex;
+    // Next nonce to send with, or -1 until looked up.
+    int64_t next_nonce ABSL_GUARDED_BY(mutex) = -1;
+    // Nonces taken by blockchain transactions that never reached the node,
+    // which later ones reuse so they don't leave a gap.
+    std::vector<int64_t> free_nonces ABSL_GUARDED_BY(mutex);
+  };
+
+  struct PendingTransaction {
+    std::string hash;
+    Callback done;
+    absl::Time deadline;
+    ReceiptCallback on_receipt;
+  };
+
+  // Sends a blockchain transaction calling the contract with |calldata| from
+  // this thread, and calls |done| once it's mined or the deadline passes.
+  void Submit(absl::Time deadline,
+              const absl::StatusOr<std::string>& calldata, Callback done,
+              ReceiptCallback on_receipt = nullptr);
+  // Runs |call| on this thread and waits for it to call back, which
+  // blockchain transactions do from the receipt poller. Blocking calls don't
+  // use the thread pool, so callbacks can make them without starving it.
+  static grpc::Status CallAndWait(const std::function<void(Callback)>& call);
+
+  // Sends the blockchain transaction from |account|, returning its hash.
+  absl::StatusOr<std::string> Send(Account& account,
+                                   const std::string& calldata);
+  absl::StatusOr<int64_t> TakeNonce(Account& account);
+  // Calls a view function of the contract at |block|, returning its ABI
+  // output.
+  absl::StatusOr<std::string> Call(const std::string& calldata,
+                                   const std::string& block = "latest");
+  // Calls a view function at the latest block, and sets |block_number| to
+  // it.
+  absl::StatusOr<std::string> CallAtLatestBlock(const std::string& calldata,
+                                                uint64_t& block_number);
+
+  // Polls for the receipts of the pending transactions until destroyed.
+  void PollReceiptsUntilStopped();
+
+  // The contract's functions, as calldata.
+  static absl::StatusOr<std::string> StartVotingCalldata(
+      const StartVotingRequest& request);
+  static absl::StatusOr<std::string> StartVotingBatchCalldata(
+      const StartVotingBatchRequest& request);
+  static std::string VoteCalldata(const VoteRequest& request);
+  // Sets the skipped indices of |response| from the StartVotingSkipped events
+  // the contract logged in |receipt|.
+  absl::Status SetSkippedIndices(const google::protobuf::Struct& receipt,
+                                 StartVotingBatchResponse& response) const;
+  static std::string VoteBatchCalldata(const VoteBatchRequest& request);
+  static absl::StatusOr<std::string> CommitWithVotesCalldata(
+      const CommitWithVotesRequest& request);
+
+  // Calls that only read the contract, or sign with the node's key, so they
+  // return once the node answers.
+  absl::Status SignCommitVote(const SignCommitVoteRequest& request,
+                              SignCommitVoteResponse& response);
+  absl::Status GetVotingDecision(const GetVotingDecisionRequest& request,
+                                 GetVotingDecisionResponse& response);
+  absl::Status GetVotingDecisions(const GetVotingDecisionsRequest& request,
+                                  GetVotingDecisionsResponse& response);
+  absl::Status GetHeartBeat(GetHeartBeatResponse& response);
+
+  grpc::ClientReaderInterface<VotingDecidedEvent>* WatchDecisionsRaw(
+      grpc::ClientContext*, const WatchDecisionsRequest&) override;
+
+  const EthereumBlockchainOptions options_;
+  JsonRpcClient client_;
+  std::vector<std::unique_ptr<Account>> accounts_;
+  std::atomic<size_t> next_account_{0};
+  AsyncApi async_{this};
+  absl::Mutex mutex_;
+  bool stopped_ ABSL_GUARDED_BY(mutex_) = false;
+  // Sent blockchain transactions waiting to be mined, in the order sent.
+  std::vector<PendingTransaction> pending_ ABSL_GUARDED_BY(mutex_);
+  std::thread receipt_poller_;
+  // Declared last so that it's destroyed first, waiting for the calls it
+  // runs before the members they use are destroyed.
+  thread_pool thread_pool_;
+};
+
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_ETHEREUM_BLOCKCHAIN_H_
@@ -0,0 +1,461 @@
+#include "src/blockchain/ethereum_blockchain.h"
+
+#include <ctime>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/util/json_util.h"
+#include "gtest/gtest.h"
+#include "src/blockchain/ethereum_abi.h"
+#include "src/blockchain/two_phase_commit.h"
+
+namespace blockchain {
+
+namespace {
+
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+
+constexpr char kContract[] = "0x5b1869d9a4c187f2eaa108f3062412ecf0526b24";
+constexpr char kAccount1[] = "0x90f8bf6a479f320ead074411a4b0e7944ea8c9c1";
+constexpr char kAccount2[] = "0xffcf8fdee72ac11b5c542428b35eef5769c409f0";
+
+struct SentTransaction {
+  std::string from;
+  std::string data;
+  uint64_t nonce;
+};
+
+// The ABI output of a function returning |values|.
+std::string Output(const std::vector<abi::Value>& values) {
+  std::string output;
+  abi::Value::EncodeTuple(values, output);
+  return output;
+}
+
+// Answers JSON-RPC requests like a node with the TwoPhaseCommit contract
+// deployed would, from recorded responses.
+class FakeNode : public JsonRpcTransport {
+ public:
+  absl::StatusOr<std::string> Post(const std::string& body) override {
+    google::protobuf::Value request;
+    if (!google::protobuf::util::JsonStringToMessage(body, &request).ok()) {
+      return absl::InternalError("Invalid JSON");
+    }
+    google::protobuf::Value response;
+    absl::MutexLock lock(&mutex_);
+    if (drop_next_send_ && request.has_struct_value() &&
+        request.struct_value().fields().at("method").string_value() ==
+            "eth_sendTransaction") {
+      drop_next_send_ = false;
+      return absl::UnavailableError("Connection refused");
+    }
+    if (request.has_list_value()) {
+      ++batches_;
+      for (const google::protobuf::Value& item :
+           request.list_value().values()) {
+        *response.mutable_list_value()->add_values() = Answer(item);
+      }
+    } else {
+      response = Answer(request);
+    }
+    std::string response_body;
+    google::protobuf::util::MessageToJsonString(response, &response_body);
+    return response_body;
+  }
+
+  // Makes eth_call of the function with |signature| return |output|.
+  void SetCallOutput(const std::string& signature, std::string output) {
+    absl::MutexLock lock(&mutex_);
+    call_outputs_[abi::Keccak256(signature).substr(0, 4)] = std::move(output);
+  }
+
+  // Makes the node reject blockchain transactions before sending them.
+  void RevertEstimates() {
+    absl::MutexLock lock(&mutex_);
+    revert_estimates_ = true;
+  }
+
+  // Makes the sent blockchain transactions revert once mined.
+  void RevertReceipts() {
+    absl::MutexLock lock(&mutex_);
+    revert_receipts_ = true;
+  }
+
+  // Makes every receipt log StartVotingSkipped for each of |indices|, and an
+  // unrelated event of another contract.
+  void LogSkippedIndices(std::vector<uint64_t> indices) {
+    absl::MutexLock lock(&mutex_);
+    skipped_indices_ = std::move(indices);
+  }
+
+  // Keeps receipts from being returned, as if nothing was mined.
+  void StopMining() {
+    absl::MutexLock lock(&mutex_);
+    mining_ = false;
+  }
+
+  // Fails the next eth_sendTransaction with a JSON-RPC error.
+  void FailNextSend() {
+    absl::MutexLock lock(&mutex_);
+    fail_next_send_ = true;
+  }
+
+  // Fails the next eth_sendTransaction as if it never reached the node.
+  void DropNextSend() {
+    absl::MutexLock lock(&mutex_);
+    drop_next_send_ = true;
+  }
+
+  std::vector<SentTransaction> sent() {
+    absl::MutexLock lock(&mutex_);
+    return sent_;
+  }
+
+  int nonce_lookups() {
+    absl::MutexLock lock(&mutex_);
+    return nonce_lookups_;
+  }
+
+  // The block the last eth_call read the state of.
+  std::string last_call_block() {
+    absl::MutexLock lock(&mutex_);
+    return last_call_block_;
+  }
+
+  int batches() {
+    absl::MutexLock lock(&mutex_);
+    return batches_;
+  }
+
+ private:
+  google::protobuf::Value Answer(const google::protobuf::Value& request)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    const auto& fields = request.struct_value().fields();
+    const std::string& method = fields.at("method").string_value();
+    const google::protobuf::ListValue& params =
+        fields.at("params").list_value();
+    google::protobuf::Value response;
+    auto& response_fields = *response.mutable_struct_value()->mutable_fields();
+    response_fields["jsonrpc"].set_string_value("2.0");
+    response_fields["id"] = fields.at("id");
+    google::protobuf::Value& result = response_fields["result"];
+    if (method == "eth_estimateGas") {
+      if (revert_estimates_) {
+        response_fields.erase("result");
+        Error("VM Exception while processing transaction: revert",
+              response_fields["error"]);
+      } else {
+        result.set_string_value("0x5208");
+      }
+    } else if (method == "eth_getTransactionCount") {
+      ++nonce_lookups_;
+      result.set_string_value("0x7");
+    } else if (method == "eth_sendTransaction") {
+      const auto& transaction = params.values(0).struct_value().fields();
+      if (fail_next_send_) {
+        fail_next_send_ = false;
+        response_fields.erase("result");
+        Error("Internal error", response_fields["error"]);
+      } else {
+        sent_.push_back(SentTransaction{
+            transaction.at("from").string_value(),
+            transaction.at("data").string_value(),
+            *abi::FromQuantity(transaction.at("nonce").string_value())});
+        result.set_string_value(abi::ToHex(abi::Keccak256(
+            absl::StrCat(sent_.back().from, sent_.back().nonce))));
+      }
+    } else if (method == "eth_getTransactionReceipt") {
+      if (mining_) {
+        auto& receipt = *result.mutable_struct_value()->mutable_fields();
+        receipt["status"].set_string_value(revert_receipts_ ? "0x0" : "0x1");
+        google::protobuf::ListValue& logs =
+            *receipt["logs"].mutable_list_value();
+        if (!skipped_indices_.empty()) {
+          *logs.add_values() =
+              Log(kAccount1, "StartVotingSkipped(uint256)", 0);
+        }
+        for (const uint64_t index : skipped_indices_) {
+          *logs.add_values() =
+              Log(kContract, "StartVotingSkipped(uint256)", index);
+        }
+      } else {
+        result.set_null_value(google::protobuf::NULL_VALUE);
+      }
+    } else if (method == "eth_call") {
+      const std::string data = *abi::FromHex(
+          params.values(0).struct_value().fields().at("data").string_value());
+      last_call_block_ = params.values(1).string_value();
+      result.set_string_value(abi::ToHex(call_outputs_[data.substr(0, 4)]));
+    } else if (method == "eth_blockNumber") {
+      result.set_string_value("0x2a");
+    } else if (method == "eth_sign") {
+      result.set_string_value(abi::ToHex(std::string(65, '\x1b')));
+    }
+    return response;
+  }
+
+  // A log of the event with |signature| and one uint256 argument.
+  static google::protobuf::Value Log(const std::string& address,
+                                     const std::string& signature,
+                                     uint64_t argument) {
+    google::protobuf::Value log;
+    auto& fields = *log.mutable_struct_value()->mutable_fields();
+    fields["address"].set_string_value(address);
+    fields["topics"].mutable_list_value()->add_values()->set_string_value(
+        abi::ToHex(abi::Keccak256(signature)));
+    fields["data"].set_string_value(
+        abi::ToHex(Output({abi::Value::Uint(argument)})));
+    return log;
+  }
+
+  static void Error(const std::string& message,
+                    google::protobuf::Value& error) {
+    auto& fields = *error.mutable_struct_value()->mutable_fields();
+    fields["code"].set_number_value(-32000);
+    fields["message"].set_string_value(message);
+  }
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, std::string> call_outputs_
+      ABSL_GUARDED_BY(mutex_);
+  bool revert_estimates_ ABSL_GUARDED_BY(mutex_) = false;
+  bool revert_receipts_ ABSL_GUARDED_BY(mutex_) = false;
+  bool mining_ ABSL_GUARDED_BY(mutex_) = true;
+  bool fail_next_send_ ABSL_GUARDED_BY(mutex_) = false;
+  bool drop_next_send_ ABSL_GUARDED_BY(mutex_) = false;
+  std::vector<SentTransaction> sent_ ABSL_GUARDED_BY(mutex_);
+  int nonce_lookups_ ABSL_GUARDED_BY(mutex_) = 0;
+  int batches_ ABSL_GUARDED_BY(mutex_) = 0;
+  std::string last_call_block_ ABSL_GUARDED_BY(mutex_);
+  std::vector<uint64_t> skipped_indices_ ABSL_GUARDED_BY(mutex_);
+};
+
+std::time_t InOneMinute() {
+  return absl::ToTimeT(absl::Now() + absl::Minutes(1));
+}
+
+class EthereumBlockchainTest : public ::testing::Test {
+ protected:
+  EthereumBlockchainTest() {
+    auto node = std::make_unique<FakeNode>();
+    node_ = node.get();
+    EthereumBlockchainOptions options;
+    options.contract_address = kContract;
+    options.accounts = {kAccount1, kAccount2};
+    options.receipt_poll_interval = absl::Milliseconds(5);
+    blockchain_ = std::make_unique<TwoPhaseCommit>(
+        std::make_unique<EthereumBlockchain>(std::move(node), options));
+  }
+
+  FakeNode* node_;
+  std::unique_ptr<TwoPhaseCommit> blockchain_;
+};
+
+TEST_F(EthereumBlockchainTest, SendsContractCallsWithLocalNonces) {
+  const std::time_t timeout_time = InOneMinute();
+  ASSERT_TRUE(blockchain_->StartVoting("t1", timeout_time, 2).ok());
+  ASSERT_TRUE(blockchain_->Vote("t1", 0, Ballot::BALLOT_COMMIT).ok());
+  ASSERT_TRUE(blockchain_->Vote("t1", 1, Ballot::BALLOT_ABORT).ok());
+
+  const std::vector<SentTransaction> sent = node_->sent();
+  ASSERT_EQ(sent.size(), 3);
+  EXPECT_EQ(sent[0].data,
+            abi::ToHex(abi::EncodeCall(
+                "startVoting(string,uint32,uint256)",
+                {abi::Value::String("t1"), abi::Value::Uint(2),
+                 abi::Value::Uint(timeout_time)})));
+  EXPECT_EQ(sent[2].data, abi::ToHex(abi::EncodeCall(
+                              "vote(string,uint32,uint8)",
+                              {abi::Value::String("t1"), abi::Value::Uint(1),
+                               abi::Value::Uint(Ballot::BALLOT_ABORT)})));
+  // Accounts take turns, each counting up from the node's nonce.
+  EXPECT_EQ(sent[0].from, kAccount1);
+  EXPECT_EQ(sent[0].nonce, 7);
+  EXPECT_EQ(sent[1].from, kAccount2);
+  EXPECT_EQ(sent[1].nonce, 7);
+  EXPECT_EQ(sent[2].from, kAccount1);
+  EXPECT_EQ(sent[2].nonce, 8);
+  EXPECT_EQ(node_->nonce_lookups(), 2);
+}
+
+TEST_F(EthereumBlockchainTest, PipelinesAsyncCalls) {
+  constexpr int kVotes = 50;
+  absl::Mutex mutex;
+  std::vector<absl::Status> statuses;
+  for (int i = 0; i < kVotes; ++i) {
+    blockchain_->VoteAsync("t1", i, Ballot::BALLOT_COMMIT,
+                           absl::Now() + absl::Seconds(10),
+                           [&](absl::Status status) {
+                             absl::MutexLock lock(&mutex);
+                             statuses.push_back(status);
+                           });
+  }
+  {
+    absl::MutexLock lock(&mutex);
+    const auto all_done = [&]() {
+      mutex.AssertHeld();
+      return statuses.size() == kVotes;
+    };
+    ASSERT_TRUE(
+        mutex.AwaitWithTimeout(absl::Condition(&all_done), absl::Seconds(10)));
+    for (const absl::Status& status : statuses) {
+      EXPECT_TRUE(status.ok()) << status;
+    }
+  }
+  // Every nonce of each account is used once, with no gaps.
+  std::set<std::pair<std::string, uint64_t>> nonces;
+  for (const SentTransaction& transaction : node_->sent()) {
+    nonces.emplace(transaction.from, transaction.nonce);
+  }
+  ASSERT_EQ(nonces.size(), kVotes);
+  EXPECT_EQ(*nonces.rbegin(), std::make_pair(std::string(kAccount2),
+                                             uint64_t{7 + kVotes / 2 - 1}));
+  // Receipts are polled in batches rather than one request each.
+  EXPECT_LT(node_->batches(), kVotes);
+}
+
+TEST_F(EthereumBlockchainTest, RejectsWhatTheContractRejects) {
+  node_->RevertEstimates();
+  EXPECT_TRUE(absl::IsFailedPrecondition(
+      blockchain_->Vote("t1", 0, Ballot::BALLOT_COMMIT)));
+  EXPECT_TRUE(node_->sent().empty());
+  EXPECT_EQ(node_->nonce_lookups(), 0);
+}
+
+TEST_F(EthereumBlockchainTest, FailsCallsThatRevertOnceMined) {
+  node_->RevertReceipts();
+  EXPECT_TRUE(absl::IsFailedPrecondition(
+      blockchain_->Vote("t1", 0, Ballot::BALLOT_COMMIT)));
+}
+
+TEST_F(EthereumBlockchainTest, ReturnsTheTransactionsABatchSkipped) {
+  node_->LogSkippedIndices({0, 2});
+  std::vector<StartVotingRequest> transactions(3);
+  for (int i = 0; i < 3; ++i) {
+    transactions[i].set_transaction_id(absl::StrCat("t", i));
+    transactions[i].set_cohorts(1);
+    transactions[i].mutable_timeout_time()->set_seconds(InOneMinute());
+  }
+  absl::StatusOr<std::vector<int>> skipped =
+      blockchain_->StartVotingBatch(transactions);
+  ASSERT_TRUE(skipped.ok()) << skipped.status();
+  EXPECT_THAT(*skipped, ::testing::ElementsAre(0, 2));
+}
+
+TEST_F(EthereumBlockchainTest, ReusesTheNoncesOfSendsThatNeverReachedTheNode) {
+  node_->DropNextSend();
+  EXPECT_TRUE(
+      absl::IsUnavailable(blockchain_->Vote("t1", 0, Ballot::BALLOT_COMMIT)));
+  ASSERT_TRUE(blockchain_->Vote("t1", 1, Ballot::BALLOT_COMMIT).ok());
+  ASSERT_TRUE(blockchain_->Vote("t1", 2, Ballot::BALLOT_COMMIT).ok());
+
+  const std::vector<SentTransaction> sent = node_->sent();
+  ASSERT_EQ(sent.size(), 2);
+  EXPECT_EQ(sent[0].from, kAccount2);
+  EXPECT_EQ(sent[0].nonce, 7);
+  // The first account's nonce 7 never reached the node, so it's sent again
+  // without asking the node.
+  EXPECT_EQ(sent[1].from, kAccount1);
+  EXPECT_EQ(sent[1].nonce, 7);
+  EXPECT_EQ(node_->nonce_lookups(), 2);
+}
+
+TEST_F(EthereumBlockchainTest, LooksUpTheNonceAgainAfterRejectedSends) {
+  node_->FailNextSend();
+  EXPECT_TRUE(
+      absl::IsInternal(blockchain_->Vote("t1", 0, Ballot::BALLOT_COMMIT)));
+  ASSERT_TRUE(blockchain_->Vote("t1", 1, Ballot::BALLOT_COMMIT).ok());
+  ASSERT_TRUE(blockchain_->Vote("t1", 2, Ballot::BALLOT_COMMIT).ok());
+
+  const std::vector<SentTransaction> sent = node_->sent();
+  ASSERT_EQ(sent.size(), 2);
+  EXPECT_EQ(sent[1].from, kAccount1);
+  EXPECT_EQ(sent[1].nonce, 7);
+  // The node answered the first send, so it may have used the nonce and the
+  // first account asks it for the next one.
+  EXPECT_EQ(node_->nonce_lookups(), 3);
+}
+
+TEST_F(EthereumBlockchainTest, TimesOutCallsNotMinedBeforeTheDeadline) {
+  node_->StopMining();
+  absl::Notification done;
+  absl::Status vote_status;
+  blockchain_->VoteAsync("t1", 0, Ballot::BALLOT_COMMIT,
+                         absl::Now() + absl::Milliseconds(50),
+                         [&](absl::Status status) {
+                           vote_status = status;
+                           done.Notify();
+                         });
+  ASSERT_TRUE(done.WaitForNotificationWithTimeout(absl::Seconds(10)));
+  EXPECT_TRUE(absl::IsDeadlineExceeded(vote_status)) << vote_status;
+}
+
+TEST_F(EthereumBlockchainTest, ReadsDecisionsFromTheContract) {
+  node_->SetCallOutput("getVotingDecision(string)",
+                       Output({abi::Value::String("2:All cohorts agreed.")}));
+  node_->SetCallOutput(
+      "getVotingDecisions(string[])",
+      Output({abi::Value::Array(
+          {abi::Value::String("1:Waiting for votes."),
+           abi::Value::String("3:A cohort voted to abort."),
+           abi::Value::String("?:Voting has not started.")})}));
+  node_->SetCallOutput("getHeartBeat()", Output({abi::Value::Uint(1)}));
+
+  EXPECT_EQ(*blockchain_->GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+  EXPECT_EQ(node_->last_call_block(), "0x2a");
+  const std::vector<std::string> transaction_ids = {"t2", "t3", "t4"};
+  absl::StatusOr<absl::flat_hash_map<std::string, VotingDecision>> decisions =
+      blockchain_->GetVotingDecisions(transaction_ids);
+  ASSERT_TRUE(decisions.ok()) << decisions.status();
+  EXPECT_THAT(*decisions,
+              UnorderedElementsAre(
+                  Pair("t2", VotingDecision::VOTING_DECISION_PENDING),
+                  Pair("t3", VotingDecision::VOTING_DECISION_ABORT),
+                  Pair("t4", VotingDecision::VOTING_DECISION_UNKNOWN)));
+  EXPECT_TRUE(blockchain_->GetHeartBeat().ok());
+  EXPECT_TRUE(node_->sent().empty());
+}
+
+TEST_F(EthereumBlockchainTest, SignsAndCommitsWithVotes) {
+  node_->SetCallOutput("getCommitVoteHash(string,uint32)",
+                       Output({abi::Value::Uint(42)}));
+  absl::StatusOr<std::string> signature = blockchain_->SignCommitVote("t1", 0);
+  ASSERT_TRUE(signature.ok()) << signature.status();
+  EXPECT_EQ(*signature, std::string(65, '\x1b'));
+
+  ASSERT_TRUE(blockchain_->CommitWithVotes("t1", {kAccount1}, {*signature})
+                  .ok());
+  const std::vector<SentTransaction> sent = node_->sent();
+  ASSERT_EQ(sent.size(), 1);
+  EXPECT_EQ(sent[0].data,
+            abi::ToHex(abi::EncodeCall(
+                "commitWithVotes(string,address[],bytes[])",
+                {abi::Value::String("t1"),
+                 abi::Value::Array({*abi::Value::Address(kAccount1)}),
+                 abi::Value::Array({abi::Value::Bytes(*signature)})})));
+}
+
+TEST_F(EthereumBlockchainTest, RejectsInvalidSigners) {
+  EXPECT_TRUE(absl::IsInvalidArgument(blockchain_->StartVotingWithSigners(
+      "t1", InOneMinute(), {"not an address"})));
+  EXPECT_TRUE(node_->sent().empty());
+}
+
+}  // namespace
+
+}  // namespace blockchain
@@ -0,0 +1,375 @@
+#include "src/blockchain/json_rpc_client.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/util/json_util.h"
+
+namespace blockchain {
+
+namespace {
+
+constexpr char kHeaderEnd[] = "\r\n\r\n";
+constexpr size_t kReadSize = 16384;
+
+absl::Status ErrnoError(absl::string_view action) {
+  return absl::UnavailableError(
+      absl::StrCat("JSON-RPC ", action, " failed: ", std::strerror(errno)));
+}
+
+// The server may have received and processed the request, e.g. sent the
+// blockchain transaction, even though its response didn't come back.
+absl::Status MaybeSentError(const absl::Status& status) {
+  return absl::UnknownError(absl::StrCat(
+      "JSON-RPC request may have been processed: ", status.message()));
+}
+
+// Converts the result or error of a JSON-RPC response object.
+absl::StatusOr<google::protobuf::Value> ToResult(
+    const google::protobuf::Struct& response) {
+  const auto error = response.fields().find("error");
+  if (error != response.fields().end()) {
+    const auto& fields = error->second.struct_value().fields();
+    const auto message = fields.find("message");
+    const std::string text = message == fields.end()
+                                 ? "Unknown JSON-RPC error"
+                                 : message->second.string_value();
+    if (absl::StrContains(text, "revert")) {
+      return absl::FailedPreconditionError(text);
+    }
+    return absl::InternalError(text);
+  }
+  const auto result = response.fields().find("result");
+  if (result == response.fields().end()) {
+    return absl::InternalError("JSON-RPC response has no result");
+  }
+  return result->second;
+}
+
+}  // namespace
+
+HttpJsonRpcTransport::HttpJsonRpcTransport(std::string host, int port,
+                                           int max_connections,
+                                           absl::Duration timeout)
+    : host_(std::move(host)),
+      port_(port),
+      max_connections_(max_connections),
+      timeout_(timeout) {}
+
+HttpJsonRpcTransport::~HttpJsonRpcTransport() {
+  absl::MutexLock lock(&mutex_);
+  for (const std::unique_ptr<Connection>& connection : idle_) {
+    close(connection->fd);
+  }
+}
+
+absl::StatusOr<std::string> HttpJsonRpcTransport::Post(
+    const std::string& body) {
+  while (true) {
+    absl::StatusOr<std::unique_ptr<Connection>> connection = Acquire();
+    if (!connection.ok()) {
+      return connection.status();
+    }
+    bool reusable = false;
+    absl::StatusOr<std::string> response =
+        PostOn(**connection, body, reusable);
+    // The server closing an idle connection before receiving the request is
+    // the only failure that's safe to retry, since requests like
+    // eth_sendTransaction aren't idempotent.
+    const bool retry = !response.ok() && (*connection)->reused &&
+                       (*connection)->closed_by_server &&
+                       (*connection)->buffer.empty();
+    Release(*std::move(connection), reusable);
+    if (!retry) {
+      return response;
+    }
+  }
+}
+
+absl::StatusOr<std::unique_ptr<HttpJsonRpcTransport::Connection>>
+HttpJsonRpcTransport::Acquire() {
+  {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(
+        +[](HttpJsonRpcTransport* transport)
+             ABSL_EXCLUSIVE_LOCKS_REQUIRED(transport->mutex_) {
+               return !transport->idle_.empty() ||
+                      transport->open_connections_ <
+                          transport->max_connections_;
+             },
+        this));
+    if (!idle_.empty()) {
+      std::unique_ptr<Connection> connection = std::move(idle_.back());
+      idle_.pop_back();
+      return connection;
+    }
+    ++open_connections_;
+  }
+  absl::StatusOr<int> fd = Connect();
+  if (!fd.ok()) {
+    absl::MutexLock lock(&mutex_);
+    --open_connections_;
+    return fd.status();
+  }
+  auto connection = std::make_unique<Connection>();
+  connection->fd = *fd;
+  return connection;
+}
+
+void HttpJsonRpcTransport::Release(std::unique_ptr<Connection> connection,
+                                   bool reusable) {
+  absl::MutexLock lock(&mutex_);
+  if (reusable) {
+    connection->reused = true;
+    idle_.push_back(std::move(connection));
+  } else {
+    close(connection->fd);
+    --open_connections_;
+  }
+}
+
+absl::StatusOr<int> HttpJsonRpcTransport::Connect() {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  const int error = getaddrinfo(host_.c_str(), std::to_string(port_).c_str(),
+                                &hints, &addresses);
+  if (error != 0) {
+    return absl::UnavailableError(absl::StrCat(
+        "Failed to resolve ", host_, ": ", gai_strerror(error)));
+  }
+  int fd = -1;
+  for (addrinfo* address = addresses; address != nullptr;
+       address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    return ErrnoError(absl::StrCat("connect to ", host_, ":", port_));
+  }
+  // Requests are small and latency-bound, so don't wait to coalesce them.
+  const int no_delay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+  const timeval timeout = absl::ToTimeval(timeout_);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+absl::Status HttpJsonRpcTransport::Receive(Connection& connection) {
+  char data[kReadSize];
+  const ssize_t size = recv(connection.fd, data, sizeof(data), 0);
+  if (size < 0) {
+    connection.closed_by_server = errno == ECONNRESET;
+    return ErrnoError("receive");
+  }
+  if (size == 0) {
+    connection.closed_by_server = true;
+    return absl::UnavailableError("JSON-RPC connection closed by the server");
+  }
+  connection.buffer.append(data, size);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> HttpJsonRpcTransport::PostOn(
+    Connection& connection, const std::string& body, bool& reusable) {
+  const std::string request = absl::StrCat(
+      "POST / HTTP/1.1\r\nHost: ", host_, ":", port_,
+      "\r\nContent-Type: application/json\r\nContent-Length: ", body.size(),
+      "\r\nConnection: keep-alive\r\n\r\n", body);
+  for (size_t sent = 0; sent < request.size();) {
+    const ssize_t size = send(connection.fd, request.data() + sent,
+                              request.size() - sent, MSG_NOSIGNAL);
+    if (size < 0) {
+      connection.closed_by_server = errno == EPIPE || errno == ECONNRESET;
+      const absl::Status status = ErrnoError("send");
+      if (sent == 0) {
+        return status;
+      }
+      return MaybeSentError(status);
+    }
+    sent += size;
+  }
+  absl::StatusOr<std::string> response = ReadResponse(connection, reusable);
+  if (!response.ok()) {
+    return MaybeSentError(response.status());
+  }
+  return response;
+}
+
+absl::StatusOr<std::string> HttpJsonRpcTransport::ReadResponse(
+    Connection& connection, bool& reusable) {
+  size_t header_end;
+  while ((header_end = connection.buffer.find(kHeaderEnd)) ==
+         std::string::npos) {
+    if (absl::Status status = Receive(connection); !status.ok()) {
+      return status;
+    }
+  }
+  const std::vector<absl::string_view> lines = absl::StrSplit(
+      absl::string_view(connection.buffer).substr(0, header_end), "\r\n");
+  const std::vector<absl::string_view> status_line =
+      absl::StrSplit(lines[0], absl::MaxSplits(' ', 2));
+  int status_code = 0;
+  if (status_line.size() < 2 ||
+      !absl::SimpleAtoi(status_line[1], &status_code)) {
+    return absl::UnavailableError(
+        absl::StrCat("Invalid HTTP status line: ", lines[0]));
+  }
+  absl::flat_hash_map<std::string, std::string> headers;
+  for (size_t i = 1; i < lines.size(); ++i) {
+    const std::vector<absl::string_view> header =
+        absl::StrSplit(lines[i], absl::MaxSplits(':', 1));
+    if (header.size() == 2) {
+      headers[absl::AsciiStrToLower(header[0])] =
+          absl::AsciiStrToLower(absl::StripAsciiWhitespace(header[1]));
+    }
+  }
+  connection.buffer.erase(0, header_end + sizeof(kHeaderEnd) - 1);
+
+  std::string response_body;
+  if (headers["transfer-encoding"] == "chunked") {
+    while (true) {
+      size_t line_end;
+      while ((line_end = connection.buffer.find("\r\n")) ==
+             std::string::npos) {
+        if (absl::Status status = Receive(connection); !status.ok()) {
+          return status;
+        }
+      }
+      // The size may be followed by extensions, which are ignored.
+      char* size_end = nullptr;
+      const size_t chunk_size =
+          std::strtoul(connection.buffer.c_str(), &size_end, 16);
+      if (size_end == connection.buffer.c_str()) {
+        return absl::UnavailableError("Invalid HTTP chunk size");
+      }
+      // Each chunk and the last (empty) one end with CRLF.
+      while (connection.buffer.size() < line_end + 2 + chunk_size + 2) {
+        if (absl::Status status = Receive(connection); !status.ok()) {
+          return status;
+        }
+      }
+      response_body.append(connection.buffer, line_end + 2, chunk_size);
+      connection.buffer.erase(0, line_end + 2 + chunk_size + 2);
+      if (chunk_size == 0) {
+        break;
+      }
+    }
+  } else {
+    size_t content_length = 0;
+    if (!absl::SimpleAtoi(headers["content-length"], &content_length)) {
+      return absl::UnavailableError("HTTP response has no Content-Length");
+    }
+    while (connection.buffer.size() < content_length) {
+      if (absl::Status status = Receive(connection); !status.ok()) {
+        return status;
+      }
+    }
+    response_body = connection.buffer.substr(0, content_length);
+    connection.buffer.erase(0, content_length);
+  }
+  reusable = headers["connection"] != "close";
+  if (status_code != 200) {
+    return absl::UnavailableError(absl::StrCat(
+        "JSON-RPC HTTP status ", status_code, ": ", response_body));
+  }
+  return response_body;
+}
+
+google::protobuf::Value JsonRpcClient::ToJson(const Request& request,
+                                              int64_t id) {
+  google::protobuf::Value json;
+  auto& fields = *json.mutable_struct_value()->mutable_fields();
+  fields["jsonrpc"].set_string_value("2.0");
+  fields["id"].set_number_value(id);
+  fields["method"].set_string_value(request.method);
+  *fields["params"].mutable_list_value() = request.params;
+  return json;
+}
+
+absl::StatusOr<google::protobuf::Value> JsonRpcClient::Call(
+    const std::string& method, const google::protobuf::ListValue& params) {
+  return CallBatch({{method, params}})[0];
+}
+
+std::vector<absl::StatusOr<google::protobuf::Value>> JsonRpcClient::CallBatch(
+    const std::vector<Request>& requests) {
+  const int64_t first_id = next_id_.fetch_add(requests.size());
+  google::protobuf::Value batch;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    *batch.mutable_list_value()->add_values() =
+        ToJson(requests[i], first_id + i);
+  }
+  // A single request is sent on its own, since not every server supports
+  // batches.
+  std::string body;
+  google::protobuf::util::MessageToJsonString(
+      requests.size() == 1 ? batch.list_value().values(0) : batch, &body);
+
+  std::vector<absl::StatusOr<google::protobuf::Value>> results(
+      requests.size(),
+      absl::InternalError("JSON-RPC response is missing the request"));
+  absl::StatusOr<std::string> response_body = transport_->Post(body);
+  if (!response_body.ok()) {
+    std::fill(results.begin(), results.end(), response_body.status());
+    return results;
+  }
+  google::protobuf::Value response;
+  if (!google::protobuf::util::JsonStringToMessage(*response_body, &response)
+           .ok()) {
+    std::fill(results.begin(), results.end(),
+              absl::InternalError(absl::StrCat("Invalid JSON-RPC response: ",
+                                               *response_body)));
+    return results;
+  }
+  if (response.has_struct_value()) {
+    google::protobuf::Value single;
+    *single.mutable_list_value()->add_values() = std::move(response);
+    response = std::move(single);
+  }
+  // Batch responses may come in any order, so match them by id.
+  for (const google::protobuf::Value& item : response.list_value().values()) {
+    const auto& fields = item.struct_value().fields();
+    const auto id = fields.find("id");
+    if (id == fields.end() || id->second.has_null_value()) {
+      // e.g. the server rejected the whole batch.
+      std::fill(results.begin(), results.end(), ToResult(item.struct_value()));
+      return results;
+    }
+    const int64_t index =
+        static_cast<int64_t>(id->second.number_value()) - first_id;
+    if (index >= 0 && index < static_cast<int64_t>(results.size())) {
+      results[index] = ToResult(item.struct_value());
+    }
+  }
+  return results;
+}
+
+}  // namespace blockchain
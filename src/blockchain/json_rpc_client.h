@@ -0,0 +1,112 @@
+#ifndef SRC_BLOCKCHAIN_JSON_RPC_CLIENT_H_
+
+#define SRC_BLOCKCHAIN_JSON_RPC_CLIENT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "google/protobuf/struct.pb.h"
+
+namespace blockchain {
+
+// Sends JSON-RPC request bodies and returns the response bodies. Must be
+// thread-safe.
+class JsonRpcTransport {
+ public:
+  virtual ~JsonRpcTransport() = default;
+
+  // Fails with Unavailable error only if the request never reached the
+  // server, so e.g. the nonce of a blockchain transaction that failed to send
+  // can be reused. Requests that may have reached it fail with Unknown error.
+  virtual absl::StatusOr<std::string> Post(const std::string& body) = 0;
+};
+
+// Posts to an HTTP JSON-RPC endpoint, e.g. Ganache's, over persistent
+// keep-alive connections. Concurrent posts use separate connections, up to
+// |max_connections|, and later ones wait for one to be free. Fails with
+// Unavailable error if the endpoint can't be reached, and with Unknown error
+// if it doesn't respond within |timeout| or responds with an HTTP error.
+class HttpJsonRpcTransport : public JsonRpcTransport {
+ public:
+  HttpJsonRpcTransport(std::string host, int port, int max_connections,
+                       absl::Duration timeout = absl::Seconds(30));
+
+  // Closes the idle connections. Posts must have returned.
+  ~HttpJsonRpcTransport() override;
+
+  HttpJsonRpcTransport(const HttpJsonRpcTransport&) = delete;
+  HttpJsonRpcTransport& operator=(const HttpJsonRpcTransport&) = delete;
+
+  absl::StatusOr<std::string> Post(const std::string& body) override;
+
+ private:
+  struct Connection {
+    int fd = -1;
+    // Received bytes not consumed by a response yet.
+    std::string buffer;
+    // Whether a response was received on it before.
+    bool reused = false;
+    // Whether the last failure was the server closing or resetting it.
+    bool closed_by_server = false;
+  };
+
+  // Returns an idle connection, or a new one if fewer than
+  // |max_connections_| are open.
+  absl::StatusOr<std::unique_ptr<Connection>> Acquire();
+  void Release(std::unique_ptr<Connection> connection, bool reusable);
+  absl::StatusOr<int> Connect();
+  // Sends the request and reads the response body. Sets |reusable| to
+  // whether the connection can send another request.
+  absl::StatusOr<std::string> PostOn(Connection& connection,
+                                     const std::string& body, bool& reusable);
+  absl::StatusOr<std::string> ReadResponse(Connection& connection,
+                                           bool& reusable);
+  absl::Status Receive(Connection& connection);
+
+  const std::string host_;
+  const int port_;
+  const int max_connections_;
+  const absl::Duration timeout_;
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Connection>> idle_ ABSL_GUARDED_BY(mutex_);
+  int open_connections_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+// Ethereum JSON-RPC 2.0 client. Requests sent with CallBatch share one round
+// trip. Calls fail with FailedPrecondition error if the EVM reverts them,
+// Internal error for other JSON-RPC errors, and the transport's error if the
+// request or its response doesn't go through.
+class JsonRpcClient {
+ public:
+  struct Request {
+    std::string method;
+    google::protobuf::ListValue params;
+  };
+
+  explicit JsonRpcClient(std::unique_ptr<JsonRpcTransport> transport)
+      : transport_(std::move(transport)) {}
+
+  absl::StatusOr<google::protobuf::Value> Call(
+      const std::string& method, const google::protobuf::ListValue& params);
+
+  // Returns the result of each request, in order.
+  std::vector<absl::StatusOr<google::protobuf::Value>> CallBatch(
+      const std::vector<Request>& requests);
+
+ private:
+  google::protobuf::Value ToJson(const Request& request, int64_t id);
+
+  std::unique_ptr<JsonRpcTransport> transport_;
+  std::atomic<int64_t> next_id_{1};
+};
+
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_JSON_RPC_CLIENT_H_
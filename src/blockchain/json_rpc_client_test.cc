@@ -0,0 +1,276 @@
+#include "src/blockchain/json_rpc_client.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/util/json_util.h"
+#include "gtest/gtest.h"
+
+namespace blockchain {
+
+namespace {
+
+// Answers every HTTP request with |respond(body)|. Closes each connection
+// after its first response if |close_idle|, like servers closing idle
+// keep-alive connections.
+class HttpServer {
+ public:
+  using Respond = std::function<std::string(const std::string& body)>;
+
+  explicit HttpServer(Respond respond, bool close_idle = false)
+      : respond_(std::move(respond)), close_idle_(close_idle) {
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    socklen_t size = sizeof(address);
+    getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &size);
+    port_ = ntohs(address.sin_port);
+    listen(listener_, 16);
+    acceptor_ = std::thread([this]() { AcceptUntilClosed(); });
+  }
+
+  ~HttpServer() {
+    shutdown(listener_, SHUT_RDWR);
+    close(listener_);
+    acceptor_.join();
+    for (std::thread& connection : connections_) {
+      connection.join();
+    }
+  }
+
+  int port() const { return port_; }
+
+  int accepted() {
+    absl::MutexLock lock(&mutex_);
+    return accepted_;
+  }
+
+ private:
+  void AcceptUntilClosed() {
+    while (true) {
+      const int fd = accept(listener_, nullptr, nullptr);
+      if (fd < 0) {
+        return;
+      }
+      {
+        absl::MutexLock lock(&mutex_);
+        ++accepted_;
+      }
+      connections_.emplace_back([this, fd]() { Serve(fd); });
+    }
+  }
+
+  void Serve(int fd) {
+    std::string buffer;
+    char data[4096];
+    while (true) {
+      const size_t header_end = buffer.find("\r\n\r\n");
+      const size_t length_start = buffer.find("Content-Length: ");
+      size_t content_length = 0;
+      if (header_end != std::string::npos &&
+          absl::SimpleAtoi(
+              buffer.substr(length_start + 16,
+                            buffer.find("\r\n", length_start) - length_start -
+                                16),
+              &content_length) &&
+          buffer.size() >= header_end + 4 + content_length) {
+        const std::string response =
+            respond_(buffer.substr(header_end + 4, content_length));
+        buffer.erase(0, header_end + 4 + content_length);
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+        if (close_idle_) {
+          break;
+        }
+        continue;
+      }
+      const ssize_t size = recv(fd, data, sizeof(data), 0);
+      if (size <= 0) {
+        break;
+      }
+      buffer.append(data, size);
+    }
+    close(fd);
+  }
+
+  const Respond respond_;
+  const bool close_idle_;
+  int listener_;
+  int port_;
+  std::thread acceptor_;
+  // Only used by the acceptor until it's joined.
+  std::vector<std::thread> connections_;
+  absl::Mutex mutex_;
+  int accepted_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+std::string Ok(const std::string& body) {
+  return absl::StrCat("HTTP/1.1 200 OK\r\nContent-Length: ", body.size(),
+                      "\r\n\r\n", body);
+}
+
+TEST(HttpJsonRpcTransportTest, ReusesConnections) {
+  HttpServer server([](const std::string& body) { return Ok(body); });
+  HttpJsonRpcTransport transport("localhost", server.port(), 2);
+  for (int i = 0; i < 3; ++i) {
+    const std::string body = absl::StrCat("{\"id\":", i, "}");
+    EXPECT_EQ(*transport.Post(body), body);
+  }
+  EXPECT_EQ(server.accepted(), 1);
+}
+
+TEST(HttpJsonRpcTransportTest, ReadsChunkedResponses) {
+  HttpServer server([](const std::string&) {
+    return std::string(
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\r\n{\"a\":\r\na;ext=1\r\n\"chunked\"}\r\n0\r\n\r\n");
+  });
+  HttpJsonRpcTransport transport("localhost", server.port(), 1);
+  EXPECT_EQ(*transport.Post("{}"), "{\"a\":\"chunked\"}");
+  EXPECT_EQ(*transport.Post("{}"), "{\"a\":\"chunked\"}");
+  EXPECT_EQ(server.accepted(), 1);
+}
+
+TEST(HttpJsonRpcTransportTest, ReconnectsOnceTheServerClosesIdleConnections) {
+  HttpServer server([](const std::string& body) { return Ok(body); },
+                    /*close_idle=*/true);
+  HttpJsonRpcTransport transport("localhost", server.port(), 1);
+  for (int i = 0; i < 3; ++i) {
+    const std::string body = absl::StrCat(i);
+    absl::StatusOr<std::string> response = transport.Post(body);
+    ASSERT_TRUE(response.ok()) << response.status();
+    EXPECT_EQ(*response, body);
+  }
+  EXPECT_EQ(server.accepted(), 3);
+}
+
+TEST(HttpJsonRpcTransportTest, FailsIfTheServerIsUnreachable) {
+  int port;
+  {
+    HttpServer server([](const std::string& body) { return Ok(body); });
+    port = server.port();
+  }
+  HttpJsonRpcTransport transport("localhost", port, 1);
+  EXPECT_TRUE(absl::IsUnavailable(transport.Post("{}").status()));
+}
+
+TEST(HttpJsonRpcTransportTest, FailsOnHttpErrors) {
+  HttpServer server([](const std::string&) {
+    return std::string(
+        "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 4\r\n\r\noops");
+  });
+  HttpJsonRpcTransport transport("localhost", server.port(), 1);
+  // The server received the request, so it may have processed it.
+  EXPECT_TRUE(absl::IsUnknown(transport.Post("{}").status()));
+}
+
+// Answers batches in reverse order, with errors for "fail" and "revert".
+class ReversingTransport : public JsonRpcTransport {
+ public:
+  absl::StatusOr<std::string> Post(const std::string& body) override {
+    {
+      absl::MutexLock lock(&mutex_);
+      bodies_.push_back(body);
+    }
+    google::protobuf::Value request;
+    if (!google::protobuf::util::JsonStringToMessage(body, &request).ok()) {
+      return absl::InvalidArgumentError("Invalid JSON");
+    }
+    if (!request.has_list_value()) {
+      google::protobuf::Value single;
+      *single.mutable_list_value()->add_values() = request;
+      request = single;
+    }
+    google::protobuf::Value response;
+    const auto& items = request.list_value().values();
+    for (auto item = items.rbegin(); item != items.rend(); ++item) {
+      const auto& fields = item->struct_value().fields();
+      const std::string& method = fields.at("method").string_value();
+      google::protobuf::Value& answer =
+          *response.mutable_list_value()->add_values();
+      auto& answer_fields = *answer.mutable_struct_value()->mutable_fields();
+      answer_fields["id"] = fields.at("id");
+      if (method == "fail" || method == "revert") {
+        (*answer_fields["error"].mutable_struct_value()->mutable_fields())
+            ["message"]
+                .set_string_value(method == "revert"
+                                      ? "VM Exception: revert"
+                                      : "Method not found");
+      } else {
+        answer_fields["result"] = fields.at("params").list_value().values(0);
+      }
+    }
+    std::string response_body;
+    google::protobuf::util::MessageToJsonString(
+        request.list_value().values_size() == 1 &&
+                !absl::StartsWith(body, "[")
+            ? response.list_value().values(0)
+            : response,
+        &response_body);
+    return response_body;
+  }
+
+  std::vector<std::string> bodies() {
+    absl::MutexLock lock(&mutex_);
+    return bodies_;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<std::string> bodies_ ABSL_GUARDED_BY(mutex_);
+};
+
+google::protobuf::ListValue Params(const std::string& value) {
+  google::protobuf::ListValue params;
+  params.add_values()->set_string_value(value);
+  return params;
+}
+
+TEST(JsonRpcClientTest, MatchesBatchResponsesById) {
+  auto transport = std::make_unique<ReversingTransport>();
+  ReversingTransport* sent = transport.get();
+  JsonRpcClient client(std::move(transport));
+  const std::vector<absl::StatusOr<google::protobuf::Value>> results =
+      client.CallBatch({{"echo", Params("a")},
+                        {"revert", Params("b")},
+                        {"fail", Params("c")},
+                        {"echo", Params("d")}});
+  ASSERT_EQ(results.size(), 4);
+  EXPECT_EQ(results[0]->string_value(), "a");
+  EXPECT_TRUE(absl::IsFailedPrecondition(results[1].status()));
+  EXPECT_TRUE(absl::IsInternal(results[2].status()));
+  EXPECT_EQ(results[3]->string_value(), "d");
+  EXPECT_EQ(sent->bodies().size(), 1);
+}
+
+TEST(JsonRpcClientTest, SendsSingleCallsUnbatched) {
+  auto transport = std::make_unique<ReversingTransport>();
+  ReversingTransport* sent = transport.get();
+  JsonRpcClient client(std::move(transport));
+  absl::StatusOr<google::protobuf::Value> result =
+      client.Call("echo", Params("a"));
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_EQ(result->string_value(), "a");
+  ASSERT_EQ(sent->bodies().size(), 1);
+  EXPECT_EQ(sent->bodies()[0].front(), '{');
+}
+
+}  // namespace
+
+}  // namespace blockchain
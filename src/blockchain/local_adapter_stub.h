@@ -0,0 +1,143 @@
+#ifndef SRC_BLOCKCHAIN_LOCAL_ADAPTER_STUB_H_
+
+#define SRC_BLOCKCHAIN_LOCAL_ADAPTER_STUB_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "grpcpp/client_context.h"
+#include "src/blockchain/proto/two_phase_commit_adapter.grpc.pb.h"
+
+namespace blockchain {
+
+// Base of the TwoPhaseCommitAdapter stubs implemented in process instead of
+// calling the adapter server, which only support the blocking and callback
+// APIs. TwoPhaseCommit doesn't use the CompletionQueue ones.
+class LocalAdapterStub : public TwoPhaseCommitAdapter::StubInterface {
+ private:
+  grpc::ClientAsyncResponseReaderInterface<StartVotingResponse>*
+  AsyncStartVotingRaw(grpc::ClientContext*, const StartVotingRequest&,
+                      grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<StartVotingResponse>*
+  PrepareAsyncStartVotingRaw(grpc::ClientContext*, const StartVotingRequest&,
+                             grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<StartVotingBatchResponse>*
+  AsyncStartVotingBatchRaw(grpc::ClientContext*,
+                           const StartVotingBatchRequest&,
+                           grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<StartVotingBatchResponse>*
+  PrepareAsyncStartVotingBatchRaw(grpc::ClientContext*,
+                                  const StartVotingBatchRequest&,
+                                  grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<VoteResponse>* AsyncVoteRaw(
+      grpc::ClientContext*, const VoteRequest&,
+      grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<VoteResponse>* PrepareAsyncVoteRaw(
+      grpc::ClientContext*, const VoteRequest&,
+      grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<VoteBatchResponse>*
+  AsyncVoteBatchRaw(grpc::ClientContext*, const VoteBatchRequest&,
+                    grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<VoteBatchResponse>*
+  PrepareAsyncVoteBatchRaw(grpc::ClientContext*, const VoteBatchRequest&,
+                           grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<SignCommitVoteResponse>*
+  AsyncSignCommitVoteRaw(grpc::ClientContext*, const SignCommitVoteRequest&,
+                         grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<SignCommitVoteResponse>*
+  PrepareAsyncSignCommitVoteRaw(grpc::ClientContext*,
+                                const SignCommitVoteRequest&,
+                                grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<CommitWithVotesResponse>*
+  AsyncCommitWithVotesRaw(grpc::ClientContext*, const CommitWithVotesRequest&,
+                          grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<CommitWithVotesResponse>*
+  PrepareAsyncCommitWithVotesRaw(grpc::ClientContext*,
+                                 const CommitWithVotesRequest&,
+                                 grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<GetVotingDecisionResponse>*
+  AsyncGetVotingDecisionRaw(grpc::ClientContext*,
+                            const GetVotingDecisionRequest&,
+                            grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<GetVotingDecisionResponse>*
+  PrepareAsyncGetVotingDecisionRaw(grpc::ClientContext*,
+                                   const GetVotingDecisionRequest&,
+                                   grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<GetVotingDecisionsResponse>*
+  AsyncGetVotingDecisionsRaw(grpc::ClientContext*,
+                             const GetVotingDecisionsRequest&,
+                             grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<GetVotingDecisionsResponse>*
+  PrepareAsyncGetVotingDecisionsRaw(grpc::ClientContext*,
+                                    const GetVotingDecisionsRequest&,
+                                    grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<GetHeartBeatResponse>*
+  AsyncGetHeartBeatRaw(grpc::ClientContext*, const GetHeartBeatRequest&,
+                       grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+  grpc::ClientAsyncResponseReaderInterface<GetHeartBeatResponse>*
+  PrepareAsyncGetHeartBeatRaw(grpc::ClientContext*, const GetHeartBeatRequest&,
+                              grpc::CompletionQueue*) override {
+    return nullptr;
+  }
+};
+
+// Decision stream that ends right away with Unimplemented error, for local
+// stubs that don't stream decisions, so callers poll them instead.
+class UnimplementedDecisionReader
+    : public grpc::ClientReaderInterface<VotingDecidedEvent> {
+ public:
+  explicit UnimplementedDecisionReader(std::string message)
+      : message_(std::move(message)) {}
+
+  grpc::Status Finish() override {
+    return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, message_);
+  }
+  bool NextMessageSize(uint32_t* size) override {
+    *size = 0;
+    return false;
+  }
+  bool Read(VotingDecidedEvent*) override { return false; }
+  void WaitForInitialMetadata() override {}
+
+ private:
+  const std::string message_;
+};
+
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_LOCAL_ADAPTER_STUB_H_
@@ -0,0 +1,467 @@
+#include "src/blockchain/simulated_blockchain.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+
+namespace blockchain {
+
+SimulatedBlockchain::SimulatedBlockchain(
+    const SimulatedBlockchainOptions& options)
+    : options_(options),
+      block_time_(absl::Now()),
+      miner_([this]() { MineUntilStopped(); }) {}
+
+SimulatedBlockchain::~SimulatedBlockchain() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+  }
+  miner_.join();
+}
+
+grpc::Status SimulatedBlockchain::StartVoting(grpc::ClientContext* context,
+                                              const StartVotingRequest& request,
+                                              StartVotingResponse*) {
+  return SubmitAndWait(context, StartVotingTransaction(request));
+}
+
+grpc::Status SimulatedBlockchain::StartVotingBatch(
+    grpc::ClientContext* context, const StartVotingBatchRequest& request,
+    StartVotingBatchResponse* response) {
+  for (const StartVotingRequest& transaction : request.transactions()) {
+    if (!transaction.signers().empty()) {
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          "StartVotingBatch doesn't support signers");
+    }
+  }
+  auto skipped_indices = std::make_shared<std::vector<uint32_t>>();
+  const grpc::Status status = SubmitAndWait(
+      context, StartVotingBatchTransaction(request, skipped_indices));
+  if (status.ok()) {
+    response->mutable_skipped_indices()->Add(skipped_indices->begin(),
+                                             skipped_indices->end());
+  }
+  return status;
+}
+
+grpc::Status SimulatedBlockchain::Vote(grpc::ClientContext* context,
+                                       const VoteRequest& request,
+                                       VoteResponse*) {
+  return SubmitAndWait(context, VoteTransaction(request));
+}
+
+grpc::Status SimulatedBlockchain::VoteBatch(grpc::ClientContext* context,
+                                            const VoteBatchRequest& request,
+                                            VoteBatchResponse*) {
+  return SubmitAndWait(context, VoteBatchTransaction(request));
+}
+
+// Signing doesn't need a block, so it's answered right away.
+grpc::Status SimulatedBlockchain::SignCommitVote(
+    grpc::ClientContext*, const SignCommitVoteRequest& request,
+    SignCommitVoteResponse* response) {
+  response->set_signature(
+      Sign(options_.signer, request.transaction_id(), request.cohort_id()));
+  return grpc::Status::OK;
+}
+
+grpc::Status SimulatedBlockchain::CommitWithVotes(
+    grpc::ClientContext* context, const CommitWithVotesRequest& request,
+    CommitWithVotesResponse*) {
+  return SubmitAndWait(context, CommitWithVotesTransaction(request));
+}
+
+grpc::Status SimulatedBlockchain::GetVotingDecision(
+    grpc::ClientContext*, const GetVotingDecisionRequest& request,
+    GetVotingDecisionResponse* response) {
+  absl::MutexLock lock(&mutex_);
+  const auto it = votings_.find(request.transaction_id());
+  if (it == votings_.end()) {
+    return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                        "Voting has not started.");
+  }
+  SetDecision(it->second, *response);
+  return grpc::Status::OK;
+}
+
+grpc::Status SimulatedBlockchain::GetVotingDecisions(
+    grpc::ClientContext*, const GetVotingDecisionsRequest& request,
+    GetVotingDecisionsResponse* response) {
+  absl::MutexLock lock(&mutex_);
+  for (const std::string& transaction_id : request.transaction_ids()) {
+    GetVotingDecisionResponse* decision = response->add_decisions();
+    const auto it = votings_.find(transaction_id);
+    if (it == votings_.end()) {
+      decision->set_decision(VotingDecision::VOTING_DECISION_UNKNOWN);
+      decision->set_reason("Voting has not started.");
+      decision->set_block_number(block_number_);
+      continue;
+    }
+    SetDecision(it->second, *decision);
+  }
+  return grpc::Status::OK;
+}
+
+grpc::Status SimulatedBlockchain::GetHeartBeat(grpc::ClientContext*,
+                                               const GetHeartBeatRequest&,
+                                               GetHeartBeatResponse* response) {
+  response->set_is_ok(true);
+  return grpc::Status::OK;
+}
+
+int64_t SimulatedBlockchain::block_number() {
+  absl::MutexLock lock(&mutex_);
+  return block_number_;
+}
+
+void SimulatedBlockchain::AsyncApi::StartVoting(
+    grpc::ClientContext* context, const StartVotingRequest* request,
+    StartVotingResponse*, Callback done) {
+  blockchain_->Submit(context, blockchain_->StartVotingTransaction(*request),
+                      std::move(done));
+}
+
+void SimulatedBlockchain::AsyncApi::StartVotingBatch(
+    grpc::ClientContext* context, const StartVotingBatchRequest* request,
+    StartVotingBatchResponse* response, Callback done) {
+  for (const StartVotingRequest& transaction : request->transactions()) {
+    if (!transaction.signers().empty()) {
+      done(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "StartVotingBatch doesn't support signers"));
+      return;
+    }
+  }
+  auto skipped_indices = std::make_shared<std::vector<uint32_t>>();
+  blockchain_->Submit(
+      context,
+      blockchain_->StartVotingBatchTransaction(*request, skipped_indices),
+      [skipped_indices, response, done = std::move(done)](grpc::Status status) {
+        if (status.ok()) {
+          response->mutable_skipped_indices()->Add(skipped_indices->begin(),
+                                                   skipped_indices->end());
+        }
+        done(std::move(status));
+      });
+}
+
+void SimulatedBlockchain::AsyncApi::Vote(grpc::ClientContext* context,
+                                         const VoteRequest* request,
+                                         VoteResponse*, Callback done) {
+  blockchain_->Submit(context, blockchain_->VoteTransaction(*request),
+                      std::move(done));
+}
+
+void SimulatedBlockchain::AsyncApi::VoteBatch(grpc::ClientContext* context,
+                                              const VoteBatchRequest* request,
+                                              VoteBatchResponse*,
+                                              Callback done) {
+  blockchain_->Submit(context, blockchain_->VoteBatchTransaction(*request),
+                      std::move(done));
+}
+
+void SimulatedBlockchain::AsyncApi::SignCommitVote(
+    grpc::ClientContext* context, const SignCommitVoteRequest* request,
+    SignCommitVoteResponse* response, Callback done) {
+  done(blockchain_->SignCommitVote(context, *request, response));
+}
+
+void SimulatedBlockchain::AsyncApi::CommitWithVotes(
+    grpc::ClientContext* context, const CommitWithVotesRequest* request,
+    CommitWithVotesResponse*, Callback done) {
+  blockchain_->Submit(context,
+                      blockchain_->CommitWithVotesTransaction(*request),
+                      std::move(done));
+}
+
+// Reads don't need a block, so they're answered right away.
+void SimulatedBlockchain::AsyncApi::GetVotingDecision(
+    grpc::ClientContext* context, const GetVotingDecisionRequest* request,
+    GetVotingDecisionResponse* response, Callback done) {
+  done(blockchain_->GetVotingDecision(context, *request, response));
+}
+
+void SimulatedBlockchain::AsyncApi::GetVotingDecisions(
+    grpc::ClientContext* context, const GetVotingDecisionsRequest* request,
+    GetVotingDecisionsResponse* response, Callback done) {
+  done(blockchain_->GetVotingDecisions(context, *request, response));
+}
+
+void SimulatedBlockchain::AsyncApi::GetHeartBeat(
+    grpc::ClientContext* context, const GetHeartBeatRequest* request,
+    GetHeartBeatResponse* response, Callback done) {
+  done(blockchain_->GetHeartBeat(context, *request, response));
+}
+
+void SimulatedBlockchain::Submit(grpc::ClientContext* context, Apply apply,
+                                 Callback done) {
+  PendingTransaction transaction;
+  transaction.apply = std::move(apply);
+  transaction.done = std::move(done);
+  transaction.deadline = absl::FromChrono(context->deadline());
+  absl::MutexLock lock(&mutex_);
+  mempool_.push_back(std::move(transaction));
+}
+
+grpc::Status SimulatedBlockchain::SubmitAndWait(grpc::ClientContext* context,
+                                                Apply apply) {
+  struct Result {
+    absl::Mutex mutex;
+    bool done ABSL_GUARDED_BY(mutex) = false;
+    grpc::Status status ABSL_GUARDED_BY(mutex);
+  };
+  // Shared with the callback, which may still be returning after the wait.
+  auto result = std::make_shared<Result>();
+  Submit(context, std::move(apply), [result](grpc::Status status) {
+    absl::MutexLock lock(&result->mutex);
+    result->status = std::move(status);
+    result->done = true;
+  });
+  absl::MutexLock lock(&result->mutex);
+  result->mutex.Await(absl::Condition(&result->done));
+  return result->status;
+}
+
+void SimulatedBlockchain::MineUntilStopped() {
+  absl::Time next_block_time = absl::Now() + options_.block_interval;
+  bool stopped = false;
+  while (!stopped) {
+    std::vector<std::pair<Callback, grpc::Status>> callbacks;
+    {
+      absl::MutexLock lock(&mutex_);
+      absl::Time wake_time = next_block_time;
+      if (!confirming_.empty()) {
+        wake_time = std::min(wake_time, confirming_.front().confirm_time);
+      }
+      mutex_.AwaitWithDeadline(absl::Condition(&stopped_), wake_time);
+      stopped = stopped_;
+      const absl::Time now = absl::Now();
+      if (!stopped && now >= next_block_time) {
+        MineBlock(now);
+        // Mining fell behind, e.g. because the machine is overloaded, so
+        // blocks are as far apart as they'd be on a chain that keeps up.
+        next_block_time =
+            std::max(next_block_time, now) + options_.block_interval;
+      }
+      while (!stopped && !confirming_.empty() &&
+             confirming_.front().confirm_time <= now) {
+        PendingTransaction& transaction = confirming_.front();
+        if (transaction.done) {
+          callbacks.emplace_back(std::move(transaction.done),
+                                 transaction.status);
+        }
+        confirming_.pop_front();
+      }
+      for (std::deque<PendingTransaction>* transactions :
+           {&mempool_, &confirming_}) {
+        for (PendingTransaction& transaction : *transactions) {
+          if (!transaction.done || (!stopped && transaction.deadline > now)) {
+            continue;
+          }
+          callbacks.emplace_back(
+              std::move(transaction.done),
+              stopped ? grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                                     "The simulated blockchain was destroyed")
+                      : grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                                     "Deadline exceeded"));
+          transaction.done = nullptr;
+        }
+      }
+    }
+    for (auto& [done, status] : callbacks) {
+      done(status);
+    }
+  }
+}
+
+void SimulatedBlockchain::MineBlock(absl::Time block_time) {
+  ++block_number_;
+  block_time_ = block_time;
+  size_t num_transactions = mempool_.size();
+  if (options_.max_transactions_per_block > 0) {
+    num_transactions = std::min<size_t>(num_transactions,
+                                        options_.max_transactions_per_block);
+  }
+  for (size_t i = 0; i < num_transactions; ++i) {
+    PendingTransaction transaction = std::move(mempool_.front());
+    mempool_.pop_front();
+    if (!transaction.apply(block_time)) {
+      transaction.status =
+          grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                       "The contract reverted the transaction");
+    }
+    transaction.confirm_time = block_time + options_.confirmation_latency;
+    confirming_.push_back(std::move(transaction));
+  }
+}
+
+SimulatedBlockchain::Apply SimulatedBlockchain::StartVotingTransaction(
+    const StartVotingRequest& request) {
+  return [this, request](absl::Time block_time) {
+    mutex_.AssertHeld();
+    if (!CanStartVoting(request, block_time)) {
+      return false;
+    }
+    StartVotingLocked(request);
+    return true;
+  };
+}
+
+SimulatedBlockchain::Apply SimulatedBlockchain::StartVotingBatchTransaction(
+    const StartVotingBatchRequest& request,
+    std::shared_ptr<std::vector<uint32_t>> skipped_indices) {
+  return [this, request, skipped_indices](absl::Time block_time) {
+    mutex_.AssertHeld();
+    skipped_indices->clear();
+    for (int i = 0; i < request.transactions_size(); ++i) {
+      if (CanStartVoting(request.transactions(i), block_time)) {
+        StartVotingLocked(request.transactions(i));
+      } else {
+        skipped_indices->push_back(i);
+      }
+    }
+    return true;
+  };
+}
+
+SimulatedBlockchain::Apply SimulatedBlockchain::VoteTransaction(
+    const VoteRequest& request) {
+  return [this, request](absl::Time block_time) {
+    mutex_.AssertHeld();
+    if (!CanVote(request, block_time)) {
+      return false;
+    }
+    VoteLocked(request);
+    return true;
+  };
+}
+
+SimulatedBlockchain::Apply SimulatedBlockchain::VoteBatchTransaction(
+    const VoteBatchRequest& request) {
+  return [this, request](absl::Time block_time) {
+    mutex_.AssertHeld();
+    for (const VoteRequest& vote : request.votes()) {
+      if (CanVote(vote, block_time)) {
+        VoteLocked(vote);
+      }
+    }
+    return true;
+  };
+}
+
+SimulatedBlockchain::Apply SimulatedBlockchain::CommitWithVotesTransaction(
+    const CommitWithVotesRequest& request) {
+  return [this, request](absl::Time block_time) {
+    mutex_.AssertHeld();
+    const auto it = votings_.find(request.transaction_id());
+    if (it == votings_.end()) {
+      return false;
+    }
+    Voting& voting = it->second;
+    if (voting.signers.empty() ||
+        !std::equal(voting.signers.begin(), voting.signers.end(),
+                    request.signers().begin(), request.signers().end()) ||
+        request.signatures_size() != request.signers_size() ||
+        absl::ToUnixSeconds(block_time) >= voting.timeout_seconds ||
+        voting.abort_votes > 0) {
+      return false;
+    }
+    for (int i = 0; i < request.signatures_size(); ++i) {
+      if (request.signatures(i) !=
+          Sign(request.signers(i), request.transaction_id(), i)) {
+        return false;
+      }
+    }
+    voting.committed_with_votes = true;
+    return true;
+  };
+}
+
+bool SimulatedBlockchain::CanStartVoting(const StartVotingRequest& request,
+                                         absl::Time now) {
+  // The contract counts the cohorts from the signers if there are any.
+  if (!request.signers().empty() &&
+      static_cast<uint32_t>(request.signers_size()) != request.cohorts()) {
+    return false;
+  }
+  return request.cohorts() > 0 &&
+         absl::ToUnixSeconds(now) < request.timeout_time().seconds();
+}
+
+void SimulatedBlockchain::StartVotingLocked(const StartVotingRequest& request) {
+  Voting& voting = votings_[request.transaction_id()];
+  voting = Voting();
+  voting.cohorts = request.cohorts();
+  voting.timeout_seconds = request.timeout_time().seconds();
+  voting.signers.assign(request.signers().begin(), request.signers().end());
+}
+
+bool SimulatedBlockchain::CanVote(const VoteRequest& request,
+                                  absl::Time now) const {
+  const auto it = votings_.find(request.transaction_id());
+  return it != votings_.end() &&
+         absl::ToUnixSeconds(now) < it->second.timeout_seconds &&
+         request.cohort_id() >= 0 &&
+         static_cast<uint32_t>(request.cohort_id()) < it->second.cohorts &&
+         (request.ballot() == Ballot::BALLOT_COMMIT ||
+          request.ballot() == Ballot::BALLOT_ABORT) &&
+         // Signed commit votes decide for good.
+         !it->second.committed_with_votes;
+}
+
+void SimulatedBlockchain::VoteLocked(const VoteRequest& request) {
+  Voting& voting = votings_[request.transaction_id()];
+  Ballot& ballot = voting.ballots[request.cohort_id()];
+  // Like the contract, a cohort may change its vote. New ballots start
+  // unspecified.
+  if (ballot == Ballot::BALLOT_COMMIT) {
+    --voting.commit_votes;
+  } else if (ballot == Ballot::BALLOT_ABORT) {
+    --voting.abort_votes;
+  }
+  ballot = request.ballot();
+  if (ballot == Ballot::BALLOT_COMMIT) {
+    ++voting.commit_votes;
+  } else {
+    ++voting.abort_votes;
+  }
+}
+
+void SimulatedBlockchain::SetDecision(
+    const Voting& voting, GetVotingDecisionResponse& response) const {
+  response.set_block_number(block_number_);
+  if (voting.committed_with_votes) {
+    response.set_decision(VotingDecision::VOTING_DECISION_COMMIT);
+    response.set_reason("Signed votes collected before timeout.");
+  } else if (voting.abort_votes > 0) {
+    response.set_decision(VotingDecision::VOTING_DECISION_ABORT);
+    response.set_reason("Cohort voted to abort.");
+  } else if (voting.commit_votes == voting.cohorts) {
+    response.set_decision(VotingDecision::VOTING_DECISION_COMMIT);
+    response.set_reason("Sufficient vote collected before timeout.");
+  } else if (absl::ToUnixSeconds(block_time_) >= voting.timeout_seconds) {
+    response.set_decision(VotingDecision::VOTING_DECISION_ABORT);
+    response.set_reason("Insufficient vote after timeout.");
+  } else {
+    response.set_decision(VotingDecision::VOTING_DECISION_PENDING);
+    response.set_reason("Insufficient vote before timeout.");
+  }
+}
+
+std::string SimulatedBlockchain::Sign(const std::string& signer,
+                                      const std::string& transaction_id,
+                                      int cohort_id) {
+  return absl::StrCat(signer, "/", transaction_id, "/", cohort_id);
+}
+
+grpc::ClientReaderInterface<VotingDecidedEvent>*
+SimulatedBlockchain::WatchDecisionsRaw(grpc::ClientContext*,
+                                       const WatchDecisionsRequest&) {
+  return new UnimplementedDecisionReader(
+      "The simulated blockchain doesn't stream decisions");
+}
+
+}  // namespace blockchain
@@ -0,0 +1,227 @@
+#ifndef SRC_BLOCKCHAIN_SIMULATED_BLOCKCHAIN_H_
+
+#define SRC_BLOCKCHAIN_SIMULATED_BLOCKCHAIN_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "grpcpp/client_context.h"
+#include "src/blockchain/local_adapter_stub.h"
+#include "src/blockchain/proto/two_phase_commit_adapter.grpc.pb.h"
+
+namespace blockchain {
+
+struct SimulatedBlockchainOptions {
+  // Time between blocks. Blockchain transactions (starting voting and
+  // voting) take effect when the next block is mined. Must be positive.
+  absl::Duration block_interval = absl::Milliseconds(100);
+  // Time between a block being mined and its senders learning about it, e.g.
+  // to wait for more confirmations.
+  absl::Duration confirmation_latency = absl::ZeroDuration();
+  // Maximum number of blockchain transactions in each block, like a block gas
+  // limit. Others wait for later blocks. 0 means no limit.
+  int max_transactions_per_block = 0;
+  // Address SignCommitVote signs with. Signatures are simulated as the signer
+  // and the vote, which CommitWithVotes checks against the signers voting
+  // started with.
+  std::string signer = "simulated-signer";
+};
+
+// In-memory blockchain running the TwoPhaseCommit contract's logic, so
+// benchmarks and tests don't need Ganache and the adapter server. Plugs into
+// TwoPhaseCommit through its stub constructor, e.g.
+//   TwoPhaseCommit(std::make_unique<SimulatedBlockchain>(options))
+// Supports the blocking and callback APIs of every call except
+// WatchDecisions, whose stream couldn't tell when the caller cancels it, so it
+// always fails with Unimplemented error and decisions must be polled.
+//
+// As with the adapter server, calls the contract rejects fail with
+// FailedPrecondition error. Calls whose deadline passes before their block is
+// confirmed fail with DeadlineExceeded error but still take effect once mined,
+// as on a real chain.
+class SimulatedBlockchain : public LocalAdapterStub {
+ public:
+  explicit SimulatedBlockchain(
+      const SimulatedBlockchainOptions& options = SimulatedBlockchainOptions());
+
+  // Fails the calls still waiting for their block with Unavailable error.
+  ~SimulatedBlockchain() override;
+
+  SimulatedBlockchain(const SimulatedBlockchain&) = delete;
+  SimulatedBlockchain& operator=(const SimulatedBlockchain&) = delete;
+
+  grpc::Status StartVoting(grpc::ClientContext* context,
+                           const StartVotingRequest& request,
+                           StartVotingResponse* response) override;
+  grpc::Status StartVotingBatch(grpc::ClientContext* context,
+                                const StartVotingBatchRequest& request,
+                                StartVotingBatchResponse* response) override;
+  grpc::Status Vote(grpc::ClientContext* context, const VoteRequest& request,
+                    VoteResponse* response) override;
+  grpc::Status VoteBatch(grpc::ClientContext* context,
+                         const VoteBatchRequest& request,
+                         VoteBatchResponse* response) override;
+  grpc::Status SignCommitVote(grpc::ClientContext* context,
+                              const SignCommitVoteRequest& request,
+                              SignCommitVoteResponse* response) override;
+  grpc::Status CommitWithVotes(grpc::ClientContext* context,
+                               const CommitWithVotesRequest& request,
+                               CommitWithVotesResponse* response) override;
+  grpc::Status GetVotingDecision(grpc::ClientContext* context,
+                                 const GetVotingDecisionRequest& request,
+                                 GetVotingDecisionResponse* response) override;
+  grpc::Status GetVotingDecisions(
+      grpc::ClientContext* context, const GetVotingDecisionsRequest& request,
+      GetVotingDecisionsResponse* response) override;
+  grpc::Status GetHeartBeat(grpc::ClientContext* context,
+                            const GetHeartBeatRequest& request,
+                            GetHeartBeatResponse* response) override;
+
+  async_interface* async() override { return &async_; }
+
+  // Number of blocks mined so far.
+  int64_t block_number();
+
+ private:
+  using Callback = std::function<void(grpc::Status)>;
+  // Applies a blockchain transaction to the contract at the block's time.
+  // Returns false if the contract reverts it.
+  using Apply = std::function<bool(absl::Time block_time)>;
+
+  class AsyncApi : public async_interface {
+   public:
+    explicit AsyncApi(SimulatedBlockchain* blockchain)
+        : blockchain_(blockchain) {}
+
+    void StartVoting(grpc::ClientContext* context,
+                     const StartVotingRequest* request,
+                     StartVotingResponse* response, Callback done) override;
+    void StartVotingBatch(grpc::ClientContext* context,
+                          const StartVotingBatchRequest* request,
+                          StartVotingBatchResponse* response,
+                          Callback done) override;
+    void Vote(grpc::ClientContext* context, const VoteRequest* request,
+              VoteResponse* response, Callback done) override;
+    void VoteBatch(grpc::ClientContext* context,
+                   const VoteBatchRequest* request, VoteBatchResponse* response,
+                   Callback done) override;
+    void SignCommitVote(grpc::ClientContext* context,
+                        const SignCommitVoteRequest* request,
+                        SignCommitVoteResponse* response,
+                        Callback done) override;
+    void CommitWithVotes(grpc::ClientContext* context,
+                         const CommitWithVotesRequest* request,
+                         CommitWithVotesResponse* response,
+                         Callback done) override;
+    void GetVotingDecision(grpc::ClientContext* context,
+                           const GetVotingDecisionRequest* request,
+                           GetVotingDecisionResponse* response,
+                           Callback done) override;
+    void GetVotingDecisions(grpc::ClientContext* context,
+                            const GetVotingDecisionsRequest* request,
+                            GetVotingDecisionsResponse* response,
+                            Callback done) override;
+    void GetHeartBeat(grpc::ClientContext* context,
+                      const GetHeartBeatRequest* request,
+                      GetHeartBeatResponse* response, Callback done) override;
+
+   private:
+    SimulatedBlockchain* const blockchain_;
+  };
+
+  // Voting state of a transaction in the contract.
+  struct Voting {
+    uint32_t cohorts = 0;
+    int64_t timeout_seconds = 0;
+    // Ballot of each cohort that voted. Like the contract, only cohorts that
+    // voted take space, so transactions can span any number of cohorts.
+    absl::flat_hash_map<uint32_t, Ballot> ballots;
+    uint32_t commit_votes = 0;
+    uint32_t abort_votes = 0;
+    // Empty unless voting started with signers.
+    std::vector<std::string> signers;
+    bool committed_with_votes = false;
+  };
+
+  struct PendingTransaction {
+    Apply apply;
+    // Reset once called, e.g. when the deadline passes before the block is
+    // confirmed.
+    Callback done;
+    absl::Time deadline;
+    // Time the sender learns the result. Set once mined.
+    absl::Time confirm_time;
+    grpc::Status status;
+  };
+
+  // Adds a blockchain transaction to the next blocks and calls |done| once
+  // its block is confirmed or the deadline of |context| passes.
+  void Submit(grpc::ClientContext* context, Apply apply, Callback done);
+
+  // Submits and waits for |done| to be called.
+  grpc::Status SubmitAndWait(grpc::ClientContext* context, Apply apply);
+
+  // Mines blocks and confirms them until destroyed.
+  void MineUntilStopped();
+
+  // Applies the next transactions in the mempool.
+  void MineBlock(absl::Time block_time) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // The contract's functions, as blockchain transactions.
+  Apply StartVotingTransaction(const StartVotingRequest& request);
+  // Sets |skipped_indices| to the indices of the transactions it skips once
+  // mined.
+  Apply StartVotingBatchTransaction(
+      const StartVotingBatchRequest& request,
+      std::shared_ptr<std::vector<uint32_t>> skipped_indices);
+  Apply VoteTransaction(const VoteRequest& request);
+  Apply VoteBatchTransaction(const VoteBatchRequest& request);
+  Apply CommitWithVotesTransaction(const CommitWithVotesRequest& request);
+
+  // The contract's logic, run with |mutex_| held by the miner.
+  static bool CanStartVoting(const StartVotingRequest& request,
+                             absl::Time now);
+  void StartVotingLocked(const StartVotingRequest& request)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool CanVote(const VoteRequest& request, absl::Time now) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void VoteLocked(const VoteRequest& request)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void SetDecision(const Voting& voting, GetVotingDecisionResponse& response)
+      const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static std::string Sign(const std::string& signer,
+                          const std::string& transaction_id, int cohort_id);
+
+  // Ends right away, since the stream couldn't tell when the caller cancels
+  // it.
+  grpc::ClientReaderInterface<VotingDecidedEvent>* WatchDecisionsRaw(
+      grpc::ClientContext*, const WatchDecisionsRequest&) override;
+
+  const SimulatedBlockchainOptions options_;
+  AsyncApi async_{this};
+  absl::Mutex mutex_;
+  bool stopped_ ABSL_GUARDED_BY(mutex_) = false;
+  int64_t block_number_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Timestamp of the latest block, which the contract's view calls use as
+  // the current time.
+  absl::Time block_time_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<std::string, Voting> votings_ ABSL_GUARDED_BY(mutex_);
+  // Blockchain transactions waiting for a block, in the order sent.
+  std::deque<PendingTransaction> mempool_ ABSL_GUARDED_BY(mutex_);
+  // Mined blockchain transactions waiting for their confirmation time, in
+  // the order mined.
+  std::deque<PendingTransaction> confirming_ ABSL_GUARDED_BY(mutex_);
+  std::thread miner_;
+};
+
+}  // namespace blockchain
+
+#endif  // SRC_BLOCKCHAIN_SIMULATED_BLOCKCHAIN_H_
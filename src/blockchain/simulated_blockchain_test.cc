@@ -0,0 +1,264 @@
+#include "src/blockchain/simulated_blockchain.h"
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/blockchain/two_phase_commit.h"
+
+namespace blockchain {
+
+namespace {
+
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+
+SimulatedBlockchainOptions FastBlocks() {
+  SimulatedBlockchainOptions options;
+  options.block_interval = absl::Milliseconds(10);
+  return options;
+}
+
+std::time_t InOneMinute() {
+  return absl::ToTimeT(absl::Now() + absl::Minutes(1));
+}
+
+// Waits for the callbacks of async calls.
+class StatusCollector {
+ public:
+  TwoPhaseCommit::StatusCallback Callback() {
+    return [this](absl::Status status) {
+      absl::MutexLock lock(&mutex_);
+      statuses_.push_back(status);
+    };
+  }
+
+  std::vector<absl::Status> Wait(size_t count) {
+    absl::MutexLock lock(&mutex_);
+    const auto all_done = [this, count]() {
+      mutex_.AssertHeld();
+      return statuses_.size() == count;
+    };
+    EXPECT_TRUE(
+        mutex_.AwaitWithTimeout(absl::Condition(&all_done), absl::Seconds(10)));
+    return statuses_;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<absl::Status> statuses_ ABSL_GUARDED_BY(mutex_);
+};
+
+TEST(SimulatedBlockchainTest, CommitsOnceEveryCohortVotesToCommit) {
+  auto simulated_blockchain =
+      std::make_unique<SimulatedBlockchain>(FastBlocks());
+  SimulatedBlockchain* simulated = simulated_blockchain.get();
+  TwoPhaseCommit blockchain(std::move(simulated_blockchain));
+
+  ASSERT_TRUE(blockchain.StartVoting("t1", InOneMinute(), 2).ok());
+  EXPECT_GE(simulated->block_number(), 1);
+  ASSERT_TRUE(blockchain.Vote("t1", 0, Ballot::BALLOT_COMMIT).ok());
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+  ASSERT_TRUE(blockchain.Vote("t1", 1, Ballot::BALLOT_COMMIT).ok());
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+}
+
+TEST(SimulatedBlockchainTest, AbortsIfAnyCohortVotesToAbort) {
+  TwoPhaseCommit blockchain(
+      std::make_unique<SimulatedBlockchain>(FastBlocks()));
+  ASSERT_TRUE(blockchain.StartVoting("t1", InOneMinute(), 3).ok());
+  std::vector<VoteRequest> votes(3);
+  for (int i = 0; i < 3; ++i) {
+    votes[i].set_transaction_id("t1");
+    votes[i].set_cohort_id(i);
+    votes[i].set_ballot(i == 1 ? Ballot::BALLOT_ABORT : Ballot::BALLOT_COMMIT);
+  }
+
+  ASSERT_TRUE(blockchain.VoteBatch(votes).ok());
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_ABORT);
+  const auto decisions = blockchain.GetVotingDecisions({"t1", "t2"});
+  ASSERT_TRUE(decisions.ok());
+  EXPECT_THAT(*decisions,
+              UnorderedElementsAre(
+                  Pair("t1", VotingDecision::VOTING_DECISION_ABORT),
+                  Pair("t2", VotingDecision::VOTING_DECISION_UNKNOWN)));
+}
+
+TEST(SimulatedBlockchainTest, RejectsWhatTheContractRejects) {
+  TwoPhaseCommit blockchain(
+      std::make_unique<SimulatedBlockchain>(FastBlocks()));
+  EXPECT_EQ(blockchain.StartVoting("t1", InOneMinute(), 0).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(
+      blockchain.StartVoting("t1", absl::ToTimeT(absl::Now()), 2).code(),
+      absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(blockchain.GetVotingDecision("t1").status().code(),
+            absl::StatusCode::kFailedPrecondition);
+
+  ASSERT_TRUE(blockchain.StartVoting("t1", InOneMinute(), 2).ok());
+  EXPECT_EQ(blockchain.Vote("t1", 2, Ballot::BALLOT_COMMIT).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(blockchain.Vote("t1", 0, Ballot::BALLOT_UNSPECIFIED).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(blockchain.Vote("t2", 0, Ballot::BALLOT_COMMIT).code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(SimulatedBlockchainTest, StartVotingBatchReturnsTheSkippedVotings) {
+  TwoPhaseCommit blockchain(
+      std::make_unique<SimulatedBlockchain>(FastBlocks()));
+  std::vector<StartVotingRequest> votings(3);
+  for (int i = 0; i < 3; ++i) {
+    votings[i].set_transaction_id(absl::StrCat("t", i));
+    votings[i].mutable_timeout_time()->set_seconds(InOneMinute());
+    votings[i].set_cohorts(i == 1 ? 0 : 2);
+  }
+  votings[2].mutable_timeout_time()->set_seconds(absl::ToTimeT(absl::Now()));
+
+  const absl::StatusOr<std::vector<int>> skipped_indices =
+      blockchain.StartVotingBatch(votings);
+  ASSERT_TRUE(skipped_indices.ok());
+  EXPECT_THAT(*skipped_indices, ::testing::ElementsAre(1, 2));
+  EXPECT_EQ(*blockchain.GetVotingDecision("t0"),
+            VotingDecision::VOTING_DECISION_PENDING);
+}
+
+TEST(SimulatedBlockchainTest, CommitsTransactionsSpanningManyCohorts) {
+  TwoPhaseCommit blockchain(
+      std::make_unique<SimulatedBlockchain>(FastBlocks()));
+  constexpr int kCohorts = 500;
+  ASSERT_TRUE(blockchain.StartVoting("t1", InOneMinute(), kCohorts).ok());
+  std::vector<VoteRequest> votes(kCohorts);
+  for (int i = 0; i < kCohorts; ++i) {
+    votes[i].set_transaction_id("t1");
+    votes[i].set_cohort_id(i);
+    votes[i].set_ballot(Ballot::BALLOT_COMMIT);
+  }
+
+  ASSERT_TRUE(blockchain.VoteBatch(
+                  std::vector<VoteRequest>(votes.begin(), votes.end() - 1))
+                  .ok());
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+  ASSERT_TRUE(blockchain.VoteBatch({votes.back()}).ok());
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+}
+
+TEST(SimulatedBlockchainTest, CommitsWithSignedVotes) {
+  SimulatedBlockchainOptions options = FastBlocks();
+  options.signer = "0xcohort";
+  TwoPhaseCommit blockchain(std::make_unique<SimulatedBlockchain>(options));
+  const std::vector<std::string> signers = {"0xcohort", "0xcohort"};
+  ASSERT_TRUE(
+      blockchain.StartVotingWithSigners("t1", InOneMinute(), signers).ok());
+  std::vector<std::string> signatures;
+  for (int i = 0; i < 2; ++i) {
+    const absl::StatusOr<std::string> signature =
+        blockchain.SignCommitVote("t1", i);
+    ASSERT_TRUE(signature.ok());
+    signatures.push_back(*signature);
+  }
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+
+  // Votes must be signed by their own cohort's signer.
+  EXPECT_EQ(blockchain
+                .CommitWithVotes("t1", signers, {signatures[0], signatures[0]})
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+  ASSERT_TRUE(blockchain.CommitWithVotes("t1", signers, signatures).ok());
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+  // The decision is final.
+  EXPECT_EQ(blockchain.Vote("t1", 0, Ballot::BALLOT_ABORT).code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(SimulatedBlockchainTest, DoesNotCommitWithSignedVotesOnceACohortAborts) {
+  TwoPhaseCommit blockchain(
+      std::make_unique<SimulatedBlockchain>(FastBlocks()));
+  const std::vector<std::string> signers = {"simulated-signer"};
+  ASSERT_TRUE(
+      blockchain.StartVotingWithSigners("t1", InOneMinute(), signers).ok());
+  const absl::StatusOr<std::string> signature =
+      blockchain.SignCommitVote("t1", 0);
+  ASSERT_TRUE(signature.ok());
+
+  ASSERT_TRUE(blockchain.Vote("t1", 0, Ballot::BALLOT_ABORT).ok());
+  EXPECT_EQ(blockchain.CommitWithVotes("t1", signers, {*signature}).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_ABORT);
+}
+
+TEST(SimulatedBlockchainTest, AbortsAtTheTimeout) {
+  TwoPhaseCommit blockchain(
+      std::make_unique<SimulatedBlockchain>(FastBlocks()));
+  const std::time_t timeout_time = absl::ToTimeT(absl::Now()) + 1;
+  ASSERT_TRUE(blockchain.StartVoting("t1", timeout_time, 1).ok());
+
+  absl::SleepFor(absl::FromTimeT(timeout_time) - absl::Now() +
+                 absl::Milliseconds(50));
+  EXPECT_EQ(blockchain.Vote("t1", 0, Ballot::BALLOT_COMMIT).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_ABORT);
+}
+
+TEST(SimulatedBlockchainTest, BlocksHoldAtMostTheMaxTransactions) {
+  SimulatedBlockchainOptions options;
+  options.block_interval = absl::Milliseconds(50);
+  options.max_transactions_per_block = 2;
+  auto simulated_blockchain = std::make_unique<SimulatedBlockchain>(options);
+  SimulatedBlockchain* simulated = simulated_blockchain.get();
+  TwoPhaseCommit blockchain(std::move(simulated_blockchain));
+  ASSERT_TRUE(blockchain.StartVoting("t1", InOneMinute(), 6).ok());
+  const int64_t start_block = simulated->block_number();
+
+  StatusCollector collector;
+  for (int i = 0; i < 6; ++i) {
+    blockchain.VoteAsync("t1", i, Ballot::BALLOT_COMMIT,
+                         absl::InfiniteFuture(), collector.Callback());
+  }
+  for (const absl::Status& status : collector.Wait(6)) {
+    EXPECT_TRUE(status.ok());
+  }
+  EXPECT_GE(simulated->block_number() - start_block, 3);
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+}
+
+TEST(SimulatedBlockchainTest, CallsTimeOutBeforeConfirmationButStillApply) {
+  SimulatedBlockchainOptions options = FastBlocks();
+  options.confirmation_latency = absl::Milliseconds(500);
+  TwoPhaseCommit blockchain(std::make_unique<SimulatedBlockchain>(options));
+  ASSERT_TRUE(blockchain.StartVoting("t1", InOneMinute(), 1).ok());
+
+  StatusCollector collector;
+  blockchain.VoteAsync("t1", 0, Ballot::BALLOT_COMMIT,
+                       absl::Now() + absl::Milliseconds(100),
+                       collector.Callback());
+  const std::vector<absl::Status> statuses = collector.Wait(1);
+  ASSERT_EQ(statuses.size(), 1);
+  EXPECT_EQ(statuses[0].code(), absl::StatusCode::kDeadlineExceeded);
+  // The vote was mined, even though the sender gave up on it.
+  EXPECT_EQ(*blockchain.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+}
+
+}  // namespace
+
+}  // namespace blockchain
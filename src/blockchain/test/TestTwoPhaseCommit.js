@@ -7,4 +7,98 @@ contract('TwoPhaseCommit', accounts => {
     const storedString = await twoPhaseCommit.getHeartBeat();
     assert.equal(storedString, true, 'Failed to get heartbeat.');
   });
+
+  it('should emit VotingDecided when the deciding vote lands', async () => {
+    const twoPhaseCommit = await TwoPhaseCommit.new();
+    await twoPhaseCommit.setMockNow(1641024000);  // 1/1/2022
+    await twoPhaseCommit.startVoting('t1', 2, 1672560000);
+
+    const firstVote = await twoPhaseCommit.vote('t1', 0, 1);
+    assert.equal(firstVote.logs.length, 0, 'The first vote decides nothing.');
+    const lastVote = await twoPhaseCommit.vote('t1', 1, 1);
+    assert.equal(lastVote.logs.length, 1, 'The last vote decides to commit.');
+    assert.equal(lastVote.logs[0].event, 'VotingDecided');
+    assert.equal(lastVote.logs[0].args.transaction_id, 't1');
+    assert.equal(lastVote.logs[0].args.decision.toString(), '2');
+  });
+
+  it('should emit StartVotingSkipped for skipped batch entries', async () => {
+    const twoPhaseCommit = await TwoPhaseCommit.new();
+    await twoPhaseCommit.setMockNow(1641024000);  // 1/1/2022
+    // The second transaction already timed out, and the third has no cohorts.
+    const result = await twoPhaseCommit.startVotingBatch(
+        ['t1', 't2', 't3'], [1, 1, 0], [1672560000, 1641024000, 1672560000]);
+    assert.deepEqual(
+        result.logs.map(log => log.event),
+        ['StartVotingSkipped', 'StartVotingSkipped']);
+    assert.deepEqual(
+        result.logs.map(log => log.args.index.toString()), ['1', '2']);
+  });
+
+  it('should commit with every cohort\'s signed vote', async () => {
+    const twoPhaseCommit = await TwoPhaseCommit.new();
+    await twoPhaseCommit.setMockNow(1641024000);  // 1/1/2022
+    const signers = [accounts[1], accounts[2]];
+    await twoPhaseCommit.startVotingWithSigners('t1', signers, 1672560000);
+
+    const signatures = [];
+    for (let i = 0; i < signers.length; i++) {
+      const hash = await twoPhaseCommit.getCommitVoteHash('t1', i);
+      signatures.push(await web3.eth.sign(hash, signers[i]));
+    }
+    const commit =
+        await twoPhaseCommit.commitWithVotes('t1', signers, signatures);
+    assert.equal(commit.logs.length, 1, 'The signed votes decide to commit.');
+    assert.equal(commit.logs[0].args.decision.toString(), '2');
+    assert.equal(
+        await twoPhaseCommit.getVotingDecision('t1'),
+        '2:Signed votes collected before timeout.');
+  });
+
+  it('should reject a vote signed by the wrong cohort', async () => {
+    const twoPhaseCommit = await TwoPhaseCommit.new();
+    await twoPhaseCommit.setMockNow(1641024000);  // 1/1/2022
+    const signers = [accounts[1], accounts[2]];
+    await twoPhaseCommit.startVotingWithSigners('t1', signers, 1672560000);
+
+    const signatures = [];
+    for (let i = 0; i < signers.length; i++) {
+      const hash = await twoPhaseCommit.getCommitVoteHash('t1', i);
+      signatures.push(await web3.eth.sign(hash, accounts[1]));
+    }
+    let reverted = false;
+    try {
+      await twoPhaseCommit.commitWithVotes('t1', signers, signatures);
+    } catch (e) {
+      reverted = true;
+    }
+    assert.isTrue(reverted, 'Cohort 1\'s vote is signed by cohort 0.');
+    assert.equal(
+        await twoPhaseCommit.getVotingDecision('t1'),
+        '1:Insufficient vote before timeout.');
+  });
+
+  it('should not commit with signed votes after a cohort aborts', async () => {
+    const twoPhaseCommit = await TwoPhaseCommit.new();
+    await twoPhaseCommit.setMockNow(1641024000);  // 1/1/2022
+    const signers = [accounts[1], accounts[2]];
+    await twoPhaseCommit.startVotingWithSigners('t1', signers, 1672560000);
+    const signatures = [];
+    for (let i = 0; i < signers.length; i++) {
+      const hash = await twoPhaseCommit.getCommitVoteHash('t1', i);
+      signatures.push(await web3.eth.sign(hash, signers[i]));
+    }
+
+    await twoPhaseCommit.vote('t1', 1, 2);
+    let reverted = false;
+    try {
+      await twoPhaseCommit.commitWithVotes('t1', signers, signatures);
+    } catch (e) {
+      reverted = true;
+    }
+    assert.isTrue(reverted, 'Cohort 1 voted to abort.');
+    assert.equal(
+        await twoPhaseCommit.getVotingDecision('t1'),
+        '3:Cohort voted to abort.');
+  });
 });
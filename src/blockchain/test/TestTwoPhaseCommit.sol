@@ -116,6 +116,147 @@ contract TestTwoPhaseCommit {
         );
     }
 
+    function testTransactionSpanningManyWords() public {
+        // Ballots of cohorts 0, 127, 128 and 499 live in different words.
+        TwoPhaseCommit two_phase_commit = new TwoPhaseCommit();
+        two_phase_commit.setMockNow(current_time);
+        two_phase_commit.startVoting("t1", 500, future_time);
+        two_phase_commit.vote("t1", 0, TwoPhaseCommit.Ballot.COMMIT);
+        two_phase_commit.vote("t1", 127, TwoPhaseCommit.Ballot.COMMIT);
+        two_phase_commit.vote("t1", 499, TwoPhaseCommit.Ballot.COMMIT);
+        two_phase_commit.vote("t1", 128, TwoPhaseCommit.Ballot.ABORT);
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t1"),
+            "3:Cohort voted to abort.",
+            "Expect getting an abort decision of a 500-cohort transaction."
+        );
+
+        two_phase_commit.vote("t1", 128, TwoPhaseCommit.Ballot.COMMIT);
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t1"),
+            "1:Insufficient vote before timeout.",
+            "Expect getting a pending decision once the cohort changes its "
+            "ballot to commit."
+        );
+
+        // Restarting voting drops the ballots of the previous round.
+        two_phase_commit.startVoting("t1", 1, future_time);
+        two_phase_commit.vote("t1", 0, TwoPhaseCommit.Ballot.COMMIT);
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t1"),
+            "2:Sufficient vote collected before timeout.",
+            "Expect getting a commit decision of a restarted transaction."
+        );
+    }
+
+    function testVoteBatch() public {
+        TwoPhaseCommit two_phase_commit = new TwoPhaseCommit();
+        two_phase_commit.setMockNow(current_time);
+        two_phase_commit.startVoting("t1", 2, future_time);
+        two_phase_commit.startVoting("t2", 2, future_time);
+
+        string[] memory transaction_ids = new string[](4);
+        uint32[] memory cohort_ids = new uint32[](4);
+        TwoPhaseCommit.Ballot[] memory ballots = new TwoPhaseCommit.Ballot[](
+            4
+        );
+        transaction_ids[0] = "t1";
+        cohort_ids[0] = 0;
+        ballots[0] = TwoPhaseCommit.Ballot.COMMIT;
+        transaction_ids[1] = "t1";
+        cohort_ids[1] = 1;
+        ballots[1] = TwoPhaseCommit.Ballot.COMMIT;
+        transaction_ids[2] = "t2";
+        cohort_ids[2] = 0;
+        ballots[2] = TwoPhaseCommit.Ballot.ABORT;
+        // Invalid cohort id, which is skipped.
+        transaction_ids[3] = "t2";
+        cohort_ids[3] = 5;
+        ballots[3] = TwoPhaseCommit.Ballot.COMMIT;
+        two_phase_commit.voteBatch(transaction_ids, cohort_ids, ballots);
+
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t1"),
+            "2:Sufficient vote collected before timeout.",
+            "Expect getting a commit decision of a transaction (t1)."
+        );
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t2"),
+            "3:Cohort voted to abort.",
+            "Expect getting an abort decision of a transaction (t2)."
+        );
+    }
+
+    function testStartVotingBatch() public {
+        TwoPhaseCommit two_phase_commit = new TwoPhaseCommit();
+        two_phase_commit.setMockNow(current_time);
+
+        string[] memory transaction_ids = new string[](3);
+        uint32[] memory cohorts = new uint32[](3);
+        uint256[] memory vote_timeout_times = new uint256[](3);
+        transaction_ids[0] = "t1";
+        cohorts[0] = 1;
+        vote_timeout_times[0] = future_time;
+        transaction_ids[1] = "t2";
+        cohorts[1] = 2;
+        vote_timeout_times[1] = future_time;
+        // Already timed out, which is skipped.
+        transaction_ids[2] = "t3";
+        cohorts[2] = 2;
+        vote_timeout_times[2] = current_time;
+        two_phase_commit.startVotingBatch(
+            transaction_ids,
+            cohorts,
+            vote_timeout_times
+        );
+        two_phase_commit.vote("t1", 0, TwoPhaseCommit.Ballot.COMMIT);
+        two_phase_commit.vote("t2", 0, TwoPhaseCommit.Ballot.COMMIT);
+
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t1"),
+            "2:Sufficient vote collected before timeout.",
+            "Expect getting a commit decision of a transaction (t1)."
+        );
+        Assert.equal(
+            two_phase_commit.getVotingDecision("t2"),
+            "1:Insufficient vote before timeout.",
+            "Expect getting a pending decision of a transaction (t2)."
+        );
+    }
+
+    function testGetVotingDecisions() public {
+        TwoPhaseCommit two_phase_commit = new TwoPhaseCommit();
+        two_phase_commit.setMockNow(current_time);
+        two_phase_commit.startVoting("t1", 1, future_time);
+        two_phase_commit.startVoting("t2", 2, future_time);
+        two_phase_commit.vote("t1", 0, TwoPhaseCommit.Ballot.COMMIT);
+
+        string[] memory transaction_ids = new string[](3);
+        transaction_ids[0] = "t1";
+        transaction_ids[1] = "t2";
+        transaction_ids[2] = "unknown";
+        string[] memory decisions = two_phase_commit.getVotingDecisions(
+            transaction_ids
+        );
+
+        Assert.equal(decisions.length, 3, "Expect one decision per id.");
+        Assert.equal(
+            decisions[0],
+            "2:Sufficient vote collected before timeout.",
+            "Expect getting a commit decision of a transaction (t1)."
+        );
+        Assert.equal(
+            decisions[1],
+            "1:Insufficient vote before timeout.",
+            "Expect getting a pending decision of a transaction (t2)."
+        );
+        Assert.equal(
+            decisions[2],
+            "?:Voting has not started.",
+            "Expect getting an unknown decision of an unknown transaction."
+        );
+    }
+
     function testHeartBeat() public {
         TwoPhaseCommit two_phase_commit = new TwoPhaseCommit();
         Assert.isTrue(
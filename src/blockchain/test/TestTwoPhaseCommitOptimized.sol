@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+// Unit-test for TwoPhaseCommitOptimized smart contract.
+pragma solidity >=0.4.22 <0.9.0;
+
+import "truffle/Assert.sol";
+import "../contracts/TwoPhaseCommitOptimized.sol";
+
+contract TestTwoPhaseCommitOptimized {
+    uint64 current_time = 1641024000; /*unix_time: 1/1/2022 00:00PM */
+    uint64 future_time = 1672560000; /*unix_time: 1/1/2032 00:00PM*/
+    bytes32 t1 = "t1";
+    bytes32 t2 = "t2";
+
+    function newContract() private returns (TwoPhaseCommitOptimized) {
+        TwoPhaseCommitOptimized two_phase_commit = new
+            TwoPhaseCommitOptimized();
+        two_phase_commit.setMockNow(current_time);
+        return two_phase_commit;
+    }
+
+    function assertDecision(
+        TwoPhaseCommitOptimized two_phase_commit,
+        bytes32 transaction_id,
+        TwoPhaseCommitOptimized.VotingDecisionOption expected,
+        string memory message
+    ) private {
+        Assert.equal(
+            uint256(two_phase_commit.getVotingDecision(transaction_id)),
+            uint256(expected),
+            message
+        );
+    }
+
+    function testCommitTransaction() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        two_phase_commit.startVoting(t1, 3, future_time);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        two_phase_commit.vote(t1, 1, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.PENDING,
+            "Expect a pending decision before all cohorts have voted."
+        );
+
+        two_phase_commit.vote(t1, 2, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.COMMIT,
+            "Expect a commit decision after all cohorts have voted commit."
+        );
+    }
+
+    function testRepeatedVotesCountOnce() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        two_phase_commit.startVoting(t1, 2, future_time);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.PENDING,
+            "Expect a cohort's repeated commit votes to count once."
+        );
+    }
+
+    function testAbortTransactionWithVote() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        two_phase_commit.startVoting(t1, 3, future_time);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        two_phase_commit.vote(t1, 1, TwoPhaseCommitOptimized.Ballot.ABORT);
+        two_phase_commit.vote(t1, 1, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        two_phase_commit.vote(t1, 2, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.ABORT,
+            "Expect an abort decision to be final."
+        );
+    }
+
+    function testDecisionsAreFinal() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        two_phase_commit.startVoting(t1, 1, future_time);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.COMMIT);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.ABORT);
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.COMMIT,
+            "Expect a commit decision to be final."
+        );
+    }
+
+    function testAbortTransactionWithTimeout() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        two_phase_commit.startVoting(t1, 2, future_time);
+        two_phase_commit.vote(t1, 0, TwoPhaseCommitOptimized.Ballot.COMMIT);
+
+        two_phase_commit.setMockNow(future_time);
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.ABORT,
+            "Expect an abort decision after the timeout."
+        );
+    }
+
+    function testUnknownTransaction() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        assertDecision(
+            two_phase_commit,
+            t1,
+            TwoPhaseCommitOptimized.VotingDecisionOption.UNKNOWN,
+            "Expect an unknown decision before voting starts."
+        );
+    }
+
+    function testBatches() public {
+        TwoPhaseCommitOptimized two_phase_commit = newContract();
+        bytes32[] memory transaction_ids = new bytes32[](3);
+        uint8[] memory cohorts = new uint8[](3);
+        uint64[] memory vote_timeout_times = new uint64[](3);
+        transaction_ids[0] = t1;
+        cohorts[0] = 1;
+        vote_timeout_times[0] = future_time;
+        transaction_ids[1] = t2;
+        cohorts[1] = 2;
+        vote_timeout_times[1] = future_time;
+        // Too many cohorts, which is skipped.
+        transaction_ids[2] = "t3";
+        cohorts[2] = 121;
+        vote_timeout_times[2] = future_time;
+        two_phase_commit.startVotingBatch(
+            transaction_ids,
+            cohorts,
+            vote_timeout_times
+        );
+
+        bytes32[] memory vote_ids = new bytes32[](3);
+        uint8[] memory cohort_ids = new uint8[](3);
+        TwoPhaseCommitOptimized.Ballot[]
+            memory ballots = new TwoPhaseCommitOptimized.Ballot[](3);
+        vote_ids[0] = t1;
+        cohort_ids[0] = 0;
+        ballots[0] = TwoPhaseCommitOptimized.Ballot.COMMIT;
+        vote_ids[1] = t2;
+        cohort_ids[1] = 0;
+        ballots[1] = TwoPhaseCommitOptimized.Ballot.COMMIT;
+        // Invalid cohort id, which is skipped.
+        vote_ids[2] = t2;
+        cohort_ids[2] = 5;
+        ballots[2] = TwoPhaseCommitOptimized.Ballot.COMMIT;
+        two_phase_commit.voteBatch(vote_ids, cohort_ids, ballots);
+
+        TwoPhaseCommitOptimized.VotingDecisionOption[]
+            memory decisions = two_phase_commit.getVotingDecisions(
+                transaction_ids
+            );
+        Assert.equal(decisions.length, 3, "Expect one decision per id.");
+        Assert.equal(
+            uint256(decisions[0]),
+            uint256(TwoPhaseCommitOptimized.VotingDecisionOption.COMMIT),
+            "Expect a commit decision of a transaction (t1)."
+        );
+        Assert.equal(
+            uint256(decisions[1]),
+            uint256(TwoPhaseCommitOptimized.VotingDecisionOption.PENDING),
+            "Expect a pending decision of a transaction (t2)."
+        );
+        Assert.equal(
+            uint256(decisions[2]),
+            uint256(TwoPhaseCommitOptimized.VotingDecisionOption.UNKNOWN),
+            "Expect an unknown decision of a skipped transaction (t3)."
+        );
+    }
+}
@@ -0,0 +1,72 @@
+// Throughput benchmark of the adapter server's TransactionPipeline against
+// sending one transaction at a time, on the local Ganache.
+//
+// Example cmd:
+// $ npx truffle test test/TransactionPipelineBenchmark.js
+const TwoPhaseCommit = artifacts.require('./TwoPhaseCommit.sol');
+const TransactionPipeline = require('../client/transaction_pipeline.js');
+
+const CURRENT_TIME = 1641024000;  // 1/1/2022
+const FUTURE_TIME = 1672560000;   // 1/1/2032
+const TRANSACTIONS = 200;
+// [sender accounts, max transactions in flight].
+const PIPELINES = [[1, 8], [1, 64], [4, 64]];
+
+// Starts voting on TRANSACTIONS new transactions with send_all, and returns
+// the transactions per second.
+async function measure(contract, label, send_all) {
+  const transaction_ids = [];
+  for (let i = 0; i < TRANSACTIONS; i++) {
+    transaction_ids.push(`${label}-${i}`);
+  }
+  const start = Date.now();
+  await send_all(
+      transaction_ids.map(
+          id => contract.methods.startVoting(id, 1, FUTURE_TIME)));
+  const transactions_per_second = TRANSACTIONS * 1000 / (Date.now() - start);
+
+  const decisions = await contract.methods.getVotingDecisions(transaction_ids)
+                        .call();
+  for (const decision of decisions) {
+    assert.equal(
+        decision.charAt(0), '1',
+        `Expect voting to have started on every transaction (${label}).`);
+  }
+  return transactions_per_second;
+}
+
+contract('TransactionPipelineBenchmark', accounts => {
+  it('should send transactions faster with a pipeline', async () => {
+    const deployed = await TwoPhaseCommit.new();
+    await deployed.setMockNow(CURRENT_TIME);
+    const contract =
+        new web3.eth.Contract(TwoPhaseCommit.abi, deployed.address);
+
+    const rows = [];
+    const sequential = await measure(contract, 'sequential', async methods => {
+      for (const method of methods) {
+        await method.send({from: accounts[0], gas: 500000});
+      }
+    });
+    rows.push({senders: 1, 'in flight': 1, 'tx/s': sequential.toFixed(1)});
+
+    let best = 0;
+    for (const [senders, max_in_flight] of PIPELINES) {
+      const pipeline = new TransactionPipeline(
+          web3, accounts.slice(0, senders), max_in_flight);
+      const pipelined = await measure(
+          contract, `pipeline-${senders}-${max_in_flight}`,
+          methods => Promise.all(methods.map(method => pipeline.send(method))));
+      rows.push({
+        senders: senders,
+        'in flight': max_in_flight,
+        'tx/s': pipelined.toFixed(1)
+      });
+      best = Math.max(best, pipelined);
+    }
+    console.table(rows);
+    assert.isAbove(
+        best, sequential,
+        'Expect a pipeline to send more transactions per second.');
+  });
+});
@@ -0,0 +1,57 @@
+// Gas benchmark of TwoPhaseCommitOptimized against TwoPhaseCommit.
+//
+// Example cmd:
+// $ npx truffle test test/TwoPhaseCommitGasBenchmark.js
+const TwoPhaseCommit = artifacts.require('./TwoPhaseCommit.sol');
+const TwoPhaseCommitOptimized =
+    artifacts.require('./TwoPhaseCommitOptimized.sol');
+
+const CURRENT_TIME = 1641024000;  // 1/1/2022
+const FUTURE_TIME = 1672560000;   // 1/1/2032
+const COMMIT = 1;
+const COHORT_COUNTS = [1, 4, 16, 64];
+
+// Returns the gas used to start voting, have every cohort vote to commit, and
+// read the decision.
+async function measure(contract, transactionId, cohorts) {
+  let writeGas = 0;
+  const start = await contract.startVoting(transactionId, cohorts, FUTURE_TIME);
+  writeGas += start.receipt.gasUsed;
+  for (let cohort = 0; cohort < cohorts; cohort++) {
+    const vote = await contract.vote(transactionId, cohort, COMMIT);
+    writeGas += vote.receipt.gasUsed;
+  }
+  const readGas = await contract.getVotingDecision.estimateGas(transactionId);
+  return {writeGas, readGas};
+}
+
+contract('TwoPhaseCommitGasBenchmark', accounts => {
+  it('should use less gas with the optimized contract', async () => {
+    const original = await TwoPhaseCommit.new();
+    const optimized = await TwoPhaseCommitOptimized.new();
+    await original.setMockNow(CURRENT_TIME);
+    await optimized.setMockNow(CURRENT_TIME);
+
+    const rows = [];
+    for (const cohorts of COHORT_COUNTS) {
+      // Transaction ids are typically 64-char hex strings, which the optimized
+      // contract takes as their keccak256.
+      const transactionId = web3.utils.sha3(`transaction-${cohorts}`).slice(2);
+      const before = await measure(original, transactionId, cohorts);
+      const after = await measure(
+          optimized, web3.utils.keccak256(transactionId), cohorts);
+      rows.push({
+        cohorts,
+        'write gas (original)': before.writeGas,
+        'write gas (optimized)': after.writeGas,
+        'read gas (original)': before.readGas,
+        'read gas (optimized)': after.readGas,
+      });
+      assert.isBelow(after.writeGas, before.writeGas,
+                     `More write gas with ${cohorts} cohorts.`);
+      assert.isBelow(after.readGas, before.readGas,
+                     `More read gas with ${cohorts} cohorts.`);
+    }
+    console.table(rows);
+  });
+});
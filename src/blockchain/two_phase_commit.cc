@@ -1,40 +1,223 @@
 #include "src/blockchain/two_phase_commit.h"
 
+#include <optional>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
 #include "src/utils/status_utils.h"
 
 namespace blockchain {
 
-absl::Status TwoPhaseCommit::StartVoting(const std::string& transaction_id,
-                                         const std::time_t& timeout_time,
-                                         int n_participants) {
-  grpc::ClientContext context;
+namespace {
+
+// How long to wait before reopening a broken decision stream.
+constexpr absl::Duration kResubscribeDelay = absl::Seconds(1);
+
+StartVotingRequest MakeStartVotingRequest(const std::string& transaction_id,
+                                          const std::time_t& timeout_time,
+                                          int n_participants) {
   StartVotingRequest request;
   request.set_transaction_id(transaction_id);
-  const absl::Time absl_time = absl::FromTimeT(timeout_time);
-  timespec ts = absl::ToTimespec(absl_time);
-  google::protobuf::Timestamp timestamp;
+  const timespec ts = absl::ToTimespec(absl::FromTimeT(timeout_time));
   request.mutable_timeout_time()->set_seconds(ts.tv_sec);
   request.mutable_timeout_time()->set_nanos(ts.tv_nsec);
   request.set_cohorts(n_participants);
+  return request;
+}
+
+VoteRequest MakeVoteRequest(const std::string& transaction_id,
+                            int participant_id, Ballot ballot) {
+  VoteRequest request;
+  request.set_transaction_id(transaction_id);
+  request.set_cohort_id(participant_id);
+  request.set_ballot(ballot);
+  return request;
+}
+
+// State of an async call, which must outlive the call.
+template <typename Request, typename Response>
+struct AsyncCall {
+  grpc::ClientContext context;
+  Request request;
+  Response response;
+};
+
+template <typename Request, typename Response>
+using AsyncMethod = void (TwoPhaseCommitAdapter::StubInterface::
+                              async_interface::*)(
+    grpc::ClientContext*, const Request*, Response*,
+    std::function<void(grpc::Status)>);
+
+// Starts |method| on the callback API of |stub| and calls
+// |done(status, response)| once it finishes.
+template <typename Request, typename Response, typename Done>
+void CallAsync(TwoPhaseCommitAdapter::StubInterface* stub,
+               AsyncMethod<Request, Response> method, Request request,
+               absl::Time deadline, Done done) {
+  if (stub->async() == nullptr) {
+    done(grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                      "The stub has no async API"),
+         Response());
+    return;
+  }
+  auto* call = new AsyncCall<Request, Response>;
+  call->request = std::move(request);
+  if (deadline != absl::InfiniteFuture()) {
+    call->context.set_deadline(absl::ToChronoTime(deadline));
+  }
+  (stub->async()->*method)(
+      &call->context, &call->request, &call->response,
+      [call, done = std::move(done)](grpc::Status status) mutable {
+        std::unique_ptr<AsyncCall<Request, Response>> owned_call(call);
+        done(status, owned_call->response);
+      });
+}
+
+}  // namespace
+
+DecisionSubscription::DecisionSubscription(
+    TwoPhaseCommitAdapter::StubInterface* stub, Callback on_decision)
+    : stub_(stub),
+      on_decision_(std::move(on_decision)),
+      thread_([this]() { ReceiveUntilCancelled(); }) {}
+
+DecisionSubscription::~DecisionSubscription() {
+  {
+    absl::MutexLock lock(&mutex_);
+    cancelled_ = true;
+    if (context_ != nullptr) {
+      context_->TryCancel();
+    }
+  }
+  thread_.join();
+}
+
+void DecisionSubscription::ReceiveUntilCancelled() {
+  while (true) {
+    grpc::ClientContext context;
+    {
+      absl::MutexLock lock(&mutex_);
+      if (cancelled_) {
+        return;
+      }
+      context_ = &context;
+    }
+    std::unique_ptr<grpc::ClientReaderInterface<VotingDecidedEvent>> reader =
+        stub_->WatchDecisions(&context, WatchDecisionsRequest());
+    VotingDecidedEvent event;
+    while (reader->Read(&event)) {
+      on_decision_(event);
+    }
+    const grpc::Status status = reader->Finish();
+    absl::MutexLock lock(&mutex_);
+    context_ = nullptr;
+    if (cancelled_) {
+      return;
+    }
+    LOG(WARNING) << "Decision stream ended, reconnecting: "
+                 << status.error_message();
+    mutex_.AwaitWithTimeout(absl::Condition(&cancelled_), kResubscribeDelay);
+  }
+}
+
+absl::Status TwoPhaseCommit::StartVoting(const std::string& transaction_id,
+                                         const std::time_t& timeout_time,
+                                         int n_participants) {
+  grpc::ClientContext context;
+  const StartVotingRequest request =
+      MakeStartVotingRequest(transaction_id, timeout_time, n_participants);
+  decisions_.Erase(transaction_id);
+  StartVotingResponse response;
+  grpc::Status status = stub_->StartVoting(&context, request, &response);
+  return utils::FromGrpcStatus(status, "Failed to start voting");
+}
+
+absl::StatusOr<std::vector<int>> TwoPhaseCommit::StartVotingBatch(
+    absl::Span<const StartVotingRequest> transactions) {
+  grpc::ClientContext context;
+  StartVotingBatchRequest request;
+  request.mutable_transactions()->Add(transactions.begin(),
+                                      transactions.end());
+  for (const StartVotingRequest& transaction : transactions) {
+    decisions_.Erase(transaction.transaction_id());
+  }
+  StartVotingBatchResponse response;
+  grpc::Status status = stub_->StartVotingBatch(&context, request, &response);
+  if (!status.ok()) {
+    return utils::FromGrpcStatus(status, "Failed to start voting");
+  }
+  return std::vector<int>(response.skipped_indices().begin(),
+                          response.skipped_indices().end());
+}
+
+absl::Status TwoPhaseCommit::StartVotingWithSigners(
+    const std::string& transaction_id, const std::time_t& timeout_time,
+    absl::Span<const std::string> signers) {
+  grpc::ClientContext context;
+  StartVotingRequest request =
+      MakeStartVotingRequest(transaction_id, timeout_time, signers.size());
+  request.mutable_signers()->Add(signers.begin(), signers.end());
+  decisions_.Erase(transaction_id);
   StartVotingResponse response;
   grpc::Status status = stub_->StartVoting(&context, request, &response);
   return utils::FromGrpcStatus(status, "Failed to start voting");
 }
 
 absl::Status TwoPhaseCommit::Vote(const std::string& transaction_id,
-                                  int participant_id, Ballot ballot) {
+                                  int participant_id, Ballot ballot,
+                                  absl::Time deadline) {
   grpc::ClientContext context;
-  VoteRequest request;
-  request.set_transaction_id(transaction_id);
-  request.set_cohort_id(participant_id);
-  request.set_ballot(ballot);
+  if (deadline != absl::InfiniteFuture()) {
+    context.set_deadline(absl::ToChronoTime(deadline));
+  }
+  const VoteRequest request =
+      MakeVoteRequest(transaction_id, participant_id, ballot);
   VoteResponse response;
   grpc::Status status = stub_->Vote(&context, request, &response);
   return utils::FromGrpcStatus(status, "Failed to vote");
 }
 
+absl::Status TwoPhaseCommit::VoteBatch(absl::Span<const VoteRequest> votes) {
+  grpc::ClientContext context;
+  VoteBatchRequest request;
+  request.mutable_votes()->Add(votes.begin(), votes.end());
+  VoteBatchResponse response;
+  grpc::Status status = stub_->VoteBatch(&context, request, &response);
+  return utils::FromGrpcStatus(status, "Failed to vote");
+}
+
+absl::StatusOr<std::string> TwoPhaseCommit::SignCommitVote(
+    const std::string& transaction_id, int participant_id) {
+  grpc::ClientContext context;
+  SignCommitVoteRequest request;
+  request.set_transaction_id(transaction_id);
+  request.set_cohort_id(participant_id);
+  SignCommitVoteResponse response;
+  grpc::Status status = stub_->SignCommitVote(&context, request, &response);
+  if (!status.ok()) {
+    return utils::FromGrpcStatus(status, "Failed to sign commit vote");
+  }
+  return std::move(*response.mutable_signature());
+}
+
+absl::Status TwoPhaseCommit::CommitWithVotes(
+    const std::string& transaction_id, absl::Span<const std::string> signers,
+    absl::Span<const std::string> signatures) {
+  grpc::ClientContext context;
+  CommitWithVotesRequest request;
+  request.set_transaction_id(transaction_id);
+  request.mutable_signers()->Add(signers.begin(), signers.end());
+  request.mutable_signatures()->Add(signatures.begin(), signatures.end());
+  CommitWithVotesResponse response;
+  grpc::Status status = stub_->CommitWithVotes(&context, request, &response);
+  return utils::FromGrpcStatus(status, "Failed to commit with votes");
+}
+
 absl::StatusOr<VotingDecision> TwoPhaseCommit::GetVotingDecision(
     const std::string& transaction_id) {
+  if (std::optional<VotingDecision> cached = decisions_.Get(transaction_id)) {
+    return *cached;
+  }
   grpc::ClientContext context;
   GetVotingDecisionRequest request;
   request.set_transaction_id(transaction_id);
@@ -43,7 +226,112 @@ absl::StatusOr<VotingDecision> TwoPhaseCommit::GetVotingDecision(
   if (!status.ok()) {
     return utils::FromGrpcStatus(status, "Failed to vote");
   }
-  return response.decision();
+  return decisions_.Update(transaction_id, response.decision(),
+                           response.block_number());
+}
+
+absl::StatusOr<absl::flat_hash_map<std::string, VotingDecision>>
+TwoPhaseCommit::GetVotingDecisions(
+    absl::Span<const std::string> transaction_ids) {
+  absl::flat_hash_map<std::string, VotingDecision> decisions;
+  decisions.reserve(transaction_ids.size());
+  GetVotingDecisionsRequest request;
+  for (const std::string& transaction_id : transaction_ids) {
+    if (std::optional<VotingDecision> cached = decisions_.Get(transaction_id)) {
+      decisions[transaction_id] = *cached;
+    } else {
+      request.add_transaction_ids(transaction_id);
+    }
+  }
+  if (request.transaction_ids().empty()) {
+    return decisions;
+  }
+  grpc::ClientContext context;
+  GetVotingDecisionsResponse response;
+  grpc::Status status =
+      stub_->GetVotingDecisions(&context, request, &response);
+  if (!status.ok()) {
+    return utils::FromGrpcStatus(status, "Failed to get voting decisions");
+  }
+  if (response.decisions_size() != request.transaction_ids_size()) {
+    return absl::InternalError(
+        absl::StrCat("Expected ", request.transaction_ids_size(),
+                     " voting decisions but got ", response.decisions_size()));
+  }
+  for (int i = 0; i < response.decisions_size(); ++i) {
+    decisions[request.transaction_ids(i)] = decisions_.Update(
+        request.transaction_ids(i), response.decisions(i).decision(),
+        response.decisions(i).block_number());
+  }
+  return decisions;
+}
+
+std::unique_ptr<DecisionSubscription> TwoPhaseCommit::WatchDecisions(
+    DecisionSubscription::Callback on_decision) {
+  // The event's block is the one that decided the transaction, so the cache
+  // counts confirmations from it.
+  return std::make_unique<DecisionSubscription>(
+      stub_.get(), [this, on_decision = std::move(on_decision)](
+                       const VotingDecidedEvent& event) {
+        if (decisions_.Update(event.transaction_id(), event.decision(),
+                              event.block_number()) == event.decision()) {
+          on_decision(event);
+        }
+      });
+}
+
+void TwoPhaseCommit::StartVotingAsync(const std::string& transaction_id,
+                                      const std::time_t& timeout_time,
+                                      int n_participants, absl::Time deadline,
+                                      StatusCallback done) {
+  decisions_.Erase(transaction_id);
+  CallAsync(stub_.get(),
+            &TwoPhaseCommitAdapter::StubInterface::async_interface::StartVoting,
+            MakeStartVotingRequest(transaction_id, timeout_time,
+                                   n_participants),
+            deadline,
+            [done = std::move(done)](const grpc::Status& status,
+                                     const StartVotingResponse&) {
+              done(utils::FromGrpcStatus(status, "Failed to start voting"));
+            });
+}
+
+void TwoPhaseCommit::VoteAsync(const std::string& transaction_id,
+                               int participant_id, Ballot ballot,
+                               absl::Time deadline, StatusCallback done) {
+  CallAsync(stub_.get(),
+            &TwoPhaseCommitAdapter::StubInterface::async_interface::Vote,
+            MakeVoteRequest(transaction_id, participant_id, ballot), deadline,
+            [done = std::move(done)](const grpc::Status& status,
+                                     const VoteResponse&) {
+              done(utils::FromGrpcStatus(status, "Failed to vote"));
+            });
+}
+
+void TwoPhaseCommit::GetVotingDecisionAsync(const std::string& transaction_id,
+                                            absl::Time deadline,
+                                            VotingDecisionCallback done) {
+  if (std::optional<VotingDecision> cached = decisions_.Get(transaction_id)) {
+    done(*cached);
+    return;
+  }
+  GetVotingDecisionRequest request;
+  request.set_transaction_id(transaction_id);
+  CallAsync(
+      stub_.get(),
+      &TwoPhaseCommitAdapter::StubInterface::async_interface::GetVotingDecision,
+      std::move(request), deadline,
+      [this, transaction_id, done = std::move(done)](
+          const grpc::Status& status,
+          const GetVotingDecisionResponse& response) {
+        if (!status.ok()) {
+          done(utils::FromGrpcStatus(status,
+                                     "Failed to get voting decision"));
+          return;
+        }
+        done(decisions_.Update(transaction_id, response.decision(),
+                               response.block_number()));
+      });
 }
 
 absl::Status TwoPhaseCommit::GetHeartBeat() {
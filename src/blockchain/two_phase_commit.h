@@ -3,23 +3,76 @@
 #define SRC_BLOCKCHAIN_TWO_PHASE_COMMIT_H_
 
 #include <ctime>
+#include <functional>
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "glog/logging.h"
 #include "grpcpp/channel.h"
 #include "grpcpp/client_context.h"
+#include "src/blockchain/decision_cache.h"
 #include "src/blockchain/proto/two_phase_commit_adapter.grpc.pb.h"
 
 namespace blockchain {
+
+// Receives the VotingDecided events of the contract on a background thread
+// until destroyed. Reconnects if the stream breaks, but events emitted while
+// disconnected are lost, so the decisions must still be polled as a fallback.
+class DecisionSubscription {
+ public:
+  using Callback = std::function<void(const VotingDecidedEvent &)>;
+
+  DecisionSubscription(TwoPhaseCommitAdapter::StubInterface *stub,
+                       Callback on_decision);
+
+  // Cancels the stream and waits for the callback to return.
+  ~DecisionSubscription();
+
+  DecisionSubscription(const DecisionSubscription &) = delete;
+  DecisionSubscription &operator=(const DecisionSubscription &) = delete;
+
+ private:
+  void ReceiveUntilCancelled();
+
+  TwoPhaseCommitAdapter::StubInterface *const stub_;
+  const Callback on_decision_;
+  absl::Mutex mutex_;
+  bool cancelled_ ABSL_GUARDED_BY(mutex_) = false;
+  // Context of the open stream, if any.
+  grpc::ClientContext *context_ ABSL_GUARDED_BY(mutex_) = nullptr;
+  std::thread thread_;
+};
+
+struct TwoPhaseCommitOptions {
+  // Blocks that must be mined on top of the one a COMMIT or ABORT decision is
+  // first seen at before it's reported, in case a reorg reverts it. Until
+  // then the transaction is reported as PENDING, and WatchDecisions skips it.
+  // 0 reports decisions as soon as they're in a block.
+  int confirmations = 0;
+  // Maximum number of transactions whose final decision is cached, so it's
+  // only read from the blockchain once. 0 disables the cache and
+  // confirmations.
+  size_t max_cached_decisions = 100000;
+};
+
 class TwoPhaseCommit {
  public:
-  explicit TwoPhaseCommit(std::shared_ptr<grpc::Channel> channel)
-      : TwoPhaseCommit(TwoPhaseCommitAdapter::NewStub(channel)) {
+  using StatusCallback = std::function<void(absl::Status)>;
+  using VotingDecisionCallback =
+      std::function<void(absl::StatusOr<VotingDecision>)>;
+
+  explicit TwoPhaseCommit(
+      std::shared_ptr<grpc::Channel> channel,
+      const TwoPhaseCommitOptions &options = TwoPhaseCommitOptions())
+      : TwoPhaseCommit(TwoPhaseCommitAdapter::NewStub(channel), options) {
     int failure_count = 0;
     while (!GetHeartBeat().ok()) {
       ++failure_count;
@@ -31,24 +84,91 @@ class TwoPhaseCommit {
   }
 
   explicit TwoPhaseCommit(
-      std::unique_ptr<TwoPhaseCommitAdapter::StubInterface> stub)
-      : stub_(stub.release()) {}
+      std::unique_ptr<TwoPhaseCommitAdapter::StubInterface> stub,
+      const TwoPhaseCommitOptions &options = TwoPhaseCommitOptions())
+      : stub_(stub.release()),
+        decisions_(options.confirmations, options.max_cached_decisions) {}
 
   absl::Status StartVoting(const std::string &transaction_id,
                            const std::time_t &timeout_time, int n_participants);
 
+  // Starts voting on all the transactions in one blockchain transaction.
+  // Transactions the contract rejects (e.g. already timed out) are skipped
+  // rather than failing the batch. Returns their indices in |transactions|,
+  // in increasing order.
+  absl::StatusOr<std::vector<int>> StartVotingBatch(
+      absl::Span<const StartVotingRequest> transactions);
+
+  // Starts voting like StartVoting, but also lets the transaction commit
+  // with CommitWithVotes once participant i has signed its commit vote with
+  // |signers[i]|.
+  absl::Status StartVotingWithSigners(const std::string &transaction_id,
+                                      const std::time_t &timeout_time,
+                                      absl::Span<const std::string> signers);
+
+  // Gives up with DeadlineExceeded error at |deadline|.
   absl::Status Vote(const std::string &transaction_id, int participant_id,
-                    Ballot ballot);
+                    Ballot ballot,
+                    absl::Time deadline = absl::InfiniteFuture());
+
+  // Casts all the votes in one blockchain transaction. Votes the contract
+  // rejects (e.g. after the timeout) are skipped rather than failing the
+  // batch.
+  absl::Status VoteBatch(absl::Span<const VoteRequest> votes);
+
+  // Signs a participant's commit vote with the adapter's account, without
+  // sending anything to the blockchain.
+  absl::StatusOr<std::string> SignCommitVote(const std::string &transaction_id,
+                                             int participant_id);
+
+  // Commits a transaction started with StartVotingWithSigners in one
+  // blockchain transaction, given every participant's signed commit vote in
+  // participant order. Fails if a signature is invalid, a participant
+  // already voted to abort or the timeout passed.
+  absl::Status CommitWithVotes(const std::string &transaction_id,
+                               absl::Span<const std::string> signers,
+                               absl::Span<const std::string> signatures);
 
   // Gets the voting decision of a transaction.
   // TODO(heronyang): Attach ABORT_REASON, PENDING_REASON to the response.
   absl::StatusOr<VotingDecision> GetVotingDecision(
       const std::string &transaction_id);
 
+  // Gets the voting decisions of many transactions in one call. Transactions
+  // whose voting hasn't started have VOTING_DECISION_UNKNOWN.
+  absl::StatusOr<absl::flat_hash_map<std::string, VotingDecision>>
+  GetVotingDecisions(absl::Span<const std::string> transaction_ids);
+
+  // Calls |on_decision| with every decision made on the blockchain from now
+  // on, as soon as it's in a block, until the subscription is destroyed.
+  // Transactions aborted at their timeout aren't included. With
+  // confirmations, decisions are skipped until confirmed, so they must be
+  // polled.
+  std::unique_ptr<DecisionSubscription> WatchDecisions(
+      DecisionSubscription::Callback on_decision);
+
+  // Non-blocking variants of the calls above, so callers can overlap the
+  // blockchain's latency with other work instead of parking a thread on it.
+  // |done| is called on a gRPC thread once the call finishes, or with
+  // DeadlineExceeded error once |deadline| passes, so it must not block.
+  // Cached decisions are passed to |done| before GetVotingDecisionAsync
+  // returns.
+  void StartVotingAsync(const std::string &transaction_id,
+                        const std::time_t &timeout_time, int n_participants,
+                        absl::Time deadline, StatusCallback done);
+
+  void VoteAsync(const std::string &transaction_id, int participant_id,
+                 Ballot ballot, absl::Time deadline, StatusCallback done);
+
+  void GetVotingDecisionAsync(const std::string &transaction_id,
+                              absl::Time deadline,
+                              VotingDecisionCallback done);
+
   absl::Status GetHeartBeat();
 
  private:
   std::unique_ptr<TwoPhaseCommitAdapter::StubInterface> stub_;
+  DecisionCache decisions_;
 };
 
 }  // namespace blockchain
@@ -1,17 +1,504 @@
 #include "src/blockchain/two_phase_commit.h"
 
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/blockchain/proto/two_phase_commit_adapter_mock.grpc.pb.h"
 
 namespace {
+using ::blockchain::Ballot;
 using ::blockchain::MockTwoPhaseCommitAdapterStub;
+using ::blockchain::StartVotingBatchRequest;
+using ::blockchain::StartVotingBatchResponse;
+using ::blockchain::StartVotingRequest;
 using ::blockchain::TwoPhaseCommit;
+using ::blockchain::VoteBatchRequest;
+using ::blockchain::VoteRequest;
+using ::blockchain::VotingDecidedEvent;
+using ::blockchain::VotingDecision;
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::Invoke;
+using ::testing::Pair;
+using ::testing::Return;
+using ::testing::UnorderedElementsAre;
 
 TEST(TwoPhaseCommitTest, Valid) {
   TwoPhaseCommit two_phase_commit(
       std::make_unique<MockTwoPhaseCommitAdapterStub>());
 }
 
+TEST(TwoPhaseCommitTest, StartVotingBatchSendsAllTransactionsInOneRequest) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  StartVotingBatchRequest sent_request;
+  EXPECT_CALL(*stub, StartVotingBatch(_, _, _))
+      .WillOnce([&sent_request](grpc::ClientContext*,
+                                const StartVotingBatchRequest& request,
+                                StartVotingBatchResponse* response) {
+        sent_request = request;
+        response->add_skipped_indices(1);
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+  std::vector<StartVotingRequest> transactions(2);
+  transactions[0].set_transaction_id("t1");
+  transactions[0].set_cohorts(2);
+  transactions[1].set_transaction_id("t2");
+  transactions[1].set_cohorts(3);
+  transactions[1].mutable_timeout_time()->set_seconds(1672560000);
+
+  const absl::StatusOr<std::vector<int>> skipped_indices =
+      two_phase_commit.StartVotingBatch(transactions);
+  ASSERT_TRUE(skipped_indices.ok());
+  EXPECT_THAT(*skipped_indices, ElementsAre(1));
+  ASSERT_EQ(sent_request.transactions_size(), 2);
+  EXPECT_EQ(sent_request.transactions(0).transaction_id(), "t1");
+  EXPECT_EQ(sent_request.transactions(1).cohorts(), 3);
+  EXPECT_EQ(sent_request.transactions(1).timeout_time().seconds(), 1672560000);
+}
+
+TEST(TwoPhaseCommitTest, GetVotingDecisionsMapsEachIdToItsDecision) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _))
+      .WillOnce([](grpc::ClientContext*,
+                   const blockchain::GetVotingDecisionsRequest& request,
+                   blockchain::GetVotingDecisionsResponse* response) {
+        EXPECT_EQ(request.transaction_ids_size(), 2);
+        response->add_decisions()->set_decision(
+            VotingDecision::VOTING_DECISION_COMMIT);
+        response->add_decisions()->set_decision(
+            VotingDecision::VOTING_DECISION_PENDING);
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  const auto decisions = two_phase_commit.GetVotingDecisions({"t1", "t2"});
+  ASSERT_TRUE(decisions.ok());
+  EXPECT_THAT(*decisions,
+              UnorderedElementsAre(
+                  Pair("t1", VotingDecision::VOTING_DECISION_COMMIT),
+                  Pair("t2", VotingDecision::VOTING_DECISION_PENDING)));
+}
+
+TEST(TwoPhaseCommitTest, GetVotingDecisionsFailsOnMissingDecisions) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _))
+      .WillOnce(Return(grpc::Status::OK));
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  EXPECT_EQ(two_phase_commit.GetVotingDecisions({"t1"}).status().code(),
+            absl::StatusCode::kInternal);
+}
+
+// Answers GetVotingDecision with |decisions| in order, each read at the
+// block number paired with it.
+auto ReturnDecisions(
+    std::vector<std::pair<VotingDecision, uint64_t>> decisions) {
+  // Shared by the copies gMock makes of the action.
+  auto next = std::make_shared<size_t>(0);
+  return [decisions = std::move(decisions), next](
+             grpc::ClientContext*,
+             const blockchain::GetVotingDecisionRequest&,
+             blockchain::GetVotingDecisionResponse* response) {
+    response->set_decision(decisions[*next].first);
+    response->set_block_number(decisions[*next].second);
+    ++*next;
+    return grpc::Status::OK;
+  };
+}
+
+TEST(TwoPhaseCommitTest, ReadsFinalDecisionsOnce) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, GetVotingDecision(_, _, _))
+      .Times(2)
+      .WillRepeatedly(
+          ReturnDecisions({{VotingDecision::VOTING_DECISION_PENDING, 1},
+                           {VotingDecision::VOTING_DECISION_COMMIT, 2}}));
+  EXPECT_CALL(*stub, GetVotingDecisions(_, _, _))
+      .WillOnce([](grpc::ClientContext*,
+                   const blockchain::GetVotingDecisionsRequest& request,
+                   blockchain::GetVotingDecisionsResponse* response) {
+        EXPECT_THAT(request.transaction_ids(), ElementsAre("t2"));
+        response->add_decisions()->set_decision(
+            VotingDecision::VOTING_DECISION_ABORT);
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+  EXPECT_THAT(*two_phase_commit.GetVotingDecisions({"t1", "t2"}),
+              UnorderedElementsAre(
+                  Pair("t1", VotingDecision::VOTING_DECISION_COMMIT),
+                  Pair("t2", VotingDecision::VOTING_DECISION_ABORT)));
+  EXPECT_THAT(*two_phase_commit.GetVotingDecisions({"t1", "t2"}),
+              UnorderedElementsAre(
+                  Pair("t1", VotingDecision::VOTING_DECISION_COMMIT),
+                  Pair("t2", VotingDecision::VOTING_DECISION_ABORT)));
+}
+
+TEST(TwoPhaseCommitTest, ReportsDecisionsOnceConfirmed) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, GetVotingDecision(_, _, _))
+      .Times(3)
+      .WillRepeatedly(
+          ReturnDecisions({{VotingDecision::VOTING_DECISION_COMMIT, 10},
+                           {VotingDecision::VOTING_DECISION_COMMIT, 11},
+                           {VotingDecision::VOTING_DECISION_COMMIT, 12}}));
+  blockchain::TwoPhaseCommitOptions options;
+  options.confirmations = 2;
+  TwoPhaseCommit two_phase_commit(std::move(stub), options);
+
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_COMMIT);
+}
+
+TEST(TwoPhaseCommitTest, StartingVotingAgainForgetsTheDecision) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, StartVoting(_, _, _)).WillOnce(Return(grpc::Status::OK));
+  EXPECT_CALL(*stub, GetVotingDecision(_, _, _))
+      .Times(2)
+      .WillRepeatedly(
+          ReturnDecisions({{VotingDecision::VOTING_DECISION_ABORT, 1},
+                           {VotingDecision::VOTING_DECISION_PENDING, 2}}));
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_ABORT);
+  ASSERT_TRUE(two_phase_commit.StartVoting("t1", 1672560000, 2).ok());
+  EXPECT_EQ(*two_phase_commit.GetVotingDecision("t1"),
+            VotingDecision::VOTING_DECISION_PENDING);
+}
+
+// Streams |events| and then ends as if the adapter went away.
+class FakeDecisionReader
+    : public grpc::ClientReaderInterface<VotingDecidedEvent> {
+ public:
+  explicit FakeDecisionReader(std::vector<VotingDecidedEvent> events)
+      : events_(std::move(events)) {}
+
+  grpc::Status Finish() override {
+    return grpc::Status(grpc::UNAVAILABLE, "closed");
+  }
+  bool NextMessageSize(uint32_t* size) override {
+    *size = 0;
+    return next_ < events_.size();
+  }
+  bool Read(VotingDecidedEvent* event) override {
+    if (next_ == events_.size()) {
+      return false;
+    }
+    *event = events_[next_++];
+    return true;
+  }
+  void WaitForInitialMetadata() override {}
+
+ private:
+  std::vector<VotingDecidedEvent> events_;
+  size_t next_ = 0;
+};
+
+TEST(TwoPhaseCommitTest, WatchDecisionsCallsBackForEachEvent) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  std::vector<VotingDecidedEvent> events(2);
+  events[0].set_transaction_id("t1");
+  events[0].set_decision(VotingDecision::VOTING_DECISION_COMMIT);
+  events[1].set_transaction_id("t2");
+  events[1].set_decision(VotingDecision::VOTING_DECISION_ABORT);
+  EXPECT_CALL(*stub, WatchDecisionsRaw(_, _))
+      .WillOnce(Return(new FakeDecisionReader(events)))
+      .WillRepeatedly([](grpc::ClientContext*,
+                         const blockchain::WatchDecisionsRequest&) {
+        return new FakeDecisionReader({});
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  absl::Mutex mutex;
+  std::vector<std::string> decided;
+  std::unique_ptr<blockchain::DecisionSubscription> subscription =
+      two_phase_commit.WatchDecisions(
+          [&mutex, &decided](const VotingDecidedEvent& event) {
+            absl::MutexLock lock(&mutex);
+            decided.push_back(event.transaction_id());
+          });
+  {
+    absl::MutexLock lock(&mutex);
+    const auto both_received = [&decided]() { return decided.size() == 2; };
+    EXPECT_TRUE(mutex.AwaitWithTimeout(absl::Condition(&both_received),
+                                       absl::Seconds(10)));
+    EXPECT_THAT(decided, ::testing::ElementsAre("t1", "t2"));
+  }
+  // Stops the reconnecting stream.
+  subscription.reset();
+}
+
+TEST(TwoPhaseCommitTest, VoteBatchSendsAllVotesInOneRequest) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  VoteBatchRequest sent_request;
+  EXPECT_CALL(*stub, VoteBatch(_, _, _))
+      .WillOnce([&sent_request](grpc::ClientContext*,
+                                const VoteBatchRequest& request,
+                                blockchain::VoteBatchResponse*) {
+        sent_request = request;
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+  std::vector<VoteRequest> votes(2);
+  votes[0].set_transaction_id("t1");
+  votes[0].set_cohort_id(0);
+  votes[0].set_ballot(Ballot::BALLOT_COMMIT);
+  votes[1].set_transaction_id("t2");
+  votes[1].set_cohort_id(1);
+  votes[1].set_ballot(Ballot::BALLOT_ABORT);
+
+  EXPECT_TRUE(two_phase_commit.VoteBatch(votes).ok());
+  ASSERT_EQ(sent_request.votes_size(), 2);
+  EXPECT_EQ(sent_request.votes(0).transaction_id(), "t1");
+  EXPECT_EQ(sent_request.votes(1).ballot(), Ballot::BALLOT_ABORT);
+}
+
+TEST(TwoPhaseCommitTest, VoteBatchReturnsRpcErrors) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, VoteBatch(_, _, _))
+      .WillOnce(Return(grpc::Status(grpc::UNAVAILABLE, "down")));
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  EXPECT_EQ(two_phase_commit.VoteBatch({VoteRequest()}).code(),
+            absl::StatusCode::kUnavailable);
+}
+
+TEST(TwoPhaseCommitTest, VoteSendsTheVoteWithItsDeadline) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  const absl::Time deadline = absl::Now() + absl::Seconds(30);
+  EXPECT_CALL(*stub, Vote(_, _, _))
+      .WillOnce([deadline](grpc::ClientContext* context,
+                           const VoteRequest& request,
+                           blockchain::VoteResponse*) {
+        EXPECT_EQ(request.transaction_id(), "t1");
+        EXPECT_LE(absl::AbsDuration(absl::FromChrono(context->deadline()) -
+                                    deadline),
+                  absl::Milliseconds(1));
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  EXPECT_TRUE(
+      two_phase_commit.Vote("t1", 2, Ballot::BALLOT_COMMIT, deadline).ok());
+}
+
+TEST(TwoPhaseCommitTest, StartVotingWithSignersSendsTheSigners) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  StartVotingRequest sent_request;
+  EXPECT_CALL(*stub, StartVoting(_, _, _))
+      .WillOnce([&sent_request](grpc::ClientContext*,
+                                const StartVotingRequest& request,
+                                blockchain::StartVotingResponse*) {
+        sent_request = request;
+        return grpc::Status::OK;
+      });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  EXPECT_TRUE(two_phase_commit
+                  .StartVotingWithSigners("t1", 1672560000, {"0xa", "0xb"})
+                  .ok());
+  EXPECT_EQ(sent_request.transaction_id(), "t1");
+  EXPECT_EQ(sent_request.cohorts(), 2);
+  EXPECT_THAT(sent_request.signers(), ElementsAre("0xa", "0xb"));
+}
+
+TEST(TwoPhaseCommitTest, CommitsWithSignedVotes) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, SignCommitVote(_, _, _))
+      .WillOnce([](grpc::ClientContext*,
+                   const blockchain::SignCommitVoteRequest& request,
+                   blockchain::SignCommitVoteResponse* response) {
+        EXPECT_EQ(request.transaction_id(), "t1");
+        EXPECT_EQ(request.cohort_id(), 1);
+        response->set_signature("signature");
+        return grpc::Status::OK;
+      });
+  blockchain::CommitWithVotesRequest sent_request;
+  EXPECT_CALL(*stub, CommitWithVotes(_, _, _))
+      .WillOnce(
+          [&sent_request](grpc::ClientContext*,
+                          const blockchain::CommitWithVotesRequest& request,
+                          blockchain::CommitWithVotesResponse*) {
+            sent_request = request;
+            return grpc::Status::OK;
+          });
+  TwoPhaseCommit two_phase_commit(std::move(stub));
+
+  const absl::StatusOr<std::string> signature =
+      two_phase_commit.SignCommitVote("t1", 1);
+  ASSERT_TRUE(signature.ok());
+  EXPECT_EQ(*signature, "signature");
+  EXPECT_TRUE(
+      two_phase_commit.CommitWithVotes("t1", {"0xa"}, {*signature}).ok());
+  EXPECT_EQ(sent_request.transaction_id(), "t1");
+  EXPECT_THAT(sent_request.signers(), ElementsAre("0xa"));
+  EXPECT_THAT(sent_request.signatures(), ElementsAre("signature"));
+}
+
+using AsyncInterface =
+    blockchain::TwoPhaseCommitAdapter::StubInterface::async_interface;
+using GrpcCallback = std::function<void(grpc::Status)>;
+
+class MockAsyncStub : public AsyncInterface {
+ public:
+  MOCK_METHOD4(StartVoting,
+               void(grpc::ClientContext*, const StartVotingRequest*,
+                    blockchain::StartVotingResponse*, GrpcCallback));
+  MOCK_METHOD4(StartVotingBatch,
+               void(grpc::ClientContext*, const StartVotingBatchRequest*,
+                    StartVotingBatchResponse*, GrpcCallback));
+  MOCK_METHOD4(Vote, void(grpc::ClientContext*, const VoteRequest*,
+                          blockchain::VoteResponse*, GrpcCallback));
+  MOCK_METHOD4(VoteBatch, void(grpc::ClientContext*, const VoteBatchRequest*,
+                               blockchain::VoteBatchResponse*, GrpcCallback));
+  MOCK_METHOD4(SignCommitVote,
+               void(grpc::ClientContext*,
+                    const blockchain::SignCommitVoteRequest*,
+                    blockchain::SignCommitVoteResponse*, GrpcCallback));
+  MOCK_METHOD4(CommitWithVotes,
+               void(grpc::ClientContext*,
+                    const blockchain::CommitWithVotesRequest*,
+                    blockchain::CommitWithVotesResponse*, GrpcCallback));
+  MOCK_METHOD4(GetVotingDecision,
+               void(grpc::ClientContext*,
+                    const blockchain::GetVotingDecisionRequest*,
+                    blockchain::GetVotingDecisionResponse*, GrpcCallback));
+  MOCK_METHOD4(GetVotingDecisions,
+               void(grpc::ClientContext*,
+                    const blockchain::GetVotingDecisionsRequest*,
+                    blockchain::GetVotingDecisionsResponse*, GrpcCallback));
+  MOCK_METHOD4(GetHeartBeat,
+               void(grpc::ClientContext*,
+                    const blockchain::GetHeartBeatRequest*,
+                    blockchain::GetHeartBeatResponse*, GrpcCallback));
+};
+
+// Stub whose callback API is |async_stub|.
+class StubWithAsync : public MockTwoPhaseCommitAdapterStub {
+ public:
+  explicit StubWithAsync(MockAsyncStub* async_stub)
+      : async_stub_(async_stub) {}
+
+  AsyncInterface* async() override { return async_stub_; }
+
+ private:
+  MockAsyncStub* const async_stub_;
+};
+
+TEST(TwoPhaseCommitTest, VoteAsyncSendsTheVoteWithItsDeadline) {
+  MockAsyncStub async_stub;
+  const absl::Time deadline = absl::Now() + absl::Seconds(30);
+  EXPECT_CALL(async_stub, Vote(_, _, _, _))
+      .WillOnce(Invoke([deadline](grpc::ClientContext* context,
+                                  const VoteRequest* request,
+                                  blockchain::VoteResponse*,
+                                  GrpcCallback done) {
+        EXPECT_EQ(request->transaction_id(), "t1");
+        EXPECT_EQ(request->cohort_id(), 2);
+        EXPECT_EQ(request->ballot(), Ballot::BALLOT_COMMIT);
+        EXPECT_LE(absl::AbsDuration(absl::FromChrono(context->deadline()) -
+                                    deadline),
+                  absl::Milliseconds(1));
+        // The callback usually runs on another thread once the chain
+        // confirms the vote.
+        std::thread([done]() { done(grpc::Status::OK); }).detach();
+      }));
+  TwoPhaseCommit two_phase_commit(
+      std::make_unique<StubWithAsync>(&async_stub));
+
+  absl::Mutex mutex;
+  absl::optional<absl::Status> vote_status;
+  two_phase_commit.VoteAsync("t1", 2, Ballot::BALLOT_COMMIT, deadline,
+                             [&mutex, &vote_status](absl::Status status) {
+                               absl::MutexLock lock(&mutex);
+                               vote_status = status;
+                             });
+  absl::MutexLock lock(&mutex);
+  const auto voted = [&vote_status]() { return vote_status.has_value(); };
+  ASSERT_TRUE(
+      mutex.AwaitWithTimeout(absl::Condition(&voted), absl::Seconds(10)));
+  EXPECT_TRUE(vote_status->ok());
+}
+
+TEST(TwoPhaseCommitTest, GetVotingDecisionAsyncReturnsTheDecision) {
+  MockAsyncStub async_stub;
+  EXPECT_CALL(async_stub, GetVotingDecision(_, _, _, _))
+      .WillOnce(Invoke([](grpc::ClientContext*,
+                          const blockchain::GetVotingDecisionRequest* request,
+                          blockchain::GetVotingDecisionResponse* response,
+                          GrpcCallback done) {
+        EXPECT_EQ(request->transaction_id(), "t1");
+        response->set_decision(VotingDecision::VOTING_DECISION_ABORT);
+        done(grpc::Status::OK);
+      }));
+  TwoPhaseCommit two_phase_commit(
+      std::make_unique<StubWithAsync>(&async_stub));
+
+  absl::StatusOr<VotingDecision> decision;
+  two_phase_commit.GetVotingDecisionAsync(
+      "t1", absl::InfiniteFuture(),
+      [&decision](absl::StatusOr<VotingDecision> result) {
+        decision = std::move(result);
+      });
+  ASSERT_TRUE(decision.ok());
+  EXPECT_EQ(*decision, VotingDecision::VOTING_DECISION_ABORT);
+}
+
+TEST(TwoPhaseCommitTest, AsyncCallsReturnRpcErrors) {
+  MockAsyncStub async_stub;
+  EXPECT_CALL(async_stub, StartVoting(_, _, _, _))
+      .WillOnce(Invoke([](grpc::ClientContext*,
+                          const StartVotingRequest* request,
+                          blockchain::StartVotingResponse*,
+                          GrpcCallback done) {
+        EXPECT_EQ(request->cohorts(), 3);
+        EXPECT_EQ(request->timeout_time().seconds(), 1672560000);
+        done(grpc::Status(grpc::DEADLINE_EXCEEDED, "too slow"));
+      }));
+  TwoPhaseCommit two_phase_commit(
+      std::make_unique<StubWithAsync>(&async_stub));
+
+  absl::Status start_status;
+  two_phase_commit.StartVotingAsync(
+      "t1", 1672560000, 3, absl::Now() + absl::Seconds(1),
+      [&start_status](absl::Status status) { start_status = status; });
+  EXPECT_EQ(start_status.code(), absl::StatusCode::kDeadlineExceeded);
+}
+
+TEST(TwoPhaseCommitTest, AsyncCallsFailWithoutAnAsyncApi) {
+  TwoPhaseCommit two_phase_commit(
+      std::make_unique<MockTwoPhaseCommitAdapterStub>());
+
+  absl::Status vote_status;
+  two_phase_commit.VoteAsync(
+      "t1", 0, Ballot::BALLOT_ABORT, absl::InfiniteFuture(),
+      [&vote_status](absl::Status status) { vote_status = status; });
+  EXPECT_EQ(vote_status.code(), absl::StatusCode::kUnimplemented);
+}
+
 }  // namespace
@@ -53,27 +53,23 @@ void AddGetOp(coordinator::CommitAtomicTransactionRequest& request,
 
 void AddPutOp(coordinator::CommitAtomicTransactionRequest& request,
               const std::string& address, const std::string& key,
-              int64_t value) {
+              const common::ConstantValue& value) {
   common::Operation* put_op = request.mutable_transaction()->add_ops();
   put_op->mutable_namespace_()->set_address(address);
   put_op->mutable_put()->set_key(key);
-  put_op->mutable_put()
-      ->mutable_value()
-      ->mutable_constant_value()
-      ->set_int64_value(value);
+  *put_op->mutable_put()->mutable_value()->mutable_constant_value() = value;
 }
 
 void AddRelativePutOp(coordinator::CommitAtomicTransactionRequest& request,
                       const std::string& address, const std::string& key,
-                      int64_t relative_value) {
+                      const common::NumericValue& relative_value) {
   common::Operation* put_op = request.mutable_transaction()->add_ops();
   put_op->mutable_namespace_()->set_address(address);
   put_op->mutable_put()->set_key(key);
-  put_op->mutable_put()
-      ->mutable_value()
-      ->mutable_relative_value()
-      ->mutable_relative_value()
-      ->set_int64_value(relative_value);
+  *put_op->mutable_put()
+       ->mutable_value()
+       ->mutable_relative_value()
+       ->mutable_relative_value() = relative_value;
 }
 
 std::string GetRandomAddress() {
@@ -104,6 +100,41 @@ int64_t GetRandomValue() {
   return rand() % 50 - 10;
 }
 
+// Returns the value to put for |op|.
+common::ConstantValue GetPutValue(const client::Operation& op) {
+  common::ConstantValue value;
+  switch (op.value_type_case()) {
+    case client::Operation::kRandomValue:
+      value.set_int64_value(GetRandomValue());
+      break;
+    case client::Operation::kStringValue:
+      value.set_string_value(op.string_value());
+      break;
+    case client::Operation::kDoubleValue:
+      value.set_double_value(op.double_value());
+      break;
+    default:
+      value.set_int64_value(op.value());
+  }
+  return value;
+}
+
+// Returns the relative value to add for |op|.
+common::NumericValue GetRelativePutValue(const client::Operation& op) {
+  common::NumericValue value;
+  switch (op.value_type_case()) {
+    case client::Operation::kRandomRelativeValue:
+      value.set_int64_value(GetRandomValue());
+      break;
+    case client::Operation::kRelativeDoubleValue:
+      value.set_double_value(op.relative_double_value());
+      break;
+    default:
+      value.set_int64_value(op.relative_value());
+  }
+  return value;
+}
+
 void AddOperation(
     const client::Operation& op,
     coordinator::CommitAtomicTransactionRequest& request, RunInfo& run_info,
@@ -126,14 +157,12 @@ void AddOperation(
   }
   if (op.type() == client::Operation::OP_TYPE_PUT) {
     put_keys_by_address[address].emplace(key);
-    if (op.value_type_case() == client::Operation::kRandomRelativeValue) {
-      AddRelativePutOp(request, address, key, GetRandomValue());
-    } else if (op.value_type_case() == client::Operation::kRelativeValue) {
-      AddRelativePutOp(request, address, key, op.relative_value());
-    } else if (op.value_type_case() == client::Operation::kRandomValue) {
-      AddPutOp(request, address, key, GetRandomValue());
+    if (op.value_type_case() == client::Operation::kRandomRelativeValue ||
+        op.value_type_case() == client::Operation::kRelativeValue ||
+        op.value_type_case() == client::Operation::kRelativeDoubleValue) {
+      AddRelativePutOp(request, address, key, GetRelativePutValue(op));
     } else {
-      AddPutOp(request, address, key, op.value());
+      AddPutOp(request, address, key, GetPutValue(op));
     }
   } else {
     AddGetOp(request, address, key);
@@ -0,0 +1,106 @@
+// Copies the db of a running cohort to bootstrap a new cohort or replica.
+//
+// Streams a snapshot from the cohort at --source_address into --db_data_dir,
+// which must not exist yet. The new cohort then serves the copy by starting
+// with the same --db_data_dir, --storage_engine=lmdb and --lmdb_shards as the
+// source.
+// Example cmd:
+//   bazel run //src/cohort:cohort_bootstrap_main -- \
+//       --source_address=10.0.0.1:50051 --db_data_dir=/tmp/data \
+//       --max_bytes_per_second=104857600
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "grpcpp/client_context.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "src/cohort/snapshot_transfer.h"
+#include "src/proto/cohort.grpc.pb.h"
+#include "src/utils/status_utils.h"
+
+ABSL_FLAG(std::string, source_address, "0.0.0.0:50051",
+          "Address of the cohort to copy the db from");
+ABSL_FLAG(std::string, db_data_dir, "/tmp/data",
+          "Directory to write the db to. Must not exist yet");
+ABSL_FLAG(uint64_t, max_bytes_per_second, 0,
+          "Maximum rate the source cohort sends the snapshot at, to limit "
+          "the impact on its transactions. 0 means no limit");
+ABSL_FLAG(uint32_t, max_chunk_bytes, 1 << 20,
+          "Maximum size of each streamed chunk");
+
+namespace {
+
+absl::Status Bootstrap(const std::string& db_data_dir) {
+  if (std::filesystem::exists(db_data_dir)) {
+    return absl::AlreadyExistsError(
+        absl::StrCat(db_data_dir, " already exists"));
+  }
+  // Only moved to |db_data_dir| once complete, so a failed copy is never
+  // served.
+  const std::string partial_dir = absl::StrCat(db_data_dir, ".partial");
+  std::filesystem::remove_all(partial_dir);
+
+  std::unique_ptr<cohort::Cohort::Stub> stub =
+      cohort::Cohort::NewStub(grpc::CreateChannel(
+          absl::GetFlag(FLAGS_source_address),
+          grpc::InsecureChannelCredentials()));
+  cohort::StreamSnapshotRequest request;
+  request.set_max_bytes_per_second(absl::GetFlag(FLAGS_max_bytes_per_second));
+  request.set_max_chunk_bytes(absl::GetFlag(FLAGS_max_chunk_bytes));
+  grpc::ClientContext context;
+  std::unique_ptr<grpc::ClientReaderInterface<cohort::SnapshotChunk>> reader =
+      stub->StreamSnapshot(&context, request);
+
+  const absl::Time start = absl::Now();
+  cohort::SnapshotReceiver receiver(partial_dir);
+  cohort::SnapshotChunk chunk;
+  absl::Status status;
+  while (status.ok() && reader->Read(&chunk)) {
+    status = receiver.Add(chunk);
+  }
+  if (!status.ok()) {
+    context.TryCancel();
+    reader->Finish();
+    return status;
+  }
+  status = utils::FromGrpcStatus(reader->Finish(),
+                                 "Streaming the snapshot failed: ");
+  if (status.ok()) {
+    status = receiver.Finish();
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  std::error_code error;
+  std::filesystem::rename(partial_dir, db_data_dir, error);
+  if (error) {
+    return absl::InternalError(absl::StrCat("Could not move ", partial_dir,
+                                            " to ", db_data_dir, ": ",
+                                            error.message()));
+  }
+  const double seconds = absl::ToDoubleSeconds(absl::Now() - start);
+  std::cout << "Copied " << receiver.bytes_received() << " bytes in "
+            << seconds << "s" << std::endl;
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  const absl::Status status = Bootstrap(absl::GetFlag(FLAGS_db_data_dir));
+  if (!status.ok()) {
+    std::cerr << "Bootstrap failed: " << status << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,13 +1,26 @@
 #include "src/cohort/cohort_server.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <string_view>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "glog/logging.h"
 #include "grpcpp/server_context.h"
 #include "src/blockchain/two_phase_commit.h"
+#include "src/cohort/execution_plan.h"
+#include "src/cohort/snapshot_transfer.h"
 #include "src/proto/cohort.grpc.pb.h"
 #include "src/utils/status_utils.h"
 
@@ -18,55 +31,258 @@ namespace {
 using Blockchain = ::blockchain::TwoPhaseCommit;
 using ::grpc::ServerContext;
 
+// Used when the streaming request doesn't set a chunk size.
+constexpr size_t kDefaultMaxChunkBytes = 1 << 20;
+
+// How long a background abort vote may take before it's given up on.
+constexpr absl::Duration kAbortVoteTimeout = absl::Minutes(1);
+
+// Times a failed commit is tried, with doubling waits in between, before the
+// cohort gives up and crashes.
+constexpr int kMaxCommitAttempts = 5;
+constexpr absl::Duration kInitialCommitBackoff = absl::Milliseconds(10);
+
+constexpr char kCommitRecordPrefix[] = "commit_";
+constexpr char kRecordSuffix[] = ".binarypb";
+
+bool IsRangeGet(const common::Operation& op) {
+  return op.has_get() && op.get().range_case() != common::Get::RANGE_NOT_SET;
+}
+
+// Returns the keys covered by a range get. A prefix covers every key from the
+// prefix up to (excluding) the prefix with its last byte incremented, after
+// dropping trailing 0xff bytes that can't be incremented.
+common::KeyRange ToKeyRange(const common::Get& get) {
+  if (get.has_key_range()) {
+    return get.key_range();
+  }
+  common::KeyRange range;
+  range.set_start_key(get.prefix());
+  std::string end_key = get.prefix();
+  while (!end_key.empty() && static_cast<uint8_t>(end_key.back()) == 0xff) {
+    end_key.pop_back();
+  }
+  // An empty end key leaves the range unbounded, which is correct for prefixes
+  // that are empty or all 0xff bytes.
+  if (!end_key.empty()) {
+    ++end_key.back();
+  }
+  range.set_end_key(end_key);
+  return range;
+}
+
+// Values are stored in the DB as serialized ConstantValues so they keep their
+// type. Parsing is the only time a value is copied out of the DB.
+absl::Status ParseValue(std::string_view bytes, const std::string& key,
+                        common::ConstantValue& value) {
+  if (!value.ParseFromArray(bytes.data(), static_cast<int>(bytes.size()))) {
+    return absl::DataLossError(
+        absl::StrCat("Stored value could not be parsed for key: ", key));
+  }
+  return absl::OkStatus();
+}
+
+common::ConstantValue ToConstantValue(const common::NumericValue& value) {
+  common::ConstantValue constant_value;
+  if (value.has_int64_value()) {
+    constant_value.set_int64_value(value.int64_value());
+  } else if (value.has_double_value()) {
+    constant_value.set_double_value(value.double_value());
+  }
+  return constant_value;
+}
+
+// Returns |value| increased by |relative_value|. Both must have the same
+// numeric type.
+absl::StatusOr<common::ConstantValue> AddRelativeValue(
+    const common::ConstantValue& value,
+    const common::NumericValue& relative_value) {
+  common::ConstantValue result;
+  if (value.has_int64_value() && relative_value.has_int64_value()) {
+    result.set_int64_value(value.int64_value() + relative_value.int64_value());
+  } else if (value.has_double_value() && relative_value.has_double_value()) {
+    result.set_double_value(value.double_value() +
+                            relative_value.double_value());
+  } else {
+    return absl::InvalidArgumentError(
+        "Relative value type doesn't match the current value type");
+  }
+  return result;
+}
+
 template <typename Message>
 bool WriteToFile(const Message& message, const std::string& path) {
   std::fstream output(path, std::ios::out | std::ios::trunc | std::ios::binary);
   return message.SerializeToOstream(&output);
 }
 
+absl::Status ErrnoError(const std::string& message) {
+  return absl::InternalError(absl::StrCat(message, ": ", std::strerror(errno)));
+}
+
+// Syncs the directory entries of |dir|, so files created or removed in it
+// stay that way after a crash.
+absl::Status SyncDirectory(const std::string& dir) {
+  const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return ErrnoError(absl::StrCat("Failed to open ", dir));
+  }
+  absl::Status status;
+  if (fsync(fd) != 0) {
+    status = ErrnoError(absl::StrCat("Failed to sync ", dir));
+  }
+  close(fd);
+  return status;
+}
+
+// Like WriteToFile, but only returns once the file and its directory entry
+// are on disk.
+template <typename Message>
+absl::Status WriteToFileDurably(const Message& message,
+                                const std::string& dir,
+                                const std::string& path) {
+  std::string data;
+  if (!message.SerializeToString(&data)) {
+    return absl::InternalError(absl::StrCat("Failed to serialize ", path));
+  }
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return ErrnoError(absl::StrCat("Failed to open ", path));
+  }
+  absl::Status status;
+  for (std::string_view rest = data; !rest.empty() && status.ok();) {
+    const ssize_t written = write(fd, rest.data(), rest.size());
+    if (written < 0 && errno != EINTR) {
+      status = ErrnoError(absl::StrCat("Failed to write ", path));
+    } else if (written > 0) {
+      rest.remove_prefix(written);
+    }
+  }
+  if (status.ok() && fsync(fd) != 0) {
+    status = ErrnoError(absl::StrCat("Failed to sync ", path));
+  }
+  close(fd);
+  if (!status.ok()) {
+    return status;
+  }
+  return SyncDirectory(dir);
+}
+
 }  // namespace
 
-absl::Mutex& CohortServer::GetLock(const std::string& key) {
-  std::unique_ptr<absl::Mutex>& lock = locks_by_key_[key];
+namespace internal {
+
+std::vector<GetTransactionResultResponse> ChunkTransactionResult(
+    GetTransactionResultResponse response, size_t max_chunk_bytes) {
+  std::vector<GetTransactionResultResponse> chunks;
+  if (!response.has_committed_response()) {
+    chunks.push_back(std::move(response));
+    return chunks;
+  }
+  size_t chunk_bytes = 0;
+  const auto start_chunk = [&chunks, &chunk_bytes]() {
+    chunks.emplace_back().mutable_committed_response();
+    chunk_bytes = 0;
+  };
+  start_chunk();
+  for (common::GetResponse& get_response :
+       *response.mutable_committed_response()->mutable_get_responses()) {
+    const size_t get_response_bytes = get_response.ByteSizeLong();
+    if (chunk_bytes > 0 && chunk_bytes + get_response_bytes > max_chunk_bytes) {
+      start_chunk();
+    }
+    common::CommittedResponse* chunk =
+        chunks.back().mutable_committed_response();
+    if (get_response_bytes <= max_chunk_bytes ||
+        get_response.key_values().empty()) {
+      chunk->add_get_responses()->Swap(&get_response);
+      chunk_bytes += get_response_bytes;
+      continue;
+    }
+    // Splits a range get that is too big for a single chunk.
+    common::GetResponse header;
+    *header.mutable_namespace_() = get_response.namespace_();
+    *header.mutable_get() = get_response.get();
+    const size_t header_bytes = header.ByteSizeLong();
+    common::GetResponse* part = nullptr;
+    for (common::KeyValue& key_value : *get_response.mutable_key_values()) {
+      const size_t key_value_bytes = key_value.ByteSizeLong();
+      if (part != nullptr && chunk_bytes + key_value_bytes > max_chunk_bytes) {
+        start_chunk();
+        chunks.back().set_continues_get_response(true);
+        chunk = chunks.back().mutable_committed_response();
+        part = nullptr;
+      }
+      if (part == nullptr) {
+        part = chunk->add_get_responses();
+        *part = header;
+        chunk_bytes += header_bytes;
+      }
+      part->add_key_values()->Swap(&key_value);
+      chunk_bytes += key_value_bytes;
+    }
+  }
+  return chunks;
+}
+
+}  // namespace internal
+
+absl::Mutex& CohortServer::GetLock(absl::string_view key) {
   absl::MutexLock locks_by_key_lock(&locks_by_key_mutex_);
+  auto it = locks_by_key_.find(key);
+  if (it == locks_by_key_.end()) {
+    it = locks_by_key_
+             .emplace(std::string(key), std::make_unique<absl::Mutex>())
+             .first;
+  }
+  return *it->second;
+}
+
+absl::Mutex& CohortServer::GetShardLock(size_t shard) {
+  absl::MutexLock locks_by_key_lock(&locks_by_key_mutex_);
+  std::unique_ptr<absl::Mutex>& lock = locks_by_shard_[shard];
   if (lock == nullptr) {
     lock = std::make_unique<absl::Mutex>();
   }
   return *lock;
 }
 
-absl::Status CohortServer::AcquireWholeDbLock(
+absl::Status CohortServer::AcquireShardLocks(
     const common::Transaction& transaction, absl::Time presumed_abort_time,
     internal::TransactionMetadata& txn_metadata) {
-  bool has_put = false;
-  bool has_get = false;
+  const size_t num_shards = txn_metadata.db->NumShards();
+  ArenaVector<bool> read_shards(num_shards, false, &txn_metadata.arena);
+  ArenaVector<bool> write_shards(num_shards, false, &txn_metadata.arena);
   for (const common::Operation& op : transaction.ops()) {
-    if (op.has_put()) {
-      has_put = true;
-    }
-    if (op.has_get()) {
-      has_get = true;
+    if (IsRangeGet(op)) {
+      // The range may have keys in every shard.
+      read_shards.assign(num_shards, true);
+    } else if (op.has_put()) {
+      write_shards[txn_metadata.db->GetShard(op.put().key())] = true;
+    } else if (op.has_get()) {
+      read_shards[txn_metadata.db->GetShard(op.get().key())] = true;
     }
-    if (has_put && has_get) {
-      break;
-    }
-  }
-  if (has_put) {
-    if (!whole_db_mutex_.WriterLockWhenWithDeadline(absl::Condition::kTrue,
-                                                    presumed_abort_time)) {
-      return absl::DeadlineExceededError(
-          "Could not acquire write lock for the DB before the abort deadline");
-    }
-    txn_metadata.has_whole_db_write_lock = true;
-    return absl::OkStatus();
   }
-  if (has_get) {
-    if (!whole_db_mutex_.ReaderLockWhenWithDeadline(absl::Condition::kTrue,
-                                                    presumed_abort_time)) {
-      return absl::DeadlineExceededError(
-          "Could not acquire read lock for the DB before the abort deadline");
+  // Locking in shard order prevents deadlocks between transactions that use
+  // several shards.
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    if (write_shards[shard]) {
+      if (!GetShardLock(shard).WriterLockWhenWithDeadline(
+              absl::Condition::kTrue, presumed_abort_time)) {
+        return absl::DeadlineExceededError(absl::StrCat(
+            "Could not acquire write lock for DB shard ", shard,
+            " before the abort deadline"));
+      }
+      txn_metadata.write_lock_shards.push_back(shard);
+    } else if (read_shards[shard]) {
+      if (!GetShardLock(shard).ReaderLockWhenWithDeadline(
+              absl::Condition::kTrue, presumed_abort_time)) {
+        return absl::DeadlineExceededError(absl::StrCat(
+            "Could not acquire read lock for DB shard ", shard,
+            " before the abort deadline"));
+      }
+      txn_metadata.read_lock_shards.push_back(shard);
     }
-    txn_metadata.has_whole_db_read_lock = true;
   }
   return absl::OkStatus();
 }
@@ -75,13 +291,19 @@ absl::Status CohortServer::AcquireDbLocks(
     const common::Transaction& transaction, absl::Time presumed_abort_time,
     internal::TransactionMetadata& txn_metadata) {
   if (!txn_metadata.db->SupportsConcurrentWrites()) {
-    return AcquireWholeDbLock(transaction, presumed_abort_time, txn_metadata);
+    return AcquireShardLocks(transaction, presumed_abort_time, txn_metadata);
   }
-  absl::flat_hash_set<std::string> write_and_readwrite_keys;
+  // Views into |transaction|, which outlives the locks.
+  ArenaHashSet<absl::string_view> write_and_readwrite_keys(&txn_metadata.arena);
   // Excludes any keys that are written to as well. Otherwise deadlocks could
   // occur if we wait for both the read and write locks.
-  absl::flat_hash_set<std::string> readonly_keys;
+  ArenaHashSet<absl::string_view> readonly_keys(&txn_metadata.arena);
+  ArenaVector<common::KeyRange> ranges(&txn_metadata.arena);
   for (const common::Operation& op : transaction.ops()) {
+    if (IsRangeGet(op)) {
+      ranges.push_back(ToKeyRange(op.get()));
+      continue;
+    }
     if (op.has_put()) {
       readonly_keys.erase(op.put().key());
       write_and_readwrite_keys.emplace(op.put().key());
@@ -91,7 +313,7 @@ absl::Status CohortServer::AcquireDbLocks(
     }
   }
 
-  for (const auto& read_key : readonly_keys) {
+  for (const absl::string_view read_key : readonly_keys) {
     if (!GetLock(read_key).ReaderLockWhenWithDeadline(absl::Condition::kTrue,
                                                       presumed_abort_time)) {
       return absl::DeadlineExceededError(
@@ -100,7 +322,7 @@ absl::Status CohortServer::AcquireDbLocks(
     }
     txn_metadata.read_lock_keys.push_back(read_key);
   }
-  for (const auto& write_key : write_and_readwrite_keys) {
+  for (const absl::string_view write_key : write_and_readwrite_keys) {
     if (!GetLock(write_key).WriterLockWhenWithDeadline(absl::Condition::kTrue,
                                                        presumed_abort_time)) {
       return absl::DeadlineExceededError(
@@ -109,67 +331,297 @@ absl::Status CohortServer::AcquireDbLocks(
     }
     txn_metadata.write_lock_keys.push_back(write_key);
   }
+  // Per-key locks only cover keys that are known upfront, so writes also need
+  // to be checked against the ranges other transactions are reading (and vice
+  // versa) to prevent phantoms.
+  if (txn_metadata.write_lock_keys.empty() && ranges.empty()) {
+    return absl::OkStatus();
+  }
+  if (!range_locks_.LockKeys(&txn_metadata, txn_metadata.write_lock_keys,
+                             presumed_abort_time)) {
+    return absl::DeadlineExceededError(
+        "Could not lock written keys against range reads before the abort "
+        "deadline");
+  }
+  txn_metadata.has_range_locks = true;
+  if (!range_locks_.LockRanges(&txn_metadata, ranges, presumed_abort_time)) {
+    return absl::DeadlineExceededError(
+        "Could not acquire range read locks before the abort deadline");
+  }
   return absl::OkStatus();
 }
 
-absl::Status CohortServer::ProcessOperationInDb(
-    const common::Operation& op, internal::TransactionMetadata& txn_metadata) {
-  if (op.has_get()) {
-    int64_t value;
-    RETURN_IF_ERROR(txn_metadata.db->Get(op.get().key(), value));
-    common::GetResponse* get_response =
-        txn_metadata.response.mutable_committed_response()->add_get_responses();
-    *get_response->mutable_get() = op.get();
-    *get_response->mutable_namespace_() = op.namespace_();
-    get_response->mutable_value()->set_int64_value(value);
+absl::Status CohortServer::ReadValues(
+    absl::Span<const std::string_view> keys,
+    internal::TransactionMetadata& txn_metadata,
+    std::vector<absl::optional<std::string_view>>& values,
+    std::vector<ReadCache::Value>& cached_values) {
+  if (read_cache_ == nullptr) {
+    return txn_metadata.db->MultiGet(keys, values);
+  }
+  values.assign(keys.size(), absl::nullopt);
+  ArenaVector<std::string_view> db_keys(&txn_metadata.arena);
+  ArenaVector<size_t> db_key_indices(&txn_metadata.arena);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!txn_metadata.writes.contains(keys[i])) {
+      if (ReadCache::Value value = read_cache_->Get(keys[i])) {
+        values[i] = *value;
+        cached_values.push_back(std::move(value));
+        continue;
+      }
+    }
+    db_keys.push_back(keys[i]);
+    db_key_indices.push_back(i);
+  }
+  if (db_keys.empty()) {
     return absl::OkStatus();
   }
-  if (op.has_put()) {
-    if (op.put().value().has_constant_value()) {
-      return txn_metadata.db->Put(
-          op.put().key(), op.put().value().constant_value().int64_value());
-    }
-    int64_t value;
-    absl::Status get_status = txn_metadata.db->Get(op.put().key(), value);
-    if (get_status.code() == absl::NotFoundError("").code() &&
-        op.put().value().relative_value().has_default_value()) {
-      value = op.put().value().relative_value().default_value().int64_value();
-    } else if (!get_status.ok()) {
-      return get_status;
-    }
-    return txn_metadata.db->Put(
-        op.put().key(),
-        value +
-            op.put().value().relative_value().relative_value().int64_value());
-  }
-  // No-op.
+  std::vector<absl::optional<std::string_view>> db_values;
+  RETURN_IF_ERROR(txn_metadata.db->MultiGet(db_keys, db_values));
+  for (size_t i = 0; i < db_keys.size(); ++i) {
+    values[db_key_indices[i]] = db_values[i];
+    // The transaction's locks keep others from writing the key, so the value
+    // can't change before the cache is updated by the next writer's commit.
+    if (db_values[i].has_value() &&
+        !txn_metadata.writes.contains(db_keys[i])) {
+      read_cache_->Insert(db_keys[i], std::string(*db_values[i]));
+    }
+  }
   return absl::OkStatus();
 }
 
+absl::Status CohortServer::ProcessOperationsInDb(
+    absl::Span<const common::Operation* const> ops,
+    internal::TransactionMetadata& txn_metadata) {
+  if (ops.empty()) {
+    return absl::OkStatus();
+  }
+  const ExecutionPlan plan = PlanOperations(ops, &txn_metadata.arena);
+  ArenaVector<std::string_view> read_keys(&txn_metadata.arena);
+  for (const KeyPlan& key_plan : plan.keys) {
+    if (key_plan.read) {
+      read_keys.push_back(*key_plan.key);
+    }
+  }
+  // Current value of each key of the plan. Reads are parsed right away since
+  // they are views into the DB that the write may invalidate.
+  std::vector<absl::optional<common::ConstantValue>> values(plan.keys.size());
+  if (!read_keys.empty()) {
+    std::vector<absl::optional<std::string_view>> read_values;
+    std::vector<ReadCache::Value> cached_values;
+    RETURN_IF_ERROR(
+        ReadValues(read_keys, txn_metadata, read_values, cached_values));
+    size_t read_index = 0;
+    for (size_t i = 0; i < plan.keys.size(); ++i) {
+      if (!plan.keys[i].read) {
+        continue;
+      }
+      const absl::optional<std::string_view>& read_value =
+          read_values[read_index++];
+      if (read_value.has_value()) {
+        RETURN_IF_ERROR(ParseValue(*read_value, *plan.keys[i].key,
+                                   values[i].emplace()));
+      }
+    }
+  }
+
+  // Runs the ops in order against the current values, so gets see earlier
+  // puts and relative puts fold into a single write.
+  for (size_t i = 0; i < ops.size(); ++i) {
+    const common::Operation& op = *ops[i];
+    const KeyPlan& key_plan = plan.keys[plan.op_keys[i]];
+    absl::optional<common::ConstantValue>& value = values[plan.op_keys[i]];
+    if (op.has_get()) {
+      if (!value.has_value()) {
+        return absl::NotFoundError(
+            absl::StrCat("Key could not be found: ", op.get().key()));
+      }
+      common::GetResponse* get_response =
+          txn_metadata.response.mutable_committed_response()
+              ->add_get_responses();
+      *get_response->mutable_get() = op.get();
+      *get_response->mutable_namespace_() = op.namespace_();
+      // Moved rather than copied (e.g. a large string value) once nothing
+      // else reads it.
+      if (key_plan.last_op == i && !key_plan.write) {
+        get_response->mutable_value()->Swap(&*value);
+      } else {
+        *get_response->mutable_value() = *value;
+      }
+      continue;
+    }
+    const common::Value& put_value = op.put().value();
+    if (put_value.has_constant_value()) {
+      value = put_value.constant_value();
+      continue;
+    }
+    if (!value.has_value()) {
+      if (!put_value.relative_value().has_default_value()) {
+        return absl::NotFoundError(
+            absl::StrCat("Key could not be found: ", op.put().key()));
+      }
+      value = ToConstantValue(put_value.relative_value().default_value());
+    }
+    ASSIGN_OR_RETURN(
+        common::ConstantValue new_value,
+        AddRelativeValue(*value, put_value.relative_value().relative_value()));
+    value = std::move(new_value);
+  }
+
+  size_t num_writes = 0;
+  for (const KeyPlan& key_plan : plan.keys) {
+    num_writes += key_plan.write ? 1 : 0;
+  }
+  if (num_writes == 0) {
+    return absl::OkStatus();
+  }
+  // Each value is serialized once, straight into the writes the commit needs,
+  // and the DB write points to it there. Reserving keeps the values from
+  // moving while it does. A failed write aborts the transaction, so the
+  // writes are never used then.
+  txn_metadata.writes.reserve(txn_metadata.writes.size() + num_writes);
+  ArenaVector<std::string_view> write_keys(&txn_metadata.arena);
+  ArenaVector<std::string_view> write_values(&txn_metadata.arena);
+  write_keys.reserve(num_writes);
+  write_values.reserve(num_writes);
+  for (size_t i = 0; i < plan.keys.size(); ++i) {
+    if (plan.keys[i].write) {
+      std::string& write_value = txn_metadata.writes[*plan.keys[i].key];
+      values[i]->SerializeToString(&write_value);
+      write_keys.push_back(*plan.keys[i].key);
+      write_values.push_back(write_value);
+    }
+  }
+  return txn_metadata.db->MultiPut(write_keys, write_values);
+}
+
+absl::Status CohortServer::ProcessRangeGetInDb(
+    const common::Operation& op, internal::TransactionMetadata& txn_metadata) {
+  const common::KeyRange range = ToKeyRange(op.get());
+  common::GetResponse* get_response =
+      txn_metadata.response.mutable_committed_response()->add_get_responses();
+  *get_response->mutable_get() = op.get();
+  *get_response->mutable_namespace_() = op.namespace_();
+  absl::Status parse_status;
+  RETURN_IF_ERROR(txn_metadata.db->Scan(
+      range.start_key(), range.end_key(), op.get().limit(),
+      [get_response, &parse_status](std::string_view key,
+                                    std::string_view value) {
+        common::KeyValue* key_value = get_response->add_key_values();
+        key_value->set_key(std::string(key));
+        parse_status.Update(
+            ParseValue(value, key_value->key(), *key_value->mutable_value()));
+      }));
+  return parse_status;
+}
+
 absl::Status CohortServer::ProcessTransactionInDb(
     const common::Transaction& transaction, absl::Time presumed_abort_time,
     internal::TransactionMetadata& txn_metadata) {
   RETURN_IF_ERROR(
       AcquireDbLocks(transaction, presumed_abort_time, txn_metadata));
   if (txn_metadata.write_lock_keys.empty() &&
-      !txn_metadata.has_whole_db_write_lock) {
+      txn_metadata.write_lock_shards.empty()) {
     RETURN_IF_ERROR(txn_metadata.db->BeginReadOnly());
   } else {
     RETURN_IF_ERROR(txn_metadata.db->Begin());
   }
+  // Plans the ops between range gets together, so each key is read and
+  // written at most once per run no matter how many ops use it.
+  ArenaVector<const common::Operation*> batch(&txn_metadata.arena);
   for (const common::Operation& op : transaction.ops()) {
-    RETURN_IF_ERROR(ProcessOperationInDb(op, txn_metadata));
+    if (!op.has_get() && !op.has_put()) {
+      // No-op.
+      continue;
+    }
+    if (IsRangeGet(op)) {
+      // Range gets run after the ops before them so they see their writes.
+      absl::Status status = ProcessOperationsInDb(batch, txn_metadata);
+      if (status.ok()) {
+        status = ProcessRangeGetInDb(op, txn_metadata);
+      }
+      if (!status.ok()) {
+        return status;
+      }
+      batch.clear();
+      continue;
+    }
+    batch.push_back(&op);
   }
-  return absl::OkStatus();
+  return ProcessOperationsInDb(batch, txn_metadata);
+}
+
+absl::Status CohortServer::Vote(const std::string& transaction_id,
+                                int cohort_index, blockchain::Ballot ballot,
+                                absl::Time deadline) {
+  if (vote_aggregator_ != nullptr) {
+    return vote_aggregator_->Vote(transaction_id, cohort_index, ballot);
+  }
+  return blockchain_->Vote(transaction_id, cohort_index, ballot, deadline);
+}
+
+void CohortServer::SignCommitVote(const std::string& transaction_id,
+                                  int cohort_index) {
+  // If signing fails, the coordinator can't commit the transaction, so it
+  // aborts at the presumed abort time.
+  absl::StatusOr<std::string> signature =
+      blockchain_->SignCommitVote(transaction_id, cohort_index);
+  if (!signature.ok()) {
+    LOG(WARNING) << "Failed to sign commit vote for " << transaction_id << ": "
+                 << signature.status();
+    return;
+  }
+  absl::MutexLock lock(&commit_signatures_mutex_);
+  commit_signatures_[transaction_id] = *std::move(signature);
+}
+
+void CohortServer::VoteAbortInBackground(const std::string& transaction_id,
+                                         int cohort_index) {
+  // It's okay if it fails since it will auto-abort at the presumed abort
+  // time.
+  if (vote_aggregator_ != nullptr) {
+    vote_aggregator_->Vote(transaction_id, cohort_index,
+                           blockchain::Ballot::BALLOT_ABORT)
+        .IgnoreError();
+    return;
+  }
+  blockchain_->VoteAsync(
+      transaction_id, cohort_index, blockchain::Ballot::BALLOT_ABORT,
+      absl::Now() + kAbortVoteTimeout, [transaction_id](absl::Status status) {
+        if (!status.ok()) {
+          LOG(WARNING) << "Failed to vote to abort " << transaction_id << ": "
+                       << status;
+        }
+      });
 }
 
 blockchain::VotingDecision CohortServer::WaitForBlockchainDecision(
     const std::string& transaction_id, absl::Time presumed_abort_time) {
+  if (decision_poller_ != nullptr) {
+    // The contract aborts transactions that are still pending at the presumed
+    // abort time, so this doesn't wait much longer than that.
+    return decision_poller_->WaitForDecision(
+        transaction_id, absl::InfiniteFuture(), presumed_abort_time);
+  }
   bool waited_until_presumed_abort_time = false;
   while (true) {
-    const blockchain::VotingDecision decision =
-        blockchain_->GetVotingDecision(transaction_id)
-            .value_or(blockchain::VotingDecision::VOTING_DECISION_PENDING);
+    const absl::Time now = absl::Now();
+    const absl::StatusOr<blockchain::VotingDecision> status_or_decision =
+        blockchain_->GetVotingDecision(transaction_id);
+    blockchain::VotingDecision decision =
+        blockchain::VotingDecision::VOTING_DECISION_PENDING;
+    if (status_or_decision.ok()) {
+      decision = *status_or_decision;
+    } else if (absl::IsFailedPrecondition(status_or_decision.status())) {
+      // The contract reverts if the voting hasn't started.
+      decision = blockchain::VotingDecision::VOTING_DECISION_UNKNOWN;
+    }
+    if (decision == blockchain::VotingDecision::VOTING_DECISION_UNKNOWN &&
+        now >= presumed_abort_time) {
+      // The contract can't start the voting past its timeout, e.g. if the
+      // coordinator failed to start it, so it will never be decided.
+      return blockchain::VotingDecision::VOTING_DECISION_ABORT;
+    }
     if (decision != blockchain::VotingDecision::VOTING_DECISION_PENDING &&
         decision != blockchain::VotingDecision::VOTING_DECISION_UNKNOWN) {
       return decision;
@@ -185,17 +637,14 @@ blockchain::VotingDecision CohortServer::WaitForBlockchainDecision(
   }
 }
 
-void CohortServer::AbortTransaction(const std::string& transaction_id,
-                                    int cohort_index,
-                                    absl::optional<absl::Status> abort_status) {
+void CohortServer::AbortTransaction(
+    const std::string& transaction_id, int cohort_index,
+    absl::optional<absl::Status> abort_status,
+    internal::TransactionMetadata& txn_metadata) {
   common::AbortReason abort_reason;
   if (abort_status.has_value()) {
     LOG(INFO) << "Aborting due to " << abort_status.value();
-    // It's okay if it fails since it will auto-abort at the presumed abort
-    // time.
-    blockchain_
-        ->Vote(transaction_id, cohort_index, blockchain::Ballot::BALLOT_ABORT)
-        .IgnoreError();
+    VoteAbortInBackground(transaction_id, cohort_index);
     switch (abort_status->code()) {
       case absl::StatusCode::kDeadlineExceeded:
         abort_reason = common::ABORT_REASON_PRESUMED_ABORT_TIMESTAMP_REACHED;
@@ -203,44 +652,177 @@ void CohortServer::AbortTransaction(const std::string& transaction_id,
       case absl::StatusCode::kNotFound:
         abort_reason = common::ABORT_REASON_OPERATION_FOR_NON_EXISTENT_VALUE;
         break;
+      case absl::StatusCode::kInvalidArgument:
+        abort_reason = common::ABORT_REASON_RELATIVE_VALUE_INVALID_TYPE;
+        break;
       default:
         abort_reason = common::ABORT_REASON_UNSPECIFIED;
     }
   }
-  metadata_by_transaction_id_[transaction_id].response.set_aborted_response(
-      abort_reason);
+  txn_metadata.response.set_aborted_response(abort_reason);
   // TODO(benjmarks22): Maybe add retry logic here?
-  metadata_by_transaction_id_[transaction_id].db->Abort().IgnoreError();
-  ReleaseLocksAndDeleteMetadata(transaction_id);
+  txn_metadata.db->Abort().IgnoreError();
+  ReleaseLocksAndDeleteMetadata(transaction_id, txn_metadata);
 }
 
-void CohortServer::CommitTransaction(const std::string& transaction_id) {
-  // The database must commit the transaction at this point, so the only
-  // acceptable failures are transient ones (e.g. deadline exceeded). Thus we
-  // retry until it succeeds.
-  while (true) {
-    absl::Status commit_status =
-        metadata_by_transaction_id_[transaction_id].db->Commit();
-    if (commit_status.ok()) {
-      break;
+void CohortServer::CommitTransaction(
+    const std::string& transaction_id,
+    internal::TransactionMetadata& txn_metadata) {
+  // A crash between the commits of the shards would leave the transaction
+  // partially committed, so its writes are recorded on disk first. No shard
+  // is committed until the record is, and if it can't be written the disk is
+  // failing, so the cohort crashes rather than risk a partial commit.
+  const bool recorded = txn_metadata.write_lock_shards.size() > 1;
+  if (recorded) {
+    absl::Status record_status =
+        WriteCommitRecord(transaction_id, txn_metadata);
+    absl::Duration backoff = kInitialCommitBackoff;
+    for (int attempt = 1; !record_status.ok(); ++attempt) {
+      if (attempt >= kMaxCommitAttempts) {
+        LOG(FATAL) << "Failed to record the commit of " << transaction_id
+                   << ": " << record_status;
+      }
+      LOG(WARNING) << "Failed to record the commit of " << transaction_id
+                   << ": " << record_status << ". Retrying";
+      absl::SleepFor(backoff);
+      backoff *= 2;
+      record_status = WriteCommitRecord(transaction_id, txn_metadata);
+    }
+  }
+  absl::Status commit_status = txn_metadata.db->Commit();
+  // A failed commit may have ended the DB transaction (e.g. LMDB frees it), so
+  // retrying it can't work. The writes are redone in a new transaction
+  // instead, while the locks are still held.
+  absl::Duration backoff = kInitialCommitBackoff;
+  for (int attempt = 1; !commit_status.ok(); ++attempt) {
+    if (!VoteSender::IsTransient(commit_status) ||
+        attempt >= kMaxCommitAttempts) {
+      if (!recorded) {
+        const absl::Status record_status =
+            WriteCommitRecord(transaction_id, txn_metadata);
+        if (!record_status.ok()) {
+          LOG(ERROR) << "Failed to record the commit of " << transaction_id
+                     << ": " << record_status;
+        }
+      }
+      LOG(FATAL) << "Failed to commit transaction " << transaction_id << ": "
+                 << commit_status
+                 << ". Its recorded writes are redone on restart";
+    }
+    LOG(WARNING) << "Failed to commit transaction " << transaction_id << ": "
+                 << commit_status << ". Redoing its writes";
+    absl::SleepFor(backoff);
+    backoff *= 2;
+    txn_metadata.db->Abort().IgnoreError();
+    CommitRecord record;
+    record.mutable_writes()->insert(txn_metadata.writes.begin(),
+                                    txn_metadata.writes.end());
+    commit_status = RedoWrites(record, *txn_metadata.db);
+  }
+  if (recorded) {
+    std::error_code error;
+    // A record left behind would be redone over later transactions' writes.
+    if (!std::filesystem::remove(CommitRecordPath(transaction_id), error)) {
+      LOG(FATAL) << "Failed to remove the commit record of " << transaction_id
+                 << ": " << error.message();
+    }
+    const absl::Status sync_status = SyncDirectory(db_txn_response_dir_);
+    if (!sync_status.ok()) {
+      LOG(FATAL) << "Failed to remove the commit record of " << transaction_id
+                 << ": " << sync_status;
+    }
+  }
+  // The keys are still write locked, so no transaction can read the old values
+  // from the cache after the commit.
+  if (read_cache_ != nullptr) {
+    for (auto& [key, value] : txn_metadata.writes) {
+      read_cache_->Update(key, std::move(value));
     }
-    LOG(WARNING) << "Failed to commit transaction " << commit_status
-                 << ". Retrying";
   }
   // This is necessary if it's a write only transaction to ensure the response
   // indicates that it committed.
-  metadata_by_transaction_id_[transaction_id]
-      .response.mutable_committed_response();
-  ReleaseLocksAndDeleteMetadata(transaction_id);
+  txn_metadata.response.mutable_committed_response();
+  ReleaseLocksAndDeleteMetadata(transaction_id, txn_metadata);
+}
+
+std::string CohortServer::CommitRecordPath(
+    const std::string& transaction_id) const {
+  return absl::StrCat(db_txn_response_dir_, "/", kCommitRecordPrefix,
+                      transaction_id, kRecordSuffix);
+}
+
+absl::Status CohortServer::WriteCommitRecord(
+    const std::string& transaction_id,
+    const internal::TransactionMetadata& txn_metadata) {
+  CommitRecord record;
+  record.set_transaction_id(transaction_id);
+  record.mutable_writes()->insert(txn_metadata.writes.begin(),
+                                  txn_metadata.writes.end());
+  return WriteToFileDurably(record, db_txn_response_dir_,
+                            CommitRecordPath(transaction_id));
+}
+
+absl::Status CohortServer::RedoWrites(const CommitRecord& record,
+                                      db::DatabaseTransactionAdapter& db) {
+  std::vector<std::string_view> keys;
+  std::vector<std::string_view> values;
+  keys.reserve(record.writes_size());
+  values.reserve(record.writes_size());
+  for (const auto& [key, value] : record.writes()) {
+    keys.push_back(key);
+    values.push_back(value);
+  }
+  RETURN_IF_ERROR(db.Begin());
+  absl::Status status = db.MultiPut(keys, values);
+  if (status.ok()) {
+    status = db.Commit();
+  }
+  if (!status.ok()) {
+    db.Abort().IgnoreError();
+  }
+  return status;
+}
+
+absl::Status CohortServer::RecoverCommits() {
+  std::error_code error;
+  std::filesystem::directory_iterator files(db_txn_response_dir_, error);
+  if (error) {
+    return absl::InternalError(absl::StrCat(
+        "Could not list ", db_txn_response_dir_, ": ", error.message()));
+  }
+  for (const std::filesystem::directory_entry& file : files) {
+    const std::string name = file.path().filename().string();
+    if (!absl::StartsWith(name, kCommitRecordPrefix) ||
+        !absl::EndsWith(name, kRecordSuffix)) {
+      continue;
+    }
+    CommitRecord record;
+    std::ifstream input(file.path(), std::ios::binary);
+    if (!record.ParseFromIstream(&input)) {
+      return absl::DataLossError(
+          absl::StrCat("Could not parse commit record ", file.path().string()));
+    }
+    LOG(INFO) << "Redoing the interrupted commit of "
+              << record.transaction_id();
+    const std::unique_ptr<db::DatabaseTransactionAdapter> db =
+        db_transaction_adapter_creator_();
+    RETURN_IF_ERROR(RedoWrites(record, *db));
+    if (!std::filesystem::remove(file.path(), error)) {
+      return absl::InternalError(
+          absl::StrCat("Could not remove commit record ",
+                       file.path().string(), ": ", error.message()));
+    }
+  }
+  return absl::OkStatus();
 }
 
 absl::Status CohortServer::PersistTransaction(
-    const PrepareTransactionRequest& request) {
+    const PrepareTransactionRequest& request,
+    const internal::TransactionMetadata& txn_metadata) {
   const std::string& response_path =
       absl::StrCat(db_txn_response_dir_, "/response_", request.transaction_id(),
                    ".binarypb");
-  if (!WriteToFile(metadata_by_transaction_id_[request.transaction_id()]
-                       .response.committed_response(),
+  if (!WriteToFile(txn_metadata.response.committed_response(),
                    response_path)) {
     return absl::InternalError(
         "Failed to write transaction responses to disk.");
@@ -254,9 +836,8 @@ absl::Status CohortServer::PersistTransaction(
 }
 
 void CohortServer::ProcessTransaction(
-    const PrepareTransactionRequest& request) {
-  internal::TransactionMetadata& metadata =
-      metadata_by_transaction_id_[request.transaction_id()];
+    const PrepareTransactionRequest& request,
+    internal::TransactionMetadata& metadata) {
   metadata.response.mutable_pending_response();
   metadata.db = db_transaction_adapter_creator_();
   const absl::Time presumed_abort_time =
@@ -267,44 +848,69 @@ void CohortServer::ProcessTransaction(
       request.transaction(), presumed_abort_time, metadata);
   if (!db_status.ok()) {
     AbortTransaction(request.transaction_id(), request.cohort_index(),
-                     db_status);
+                     db_status, metadata);
     return;
   }
   if (request.only_cohort()) {
-    CommitTransaction(request.transaction_id());
+    CommitTransaction(request.transaction_id(), metadata);
     return;
   }
 
-  const absl::Status persist_status = PersistTransaction(request);
+  const absl::Status persist_status = PersistTransaction(request, metadata);
   if (!persist_status.ok()) {
     AbortTransaction(request.transaction_id(), request.cohort_index(),
-                     persist_status);
+                     persist_status, metadata);
     return;
   }
 
   // It's not safe to abort if there's an error here since the blockchain may
   // have accepted our commit vote and decided to commit the transaction.
-  // TODO(benjmarks22): Add retry logic here.
-  blockchain_
-      ->Vote(request.transaction_id(), request.cohort_index(),
-             blockchain::Ballot::BALLOT_COMMIT)
-      .IgnoreError();
+  // Transient errors are retried until the presumed abort time, after which
+  // the contract rejects the vote anyway.
+  if (request.sign_commit_vote()) {
+    SignCommitVote(request.transaction_id(), request.cohort_index());
+  } else {
+    const absl::Status vote_status = vote_sender_->Vote(
+        request.transaction_id(), request.cohort_index(),
+        blockchain::Ballot::BALLOT_COMMIT, presumed_abort_time);
+    if (!vote_status.ok()) {
+      LOG(WARNING) << "Failed to vote to commit " << request.transaction_id()
+                   << ": " << vote_status;
+    }
+  }
   if (WaitForBlockchainDecision(request.transaction_id(),
                                 presumed_abort_time) ==
       blockchain::VotingDecision::VOTING_DECISION_COMMIT) {
-    CommitTransaction(request.transaction_id());
+    CommitTransaction(request.transaction_id(), metadata);
   } else {
     AbortTransaction(request.transaction_id(), request.cohort_index(),
-                     absl::nullopt);
+                     absl::nullopt, metadata);
   }
 }
 
 grpc::Status CohortServer::PrepareTransaction(
     ServerContext* /*context*/, const PrepareTransactionRequest* request,
     PrepareTransactionResponse* /*response*/) {
+  // Registering the transaction before queueing it lets GetTransactionResult
+  // report it as pending while it waits for a DB thread. Duplicate requests are
+  // ignored since the transaction is already being (or has been) processed.
+  if (final_responses_.Contains(request->transaction_id())) {
+    return grpc::Status::OK;
+  }
+  auto [metadata, inserted] =
+      metadata_by_transaction_id_.TryEmplace(request->transaction_id());
+  if (!inserted) {
+    return grpc::Status::OK;
+  }
+  // The transaction may have finished since the first check. Its final
+  // response is stored before its metadata is deleted, so it's found now.
+  if (final_responses_.Contains(request->transaction_id())) {
+    metadata_by_transaction_id_.Erase(request->transaction_id());
+    return grpc::Status::OK;
+  }
   const PrepareTransactionRequest& request_non_pointer = *request;
-  thread_pool_.push_task([this, request_non_pointer]() {
-    return ProcessTransaction(request_non_pointer);
+  thread_pool_.push_task([this, request_non_pointer, metadata = metadata]() {
+    return ProcessTransaction(request_non_pointer, *metadata);
   });
   return grpc::Status::OK;
 }
@@ -312,35 +918,129 @@ grpc::Status CohortServer::PrepareTransaction(
 grpc::Status CohortServer::GetTransactionResult(
     ServerContext* /*context*/, const GetTransactionResultRequest* request,
     GetTransactionResultResponse* response) {
-  if (final_response_by_transaction_id_.contains(request->transaction_id())) {
-    *response = final_response_by_transaction_id_[request->transaction_id()];
-  } else {
+  // The in-flight table must be checked first. The final response is stored
+  // before the in-flight metadata is deleted, so a transaction missing from
+  // both has either never been received or its final response has expired.
+  if (metadata_by_transaction_id_.Contains(request->transaction_id())) {
     response->mutable_pending_response();
+    absl::MutexLock lock(&commit_signatures_mutex_);
+    const auto it = commit_signatures_.find(request->transaction_id());
+    if (it != commit_signatures_.end()) {
+      response->set_commit_signature(it->second);
+    }
+    return grpc::Status::OK;
+  }
+  absl::optional<GetTransactionResultResponse> final_response =
+      final_responses_.Get(request->transaction_id());
+  if (!final_response.has_value()) {
+    return grpc::Status(grpc::NOT_FOUND,
+                        "Transaction was never received or its result expired");
+  }
+  response->Swap(&final_response.value());
+  return grpc::Status::OK;
+}
+
+grpc::Status CohortServer::StreamTransactionResult(
+    ServerContext* context, const StreamTransactionResultRequest* request,
+    grpc::ServerWriter<GetTransactionResultResponse>* writer) {
+  GetTransactionResultRequest result_request;
+  result_request.set_transaction_id(request->transaction_id());
+  GetTransactionResultResponse response;
+  const grpc::Status status =
+      GetTransactionResult(context, &result_request, &response);
+  if (!status.ok()) {
+    return status;
+  }
+  const size_t max_chunk_bytes = request->max_chunk_bytes() > 0
+                                     ? request->max_chunk_bytes()
+                                     : kDefaultMaxChunkBytes;
+  for (const GetTransactionResultResponse& chunk :
+       internal::ChunkTransactionResult(std::move(response),
+                                        max_chunk_bytes)) {
+    if (!writer->Write(chunk)) {
+      return grpc::Status(grpc::CANCELLED,
+                          "Stream closed before the whole result was sent");
+    }
+  }
+  return grpc::Status::OK;
+}
+
+grpc::Status CohortServer::GetReadCacheStats(
+    ServerContext* /*context*/, const GetReadCacheStatsRequest* /*request*/,
+    GetReadCacheStatsResponse* response) {
+  if (read_cache_ == nullptr) {
+    return grpc::Status(grpc::FAILED_PRECONDITION,
+                        "The read cache is disabled");
+  }
+  const ReadCacheStats stats = read_cache_->GetStats();
+  response->set_hits(stats.hits);
+  response->set_misses(stats.misses);
+  response->set_hit_ratio(stats.HitRatio());
+  response->set_evictions(stats.evictions);
+  response->set_entries(stats.entries);
+  response->set_bytes(stats.bytes);
+  return grpc::Status::OK;
+}
+
+grpc::Status CohortServer::StreamSnapshot(
+    ServerContext* /*context*/, const StreamSnapshotRequest* request,
+    grpc::ServerWriter<SnapshotChunk>* writer) {
+  if (write_snapshot_ == nullptr) {
+    return grpc::Status(grpc::FAILED_PRECONDITION,
+                        "The storage engine doesn't support snapshots");
+  }
+  // The snapshot is written to disk before it's sent, so a slow receiver
+  // doesn't keep the DB's read transaction open. Writing it is throttled
+  // too, so the copy doesn't take the disk from transactions.
+  const std::string snapshot_dir =
+      absl::StrCat(snapshot_dir_, "/snapshot_", next_snapshot_id_++);
+  std::filesystem::remove_all(snapshot_dir);
+  absl::Status status =
+      write_snapshot_(snapshot_dir, request->max_bytes_per_second());
+  if (status.ok()) {
+    SnapshotSendOptions options;
+    if (request->max_chunk_bytes() > 0) {
+      options.max_chunk_bytes = request->max_chunk_bytes();
+    }
+    options.max_bytes_per_second = request->max_bytes_per_second();
+    status = SendSnapshot(snapshot_dir, options,
+                          [writer](const SnapshotChunk& chunk) {
+                            return writer->Write(chunk);
+                          });
+  }
+  std::filesystem::remove_all(snapshot_dir);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to stream a snapshot: " << status;
+    return utils::FromAbslStatus(status, "Failed to stream the snapshot:");
   }
   return grpc::Status::OK;
 }
 
 void CohortServer::ReleaseLocksAndDeleteMetadata(
-    const std::string& transaction_id) {
-  for (const auto& write_key :
-       metadata_by_transaction_id_[transaction_id].write_lock_keys) {
+    const std::string& transaction_id,
+    internal::TransactionMetadata& txn_metadata) {
+  for (const absl::string_view write_key : txn_metadata.write_lock_keys) {
     GetLock(write_key).WriterUnlock();
   }
-  for (const auto& read_key :
-       metadata_by_transaction_id_[transaction_id].read_lock_keys) {
+  for (const absl::string_view read_key : txn_metadata.read_lock_keys) {
     GetLock(read_key).ReaderUnlock();
   }
-  if (metadata_by_transaction_id_[transaction_id].has_whole_db_write_lock) {
-    whole_db_mutex_.WriterUnlock();
+  if (txn_metadata.has_range_locks) {
+    range_locks_.Unlock(&txn_metadata);
+  }
+  for (const size_t shard : txn_metadata.write_lock_shards) {
+    GetShardLock(shard).WriterUnlock();
   }
-  if (metadata_by_transaction_id_[transaction_id].has_whole_db_read_lock) {
-    whole_db_mutex_.ReaderUnlock();
+  for (const size_t shard : txn_metadata.read_lock_shards) {
+    GetShardLock(shard).ReaderUnlock();
   }
   // Should be faster than copying the response and the metadata one gets
-  // deleted right after.
-  final_response_by_transaction_id_[transaction_id].Swap(
-      &metadata_by_transaction_id_[transaction_id].response);
-  metadata_by_transaction_id_.erase(transaction_id);
+  // deleted right after. It must be stored before the metadata is deleted so
+  // GetTransactionResult never sees the transaction in neither table.
+  final_responses_.Insert(transaction_id, std::move(txn_metadata.response));
+  metadata_by_transaction_id_.Erase(transaction_id);
+  absl::MutexLock lock(&commit_signatures_mutex_);
+  commit_signatures_.erase(transaction_id);
 }
 
 }  // namespace cohort
\ No newline at end of file
@@ -2,40 +2,167 @@
 
 #define SRC_COHORT_COHORT_SERVER_H_
 
+#include <atomic>
+#include <functional>
 #include <thread>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/statusor.h"
 #include "grpcpp/server_context.h"
+#include "absl/time/time.h"
+#include "src/blockchain/decision_poller.h"
 #include "src/blockchain/two_phase_commit.h"
+#include "src/cohort/final_response_store.h"
+#include "src/cohort/range_lock_table.h"
+#include "src/cohort/read_cache.h"
+#include "src/cohort/transaction_arena.h"
+#include "src/cohort/vote_aggregator.h"
+#include "src/cohort/vote_sender.h"
 #include "src/db/database_transaction_adapter.h"
 #include "src/proto/cohort.grpc.pb.h"
+#include "src/utils/sharded_map.h"
 #include "thread_pool.hpp"
 
 namespace cohort {
 
 namespace internal {
 struct TransactionMetadata {
+  TransactionMetadata()
+      : read_lock_shards(&arena),
+        write_lock_shards(&arena),
+        read_lock_keys(&arena),
+        write_lock_keys(&arena) {}
+
+  // Holds the transaction's scratch data, which is all freed at once with the
+  // metadata. Declared first so it outlives the containers using it.
+  TransactionArena arena;
+  // The response outlives the transaction in the final response store, so it
+  // isn't in the arena.
   GetTransactionResultResponse response;
   std::unique_ptr<db::DatabaseTransactionAdapter> db;
-  bool has_whole_db_read_lock;
-  bool has_whole_db_write_lock;
-  std::vector<std::string> read_lock_keys;
-  std::vector<std::string> write_lock_keys;
+  // Shards locked for DBs that don't support concurrent write transactions.
+  ArenaVector<size_t> read_lock_shards;
+  ArenaVector<size_t> write_lock_shards;
+  // Views into the keys of the request, which outlives the metadata's locks.
+  ArenaVector<absl::string_view> read_lock_keys;
+  ArenaVector<absl::string_view> write_lock_keys;
+  bool has_range_locks = false;
+  // Latest value the transaction wrote to each key, to update the read cache
+  // with on commit and to redo the commit from if it fails. Reads of these
+  // keys bypass the cache since they must see the uncommitted value.
+  absl::flat_hash_map<std::string, std::string> writes;
 };
+
+// Splits |response| into responses whose committed get responses add up to
+// roughly |max_chunk_bytes| at most. Range gets that don't fit in one chunk
+// have their key values split over several get responses, each repeating the
+// namespace and get, and each chunk but the first of such a split sets
+// continues_get_response. Pending and aborted responses are a single chunk.
+std::vector<GetTransactionResultResponse> ChunkTransactionResult(
+    GetTransactionResultResponse response, size_t max_chunk_bytes);
 }  // namespace internal
 
+struct CohortServerOptions {
+  // Maximum number of final transaction responses kept for the coordinator to
+  // fetch. The oldest responses are evicted first.
+  size_t max_final_responses = 100000;
+  // How long final transaction responses are kept for the coordinator to
+  // fetch.
+  absl::Duration final_response_ttl = absl::Minutes(10);
+  // Size of the cache of committed values in front of the DB. Zero disables
+  // the cache.
+  size_t read_cache_bytes = 0;
+  // Writes a consistent copy of the DB into the given directory while
+  // transactions keep running, at most at the given bytes per second (0
+  // means no limit). Null if the DB doesn't support snapshots.
+  std::function<absl::Status(const std::string& dir,
+                             uint64_t max_bytes_per_second)>
+      write_snapshot;
+  // Directory to write snapshots to while they are streamed.
+  std::string snapshot_dir = "/tmp/cohort_snapshots";
+  // Longest a vote waits to be sent to the blockchain together with other
+  // transactions' votes. Zero sends every vote in its own blockchain
+  // transaction.
+  absl::Duration vote_batch_window = absl::ZeroDuration();
+  // Maximum number of votes sent in one blockchain transaction.
+  size_t max_vote_batch_size = 64;
+  // How often the decisions of all the transactions waiting for the
+  // blockchain are fetched together. Zero makes each transaction poll its own
+  // decision.
+  absl::Duration decision_poll_interval = absl::ZeroDuration();
+  // Whether to also stream the decisions from the blockchain, so waiting
+  // transactions learn them within a block instead of at the next poll. Only
+  // used with a decision_poll_interval.
+  bool watch_decisions = false;
+  // Maximum number of times a commit vote is sent to the blockchain while it
+  // fails transiently, before the transaction is left to abort at its
+  // presumed abort time. One disables retries.
+  int max_vote_attempts = 5;
+  // Wait before the first retry of a commit vote, doubled for each later
+  // one.
+  absl::Duration vote_retry_backoff = absl::Milliseconds(10);
+  // How long each attempt to send a commit vote may take before it's retried.
+  absl::Duration vote_attempt_timeout = absl::Seconds(30);
+  // Number of consecutive transient vote failures that stop votes from being
+  // sent for vote_circuit_breaker_cooldown. Zero disables the breaker.
+  int vote_circuit_breaker_failures = 20;
+  absl::Duration vote_circuit_breaker_cooldown = absl::Seconds(1);
+};
+
 class CohortServer : public Cohort::Service {
  public:
   CohortServer(uint num_db_threads, const std::string& db_txn_response_dir,
                std::function<std::unique_ptr<db::DatabaseTransactionAdapter>()>
                    db_transaction_adapter_creator,
-               std::unique_ptr<blockchain::TwoPhaseCommit> blockchain)
-      : thread_pool_(num_db_threads),
+               std::unique_ptr<blockchain::TwoPhaseCommit> blockchain,
+               const CohortServerOptions& options = CohortServerOptions())
+      : final_responses_(options.max_final_responses,
+                         options.final_response_ttl),
         db_txn_response_dir_(db_txn_response_dir),
         db_transaction_adapter_creator_(db_transaction_adapter_creator),
-        blockchain_(blockchain.release()) {}
+        write_snapshot_(options.write_snapshot),
+        snapshot_dir_(options.snapshot_dir),
+        blockchain_(blockchain.release()),
+        thread_pool_(num_db_threads) {
+    if (options.read_cache_bytes > 0) {
+      ReadCacheOptions read_cache_options;
+      read_cache_options.max_bytes = options.read_cache_bytes;
+      read_cache_ = std::make_unique<ReadCache>(read_cache_options);
+    }
+    if (options.vote_batch_window > absl::ZeroDuration()) {
+      utils::BatcherOptions vote_aggregator_options;
+      vote_aggregator_options.max_batch_size = options.max_vote_batch_size;
+      vote_aggregator_options.max_delay = options.vote_batch_window;
+      vote_aggregator_ = std::make_unique<VoteAggregator>(
+          blockchain_.get(), vote_aggregator_options);
+    }
+    if (options.decision_poll_interval > absl::ZeroDuration()) {
+      blockchain::DecisionPollerOptions decision_poller_options;
+      decision_poller_options.poll_interval = options.decision_poll_interval;
+      decision_poller_options.watch_decisions = options.watch_decisions;
+      decision_poller_ = std::make_unique<blockchain::DecisionPoller>(
+          blockchain_.get(), decision_poller_options);
+    }
+    VoteSenderOptions vote_sender_options;
+    vote_sender_options.max_attempts = options.max_vote_attempts;
+    vote_sender_options.initial_backoff = options.vote_retry_backoff;
+    vote_sender_options.attempt_timeout = options.vote_attempt_timeout;
+    vote_sender_options.circuit_breaker_failures =
+        options.vote_circuit_breaker_failures;
+    vote_sender_options.circuit_breaker_cooldown =
+        options.vote_circuit_breaker_cooldown;
+    vote_sender_ = std::make_unique<VoteSender>(
+        [this](const std::string& transaction_id, int cohort_index,
+               blockchain::Ballot ballot, absl::Time attempt_deadline) {
+          return Vote(transaction_id, cohort_index, ballot, attempt_deadline);
+        },
+        vote_sender_options);
+  }
+
+  // Redoes the commits a crash interrupted, from the commit records left in
+  // the response directory. Must be called before serving transactions.
+  absl::Status RecoverCommits();
 
   grpc::Status PrepareTransaction(
       grpc::ServerContext* context, const PrepareTransactionRequest* request,
@@ -45,54 +172,154 @@ class CohortServer : public Cohort::Service {
       grpc::ServerContext* context, const GetTransactionResultRequest* request,
       GetTransactionResultResponse* response) override;
 
+  grpc::Status StreamTransactionResult(
+      grpc::ServerContext* context,
+      const StreamTransactionResultRequest* request,
+      grpc::ServerWriter<GetTransactionResultResponse>* writer) override;
+
+  grpc::Status GetReadCacheStats(grpc::ServerContext* context,
+                                 const GetReadCacheStatsRequest* request,
+                                 GetReadCacheStatsResponse* response) override;
+
+  grpc::Status StreamSnapshot(
+      grpc::ServerContext* context, const StreamSnapshotRequest* request,
+      grpc::ServerWriter<SnapshotChunk>* writer) override;
+
  private:
-  absl::Mutex& GetLock(const std::string& key);
+  absl::Mutex& GetLock(absl::string_view key);
+
+  absl::Mutex& GetShardLock(size_t shard);
 
-  absl::Status AcquireWholeDbLock(const common::Transaction& transaction,
-                                  absl::Time presumed_abort_time,
-                                  internal::TransactionMetadata& txn_metadata);
+  // Locks the shards a transaction uses, exclusively if it writes to them.
+  absl::Status AcquireShardLocks(const common::Transaction& transaction,
+                                 absl::Time presumed_abort_time,
+                                 internal::TransactionMetadata& txn_metadata);
 
   absl::Status AcquireDbLocks(const common::Transaction& transaction,
                               absl::Time presumed_abort_time,
                               internal::TransactionMetadata& txn_metadata);
 
-  void ProcessTransaction(const PrepareTransactionRequest& request);
+  void ProcessTransaction(const PrepareTransactionRequest& request,
+                          internal::TransactionMetadata& metadata);
+
+  // Votes on the blockchain, batched with other transactions' votes if
+  // enabled. Unbatched votes give up at |deadline|; batched ones wait for
+  // their batch.
+  absl::Status Vote(const std::string& transaction_id, int cohort_index,
+                    blockchain::Ballot ballot, absl::Time deadline);
+
+  // Signs the commit vote for the coordinator to fetch with
+  // GetTransactionResult instead of sending it to the blockchain.
+  void SignCommitVote(const std::string& transaction_id, int cohort_index);
+
+  // Votes to abort without waiting for the blockchain, since the contract
+  // aborts the transaction at its presumed abort time anyway.
+  void VoteAbortInBackground(const std::string& transaction_id,
+                             int cohort_index);
 
   blockchain::VotingDecision WaitForBlockchainDecision(
       const std::string& transaction_id, absl::Time presumed_abort_time);
 
   void AbortTransaction(const std::string& transaction_id, int cohort_index,
-                        absl::optional<absl::Status> abort_status);
+                        absl::optional<absl::Status> abort_status,
+                        internal::TransactionMetadata& txn_metadata);
+
+  // Commits the transaction the blockchain decided to commit, or that only
+  // this cohort is in. It can't be aborted anymore, so a failed commit is
+  // redone from the transaction's writes. If that keeps failing, the cohort
+  // crashes rather than release a partial commit, and redoes the commit with
+  // RecoverCommits once restarted.
+  void CommitTransaction(const std::string& transaction_id,
+                         internal::TransactionMetadata& txn_metadata);
+
+  std::string CommitRecordPath(const std::string& transaction_id) const;
+
+  // Writes the transaction's writes to its commit record and syncs the record
+  // and the response directory.
+  absl::Status WriteCommitRecord(
+      const std::string& transaction_id,
+      const internal::TransactionMetadata& txn_metadata);
+
+  // Writes the recorded values in a new transaction of |db|. Shards that
+  // already committed them are rewritten with the same values.
+  static absl::Status RedoWrites(const CommitRecord& record,
+                                 db::DatabaseTransactionAdapter& db);
 
-  void CommitTransaction(const std::string& transaction_id);
+  absl::Status PersistTransaction(
+      const PrepareTransactionRequest& request,
+      const internal::TransactionMetadata& txn_metadata);
 
-  absl::Status PersistTransaction(const PrepareTransactionRequest& request);
+  // Reads the values of |keys| from the read cache, and from the DB with one
+  // batched read if they aren't cached. |cached_values| keeps the values from
+  // the cache alive while |values| points to them.
+  absl::Status ReadValues(
+      absl::Span<const std::string_view> keys,
+      internal::TransactionMetadata& txn_metadata,
+      std::vector<absl::optional<std::string_view>>& values,
+      std::vector<ReadCache::Value>& cached_values);
 
-  absl::Status ProcessOperationInDb(
-      const common::Operation& op, internal::TransactionMetadata& txn_metadata);
+  // Runs the single-key |ops| in order with one batched read and one batched
+  // write, using an ExecutionPlan.
+  absl::Status ProcessOperationsInDb(
+      absl::Span<const common::Operation* const> ops,
+      internal::TransactionMetadata& txn_metadata);
+
+  // Scans the range of a range get and adds all the key values found to the
+  // response.
+  absl::Status ProcessRangeGetInDb(const common::Operation& op,
+                                   internal::TransactionMetadata& txn_metadata);
 
   absl::Status ProcessTransactionInDb(
       const common::Transaction& transaction, absl::Time presumed_abort_time,
       internal::TransactionMetadata& txn_metadata);
 
-  void ReleaseLocksAndDeleteMetadata(const std::string& transaction_id);
+  void ReleaseLocksAndDeleteMetadata(
+      const std::string& transaction_id,
+      internal::TransactionMetadata& txn_metadata);
 
-  absl::flat_hash_map<const std::string, internal::TransactionMetadata>
-      metadata_by_transaction_id_;
+  // Transactions that have been received but don't have a final response yet.
+  // Each entry is only accessed by the thread processing the transaction,
+  // other threads only check whether it exists.
+  utils::ShardedMap<internal::TransactionMetadata> metadata_by_transaction_id_;
 
-  absl::flat_hash_map<const std::string, GetTransactionResultResponse>
-      final_response_by_transaction_id_;
+  FinalResponseStore final_responses_;
 
-  thread_pool thread_pool_;
   const std::string db_txn_response_dir_;
   std::function<std::unique_ptr<db::DatabaseTransactionAdapter>()>
       db_transaction_adapter_creator_;
 
   absl::Mutex locks_by_key_mutex_;
-  absl::flat_hash_map<std::string, std::unique_ptr<absl::Mutex>> locks_by_key_;
-  // Used for DBs that don't support concurrent write transactions.
-  absl::Mutex whole_db_mutex_;
+  absl::flat_hash_map<std::string, std::unique_ptr<absl::Mutex>> locks_by_key_
+      ABSL_GUARDED_BY(locks_by_key_mutex_);
+  // Used for DBs that don't support concurrent write transactions, which
+  // still allow one per shard.
+  absl::flat_hash_map<size_t, std::unique_ptr<absl::Mutex>> locks_by_shard_
+      ABSL_GUARDED_BY(locks_by_key_mutex_);
+  // Protects the ranges read by range gets from concurrent writes. Only used
+  // for DBs that support concurrent write transactions.
+  RangeLockTable range_locks_;
+  // Null if the cache is disabled.
+  std::unique_ptr<ReadCache> read_cache_;
+  const std::function<absl::Status(const std::string& dir,
+                                   uint64_t max_bytes_per_second)>
+      write_snapshot_;
+  const std::string snapshot_dir_;
+  // Gives each streamed snapshot its own directory.
+  std::atomic<uint64_t> next_snapshot_id_ = 0;
   std::unique_ptr<blockchain::TwoPhaseCommit> blockchain_;
+  // Null if votes aren't batched.
+  std::unique_ptr<VoteAggregator> vote_aggregator_;
+  // Retries the votes the transactions wait on.
+  std::unique_ptr<VoteSender> vote_sender_;
+  // Null if each transaction polls its own decision.
+  std::unique_ptr<blockchain::DecisionPoller> decision_poller_;
+  // Signed commit votes of the transactions still waiting for a decision.
+  absl::Mutex commit_signatures_mutex_;
+  absl::flat_hash_map<std::string, std::string> commit_signatures_
+      ABSL_GUARDED_BY(commit_signatures_mutex_);
+  // Declared last so it's destroyed first: its destructor waits for the
+  // queued transactions, which use every other member.
+  thread_pool thread_pool_;
 };
 
 }  // namespace cohort
@@ -0,0 +1,240 @@
+// Benchmark of the heap allocations and throughput of cohort transactions.
+//
+// Runs --num_transactions single-cohort transactions (which don't wait for
+// the blockchain) against the in_memory storage engine and counts every heap
+// allocation made while they run, including the request copy, the thread
+// pool task and the final response.
+// With --simulate_blockchain, the transactions instead vote and wait for the
+// decision on an in-process simulated blockchain, like multi-cohort
+// transactions, whose voting is started before the timing starts. Each
+// transaction holds a db thread while it waits, so this needs many threads.
+// Example cmds:
+//   bazel run //src/cohort:cohort_server_benchmark_main -- \
+//       --ops_per_transaction=20
+//   bazel run //src/cohort:cohort_server_benchmark_main -- \
+//       --simulate_blockchain --num_db_threads=1000 --vote_batch_window=20ms \
+//       --decision_poll_interval=20ms
+//
+// Example output format:
+//   | ops/txn | txns | allocs/txn | KiB/txn | txns/s |
+//   |---|---|---|---|---|
+//   | 20 | 10000 | ... | ... | ... |
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+#include "grpcpp/server_context.h"
+#include "src/blockchain/simulated_blockchain.h"
+#include "src/blockchain/two_phase_commit.h"
+#include "src/cohort/cohort_server.h"
+#include "src/db/in_memory_database_transaction_adapter.h"
+#include "src/proto/cohort.pb.h"
+
+ABSL_FLAG(int, num_transactions, 10000, "Number of transactions to run");
+ABSL_FLAG(int, ops_per_transaction, 10,
+          "Number of ops in each transaction, alternating relative puts and "
+          "gets of the key just put");
+ABSL_FLAG(int, num_keys, 100000, "Number of distinct keys the ops use");
+ABSL_FLAG(int, key_size, 32, "Size in bytes of each key");
+ABSL_FLAG(int, num_db_threads, 4, "Number of threads processing transactions");
+ABSL_FLAG(bool, simulate_blockchain, false,
+          "Whether transactions vote on a simulated blockchain, instead of "
+          "committing right away as the only cohort");
+ABSL_FLAG(absl::Duration, block_interval, absl::Milliseconds(100),
+          "Time between blocks of the simulated blockchain");
+ABSL_FLAG(absl::Duration, confirmation_latency, absl::ZeroDuration(),
+          "Time between a simulated block and its senders learning about it");
+ABSL_FLAG(int, max_transactions_per_block, 0,
+          "Maximum number of blockchain transactions in each simulated block. "
+          "0 means no limit");
+ABSL_FLAG(absl::Duration, vote_batch_window, absl::ZeroDuration(),
+          "Longest a vote waits to be sent to the blockchain in one "
+          "transaction with other votes. 0 sends each vote on its own");
+ABSL_FLAG(absl::Duration, decision_poll_interval, absl::ZeroDuration(),
+          "How often to fetch the decisions of all the transactions waiting "
+          "for the blockchain together. 0 makes each poll its own");
+
+constexpr char kResponseDir[] = "/tmp/cohort_benchmark_responses";
+
+namespace {
+
+std::atomic<uint64_t> allocations = 0;
+std::atomic<uint64_t> allocated_bytes = 0;
+
+cohort::PrepareTransactionRequest MakeRequest(int index, std::mt19937& random) {
+  cohort::PrepareTransactionRequest request;
+  request.set_transaction_id(absl::StrCat("benchmark_", index));
+  request.set_only_cohort(!absl::GetFlag(FLAGS_simulate_blockchain));
+  request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Minutes(10)));
+  std::uniform_int_distribution<int> key_distribution(
+      0, absl::GetFlag(FLAGS_num_keys) - 1);
+  std::string key;
+  for (int i = 0; i < absl::GetFlag(FLAGS_ops_per_transaction); ++i) {
+    common::Operation* op = request.mutable_transaction()->add_ops();
+    op->mutable_namespace_()->set_identifier("benchmark");
+    // Gets read the key the previous put created, since a missing key would
+    // abort the transaction.
+    if (i % 2 == 1) {
+      op->mutable_get()->set_key(key);
+      continue;
+    }
+    key = absl::StrCat(key_distribution(random));
+    key.resize(absl::GetFlag(FLAGS_key_size), '_');
+    op->mutable_put()->set_key(key);
+    common::RelativeValue* relative_value =
+        op->mutable_put()->mutable_value()->mutable_relative_value();
+    relative_value->mutable_relative_value()->set_int64_value(1);
+    relative_value->mutable_default_value()->set_int64_value(0);
+  }
+  return request;
+}
+
+}  // namespace
+
+// Counts every allocation of the process.
+void* operator new(size_t size) {
+  ++allocations;
+  allocated_bytes += size;
+  if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, size_t /*size*/) noexcept {
+  std::free(pointer);
+}
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  // Transactions lock their keys in any order and rely on the presumed abort
+  // time to break deadlocks, which debug builds would otherwise die on.
+  absl::SetMutexDeadlockDetectionMode(absl::OnDeadlockCycle::kIgnore);
+  absl::StatusOr<std::shared_ptr<db::InMemoryStore>> store =
+      db::InMemoryStore::Open(db::InMemoryStoreOptions());
+  if (!store.ok()) {
+    std::cerr << "Failed to open the store: " << store.status() << std::endl;
+    return 1;
+  }
+  std::unique_ptr<blockchain::TwoPhaseCommit> two_phase_commit;
+  if (absl::GetFlag(FLAGS_simulate_blockchain)) {
+    blockchain::SimulatedBlockchainOptions options;
+    options.block_interval = absl::GetFlag(FLAGS_block_interval);
+    options.confirmation_latency = absl::GetFlag(FLAGS_confirmation_latency);
+    options.max_transactions_per_block =
+        absl::GetFlag(FLAGS_max_transactions_per_block);
+    two_phase_commit = std::make_unique<blockchain::TwoPhaseCommit>(
+        std::make_unique<blockchain::SimulatedBlockchain>(options));
+  } else {
+    // Single-cohort transactions never use the blockchain adapter, so the
+    // stub is never connected (unlike the channel constructor, it doesn't
+    // wait for the adapter's heartbeat).
+    two_phase_commit = std::make_unique<blockchain::TwoPhaseCommit>(
+        blockchain::TwoPhaseCommitAdapter::NewStub(grpc::CreateChannel(
+            "localhost:1", grpc::InsecureChannelCredentials())));
+  }
+  // Owned by the server, which outlives its uses here.
+  blockchain::TwoPhaseCommit* const blockchain_client = two_phase_commit.get();
+  std::filesystem::create_directories(kResponseDir);
+  cohort::CohortServerOptions server_options;
+  server_options.vote_batch_window = absl::GetFlag(FLAGS_vote_batch_window);
+  server_options.decision_poll_interval =
+      absl::GetFlag(FLAGS_decision_poll_interval);
+  cohort::CohortServer server(
+      absl::GetFlag(FLAGS_num_db_threads), kResponseDir,
+      [store = *store]() {
+        return std::make_unique<db::InMemoryDatabaseTransactionAdapter>(store);
+      },
+      std::move(two_phase_commit), server_options);
+
+  std::mt19937 random;
+  const int num_transactions = absl::GetFlag(FLAGS_num_transactions);
+  std::vector<cohort::PrepareTransactionRequest> requests;
+  for (int i = 0; i < num_transactions; ++i) {
+    requests.push_back(MakeRequest(i, random));
+  }
+  if (absl::GetFlag(FLAGS_simulate_blockchain)) {
+    // Started like the coordinator would, with the transaction as its only
+    // cohort on the blockchain.
+    std::vector<blockchain::StartVotingRequest> votings;
+    for (const cohort::PrepareTransactionRequest& request : requests) {
+      blockchain::StartVotingRequest& voting = votings.emplace_back();
+      voting.set_transaction_id(request.transaction_id());
+      *voting.mutable_timeout_time() = request.config().presumed_abort_time();
+      voting.set_cohorts(1);
+    }
+    const absl::StatusOr<std::vector<int>> skipped_indices =
+        blockchain_client->StartVotingBatch(votings);
+    if (!skipped_indices.ok()) {
+      std::cerr << "Failed to start voting: " << skipped_indices.status()
+                << std::endl;
+      return 1;
+    }
+    if (!skipped_indices->empty()) {
+      std::cerr << "Failed to start voting of " << skipped_indices->size()
+                << " transactions" << std::endl;
+      return 1;
+    }
+  }
+
+  grpc::ServerContext context;
+  cohort::PrepareTransactionResponse prepare_response;
+  cohort::GetTransactionResultRequest result_request;
+  cohort::GetTransactionResultResponse result_response;
+  const uint64_t start_allocations = allocations;
+  const uint64_t start_bytes = allocated_bytes;
+  const absl::Time start = absl::Now();
+  for (const cohort::PrepareTransactionRequest& request : requests) {
+    server.PrepareTransaction(&context, &request, &prepare_response);
+  }
+  // Transactions finish in about the order they were queued, so waiting for
+  // each one in turn rarely polls.
+  for (const cohort::PrepareTransactionRequest& request : requests) {
+    result_request.set_transaction_id(request.transaction_id());
+    while (true) {
+      server.GetTransactionResult(&context, &result_request, &result_response);
+      if (!result_response.has_pending_response()) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if (!result_response.has_committed_response()) {
+      std::cerr << "Transaction " << request.transaction_id()
+                << " aborted: " << result_response.DebugString() << std::endl;
+      return 1;
+    }
+  }
+  const absl::Duration elapsed = absl::Now() - start;
+  const double transactions = num_transactions;
+  std::cout << "| ops/txn | txns | allocs/txn | KiB/txn | txns/s |" << std::endl
+            << "|---|---|---|---|---|" << std::endl
+            << absl::StrFormat(
+                   "| %d | %d | %.1f | %.2f | %.0f |",
+                   absl::GetFlag(FLAGS_ops_per_transaction), num_transactions,
+                   (allocations - start_allocations) / transactions,
+                   (allocated_bytes - start_bytes) / transactions / 1024,
+                   transactions / absl::ToDoubleSeconds(elapsed))
+            << std::endl;
+  return 0;
+}
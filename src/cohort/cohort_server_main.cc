@@ -1,18 +1,31 @@
 #include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
 #include "grpc/grpc.h"
 #include "grpcpp/create_channel.h"
 #include "grpcpp/security/credentials.h"
 #include "grpcpp/server.h"
 #include "grpcpp/server_builder.h"
+#include "src/blockchain/ethereum_blockchain.h"
+#include "src/blockchain/json_rpc_client.h"
 #include "src/blockchain/two_phase_commit.h"
 #include "src/cohort/cohort_server.h"
+#include "src/db/in_memory_database_transaction_adapter.h"
 #include "src/db/lmdb_database_transaction_adapter.h"
+#include "src/db/sharded_lmdb_database_transaction_adapter.h"
 
 ABSL_FLAG(std::string, port, "50051", "Port to listen to connections on");
 ABSL_FLAG(std::string, blockchain_adapter_port, "50551",
@@ -21,27 +34,244 @@ ABSL_FLAG(double, db_thread_ratio, 0.75,
           "Fraction of threads to assign to DB processing. The remaining "
           "threads are used by gRPC.");
 ABSL_FLAG(std::string, db_data_dir, "/tmp/data", "Directory for db data");
+ABSL_FLAG(std::string, storage_engine, "lmdb",
+          "Database to store data in. Either lmdb or in_memory");
+ABSL_FLAG(std::string, lmdb_durability, "sync",
+          "How lmdb commits reach the disk. One of sync, nometasync or "
+          "writemap+async-flush (flushed every lmdb_flush_interval)");
+ABSL_FLAG(absl::Duration, lmdb_flush_interval, absl::Seconds(1),
+          "How often to sync lmdb to disk with writemap+async-flush");
+ABSL_FLAG(size_t, lmdb_initial_map_size, 1UL << 30,
+          "Initial size in bytes of the lmdb memory map. It doubles when it's "
+          "nearly full, but only while no transaction is open, so it should "
+          "fit the data");
+ABSL_FLAG(size_t, lmdb_max_map_size, 0,
+          "Maximum size in bytes of the lmdb memory map. 0 means no limit");
+ABSL_FLAG(size_t, lmdb_shards, 1,
+          "Number of lmdb environments to hash-partition keys over. Each one "
+          "allows a concurrent write transaction. Must stay the same for "
+          "existing data");
+ABSL_FLAG(bool, in_memory_wal, false,
+          "Whether the in_memory storage engine logs commits to a WAL in "
+          "db_data_dir so they survive restarts");
+ABSL_FLAG(bool, in_memory_sync_wal, false,
+          "Whether in_memory commits wait for the WAL to reach the disk");
+ABSL_FLAG(absl::Duration, in_memory_checkpoint_interval, absl::ZeroDuration(),
+          "How often the in_memory storage engine writes a snapshot to "
+          "db_data_dir (and empties the WAL). Zero disables periodic "
+          "snapshots");
+ABSL_FLAG(uint64_t, in_memory_checkpoint_wal_bytes, 64 << 20,
+          "Size the in_memory storage engine's WAL grows to before it writes "
+          "a snapshot to db_data_dir (and empties the WAL). Zero disables "
+          "snapshots by WAL size");
 ABSL_FLAG(std::string, db_txn_response_dir, "/tmp/txn_responses",
           "Directory for persisted transaction responses in case of a crash "
           "while waiting for the blockchain decision");
+ABSL_FLAG(size_t, max_final_responses, 100000,
+          "Maximum number of final transaction responses to keep for the "
+          "coordinator to fetch");
+ABSL_FLAG(size_t, read_cache_bytes, 0,
+          "Size in bytes of the cache of frequently read values in front of "
+          "the database. 0 disables the cache");
+ABSL_FLAG(std::string, snapshot_dir, "/tmp/cohort_snapshots",
+          "Directory for copies of the lmdb db while they are streamed to new "
+          "cohorts");
+ABSL_FLAG(absl::Duration, final_response_ttl, absl::Minutes(10),
+          "How long to keep final transaction responses for the coordinator "
+          "to fetch");
+ABSL_FLAG(absl::Duration, vote_batch_window, absl::ZeroDuration(),
+          "Longest a vote waits to be sent to the blockchain in one "
+          "transaction with other votes. 0 sends each vote on its own");
+ABSL_FLAG(size_t, max_vote_batch_size, 64,
+          "Maximum number of votes sent in one blockchain transaction");
+ABSL_FLAG(absl::Duration, decision_poll_interval, absl::ZeroDuration(),
+          "How often to fetch the decisions of all the transactions waiting "
+          "for the blockchain in one call. 0 makes each transaction poll its "
+          "own decision");
+ABSL_FLAG(bool, watch_decisions, false,
+          "Whether to stream the decisions from the blockchain as they are "
+          "made. Only used with --decision_poll_interval");
+ABSL_FLAG(int, max_vote_attempts, 5,
+          "Maximum number of times a commit vote is sent to the blockchain "
+          "while it fails transiently. 1 disables retries");
+ABSL_FLAG(absl::Duration, vote_retry_backoff, absl::Milliseconds(10),
+          "Wait before the first retry of a commit vote, doubled for each "
+          "later one");
+ABSL_FLAG(absl::Duration, vote_attempt_timeout, absl::Seconds(30),
+          "How long each attempt to send a commit vote may take before it's "
+          "retried");
+ABSL_FLAG(int, vote_circuit_breaker_failures, 20,
+          "Consecutive transient vote failures after which votes aren't sent "
+          "for --vote_circuit_breaker_cooldown. 0 disables the breaker");
+ABSL_FLAG(absl::Duration, vote_circuit_breaker_cooldown, absl::Seconds(1),
+          "How long votes are held back once the circuit breaker opens");
+ABSL_FLAG(std::string, ethereum_rpc_address, "",
+          "<host>:<port> of an Ethereum JSON-RPC endpoint, e.g. Ganache's, to "
+          "call the TwoPhaseCommit contract through directly instead of the "
+          "blockchain adapter server. Empty uses the adapter server");
+ABSL_FLAG(std::string, contract_address, "",
+          "Address of the TwoPhaseCommit contract. Only used with "
+          "--ethereum_rpc_address");
+ABSL_FLAG(std::vector<std::string>, ethereum_accounts, {},
+          "Comma-separated unlocked accounts to send blockchain transactions "
+          "from. Only used with --ethereum_rpc_address");
+ABSL_FLAG(int, ethereum_rpc_connections, 8,
+          "Maximum number of concurrent requests to the Ethereum JSON-RPC "
+          "endpoint");
+ABSL_FLAG(int, decision_confirmations, 0,
+          "Blocks to wait for on top of the one deciding a transaction before "
+          "acting on the decision");
+
+absl::StatusOr<
+    std::function<std::unique_ptr<db::DatabaseTransactionAdapter>()>>
+GetDbTransactionAdapterCreator(
+    const std::string& storage_engine, const std::string& db_data_dir,
+    std::function<absl::Status(const std::string&, uint64_t)>&
+        write_snapshot) {
+  if (storage_engine == "lmdb") {
+    db::LMDBOptions lmdb_options;
+    absl::StatusOr<db::LMDBDurability> durability =
+        db::ParseLMDBDurability(absl::GetFlag(FLAGS_lmdb_durability));
+    if (!durability.ok()) {
+      return durability.status();
+    }
+    lmdb_options.durability = *durability;
+    lmdb_options.flush_interval = absl::GetFlag(FLAGS_lmdb_flush_interval);
+    lmdb_options.initial_map_size = absl::GetFlag(FLAGS_lmdb_initial_map_size);
+    lmdb_options.max_map_size = absl::GetFlag(FLAGS_lmdb_max_map_size);
+    const size_t num_shards = absl::GetFlag(FLAGS_lmdb_shards);
+    if (num_shards > 1) {
+      absl::StatusOr<std::vector<std::shared_ptr<db::LMDBEnvironment>>>
+          shards = db::OpenLMDBShards(db_data_dir, num_shards, lmdb_options);
+      if (!shards.ok()) {
+        return shards.status();
+      }
+      write_snapshot = [shards = *shards](const std::string& dir,
+                                          uint64_t max_bytes_per_second) {
+        return db::CopyLMDBShards(shards, dir, max_bytes_per_second);
+      };
+      return [shards = *shards]() {
+        return std::make_unique<db::ShardedLMDBDatabaseTransactionAdapter>(
+            shards);
+      };
+    }
+    absl::StatusOr<std::shared_ptr<db::LMDBEnvironment>> env =
+        db::LMDBEnvironment::Open(db_data_dir, lmdb_options);
+    if (!env.ok()) {
+      return env.status();
+    }
+    write_snapshot = [env = *env](const std::string& dir,
+                                  uint64_t max_bytes_per_second) {
+      return db::CopyLMDBShards({env}, dir, max_bytes_per_second);
+    };
+    return [env = *env]() {
+      return std::make_unique<db::LMDBDatabaseTransactionAdapter>(env);
+    };
+  }
+  if (storage_engine != "in_memory") {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown storage engine: ", storage_engine));
+  }
+  db::InMemoryStoreOptions store_options;
+  if (absl::GetFlag(FLAGS_in_memory_wal)) {
+    store_options.wal_path = absl::StrCat(db_data_dir, "/in_memory_wal");
+    store_options.sync_wal = absl::GetFlag(FLAGS_in_memory_sync_wal);
+  }
+  store_options.checkpoint_interval =
+      absl::GetFlag(FLAGS_in_memory_checkpoint_interval);
+  if (!store_options.wal_path.empty()) {
+    store_options.checkpoint_wal_bytes =
+        absl::GetFlag(FLAGS_in_memory_checkpoint_wal_bytes);
+  }
+  if (store_options.checkpoint_interval > absl::ZeroDuration() ||
+      store_options.checkpoint_wal_bytes > 0) {
+    store_options.snapshot_path =
+        absl::StrCat(db_data_dir, "/in_memory_snapshot");
+  }
+  absl::StatusOr<std::shared_ptr<db::InMemoryStore>> store =
+      db::InMemoryStore::Open(store_options);
+  if (!store.ok()) {
+    return store.status();
+  }
+  return [store = *store]() {
+    return std::make_unique<db::InMemoryDatabaseTransactionAdapter>(store);
+  };
+}
+
+// Calls the contract through the Ethereum JSON-RPC endpoint if one is set,
+// or else through the blockchain adapter server.
+std::unique_ptr<blockchain::TwoPhaseCommit> CreateTwoPhaseCommit(
+    const std::string& blockchain_adapter_address) {
+  blockchain::TwoPhaseCommitOptions two_phase_commit_options;
+  two_phase_commit_options.confirmations =
+      absl::GetFlag(FLAGS_decision_confirmations);
+  const std::string rpc_address = absl::GetFlag(FLAGS_ethereum_rpc_address);
+  if (rpc_address.empty()) {
+    return std::make_unique<blockchain::TwoPhaseCommit>(
+        grpc::CreateChannel(blockchain_adapter_address,
+                            grpc::InsecureChannelCredentials()),
+        two_phase_commit_options);
+  }
+  const size_t port_start = rpc_address.rfind(':');
+  int port = 0;
+  if (port_start == std::string::npos ||
+      !absl::SimpleAtoi(rpc_address.substr(port_start + 1), &port)) {
+    std::cerr << "Invalid --ethereum_rpc_address: " << rpc_address
+              << std::endl;
+    return nullptr;
+  }
+  blockchain::EthereumBlockchainOptions options;
+  options.contract_address = absl::GetFlag(FLAGS_contract_address);
+  options.accounts = absl::GetFlag(FLAGS_ethereum_accounts);
+  options.num_threads = absl::GetFlag(FLAGS_ethereum_rpc_connections);
+  if (options.contract_address.empty() || options.accounts.empty()) {
+    std::cerr << "--ethereum_rpc_address needs --contract_address and "
+                 "--ethereum_accounts"
+              << std::endl;
+    return nullptr;
+  }
+  return std::make_unique<blockchain::TwoPhaseCommit>(
+      std::make_unique<blockchain::EthereumBlockchain>(
+          std::make_unique<blockchain::HttpJsonRpcTransport>(
+              rpc_address.substr(0, port_start), port, options.num_threads),
+          options),
+      two_phase_commit_options);
+}
 
 void RunServer(const std::string& port,
                const std::string& blockchain_adapter_port, uint num_db_threads,
                const std::string& db_data_dir,
-               const std::string& db_txn_response_dir) {
+               const std::string& db_txn_response_dir,
+               cohort::CohortServerOptions options) {
   std::filesystem::create_directories(db_data_dir);
   std::filesystem::create_directories(db_txn_response_dir);
+  absl::StatusOr<
+      std::function<std::unique_ptr<db::DatabaseTransactionAdapter>()>>
+      db_transaction_adapter_creator = GetDbTransactionAdapterCreator(
+          absl::GetFlag(FLAGS_storage_engine), db_data_dir,
+          options.write_snapshot);
+  if (!db_transaction_adapter_creator.ok()) {
+    std::cerr << "Failed to open the database: "
+              << db_transaction_adapter_creator.status() << std::endl;
+    return;
+  }
   std::string server_address = absl::StrCat("0.0.0.0:", port);
   std::string blockchain_adapter_address =
       absl::StrCat("0.0.0.0:", blockchain_adapter_port);
-  cohort::CohortServer service(
-      num_db_threads, db_txn_response_dir,
-      [&db_data_dir]() {
-        return std::make_unique<db::LMDBDatabaseTransactionAdapter>(
-            db_data_dir);
-      },
-      std::make_unique<blockchain::TwoPhaseCommit>(grpc::CreateChannel(
-          blockchain_adapter_address, grpc::InsecureChannelCredentials())));
+  std::unique_ptr<blockchain::TwoPhaseCommit> two_phase_commit =
+      CreateTwoPhaseCommit(blockchain_adapter_address);
+  if (two_phase_commit == nullptr) {
+    return;
+  }
+  cohort::CohortServer service(num_db_threads, db_txn_response_dir,
+                               *db_transaction_adapter_creator,
+                               std::move(two_phase_commit), options);
+  const absl::Status recover_status = service.RecoverCommits();
+  if (!recover_status.ok()) {
+    std::cerr << "Failed to recover interrupted commits: " << recover_status
+              << std::endl;
+    return;
+  }
 
   grpc::ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -53,12 +283,28 @@ void RunServer(const std::string& port,
 
 int main(int argc, char** argv) {
   absl::ParseCommandLine(argc, argv);
+  cohort::CohortServerOptions options;
+  options.max_final_responses = absl::GetFlag(FLAGS_max_final_responses);
+  options.final_response_ttl = absl::GetFlag(FLAGS_final_response_ttl);
+  options.read_cache_bytes = absl::GetFlag(FLAGS_read_cache_bytes);
+  options.snapshot_dir = absl::GetFlag(FLAGS_snapshot_dir);
+  options.vote_batch_window = absl::GetFlag(FLAGS_vote_batch_window);
+  options.max_vote_batch_size = absl::GetFlag(FLAGS_max_vote_batch_size);
+  options.decision_poll_interval = absl::GetFlag(FLAGS_decision_poll_interval);
+  options.watch_decisions = absl::GetFlag(FLAGS_watch_decisions);
+  options.max_vote_attempts = absl::GetFlag(FLAGS_max_vote_attempts);
+  options.vote_retry_backoff = absl::GetFlag(FLAGS_vote_retry_backoff);
+  options.vote_attempt_timeout = absl::GetFlag(FLAGS_vote_attempt_timeout);
+  options.vote_circuit_breaker_failures =
+      absl::GetFlag(FLAGS_vote_circuit_breaker_failures);
+  options.vote_circuit_breaker_cooldown =
+      absl::GetFlag(FLAGS_vote_circuit_breaker_cooldown);
   RunServer(absl::GetFlag(FLAGS_port),
             absl::GetFlag(FLAGS_blockchain_adapter_port),
             uint(absl::GetFlag(FLAGS_db_thread_ratio) *
                  std::thread::hardware_concurrency()),
             absl::GetFlag(FLAGS_db_data_dir),
-            absl::GetFlag(FLAGS_db_txn_response_dir));
+            absl::GetFlag(FLAGS_db_txn_response_dir), options);
 
   return 0;
 }
\ No newline at end of file
@@ -1,5 +1,13 @@
 #include "src/cohort/cohort_server.h"
 
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "absl/time/time.h"
 #include "gmock/gmock.h"
 #include "grpcpp/server_context.h"
@@ -12,12 +20,23 @@
 
 namespace {
 using ::protobuf_matchers::EqualsProto;
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::Gt;
+using ::testing::SizeIs;
+
+// Number of batched reads and writes done by InMemoryDbs.
+struct DbCallCounts {
+  std::atomic<int> multi_gets = 0;
+  std::atomic<int> multi_puts = 0;
+};
 
 class InMemoryDb : public db::DatabaseTransactionAdapter {
  public:
-  explicit InMemoryDb(absl::flat_hash_map<std::string, int64_t>& data,
-                      absl::Mutex& data_mutex)
-      : data_(data), data_mutex_(data_mutex) {}
+  explicit InMemoryDb(absl::flat_hash_map<std::string, std::string>& data,
+                      absl::Mutex& data_mutex,
+                      DbCallCounts* call_counts = nullptr)
+      : data_(data), data_mutex_(data_mutex), call_counts_(call_counts) {}
 
   [[nodiscard]] bool SupportsConcurrentWrites() const override { return true; }
   absl::Status Begin() override {
@@ -39,7 +58,9 @@ class InMemoryDb : public db::DatabaseTransactionAdapter {
       return absl::FailedPreconditionError("Not in transaction");
     }
     data_mutex_.WriterLock();
-    data_.insert(txn_data_.begin(), txn_data_.end());
+    for (auto& [key, value] : txn_data_) {
+      data_[key] = std::move(value);
+    }
     data_mutex_.WriterUnlock();
     txn_data_.clear();
     in_txn_ = false;
@@ -53,7 +74,8 @@ class InMemoryDb : public db::DatabaseTransactionAdapter {
     in_txn_ = false;
     return absl::OkStatus();
   }
-  absl::Status Get(const std::string& key, int64_t& output_value) override {
+  absl::Status Get(const std::string& key,
+                   std::string_view& output_value) override {
     if (!in_txn_) {
       return absl::FailedPreconditionError("Not in transaction");
     }
@@ -73,31 +95,124 @@ class InMemoryDb : public db::DatabaseTransactionAdapter {
     }
     return absl::OkStatus();
   }
-  absl::Status Put(const std::string& key, int64_t value) override {
+  absl::Status Put(const std::string& key, std::string_view value) override {
+    if (!in_txn_) {
+      return absl::FailedPreconditionError("Not in transaction");
+    }
+    txn_data_[key] = std::string(value);
+    return absl::OkStatus();
+  }
+  absl::Status MultiGet(
+      absl::Span<const std::string_view> keys,
+      std::vector<absl::optional<std::string_view>>& output_values) override {
+    if (call_counts_ != nullptr) {
+      ++call_counts_->multi_gets;
+    }
+    return DatabaseTransactionAdapter::MultiGet(keys, output_values);
+  }
+  absl::Status MultiPut(absl::Span<const std::string_view> keys,
+                        absl::Span<const std::string_view> values) override {
+    if (call_counts_ != nullptr) {
+      ++call_counts_->multi_puts;
+    }
+    return DatabaseTransactionAdapter::MultiPut(keys, values);
+  }
+  absl::Status Scan(const std::string& start_key, const std::string& end_key,
+                    size_t limit, const ScanCallback& callback) override {
     if (!in_txn_) {
       return absl::FailedPreconditionError("Not in transaction");
     }
-    txn_data_[key] = value;
+    std::map<std::string, std::string> sorted_data;
+    data_mutex_.ReaderLock();
+    sorted_data.insert(data_.begin(), data_.end());
+    data_mutex_.ReaderUnlock();
+    for (const auto& [key, value] : txn_data_) {
+      sorted_data[key] = value;
+    }
+    size_t count = 0;
+    for (auto it = sorted_data.lower_bound(start_key);
+         it != sorted_data.end() && (end_key.empty() || it->first < end_key) &&
+         (limit == 0 || count < limit);
+         ++it, ++count) {
+      callback(it->first, it->second);
+    }
     return absl::OkStatus();
   }
 
  private:
   void Connect() override {}
-  bool in_txn_;
-  absl::flat_hash_map<std::string, int64_t>& data_;
-  absl::flat_hash_map<std::string, int64_t> txn_data_;
+  bool in_txn_ = false;
+  absl::flat_hash_map<std::string, std::string>& data_;
+  absl::flat_hash_map<std::string, std::string> txn_data_;
   // Necessary since flat_hash_map doesn't support concurrent access.
   absl::Mutex& data_mutex_;
+  DbCallCounts* call_counts_;
 };
 
 std::function<std::unique_ptr<db::DatabaseTransactionAdapter>()>
-GetDbCreatorFunc(absl::flat_hash_map<std::string, int64_t>& data,
-                 absl::Mutex& data_mutex) {
-  return [&data, &data_mutex]() {
-    return std::make_unique<InMemoryDb>(data, data_mutex);
+GetDbCreatorFunc(absl::flat_hash_map<std::string, std::string>& data,
+                 absl::Mutex& data_mutex,
+                 DbCallCounts* call_counts = nullptr) {
+  return [&data, &data_mutex, call_counts]() {
+    return std::make_unique<InMemoryDb>(data, data_mutex, call_counts);
   };
 }
 
+// Fails the first |failures| commits after dropping the transaction, like
+// LMDB does.
+class FailingCommitDb : public InMemoryDb {
+ public:
+  FailingCommitDb(absl::flat_hash_map<std::string, std::string>& data,
+                  absl::Mutex& data_mutex, std::atomic<int>& failures)
+      : InMemoryDb(data, data_mutex), failures_(failures) {}
+
+  absl::Status Commit() override {
+    if (failures_-- > 0) {
+      Abort().IgnoreError();
+      return absl::InternalError("disk full");
+    }
+    return InMemoryDb::Commit();
+  }
+
+ private:
+  std::atomic<int>& failures_;
+};
+
+// Splits the keys over two shards by their first byte and checks that
+// transactions writing to both are recorded before they commit.
+class TwoShardDb : public InMemoryDb {
+ public:
+  TwoShardDb(absl::flat_hash_map<std::string, std::string>& data,
+             absl::Mutex& data_mutex, std::string commit_record_path,
+             std::atomic<bool>& recorded)
+      : InMemoryDb(data, data_mutex),
+        commit_record_path_(std::move(commit_record_path)),
+        recorded_(recorded) {}
+
+  [[nodiscard]] bool SupportsConcurrentWrites() const override {
+    return false;
+  }
+  [[nodiscard]] size_t NumShards() const override { return 2; }
+  [[nodiscard]] size_t GetShard(const std::string& key) const override {
+    return key.empty() ? 0 : static_cast<uint8_t>(key[0]) % 2;
+  }
+  absl::Status Commit() override {
+    recorded_ = std::filesystem::exists(commit_record_path_);
+    return InMemoryDb::Commit();
+  }
+
+ private:
+  const std::string commit_record_path_;
+  std::atomic<bool>& recorded_;
+};
+
+// Returns the DB encoding of an int64 value.
+std::string Int64Value(int64_t value) {
+  common::ConstantValue constant_value;
+  constant_value.set_int64_value(value);
+  return constant_value.SerializeAsString();
+}
+
 // TODO(benjmarks22): Add more tests.
 
 TEST(CohortServerTest, GetRequestForNotFoundAborts) {
@@ -112,7 +227,7 @@ TEST(CohortServerTest, GetRequestForNotFoundAborts) {
   operation->mutable_namespace_()->set_identifier("foo");
   operation->mutable_get()->set_key("a");
   absl::Mutex data_mutex;
-  absl::flat_hash_map<std::string, int64_t> data;
+  absl::flat_hash_map<std::string, std::string> data;
   cohort::CohortServer server(
       1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
       std::make_unique<blockchain::TwoPhaseCommit>(
@@ -133,4 +248,777 @@ TEST(CohortServerTest, GetRequestForNotFoundAborts) {
                            ABORT_REASON_OPERATION_FOR_NON_EXISTENT_VALUE)pb"));
 }
 
-}  // namespace
\ No newline at end of file
+TEST(CohortServerTest, BatchedOpsKeepOrderedSemantics) {
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+  prepare_request.set_transaction_id("batched id");
+  prepare_request.set_only_cohort(true);
+  // a = 1, b = 2, a += 5, get a, get b, b = 7, get b, c += 3 (default 10).
+  const auto add_op = [&prepare_request]() {
+    common::Operation* operation =
+        prepare_request.mutable_transaction()->add_ops();
+    operation->mutable_namespace_()->set_identifier("foo");
+    return operation;
+  };
+  common::Operation* operation = add_op();
+  operation->mutable_put()->set_key("a");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_int64_value(1);
+  operation = add_op();
+  operation->mutable_put()->set_key("b");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_int64_value(2);
+  operation = add_op();
+  operation->mutable_put()->set_key("a");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_relative_value()
+      ->mutable_relative_value()
+      ->set_int64_value(5);
+  add_op()->mutable_get()->set_key("a");
+  add_op()->mutable_get()->set_key("b");
+  operation = add_op();
+  operation->mutable_put()->set_key("b");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_int64_value(7);
+  add_op()->mutable_get()->set_key("b");
+  operation = add_op();
+  operation->mutable_put()->set_key("c");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_relative_value()
+      ->mutable_relative_value()
+      ->set_int64_value(3);
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_relative_value()
+      ->mutable_default_value()
+      ->set_int64_value(10);
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("batched id");
+  cohort::GetTransactionResultResponse get_response;
+  // Necessary so it can process the transaction.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  EXPECT_TRUE(
+      server.GetTransactionResult(&context, &get_request, &get_response).ok());
+  EXPECT_THAT(get_response, EqualsProto(R"pb(committed_response {
+                                               get_responses {
+                                                 namespace { identifier: "foo" }
+                                                 get { key: "a" }
+                                                 value { int64_value: 6 }
+                                               }
+                                               get_responses {
+                                                 namespace { identifier: "foo" }
+                                                 get { key: "b" }
+                                                 value { int64_value: 2 }
+                                               }
+                                               get_responses {
+                                                 namespace { identifier: "foo" }
+                                                 get { key: "b" }
+                                                 value { int64_value: 7 }
+                                               }
+                                             })pb"));
+  absl::MutexLock lock(&data_mutex);
+  EXPECT_EQ(data["a"], Int64Value(6));
+  EXPECT_EQ(data["b"], Int64Value(7));
+  EXPECT_EQ(data["c"], Int64Value(13));
+}
+
+TEST(CohortServerTest, OpsOnTheSameKeyReadAndWriteItOnce) {
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+  prepare_request.set_transaction_id("coalesced id");
+  prepare_request.set_only_cohort(true);
+  // counter += 1 five times with a get after each.
+  for (int i = 0; i < 5; ++i) {
+    common::Operation* operation =
+        prepare_request.mutable_transaction()->add_ops();
+    operation->mutable_namespace_()->set_identifier("foo");
+    operation->mutable_put()->set_key("counter");
+    operation->mutable_put()
+        ->mutable_value()
+        ->mutable_relative_value()
+        ->mutable_relative_value()
+        ->set_int64_value(1);
+    operation = prepare_request.mutable_transaction()->add_ops();
+    operation->mutable_namespace_()->set_identifier("foo");
+    operation->mutable_get()->set_key("counter");
+  }
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data = {
+      {"counter", Int64Value(10)}};
+  DbCallCounts call_counts;
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses",
+      GetDbCreatorFunc(data, data_mutex, &call_counts),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("coalesced id");
+  cohort::GetTransactionResultResponse get_response;
+  // Necessary so it can process the transaction.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  EXPECT_TRUE(
+      server.GetTransactionResult(&context, &get_request, &get_response).ok());
+  ASSERT_THAT(get_response.committed_response().get_responses(), SizeIs(5));
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(get_response.committed_response()
+                  .get_responses(i)
+                  .value()
+                  .int64_value(),
+              11 + i);
+  }
+  EXPECT_EQ(call_counts.multi_gets, 1);
+  EXPECT_EQ(call_counts.multi_puts, 1);
+  absl::MutexLock lock(&data_mutex);
+  EXPECT_EQ(data["counter"], Int64Value(15));
+}
+
+TEST(CohortServerTest, SignsCommitVoteForTheCoordinatorInsteadOfVoting) {
+  const std::string response_dir =
+      absl::StrCat(testing::TempDir(), "/signed_txn_responses");
+  std::filesystem::create_directories(response_dir);
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(2)));
+  prepare_request.set_transaction_id("signed id");
+  prepare_request.set_cohort_index(1);
+  prepare_request.set_sign_commit_vote(true);
+  common::Operation* operation =
+      prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_namespace_()->set_identifier("foo");
+  operation->mutable_put()->set_key("a");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_int64_value(1);
+  auto stub = std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, SignCommitVote(_, _, _))
+      .WillOnce([](grpc::ClientContext*,
+                   const blockchain::SignCommitVoteRequest& request,
+                   blockchain::SignCommitVoteResponse* response) {
+        EXPECT_EQ(request.transaction_id(), "signed id");
+        EXPECT_EQ(request.cohort_id(), 1);
+        response->set_signature("signature");
+        return grpc::Status::OK;
+      });
+  EXPECT_CALL(*stub, Vote(_, _, _)).Times(0);
+  // The decision stays pending until the coordinator has the signature.
+  std::atomic<bool> committed = false;
+  EXPECT_CALL(*stub, GetVotingDecision(_, _, _))
+      .WillRepeatedly([&committed](grpc::ClientContext*,
+                                   const blockchain::GetVotingDecisionRequest&,
+                                   blockchain::GetVotingDecisionResponse*
+                                       response) {
+        response->set_decision(
+            committed ? blockchain::VotingDecision::VOTING_DECISION_COMMIT
+                      : blockchain::VotingDecision::VOTING_DECISION_PENDING);
+        return grpc::Status::OK;
+      });
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  cohort::CohortServer server(
+      1, response_dir, GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(std::move(stub)));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("signed id");
+  cohort::GetTransactionResultResponse get_response;
+  for (int i = 0; i < 100 && get_response.commit_signature().empty(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(
+        server.GetTransactionResult(&context, &get_request, &get_response)
+            .ok());
+  }
+  EXPECT_TRUE(get_response.has_pending_response());
+  EXPECT_EQ(get_response.commit_signature(), "signature");
+
+  committed = true;
+  // Necessary so it polls the decision again after the presumed abort time.
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  EXPECT_TRUE(
+      server.GetTransactionResult(&context, &get_request, &get_response).ok());
+  EXPECT_TRUE(get_response.has_committed_response());
+  EXPECT_TRUE(get_response.commit_signature().empty());
+}
+
+TEST(CohortServerTest, AbortsIfTheVotingNeverStarted) {
+  const std::string response_dir =
+      absl::StrCat(testing::TempDir(), "/unstarted_txn_responses");
+  std::filesystem::create_directories(response_dir);
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(1)));
+  prepare_request.set_transaction_id("unstarted id");
+  prepare_request.set_sign_commit_vote(true);
+  common::Operation* operation =
+      prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_namespace_()->set_identifier("foo");
+  operation->mutable_put()->set_key("a");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_int64_value(1);
+  auto stub = std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, SignCommitVote(_, _, _))
+      .WillRepeatedly(::testing::Return(grpc::Status::OK));
+  // The contract reverts since the coordinator never started the voting.
+  EXPECT_CALL(*stub, GetVotingDecision(_, _, _))
+      .WillRepeatedly(::testing::Return(
+          grpc::Status(grpc::FAILED_PRECONDITION, "revert")));
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  cohort::CohortServer server(
+      1, response_dir, GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(std::move(stub)));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("unstarted id");
+  cohort::GetTransactionResultResponse get_response;
+  for (int i = 0; i < 50 && !get_response.has_aborted_response(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_TRUE(
+        server.GetTransactionResult(&context, &get_request, &get_response)
+            .ok());
+  }
+  EXPECT_TRUE(get_response.has_aborted_response());
+  EXPECT_TRUE(data.empty());
+}
+
+// Returns a request for a transaction that puts 1 into each of |keys| and is
+// only in this cohort.
+cohort::PrepareTransactionRequest OnlyCohortPuts(
+    const std::string& transaction_id, const std::vector<std::string>& keys) {
+  cohort::PrepareTransactionRequest request;
+  request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+  request.set_transaction_id(transaction_id);
+  request.set_only_cohort(true);
+  for (const std::string& key : keys) {
+    common::Operation* operation = request.mutable_transaction()->add_ops();
+    operation->mutable_namespace_()->set_identifier("foo");
+    operation->mutable_put()->set_key(key);
+    operation->mutable_put()
+        ->mutable_value()
+        ->mutable_constant_value()
+        ->set_int64_value(1);
+  }
+  return request;
+}
+
+// Waits for the transaction to have a final result and returns it.
+cohort::GetTransactionResultResponse WaitForResult(
+    cohort::CohortServer& server, const std::string& transaction_id) {
+  grpc::ServerContext context;
+  cohort::GetTransactionResultRequest request;
+  request.set_transaction_id(transaction_id);
+  cohort::GetTransactionResultResponse response;
+  for (int i = 0; i < 100; ++i) {
+    if (server.GetTransactionResult(&context, &request, &response).ok() &&
+        !response.has_pending_response()) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return response;
+}
+
+TEST(CohortServerTest, RedoesTheWritesOfAFailedCommit) {
+  const std::string response_dir =
+      absl::StrCat(testing::TempDir(), "/failed_commit_responses");
+  std::filesystem::create_directories(response_dir);
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  std::atomic<int> failures = 1;
+  cohort::CohortServer server(
+      1, response_dir,
+      [&data, &data_mutex, &failures]() {
+        return std::make_unique<FailingCommitDb>(data, data_mutex, failures);
+      },
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  grpc::ServerContext context;
+  const cohort::PrepareTransactionRequest request =
+      OnlyCohortPuts("failed commit", {"a", "b"});
+  cohort::PrepareTransactionResponse prepare_response;
+  ASSERT_TRUE(
+      server.PrepareTransaction(&context, &request, &prepare_response).ok());
+
+  EXPECT_TRUE(WaitForResult(server, "failed commit").has_committed_response());
+  absl::MutexLock lock(&data_mutex);
+  EXPECT_EQ(data["a"], Int64Value(1));
+  EXPECT_EQ(data["b"], Int64Value(1));
+}
+
+TEST(CohortServerTest, RecordsCommitsAcrossShardsUntilTheyFinish) {
+  const std::string response_dir =
+      absl::StrCat(testing::TempDir(), "/sharded_commit_responses");
+  std::filesystem::create_directories(response_dir);
+  const std::string record_path =
+      absl::StrCat(response_dir, "/commit_sharded.binarypb");
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  std::atomic<bool> recorded = false;
+  cohort::CohortServer server(
+      1, response_dir,
+      [&data, &data_mutex, &record_path, &recorded]() {
+        return std::make_unique<TwoShardDb>(data, data_mutex, record_path,
+                                            recorded);
+      },
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  grpc::ServerContext context;
+  // "a" and "b" are in different shards.
+  const cohort::PrepareTransactionRequest request =
+      OnlyCohortPuts("sharded", {"a", "b"});
+  cohort::PrepareTransactionResponse prepare_response;
+  ASSERT_TRUE(
+      server.PrepareTransaction(&context, &request, &prepare_response).ok());
+
+  EXPECT_TRUE(WaitForResult(server, "sharded").has_committed_response());
+  EXPECT_TRUE(recorded);
+  EXPECT_FALSE(std::filesystem::exists(record_path));
+}
+
+TEST(CohortServerTest, IgnoresResentRequestsOfFinishedTransactions) {
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  std::atomic<int> commits = 0;
+  cohort::CohortServer server(
+      4, "/tmp/txn_responses",
+      [&data, &data_mutex, &commits]() {
+        ++commits;
+        return std::make_unique<InMemoryDb>(data, data_mutex);
+      },
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  grpc::ServerContext context;
+  const cohort::PrepareTransactionRequest request =
+      OnlyCohortPuts("resent", {"a"});
+  cohort::PrepareTransactionResponse prepare_response;
+  // Resent while the transaction runs and after it finished.
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(
+        server.PrepareTransaction(&context, &request, &prepare_response).ok());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  EXPECT_TRUE(WaitForResult(server, "resent").has_committed_response());
+  ASSERT_TRUE(
+      server.PrepareTransaction(&context, &request, &prepare_response).ok());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(commits, 1);
+}
+
+TEST(CohortServerTest, RecoverCommitsRedoesRecordedWrites) {
+  const std::string response_dir =
+      absl::StrCat(testing::TempDir(), "/interrupted_commit_responses");
+  std::filesystem::create_directories(response_dir);
+  const std::string record_path =
+      absl::StrCat(response_dir, "/commit_interrupted.binarypb");
+  cohort::CommitRecord record;
+  record.set_transaction_id("interrupted");
+  (*record.mutable_writes())["a"] = Int64Value(1);
+  (*record.mutable_writes())["b"] = Int64Value(2);
+  {
+    std::ofstream output(record_path, std::ios::binary);
+    ASSERT_TRUE(record.SerializeToOstream(&output));
+  }
+  absl::Mutex data_mutex;
+  // "a" committed before the crash.
+  absl::flat_hash_map<std::string, std::string> data = {{"a", Int64Value(1)}};
+  cohort::CohortServer server(
+      1, response_dir, GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+
+  ASSERT_TRUE(server.RecoverCommits().ok());
+  EXPECT_EQ(data["a"], Int64Value(1));
+  EXPECT_EQ(data["b"], Int64Value(2));
+  EXPECT_FALSE(std::filesystem::exists(record_path));
+}
+
+TEST(CohortServerTest, ReadCacheServesCommittedWrites) {
+  grpc::ServerContext context;
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data = {{"a", Int64Value(1)}};
+  cohort::CohortServerOptions options;
+  options.read_cache_bytes = 1 << 20;
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()),
+      options);
+  // Runs a transaction that optionally sets a to |put_value| and then gets a.
+  const auto put_and_get = [&server, &context](const std::string& id,
+                                               absl::optional<int> put_value) {
+    cohort::PrepareTransactionRequest prepare_request;
+    cohort::PrepareTransactionResponse prepare_response;
+    prepare_request.mutable_config()
+        ->mutable_presumed_abort_time()
+        ->set_seconds(absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+    prepare_request.set_transaction_id(id);
+    prepare_request.set_only_cohort(true);
+    if (put_value.has_value()) {
+      common::Operation* operation =
+          prepare_request.mutable_transaction()->add_ops();
+      operation->mutable_put()->set_key("a");
+      operation->mutable_put()
+          ->mutable_value()
+          ->mutable_constant_value()
+          ->set_int64_value(*put_value);
+    }
+    prepare_request.mutable_transaction()->add_ops()->mutable_get()->set_key(
+        "a");
+    EXPECT_TRUE(
+        server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+            .ok());
+    cohort::GetTransactionResultRequest get_request;
+    get_request.set_transaction_id(id);
+    cohort::GetTransactionResultResponse get_response;
+    // Necessary so it can process the transaction.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_TRUE(
+        server.GetTransactionResult(&context, &get_request, &get_response)
+            .ok());
+    return get_response.committed_response().get_responses(0).value();
+  };
+
+  // Misses and caches a = 1.
+  EXPECT_THAT(put_and_get("id1", absl::nullopt),
+              EqualsProto(R"pb(int64_value: 1)pb"));
+  // Reads its own write without the cache and updates the cache on commit.
+  EXPECT_THAT(put_and_get("id2", 5), EqualsProto(R"pb(int64_value: 5)pb"));
+  // Hits.
+  EXPECT_THAT(put_and_get("id3", absl::nullopt),
+              EqualsProto(R"pb(int64_value: 5)pb"));
+
+  cohort::GetReadCacheStatsRequest stats_request;
+  cohort::GetReadCacheStatsResponse stats_response;
+  EXPECT_TRUE(
+      server.GetReadCacheStats(&context, &stats_request, &stats_response)
+          .ok());
+  EXPECT_THAT(stats_response, EqualsProto(R"pb(hits: 1
+                                                misses: 1
+                                                hit_ratio: 0.5
+                                                entries: 1
+                                                bytes: 131)pb"));
+}
+
+TEST(CohortServerTest, NonIntegerValuesKeepTheirType) {
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+  prepare_request.set_transaction_id("typed id");
+  prepare_request.set_only_cohort(true);
+  // s = "hi", d += 0.25 (default 1.5), get s, get d, get b, get b. Only the
+  // last get of b can take its value instead of copying it.
+  common::Operation* operation =
+      prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_put()->set_key("s");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_string_value("hi");
+  operation = prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_put()->set_key("d");
+  common::RelativeValue* relative_value =
+      operation->mutable_put()->mutable_value()->mutable_relative_value();
+  relative_value->mutable_relative_value()->set_double_value(0.25);
+  relative_value->mutable_default_value()->set_double_value(1.5);
+  prepare_request.mutable_transaction()->add_ops()->mutable_get()->set_key(
+      "s");
+  prepare_request.mutable_transaction()->add_ops()->mutable_get()->set_key(
+      "d");
+  prepare_request.mutable_transaction()->add_ops()->mutable_get()->set_key(
+      "b");
+  prepare_request.mutable_transaction()->add_ops()->mutable_get()->set_key(
+      "b");
+  absl::Mutex data_mutex;
+  common::ConstantValue bytes_value;
+  bytes_value.set_bytes_value(std::string("\0\xff", 2));
+  absl::flat_hash_map<std::string, std::string> data = {
+      {"b", bytes_value.SerializeAsString()}};
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("typed id");
+  cohort::GetTransactionResultResponse get_response;
+  // Necessary so it can process the transaction.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  EXPECT_TRUE(
+      server.GetTransactionResult(&context, &get_request, &get_response).ok());
+  EXPECT_THAT(get_response, EqualsProto(R"pb(committed_response {
+                                               get_responses {
+                                                 namespace {}
+                                                 get { key: "s" }
+                                                 value { string_value: "hi" }
+                                               }
+                                               get_responses {
+                                                 namespace {}
+                                                 get { key: "d" }
+                                                 value { double_value: 1.75 }
+                                               }
+                                               get_responses {
+                                                 namespace {}
+                                                 get { key: "b" }
+                                                 value {
+                                                   bytes_value: "\000\377"
+                                                 }
+                                               }
+                                               get_responses {
+                                                 namespace {}
+                                                 get { key: "b" }
+                                                 value {
+                                                   bytes_value: "\000\377"
+                                                 }
+                                               }
+                                             })pb"));
+}
+
+TEST(CohortServerTest, RelativePutOnStringAborts) {
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+  prepare_request.set_transaction_id("invalid type id");
+  prepare_request.set_only_cohort(true);
+  common::Operation* operation =
+      prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_put()->set_key("s");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_relative_value()
+      ->mutable_relative_value()
+      ->set_int64_value(1);
+  absl::Mutex data_mutex;
+  common::ConstantValue string_value;
+  string_value.set_string_value("hi");
+  absl::flat_hash_map<std::string, std::string> data = {
+      {"s", string_value.SerializeAsString()}};
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("invalid type id");
+  cohort::GetTransactionResultResponse get_response;
+  // Necessary so it can process the transaction.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  EXPECT_TRUE(
+      server.GetTransactionResult(&context, &get_request, &get_response).ok());
+  EXPECT_THAT(
+      get_response,
+      EqualsProto(
+          R"pb(aborted_response: ABORT_REASON_RELATIVE_VALUE_INVALID_TYPE)pb"));
+  absl::MutexLock lock(&data_mutex);
+  EXPECT_EQ(data["s"], string_value.SerializeAsString());
+}
+
+TEST(CohortServerTest, GetResultForUnknownTransactionIsNotFound) {
+  grpc::ServerContext context;
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("unknown id");
+  cohort::GetTransactionResultResponse get_response;
+  EXPECT_EQ(server.GetTransactionResult(&context, &get_request, &get_response)
+                .error_code(),
+            grpc::NOT_FOUND);
+}
+
+TEST(CohortServerTest, StreamSnapshotWithoutSnapshotSupportFails) {
+  grpc::ServerContext context;
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data;
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  cohort::StreamSnapshotRequest request;
+  EXPECT_EQ(server.StreamSnapshot(&context, &request, /*writer=*/nullptr)
+                .error_code(),
+            grpc::FAILED_PRECONDITION);
+}
+
+TEST(CohortServerTest, RangeGetsSeeEarlierWritesInKeyOrder) {
+  grpc::ServerContext context;
+  cohort::PrepareTransactionRequest prepare_request;
+  cohort::PrepareTransactionResponse prepare_response;
+  prepare_request.mutable_config()->mutable_presumed_abort_time()->set_seconds(
+      absl::ToUnixSeconds(absl::Now() + absl::Seconds(5)));
+  prepare_request.set_transaction_id("range id");
+  prepare_request.set_only_cohort(true);
+  // acct/2 = 20, get prefix acct/, get [acct/1, acct/3) with limit 1.
+  common::Operation* operation =
+      prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_put()->set_key("acct/2");
+  operation->mutable_put()
+      ->mutable_value()
+      ->mutable_constant_value()
+      ->set_int64_value(20);
+  operation = prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_get()->set_prefix("acct/");
+  operation = prepare_request.mutable_transaction()->add_ops();
+  operation->mutable_get()->mutable_key_range()->set_start_key("acct/1");
+  operation->mutable_get()->mutable_key_range()->set_end_key("acct/3");
+  operation->mutable_get()->set_limit(1);
+  absl::Mutex data_mutex;
+  absl::flat_hash_map<std::string, std::string> data = {
+      {"acct/3", Int64Value(30)},
+      {"acct/1", Int64Value(10)},
+      {"acct0", Int64Value(0)},
+      {"acc", Int64Value(-1)}};
+  cohort::CohortServer server(
+      1, "/tmp/txn_responses", GetDbCreatorFunc(data, data_mutex),
+      std::make_unique<blockchain::TwoPhaseCommit>(
+          std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()));
+  EXPECT_TRUE(
+      server.PrepareTransaction(&context, &prepare_request, &prepare_response)
+          .ok());
+  cohort::GetTransactionResultRequest get_request;
+  get_request.set_transaction_id("range id");
+  cohort::GetTransactionResultResponse get_response;
+  // Necessary so it can process the transaction.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  EXPECT_TRUE(
+      server.GetTransactionResult(&context, &get_request, &get_response).ok());
+  EXPECT_THAT(get_response, EqualsProto(R"pb(committed_response {
+                                               get_responses {
+                                                 namespace {}
+                                                 get { prefix: "acct/" }
+                                                 key_values {
+                                                   key: "acct/1"
+                                                   value { int64_value: 10 }
+                                                 }
+                                                 key_values {
+                                                   key: "acct/2"
+                                                   value { int64_value: 20 }
+                                                 }
+                                                 key_values {
+                                                   key: "acct/3"
+                                                   value { int64_value: 30 }
+                                                 }
+                                               }
+                                               get_responses {
+                                                 namespace {}
+                                                 get {
+                                                   key_range {
+                                                     start_key: "acct/1"
+                                                     end_key: "acct/3"
+                                                   }
+                                                   limit: 1
+                                                 }
+                                                 key_values {
+                                                   key: "acct/1"
+                                                   value { int64_value: 10 }
+                                                 }
+                                               }
+                                             })pb"));
+}
+
+TEST(CohortServerTest, ChunkTransactionResultSplitsLargeRangeGets) {
+  cohort::GetTransactionResultResponse response;
+  common::GetResponse* point_get =
+      response.mutable_committed_response()->add_get_responses();
+  point_get->mutable_get()->set_key("a");
+  point_get->mutable_value()->set_int64_value(1);
+  common::GetResponse* range_get =
+      response.mutable_committed_response()->add_get_responses();
+  range_get->mutable_get()->set_prefix("p");
+  for (int i = 0; i < 100; ++i) {
+    common::KeyValue* key_value = range_get->add_key_values();
+    key_value->set_key(absl::StrCat("p", i));
+    key_value->mutable_value()->set_int64_value(i);
+  }
+
+  const std::vector<cohort::GetTransactionResultResponse> chunks =
+      cohort::internal::ChunkTransactionResult(response, 200);
+  EXPECT_THAT(chunks, SizeIs(Gt(1)));
+  // The range get doesn't fit next to the point get, so it starts the second
+  // chunk and every later one continues it.
+  ASSERT_THAT(chunks, SizeIs(Gt(2)));
+  EXPECT_FALSE(chunks[0].continues_get_response());
+  EXPECT_FALSE(chunks[1].continues_get_response());
+  for (size_t i = 2; i < chunks.size(); ++i) {
+    EXPECT_TRUE(chunks[i].continues_get_response());
+  }
+  cohort::GetTransactionResultResponse merged;
+  for (const cohort::GetTransactionResultResponse& chunk : chunks) {
+    EXPECT_LE(chunk.committed_response().ByteSizeLong(), 250);
+    merged.mutable_committed_response()->MergeFrom(chunk.committed_response());
+  }
+  // Concatenating the key values of the split range get gives back the
+  // original.
+  cohort::GetTransactionResultResponse rejoined;
+  *rejoined.mutable_committed_response()->add_get_responses() =
+      merged.committed_response().get_responses(0);
+  common::GetResponse* rejoined_range =
+      rejoined.mutable_committed_response()->add_get_responses();
+  *rejoined_range->mutable_get() =
+      merged.committed_response().get_responses(1).get();
+  for (int i = 1; i < merged.committed_response().get_responses_size(); ++i) {
+    EXPECT_THAT(merged.committed_response().get_responses(i).get(),
+                EqualsProto(R"pb(prefix: "p")pb"));
+    rejoined_range->mutable_key_values()->MergeFrom(
+        merged.committed_response().get_responses(i).key_values());
+  }
+  EXPECT_THAT(rejoined, EqualsProto(response));
+}
+
+TEST(CohortServerTest, ChunkTransactionResultKeepsAbortedResponse) {
+  cohort::GetTransactionResultResponse response;
+  response.set_aborted_response(common::ABORT_REASON_UNSPECIFIED);
+  EXPECT_THAT(cohort::internal::ChunkTransactionResult(response, 1),
+              ElementsAre(EqualsProto(response)));
+}
+
+}  // namespace
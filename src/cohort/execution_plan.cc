@@ -0,0 +1,29 @@
+#include "src/cohort/execution_plan.h"
+
+#include "absl/strings/string_view.h"
+
+namespace cohort {
+
+ExecutionPlan PlanOperations(absl::Span<const common::Operation* const> ops,
+                             std::pmr::memory_resource* arena) {
+  ExecutionPlan plan(arena);
+  plan.op_keys.reserve(ops.size());
+  ArenaHashMap<absl::string_view, size_t> key_indices(arena);
+  for (const common::Operation* op : ops) {
+    const std::string& key = op->has_get() ? op->get().key() : op->put().key();
+    const auto [it, inserted] = key_indices.emplace(key, plan.keys.size());
+    if (inserted) {
+      KeyPlan& key_plan = plan.keys.emplace_back();
+      key_plan.key = &key;
+      key_plan.read =
+          op->has_get() || !op->put().value().has_constant_value();
+    }
+    KeyPlan& key_plan = plan.keys[it->second];
+    key_plan.write |= op->has_put();
+    key_plan.last_op = plan.op_keys.size();
+    plan.op_keys.push_back(it->second);
+  }
+  return plan;
+}
+
+}  // namespace cohort
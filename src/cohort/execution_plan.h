@@ -0,0 +1,50 @@
+#ifndef SRC_COHORT_EXECUTION_PLAN_H_
+
+#define SRC_COHORT_EXECUTION_PLAN_H_
+
+#include <memory_resource>
+#include <string>
+
+#include "absl/types/span.h"
+#include "src/cohort/transaction_arena.h"
+#include "src/proto/common.pb.h"
+
+namespace cohort {
+
+struct KeyPlan {
+  // Points into the key of the key's first op.
+  const std::string* key;
+  // Whether the ops need the key's stored value, which is the case unless its
+  // first op is a constant put.
+  bool read = false;
+  // Whether any op puts the key.
+  bool write = false;
+  // Index of the key's last op, after which its in-memory value is only
+  // needed to write it.
+  size_t last_op = 0;
+};
+
+// Per-key plan of a run of single-key gets and puts. Running the ops in order
+// against an in-memory value per key (read once from the DB if needed) and
+// writing each put key's final value once gives the same results as running
+// every op against the DB, with one read and one write per key instead of one
+// per op.
+struct ExecutionPlan {
+  explicit ExecutionPlan(std::pmr::memory_resource* arena)
+      : keys(arena), op_keys(arena) {}
+
+  // Keys used by the ops, in order of first use.
+  ArenaVector<KeyPlan> keys;
+  // Index in |keys| of the key of each op.
+  ArenaVector<size_t> op_keys;
+};
+
+// Plans |ops|, which must all be single-key gets or puts, allocating the plan
+// in |arena|.
+ExecutionPlan PlanOperations(
+    absl::Span<const common::Operation* const> ops,
+    std::pmr::memory_resource* arena = std::pmr::get_default_resource());
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_EXECUTION_PLAN_H_
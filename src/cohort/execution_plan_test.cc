@@ -0,0 +1,91 @@
+#include "src/cohort/execution_plan.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cohort {
+
+namespace {
+
+using ::testing::ElementsAre;
+
+common::Operation Get(const std::string& key) {
+  common::Operation op;
+  op.mutable_get()->set_key(key);
+  return op;
+}
+
+common::Operation ConstantPut(const std::string& key) {
+  common::Operation op;
+  op.mutable_put()->set_key(key);
+  op.mutable_put()->mutable_value()->mutable_constant_value()->set_int64_value(
+      1);
+  return op;
+}
+
+common::Operation RelativePut(const std::string& key) {
+  common::Operation op;
+  op.mutable_put()->set_key(key);
+  op.mutable_put()
+      ->mutable_value()
+      ->mutable_relative_value()
+      ->mutable_relative_value()
+      ->set_int64_value(1);
+  return op;
+}
+
+ExecutionPlan Plan(const std::vector<common::Operation>& ops) {
+  std::vector<const common::Operation*> op_pointers;
+  for (const common::Operation& op : ops) {
+    op_pointers.push_back(&op);
+  }
+  return PlanOperations(op_pointers);
+}
+
+TEST(ExecutionPlanTest, GroupsOpsByKeyInOrderOfFirstUse) {
+  const std::vector<common::Operation> ops = {
+      RelativePut("a"), RelativePut("a"), Get("b"), RelativePut("a"),
+      Get("a")};
+  const ExecutionPlan plan = Plan(ops);
+  ASSERT_EQ(plan.keys.size(), 2);
+  EXPECT_EQ(*plan.keys[0].key, "a");
+  EXPECT_TRUE(plan.keys[0].read);
+  EXPECT_TRUE(plan.keys[0].write);
+  EXPECT_EQ(*plan.keys[1].key, "b");
+  EXPECT_TRUE(plan.keys[1].read);
+  EXPECT_FALSE(plan.keys[1].write);
+  EXPECT_THAT(plan.op_keys, ElementsAre(0, 0, 1, 0, 0));
+  EXPECT_EQ(plan.keys[0].last_op, 4);
+  EXPECT_EQ(plan.keys[1].last_op, 2);
+}
+
+TEST(ExecutionPlanTest, PlanIsAllocatedInTheArena) {
+  const std::vector<common::Operation> ops = {Get("a"), Get("b"), Get("a")};
+  std::vector<const common::Operation*> op_pointers;
+  for (const common::Operation& op : ops) {
+    op_pointers.push_back(&op);
+  }
+  TransactionArena arena;
+  const ExecutionPlan plan = PlanOperations(op_pointers, &arena);
+  EXPECT_EQ(plan.keys.get_allocator().resource(), &arena);
+  EXPECT_EQ(plan.keys.size(), 2);
+}
+
+TEST(ExecutionPlanTest, KeysFirstOverwrittenAreNotRead) {
+  const std::vector<common::Operation> ops = {ConstantPut("a"), Get("a"),
+                                              RelativePut("a"), Get("b"),
+                                              ConstantPut("b")};
+  const ExecutionPlan plan = Plan(ops);
+  ASSERT_EQ(plan.keys.size(), 2);
+  EXPECT_FALSE(plan.keys[0].read);
+  EXPECT_TRUE(plan.keys[0].write);
+  // The get comes before the put, so it needs the stored value.
+  EXPECT_TRUE(plan.keys[1].read);
+  EXPECT_TRUE(plan.keys[1].write);
+}
+
+}  // namespace
+
+}  // namespace cohort
@@ -0,0 +1,76 @@
+#include "src/cohort/final_response_store.h"
+
+#include <algorithm>
+
+#include "absl/hash/hash.h"
+
+namespace cohort {
+
+FinalResponseStore::FinalResponseStore(size_t max_responses,
+                                       absl::Duration ttl)
+    : max_responses_per_shard_(
+          std::max<size_t>(1, (max_responses + kNumShards - 1) / kNumShards)),
+      ttl_(ttl) {}
+
+FinalResponseStore::Shard& FinalResponseStore::GetShard(
+    const std::string& transaction_id) {
+  return shards_[absl::Hash<std::string>{}(transaction_id) % kNumShards];
+}
+
+void FinalResponseStore::EvictLocked(Shard& shard, absl::Time now) {
+  while (!shard.insertion_order.empty() &&
+         (shard.insertion_order.size() > max_responses_per_shard_ ||
+          now - shard.insertion_order.front().second >= ttl_)) {
+    const auto& [transaction_id, insert_time] = shard.insertion_order.front();
+    auto it = shard.entries.find(transaction_id);
+    // The response may have been replaced since, in which case a later
+    // position in the insertion order is responsible for it.
+    if (it != shard.entries.end() && it->second.insert_time == insert_time) {
+      shard.entries.erase(it);
+    }
+    shard.insertion_order.pop_front();
+  }
+}
+
+void FinalResponseStore::Insert(const std::string& transaction_id,
+                                GetTransactionResultResponse response) {
+  const absl::Time now = Now();
+  Shard& shard = GetShard(transaction_id);
+  absl::MutexLock lock(&shard.mutex);
+  Entry& entry = shard.entries[transaction_id];
+  entry.response.Swap(&response);
+  entry.insert_time = now;
+  shard.insertion_order.emplace_back(transaction_id, now);
+  EvictLocked(shard, now);
+}
+
+absl::optional<GetTransactionResultResponse> FinalResponseStore::Get(
+    const std::string& transaction_id) {
+  const absl::Time now = Now();
+  Shard& shard = GetShard(transaction_id);
+  absl::MutexLock lock(&shard.mutex);
+  auto it = shard.entries.find(transaction_id);
+  if (it == shard.entries.end() || now - it->second.insert_time >= ttl_) {
+    return absl::nullopt;
+  }
+  return it->second.response;
+}
+
+bool FinalResponseStore::Contains(const std::string& transaction_id) {
+  const absl::Time now = Now();
+  Shard& shard = GetShard(transaction_id);
+  absl::MutexLock lock(&shard.mutex);
+  auto it = shard.entries.find(transaction_id);
+  return it != shard.entries.end() && now - it->second.insert_time < ttl_;
+}
+
+size_t FinalResponseStore::size() const {
+  size_t total = 0;
+  for (const Shard& shard : shards_) {
+    absl::MutexLock lock(&shard.mutex);
+    total += shard.entries.size();
+  }
+  return total;
+}
+
+}  // namespace cohort
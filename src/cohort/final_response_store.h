@@ -0,0 +1,78 @@
+#ifndef SRC_COHORT_FINAL_RESPONSE_STORE_H_
+
+#define SRC_COHORT_FINAL_RESPONSE_STORE_H_
+
+#include <array>
+#include <deque>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "src/proto/cohort.pb.h"
+
+namespace cohort {
+
+// Thread-safe store for the final (committed or aborted) responses of
+// transactions so the coordinator can fetch them after the cohort is done.
+// Responses are only kept for |ttl| and at most |max_responses| are kept at
+// once (oldest are evicted first), so memory doesn't grow with the number of
+// transactions the cohort has ever processed.
+class FinalResponseStore {
+ public:
+  FinalResponseStore(size_t max_responses, absl::Duration ttl);
+  virtual ~FinalResponseStore() = default;
+
+  // Stores the final response for |transaction_id|, evicting expired or
+  // excess responses.
+  void Insert(const std::string& transaction_id,
+              GetTransactionResultResponse response);
+
+  // Returns the final response for |transaction_id| or nullopt if there isn't
+  // one or it has expired.
+  absl::optional<GetTransactionResultResponse> Get(
+      const std::string& transaction_id);
+
+  // Same as Get(transaction_id).has_value(), without copying the response.
+  bool Contains(const std::string& transaction_id);
+
+  // Number of responses currently retained (including expired responses that
+  // haven't been evicted yet).
+  size_t size() const;
+
+ protected:
+  // Virtual so it can be mocked out for testing.
+  virtual absl::Time Now() { return absl::Now(); }
+
+ private:
+  static constexpr size_t kNumShards = 16;
+
+  struct Entry {
+    GetTransactionResultResponse response;
+    absl::Time insert_time;
+  };
+
+  struct Shard {
+    mutable absl::Mutex mutex;
+    absl::flat_hash_map<std::string, Entry> entries ABSL_GUARDED_BY(mutex);
+    // Transaction ids in insertion order, used to evict the oldest first.
+    std::deque<std::pair<std::string, absl::Time>> insertion_order
+        ABSL_GUARDED_BY(mutex);
+  };
+
+  Shard& GetShard(const std::string& transaction_id);
+
+  // Evicts responses from the front of the shard's insertion order that have
+  // expired or don't fit in the shard.
+  void EvictLocked(Shard& shard, absl::Time now)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mutex);
+
+  const size_t max_responses_per_shard_;
+  const absl::Duration ttl_;
+  std::array<Shard, kNumShards> shards_;
+};
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_FINAL_RESPONSE_STORE_H_
@@ -0,0 +1,70 @@
+#include "src/cohort/final_response_store.h"
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "protobuf-matchers/protocol-buffer-matchers.h"
+#include "src/proto/cohort.pb.h"
+
+namespace {
+using ::protobuf_matchers::EqualsProto;
+
+class FinalResponseStoreWithMockTime : public cohort::FinalResponseStore {
+ public:
+  FinalResponseStoreWithMockTime(size_t max_responses, absl::Duration ttl)
+      : cohort::FinalResponseStore(max_responses, ttl) {}
+
+  absl::Time now = absl::FromUnixSeconds(10);
+
+ private:
+  absl::Time Now() override { return now; }
+};
+
+cohort::GetTransactionResultResponse AbortedResponse() {
+  cohort::GetTransactionResultResponse response;
+  response.set_aborted_response(
+      common::ABORT_REASON_PRESUMED_ABORT_TIMESTAMP_REACHED);
+  return response;
+}
+
+TEST(FinalResponseStoreTest, ReturnsInsertedResponse) {
+  FinalResponseStoreWithMockTime store(10, absl::Minutes(1));
+  store.Insert("id", AbortedResponse());
+  ASSERT_TRUE(store.Get("id").has_value());
+  EXPECT_THAT(
+      *store.Get("id"),
+      EqualsProto(
+          R"pb(aborted_response: ABORT_REASON_PRESUMED_ABORT_TIMESTAMP_REACHED)pb"));
+  EXPECT_FALSE(store.Get("other id").has_value());
+  EXPECT_TRUE(store.Contains("id"));
+  EXPECT_FALSE(store.Contains("other id"));
+}
+
+TEST(FinalResponseStoreTest, ExpiresResponsesAfterTtl) {
+  FinalResponseStoreWithMockTime store(10000, absl::Minutes(1));
+  store.Insert("old", AbortedResponse());
+  store.now += absl::Seconds(59);
+  EXPECT_TRUE(store.Get("old").has_value());
+  store.now += absl::Seconds(1);
+  EXPECT_FALSE(store.Get("old").has_value());
+  EXPECT_FALSE(store.Contains("old"));
+  // Expired responses are evicted once there are new insertions.
+  for (int i = 0; i < 1000; ++i) {
+    store.Insert(absl::StrCat("new", i), AbortedResponse());
+  }
+  EXPECT_EQ(store.size(), 1000);
+}
+
+TEST(FinalResponseStoreTest, BoundsNumberOfResponses) {
+  FinalResponseStoreWithMockTime store(160, absl::Hours(1));
+  for (int i = 0; i < 10000; ++i) {
+    store.Insert(absl::StrCat("id", i), AbortedResponse());
+  }
+  EXPECT_LE(store.size(), 160);
+  // The most recent response is always kept.
+  EXPECT_TRUE(store.Get("id9999").has_value());
+  EXPECT_FALSE(store.Get("id0").has_value());
+}
+
+}  // namespace
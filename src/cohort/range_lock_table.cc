@@ -0,0 +1,92 @@
+#include "src/cohort/range_lock_table.h"
+
+#include <algorithm>
+
+namespace cohort {
+
+namespace {
+
+bool RangeContains(const common::KeyRange& range, absl::string_view key) {
+  return key >= range.start_key() &&
+         (range.end_key().empty() || key < range.end_key());
+}
+
+}  // namespace
+
+bool RangeLockTable::KeyIsFree(Owner owner, absl::string_view key) const {
+  return std::none_of(locked_ranges_.begin(), locked_ranges_.end(),
+                      [owner, &key](const auto& locked_range) {
+                        return locked_range.second != owner &&
+                               RangeContains(locked_range.first, key);
+                      });
+}
+
+bool RangeLockTable::RangeIsFree(Owner owner,
+                                 const common::KeyRange& range) const {
+  for (auto it = locked_keys_.lower_bound(range.start_key());
+       it != locked_keys_.end() && RangeContains(range, it->first); ++it) {
+    if (it->second != owner) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RangeLockTable::LockKeys(Owner owner,
+                              absl::Span<const absl::string_view> keys,
+                              absl::Time deadline) {
+  const auto can_lock = [this, owner, keys]() {
+    mutex_.AssertReaderHeld();
+    return std::all_of(keys.begin(), keys.end(), [&](absl::string_view key) {
+      return KeyIsFree(owner, key);
+    });
+  };
+  absl::MutexLock lock(&mutex_);
+  if (!mutex_.AwaitWithDeadline(absl::Condition(&can_lock), deadline)) {
+    return false;
+  }
+  std::vector<LockedKeys::iterator>& owner_keys = locked_keys_by_owner_[owner];
+  for (const absl::string_view key : keys) {
+    owner_keys.push_back(locked_keys_.emplace(std::string(key), owner));
+  }
+  return true;
+}
+
+bool RangeLockTable::LockRanges(Owner owner,
+                                absl::Span<const common::KeyRange> ranges,
+                                absl::Time deadline) {
+  const auto can_lock = [this, owner, ranges]() {
+    mutex_.AssertReaderHeld();
+    return std::all_of(ranges.begin(), ranges.end(),
+                       [&](const common::KeyRange& range) {
+                         return RangeIsFree(owner, range);
+                       });
+  };
+  absl::MutexLock lock(&mutex_);
+  if (!mutex_.AwaitWithDeadline(absl::Condition(&can_lock), deadline)) {
+    return false;
+  }
+  for (const common::KeyRange& range : ranges) {
+    locked_ranges_.emplace_back(range, owner);
+  }
+  return true;
+}
+
+void RangeLockTable::Unlock(Owner owner) {
+  absl::MutexLock lock(&mutex_);
+  if (auto it = locked_keys_by_owner_.find(owner);
+      it != locked_keys_by_owner_.end()) {
+    for (const LockedKeys::iterator& key_it : it->second) {
+      locked_keys_.erase(key_it);
+    }
+    locked_keys_by_owner_.erase(it);
+  }
+  locked_ranges_.erase(
+      std::remove_if(locked_ranges_.begin(), locked_ranges_.end(),
+                     [owner](const auto& locked_range) {
+                       return locked_range.second == owner;
+                     }),
+      locked_ranges_.end());
+}
+
+}  // namespace cohort
@@ -0,0 +1,72 @@
+#ifndef SRC_COHORT_RANGE_LOCK_TABLE_H_
+
+#define SRC_COHORT_RANGE_LOCK_TABLE_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "src/proto/common.pb.h"
+
+namespace cohort {
+
+// Locks key ranges against writes to keys inside them. Per-key locks can't do
+// this since a range read also depends on keys that don't exist yet (phantoms).
+// Transactions read lock the ranges they scan and write lock the keys they
+// put. A locked range conflicts with a locked key inside it unless both are
+// held by the same owner (i.e. a transaction can write inside a range it
+// read). Ranges never conflict with other ranges and keys never conflict with
+// other keys; the per-key locks handle those.
+// An owner is an opaque pointer identifying the transaction (e.g. the address
+// of its metadata).
+class RangeLockTable {
+ public:
+  using Owner = const void*;
+
+  RangeLockTable() = default;
+  RangeLockTable(const RangeLockTable&) = delete;
+  RangeLockTable& operator=(const RangeLockTable&) = delete;
+
+  // Waits until none of |keys| are in a range locked by another owner, then
+  // locks them for |owner|. Returns false without locking anything if that
+  // doesn't happen before |deadline|.
+  bool LockKeys(Owner owner, absl::Span<const absl::string_view> keys,
+                absl::Time deadline);
+
+  // Waits until no key locked by another owner is in any of |ranges|, then
+  // locks them for |owner|. An empty end key means the range has no upper
+  // bound. Returns false without locking anything if that doesn't happen
+  // before |deadline|.
+  bool LockRanges(Owner owner, absl::Span<const common::KeyRange> ranges,
+                  absl::Time deadline);
+
+  // Releases every key and range locked by |owner|.
+  void Unlock(Owner owner);
+
+ private:
+  bool KeyIsFree(Owner owner, absl::string_view key) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  bool RangeIsFree(Owner owner, const common::KeyRange& range) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  using LockedKeys = std::multimap<std::string, Owner>;
+
+  mutable absl::Mutex mutex_;
+  LockedKeys locked_keys_ ABSL_GUARDED_BY(mutex_);
+  // Lets Unlock erase an owner's keys without scanning every locked key.
+  absl::flat_hash_map<Owner, std::vector<LockedKeys::iterator>>
+      locked_keys_by_owner_ ABSL_GUARDED_BY(mutex_);
+  std::vector<std::pair<common::KeyRange, Owner>> locked_ranges_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_RANGE_LOCK_TABLE_H_
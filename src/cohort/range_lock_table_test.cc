@@ -0,0 +1,68 @@
+#include "src/cohort/range_lock_table.h"
+
+#include <thread>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "src/proto/common.pb.h"
+
+namespace {
+
+common::KeyRange Range(const std::string& start_key,
+                       const std::string& end_key) {
+  common::KeyRange range;
+  range.set_start_key(start_key);
+  range.set_end_key(end_key);
+  return range;
+}
+
+absl::Time ShortDeadline() { return absl::Now() + absl::Milliseconds(10); }
+
+TEST(RangeLockTableTest, KeyInsideLockedRangeWaits) {
+  cohort::RangeLockTable table;
+  int reader, writer;
+  ASSERT_TRUE(table.LockRanges(&reader, {Range("b", "d")}, ShortDeadline()));
+  EXPECT_FALSE(table.LockKeys(&writer, {"c"}, ShortDeadline()));
+  EXPECT_TRUE(table.LockKeys(&writer, {"a", "d"}, ShortDeadline()));
+}
+
+TEST(RangeLockTableTest, RangeWithLockedKeyWaits) {
+  cohort::RangeLockTable table;
+  int reader, writer;
+  ASSERT_TRUE(table.LockKeys(&writer, {"c"}, ShortDeadline()));
+  EXPECT_FALSE(table.LockRanges(&reader, {Range("b", "d")}, ShortDeadline()));
+  EXPECT_FALSE(table.LockRanges(&reader, {Range("a", "")}, ShortDeadline()));
+  EXPECT_TRUE(table.LockRanges(&reader, {Range("a", "c")}, ShortDeadline()));
+}
+
+TEST(RangeLockTableTest, SameOwnerDoesNotConflict) {
+  cohort::RangeLockTable table;
+  int owner;
+  ASSERT_TRUE(table.LockRanges(&owner, {Range("b", "d")}, ShortDeadline()));
+  EXPECT_TRUE(table.LockKeys(&owner, {"c"}, ShortDeadline()));
+}
+
+TEST(RangeLockTableTest, RangesDoNotConflictWithEachOther) {
+  cohort::RangeLockTable table;
+  int reader1, reader2;
+  ASSERT_TRUE(table.LockRanges(&reader1, {Range("b", "d")}, ShortDeadline()));
+  EXPECT_TRUE(table.LockRanges(&reader2, {Range("a", "")}, ShortDeadline()));
+}
+
+TEST(RangeLockTableTest, UnlockWakesUpWaiters) {
+  cohort::RangeLockTable table;
+  int reader, writer;
+  ASSERT_TRUE(table.LockRanges(&reader, {Range("b", "d")}, ShortDeadline()));
+  std::thread unlocker([&table, &reader]() {
+    absl::SleepFor(absl::Milliseconds(10));
+    table.Unlock(&reader);
+  });
+  EXPECT_TRUE(
+      table.LockKeys(&writer, {"c"}, absl::Now() + absl::Seconds(10)));
+  unlocker.join();
+  table.Unlock(&writer);
+  EXPECT_TRUE(table.LockRanges(&reader, {Range("b", "d")}, ShortDeadline()));
+}
+
+}  // namespace
@@ -0,0 +1,121 @@
+#include "src/cohort/read_cache.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/hash/hash.h"
+
+namespace cohort {
+
+namespace {
+
+// Rough memory used by an entry besides its key and value (hash table slot,
+// entry, shared_ptr control block and string headers).
+constexpr size_t kEntryOverheadBytes = 128;
+
+}  // namespace
+
+ReadCache::ReadCache(const ReadCacheOptions& options)
+    : max_shard_bytes_(options.max_bytes / std::max<size_t>(options.num_shards,
+                                                            1)),
+      shards_(std::max<size_t>(options.num_shards, 1)) {}
+
+size_t ReadCache::EntryBytes(std::string_view key,
+                             const std::string& value) {
+  return key.size() + value.size() + kEntryOverheadBytes;
+}
+
+ReadCache::Shard& ReadCache::GetShard(std::string_view key) {
+  return shards_[absl::Hash<std::string_view>()(key) % shards_.size()];
+}
+
+ReadCache::Value ReadCache::Get(std::string_view key) {
+  Shard& shard = GetShard(key);
+  absl::MutexLock lock(&shard.mutex);
+  const auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  Entry& entry = shard.entries[it->second];
+  entry.referenced = true;
+  return entry.value;
+}
+
+void ReadCache::Insert(std::string_view key, std::string value) {
+  Set(key, std::move(value), /*insert=*/true);
+}
+
+void ReadCache::Update(std::string_view key, std::string value) {
+  Set(key, std::move(value), /*insert=*/false);
+}
+
+void ReadCache::Set(std::string_view key, std::string value, bool insert) {
+  const size_t bytes = EntryBytes(key, value);
+  Shard& shard = GetShard(key);
+  absl::MutexLock lock(&shard.mutex);
+  const auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    // Removes the old entry so the new value is accounted (and evicted) like
+    // a new entry. The reference bit isn't kept since updates aren't reads.
+    const size_t old_index = it->second;
+    shard.bytes -= EntryBytes(key, *shard.entries[old_index].value);
+    shard.index.erase(it);
+    if (old_index != shard.entries.size() - 1) {
+      shard.entries[old_index] = std::move(shard.entries.back());
+      shard.index[shard.entries[old_index].key] = old_index;
+    }
+    shard.entries.pop_back();
+  } else if (!insert) {
+    return;
+  }
+  if (bytes > max_shard_bytes_) {
+    return;
+  }
+  MakeRoom(shard, bytes);
+  shard.entries.push_back(
+      {std::string(key), std::make_shared<const std::string>(std::move(value)),
+       /*referenced=*/false});
+  shard.index[shard.entries.back().key] = shard.entries.size() - 1;
+  shard.bytes += bytes;
+}
+
+void ReadCache::MakeRoom(Shard& shard, size_t bytes) {
+  while (!shard.entries.empty() && shard.bytes + bytes > max_shard_bytes_) {
+    if (shard.hand >= shard.entries.size()) {
+      shard.hand = 0;
+    }
+    Entry& entry = shard.entries[shard.hand];
+    if (entry.referenced) {
+      entry.referenced = false;
+      ++shard.hand;
+      continue;
+    }
+    // Moves the last entry into the evicted one's slot, which the hand checks
+    // next.
+    shard.bytes -= EntryBytes(entry.key, *entry.value);
+    shard.index.erase(entry.key);
+    if (shard.hand != shard.entries.size() - 1) {
+      entry = std::move(shard.entries.back());
+      shard.index[entry.key] = shard.hand;
+    }
+    shard.entries.pop_back();
+    ++evictions_;
+  }
+}
+
+ReadCacheStats ReadCache::GetStats() const {
+  ReadCacheStats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  for (const Shard& shard : shards_) {
+    absl::MutexLock lock(&shard.mutex);
+    stats.entries += shard.entries.size();
+    stats.bytes += shard.bytes;
+  }
+  return stats;
+}
+
+}  // namespace cohort
@@ -0,0 +1,105 @@
+#ifndef SRC_COHORT_READ_CACHE_H_
+
+#define SRC_COHORT_READ_CACHE_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+
+namespace cohort {
+
+struct ReadCacheOptions {
+  // Maximum total size of the cached keys and values (plus a small overhead
+  // per entry). Split evenly between the shards.
+  size_t max_bytes = 64 << 20;
+  // Number of independently locked parts of the cache.
+  size_t num_shards = 16;
+};
+
+struct ReadCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  uint64_t entries = 0;
+  uint64_t bytes = 0;
+
+  // Fraction of lookups that were hits, or 0 if there were none.
+  double HitRatio() const {
+    return hits + misses == 0 ? 0 : static_cast<double>(hits) / (hits + misses);
+  }
+};
+
+// Byte-bounded cache of committed DB values for frequently read keys.
+// Each shard evicts with the CLOCK algorithm (an approximation of LRU): every
+// hit sets the entry's reference bit, and the clock hand evicts the first
+// entry it finds without one, clearing bits as it passes them.
+// The cache doesn't lock keys. Callers must only insert values read while
+// holding the key's read lock and update values while holding its write lock
+// (as the cohort does), so the cache never disagrees with the DB.
+class ReadCache {
+ public:
+  // Values are shared so that a reader can keep using one after it is
+  // evicted or replaced.
+  using Value = std::shared_ptr<const std::string>;
+
+  explicit ReadCache(const ReadCacheOptions& options = ReadCacheOptions());
+
+  ReadCache(const ReadCache&) = delete;
+  ReadCache& operator=(const ReadCache&) = delete;
+
+  // Returns the cached value of |key|, or nullptr on a miss.
+  Value Get(std::string_view key);
+
+  // Caches |value| for |key|, evicting other entries if needed. Values too
+  // big for a shard aren't cached.
+  void Insert(std::string_view key, std::string value);
+
+  // Replaces the value of |key| if it is cached. Used for committed writes,
+  // so keys that are written but never read don't take up space.
+  void Update(std::string_view key, std::string value);
+
+  ReadCacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    Value value;
+    bool referenced;
+  };
+
+  struct Shard {
+    mutable absl::Mutex mutex;
+    // Index of each key's entry in |entries|.
+    absl::flat_hash_map<std::string, size_t> index ABSL_GUARDED_BY(mutex);
+    std::vector<Entry> entries ABSL_GUARDED_BY(mutex);
+    size_t hand ABSL_GUARDED_BY(mutex) = 0;
+    size_t bytes ABSL_GUARDED_BY(mutex) = 0;
+  };
+
+  static size_t EntryBytes(std::string_view key, const std::string& value);
+
+  Shard& GetShard(std::string_view key);
+
+  // Sets the value of |key|, inserting it if |insert| is true and it isn't
+  // cached yet.
+  void Set(std::string_view key, std::string value, bool insert);
+
+  // Evicts entries until |bytes| more fit in |shard|.
+  void MakeRoom(Shard& shard, size_t bytes)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mutex);
+
+  const size_t max_shard_bytes_;
+  std::vector<Shard> shards_;
+  std::atomic<uint64_t> hits_ = 0;
+  std::atomic<uint64_t> misses_ = 0;
+  std::atomic<uint64_t> evictions_ = 0;
+};
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_READ_CACHE_H_
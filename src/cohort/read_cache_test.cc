@@ -0,0 +1,69 @@
+#include "src/cohort/read_cache.h"
+
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// A single shard makes eviction order predictable.
+cohort::ReadCacheOptions SingleShardOptions(size_t max_bytes) {
+  cohort::ReadCacheOptions options;
+  options.max_bytes = max_bytes;
+  options.num_shards = 1;
+  return options;
+}
+
+TEST(ReadCacheTest, GetReturnsInsertedValueAndCountsHits) {
+  cohort::ReadCache cache;
+  EXPECT_EQ(cache.Get("key"), nullptr);
+  cache.Insert("key", "value");
+  cohort::ReadCache::Value value = cache.Get("key");
+  ASSERT_NE(value, nullptr);
+  EXPECT_EQ(*value, "value");
+
+  const cohort::ReadCacheStats stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.entries, 1);
+  EXPECT_DOUBLE_EQ(stats.HitRatio(), 0.5);
+}
+
+TEST(ReadCacheTest, UpdateOnlyReplacesCachedValues) {
+  cohort::ReadCache cache;
+  cache.Insert("cached", "old");
+  cohort::ReadCache::Value old_value = cache.Get("cached");
+  cache.Update("cached", "new");
+  cache.Update("uncached", "new");
+
+  EXPECT_EQ(*cache.Get("cached"), "new");
+  EXPECT_EQ(cache.Get("uncached"), nullptr);
+  // Readers keep the value they got.
+  EXPECT_EQ(*old_value, "old");
+}
+
+TEST(ReadCacheTest, EvictsUnreferencedEntriesFirst) {
+  // Fits two entries with one byte keys and values.
+  cohort::ReadCache cache(SingleShardOptions(2 * 130 + 10));
+  cache.Insert("a", "1");
+  cache.Insert("b", "2");
+  ASSERT_NE(cache.Get("a"), nullptr);
+  cache.Insert("c", "3");
+
+  EXPECT_NE(cache.Get("a"), nullptr);
+  EXPECT_EQ(cache.Get("b"), nullptr);
+  EXPECT_NE(cache.Get("c"), nullptr);
+  EXPECT_EQ(cache.GetStats().evictions, 1);
+}
+
+TEST(ReadCacheTest, StaysWithinMaxBytes) {
+  constexpr size_t kMaxBytes = 10000;
+  cohort::ReadCache cache(SingleShardOptions(kMaxBytes));
+  for (int i = 0; i < 1000; ++i) {
+    cache.Insert(absl::StrCat("key_", i), std::string(i % 100, 'v'));
+    EXPECT_LE(cache.GetStats().bytes, kMaxBytes);
+  }
+  cache.Insert("too_big", std::string(kMaxBytes, 'v'));
+  EXPECT_EQ(cache.Get("too_big"), nullptr);
+}
+
+}  // namespace
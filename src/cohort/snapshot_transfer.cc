@@ -0,0 +1,173 @@
+#include "src/cohort/snapshot_transfer.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "src/utils/crc32c.h"
+
+namespace cohort {
+
+namespace {
+
+// Returns the paths of the regular files in |dir|, relative to it.
+absl::Status ListFiles(const std::string& dir,
+                       std::vector<std::string>& paths) {
+  std::error_code error;
+  for (std::filesystem::recursive_directory_iterator it(dir, error), end;
+       !error && it != end; it.increment(error)) {
+    if (it->is_regular_file()) {
+      paths.push_back(std::filesystem::relative(it->path(), dir).string());
+    }
+  }
+  if (error) {
+    return absl::InternalError(
+        absl::StrCat("Could not list ", dir, ": ", error.message()));
+  }
+  std::sort(paths.begin(), paths.end());
+  return absl::OkStatus();
+}
+
+// Paths come from the network, so they must stay inside the db directory.
+bool IsSafeRelativePath(const std::string& path) {
+  const std::filesystem::path fs_path(path);
+  if (path.empty() || fs_path.is_absolute()) {
+    return false;
+  }
+  for (const auto& part : fs_path) {
+    if (part == "..") {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::Status SendSnapshot(
+    const std::string& snapshot_dir, const SnapshotSendOptions& options,
+    const std::function<bool(const SnapshotChunk&)>& write) {
+  std::vector<std::string> paths;
+  const absl::Status status = ListFiles(snapshot_dir, paths);
+  if (!status.ok()) {
+    return status;
+  }
+  const absl::Time start = absl::Now();
+  uint64_t bytes_sent = 0;
+  std::string buffer(std::max<size_t>(options.max_chunk_bytes, 1), '\0');
+  for (const std::string& path : paths) {
+    const std::string full_path = absl::StrCat(snapshot_dir, "/", path);
+    std::ifstream file(full_path, std::ios::binary);
+    if (!file.is_open()) {
+      return absl::InternalError(absl::StrCat("Could not open ", full_path));
+    }
+    uint32_t crc32c = 0;
+    uint64_t offset = 0;
+    bool last_chunk = false;
+    while (!last_chunk) {
+      file.read(buffer.data(), buffer.size());
+      const size_t size = file.gcount();
+      if (file.bad()) {
+        return absl::InternalError(absl::StrCat("Could not read ", full_path));
+      }
+      // A full read might be followed by the end of the file, in which case
+      // the next chunk is empty.
+      last_chunk = file.eof();
+      SnapshotChunk chunk;
+      chunk.set_path(path);
+      chunk.set_offset(offset);
+      chunk.set_data(buffer.data(), size);
+      crc32c = utils::ExtendCrc32c(crc32c, chunk.data());
+      if (last_chunk) {
+        chunk.set_last_chunk(true);
+        chunk.set_crc32c(crc32c);
+      }
+      if (!write(chunk)) {
+        return absl::CancelledError("The snapshot receiver went away");
+      }
+      offset += size;
+      bytes_sent += size;
+      if (options.max_bytes_per_second > 0) {
+        const absl::Time send_time =
+            start + absl::Seconds(static_cast<double>(bytes_sent) /
+                                  options.max_bytes_per_second);
+        absl::SleepFor(send_time - absl::Now());
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SnapshotReceiver::StartFile(const std::string& path) {
+  if (!path_.empty()) {
+    return absl::OkStatus();
+  }
+  if (!IsSafeRelativePath(path)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid snapshot file path: ", path));
+  }
+  const std::filesystem::path full_path =
+      std::filesystem::path(db_dir_) / path;
+  std::error_code error;
+  std::filesystem::create_directories(full_path.parent_path(), error);
+  if (error) {
+    return absl::InternalError(absl::StrCat(
+        "Could not create ", full_path.parent_path().string(), ": ",
+        error.message()));
+  }
+  file_.open(full_path, std::ios::binary | std::ios::trunc);
+  if (!file_.is_open()) {
+    return absl::InternalError(
+        absl::StrCat("Could not open ", full_path.string()));
+  }
+  path_ = path;
+  offset_ = 0;
+  crc32c_ = 0;
+  return absl::OkStatus();
+}
+
+absl::Status SnapshotReceiver::Add(const SnapshotChunk& chunk) {
+  const absl::Status status = StartFile(chunk.path());
+  if (!status.ok()) {
+    return status;
+  }
+  if (chunk.path() != path_ || chunk.offset() != offset_) {
+    return absl::DataLossError(absl::StrCat(
+        "Expected ", path_, " at offset ", offset_, " but got ", chunk.path(),
+        " at offset ", chunk.offset()));
+  }
+  file_.write(chunk.data().data(), chunk.data().size());
+  if (!file_.good()) {
+    return absl::InternalError(absl::StrCat("Could not write ", path_));
+  }
+  offset_ += chunk.data().size();
+  bytes_received_ += chunk.data().size();
+  crc32c_ = utils::ExtendCrc32c(crc32c_, chunk.data());
+  if (!chunk.last_chunk()) {
+    return absl::OkStatus();
+  }
+  file_.close();
+  if (file_.fail()) {
+    return absl::InternalError(absl::StrCat("Could not write ", path_));
+  }
+  if (crc32c_ != chunk.crc32c()) {
+    return absl::DataLossError(
+        absl::StrCat("Checksum mismatch for ", path_, ": expected ",
+                     chunk.crc32c(), " but got ", crc32c_));
+  }
+  path_.clear();
+  return absl::OkStatus();
+}
+
+absl::Status SnapshotReceiver::Finish() {
+  if (!path_.empty()) {
+    return absl::DataLossError(
+        absl::StrCat("The snapshot ended in the middle of ", path_));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace cohort
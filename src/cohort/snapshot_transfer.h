@@ -0,0 +1,62 @@
+#ifndef SRC_COHORT_SNAPSHOT_TRANSFER_H_
+
+#define SRC_COHORT_SNAPSHOT_TRANSFER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+#include "absl/status/status.h"
+#include "src/proto/cohort.pb.h"
+
+namespace cohort {
+
+struct SnapshotSendOptions {
+  // Maximum size of the data of each chunk.
+  size_t max_chunk_bytes = 1 << 20;
+  // Maximum number of bytes to send per second. 0 means no limit.
+  uint64_t max_bytes_per_second = 0;
+};
+
+// Sends every file in |snapshot_dir| (recursively, in path order) to |write|
+// in chunks, sleeping between chunks to stay under the byte rate. Returns
+// Cancelled error if |write| returns false (e.g. the client disconnected).
+absl::Status SendSnapshot(
+    const std::string& snapshot_dir, const SnapshotSendOptions& options,
+    const std::function<bool(const SnapshotChunk&)>& write);
+
+// Writes the chunks of a snapshot sent by SendSnapshot into a db directory,
+// checking each file arrives whole and with the right checksum.
+class SnapshotReceiver {
+ public:
+  explicit SnapshotReceiver(const std::string& db_dir) : db_dir_(db_dir) {}
+
+  SnapshotReceiver(const SnapshotReceiver&) = delete;
+  SnapshotReceiver& operator=(const SnapshotReceiver&) = delete;
+
+  // Returns DataLoss error if the chunk doesn't continue the current file or
+  // completes a file with the wrong checksum.
+  absl::Status Add(const SnapshotChunk& chunk);
+
+  // Returns DataLoss error if the last file wasn't completed.
+  absl::Status Finish();
+
+  uint64_t bytes_received() const { return bytes_received_; }
+
+ private:
+  // Opens |path| for writing if no file is being received.
+  absl::Status StartFile(const std::string& path);
+
+  const std::string db_dir_;
+  // File being received. Empty between files.
+  std::string path_;
+  std::ofstream file_;
+  uint64_t offset_ = 0;
+  uint32_t crc32c_ = 0;
+  uint64_t bytes_received_ = 0;
+};
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_SNAPSHOT_TRANSFER_H_
@@ -0,0 +1,131 @@
+#include "src/cohort/snapshot_transfer.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace cohort {
+
+namespace {
+
+void WriteFile(const std::string& path, const std::string& contents) {
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path());
+  std::ofstream(path, std::ios::binary) << contents;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Returns a snapshot dir with a few files in a new directory.
+std::string MakeSnapshot(const std::string& test_name) {
+  const std::string dir = "/tmp/snapshot_transfer_test_" + test_name;
+  std::filesystem::remove_all(dir);
+  WriteFile(dir + "/num_shards", "2");
+  WriteFile(dir + "/shard_0/data.mdb", std::string(2500, 'a'));
+  WriteFile(dir + "/shard_1/data.mdb", "");
+  return dir;
+}
+
+std::vector<SnapshotChunk> Send(const std::string& snapshot_dir,
+                                const SnapshotSendOptions& options) {
+  std::vector<SnapshotChunk> chunks;
+  EXPECT_TRUE(SendSnapshot(snapshot_dir, options,
+                           [&chunks](const SnapshotChunk& chunk) {
+                             chunks.push_back(chunk);
+                             return true;
+                           })
+                  .ok());
+  return chunks;
+}
+
+TEST(SnapshotTransferTest, ReceiverRecreatesTheSnapshot) {
+  const std::string snapshot_dir = MakeSnapshot("copy");
+  SnapshotSendOptions options;
+  options.max_chunk_bytes = 1000;
+  const std::vector<SnapshotChunk> chunks = Send(snapshot_dir, options);
+  // num_shards, three chunks of shard_0 and the empty shard_1.
+  ASSERT_EQ(chunks.size(), 5);
+  EXPECT_EQ(chunks[1].path(), "shard_0/data.mdb");
+  EXPECT_EQ(chunks[2].offset(), 1000);
+  EXPECT_TRUE(chunks[3].last_chunk());
+
+  const std::string db_dir = "/tmp/snapshot_transfer_test_copy_received";
+  std::filesystem::remove_all(db_dir);
+  SnapshotReceiver receiver(db_dir);
+  for (const SnapshotChunk& chunk : chunks) {
+    ASSERT_TRUE(receiver.Add(chunk).ok());
+  }
+  EXPECT_TRUE(receiver.Finish().ok());
+  EXPECT_EQ(receiver.bytes_received(), 2501);
+  EXPECT_EQ(ReadFile(db_dir + "/num_shards"), "2");
+  EXPECT_EQ(ReadFile(db_dir + "/shard_0/data.mdb"), std::string(2500, 'a'));
+  EXPECT_TRUE(std::filesystem::exists(db_dir + "/shard_1/data.mdb"));
+}
+
+TEST(SnapshotTransferTest, ReceiverDetectsCorruptionAndMissingChunks) {
+  SnapshotSendOptions options;
+  options.max_chunk_bytes = 1000;
+  std::vector<SnapshotChunk> chunks = Send(MakeSnapshot("corrupt"), options);
+  const std::string db_dir = "/tmp/snapshot_transfer_test_corrupt_received";
+
+  chunks[2].mutable_data()->at(0) = 'b';
+  SnapshotReceiver corrupt_receiver(db_dir);
+  absl::Status status;
+  for (const SnapshotChunk& chunk : chunks) {
+    status = corrupt_receiver.Add(chunk);
+    if (!status.ok()) {
+      break;
+    }
+  }
+  EXPECT_EQ(status.code(), absl::StatusCode::kDataLoss);
+
+  SnapshotReceiver missing_chunk_receiver(db_dir);
+  EXPECT_TRUE(missing_chunk_receiver.Add(chunks[0]).ok());
+  EXPECT_TRUE(missing_chunk_receiver.Add(chunks[1]).ok());
+  EXPECT_EQ(missing_chunk_receiver.Add(chunks[3]).code(),
+            absl::StatusCode::kDataLoss);
+
+  SnapshotReceiver truncated_receiver(db_dir);
+  EXPECT_TRUE(truncated_receiver.Add(chunks[0]).ok());
+  EXPECT_TRUE(truncated_receiver.Add(chunks[1]).ok());
+  EXPECT_EQ(truncated_receiver.Finish().code(), absl::StatusCode::kDataLoss);
+}
+
+TEST(SnapshotTransferTest, ReceiverRejectsPathsOutsideTheDb) {
+  SnapshotChunk chunk;
+  chunk.set_path("../escape");
+  chunk.set_last_chunk(true);
+  SnapshotReceiver receiver("/tmp/snapshot_transfer_test_escape");
+  EXPECT_EQ(receiver.Add(chunk).code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SnapshotTransferTest, SendingIsThrottled) {
+  SnapshotSendOptions options;
+  options.max_chunk_bytes = 500;
+  options.max_bytes_per_second = 10000;
+  const absl::Time start = absl::Now();
+  Send(MakeSnapshot("throttled"), options);
+  // 2501 bytes at 10000 bytes/s.
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(240));
+}
+
+TEST(SnapshotTransferTest, StopsWhenTheReceiverGoesAway) {
+  EXPECT_EQ(SendSnapshot(MakeSnapshot("cancelled"), SnapshotSendOptions(),
+                         [](const SnapshotChunk&) { return false; })
+                .code(),
+            absl::StatusCode::kCancelled);
+}
+
+}  // namespace
+
+}  // namespace cohort
@@ -0,0 +1,51 @@
+#ifndef SRC_COHORT_TRANSACTION_ARENA_H_
+
+#define SRC_COHORT_TRANSACTION_ARENA_H_
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
+namespace cohort {
+
+// Monotonic memory for the scratch data of a single transaction (locks,
+// plans, key sets). Allocations bump a pointer, deallocations are no-ops, and
+// everything is released at once when the arena is destroyed. The first
+// kInlineBytes come from the arena itself, so small transactions don't
+// allocate at all. Not thread-safe; a transaction is only processed by one
+// thread at a time.
+class TransactionArena : public std::pmr::monotonic_buffer_resource {
+ public:
+  static constexpr size_t kInlineBytes = 2048;
+
+  TransactionArena()
+      : std::pmr::monotonic_buffer_resource(buffer_, sizeof(buffer_)) {}
+
+  TransactionArena(const TransactionArena&) = delete;
+  TransactionArena& operator=(const TransactionArena&) = delete;
+
+ private:
+  alignas(std::max_align_t) char buffer_[kInlineBytes];
+};
+
+template <typename T>
+using ArenaVector = std::pmr::vector<T>;
+
+template <typename T>
+using ArenaHashSet = absl::flat_hash_set<
+    T, typename absl::flat_hash_set<T>::hasher,
+    typename absl::flat_hash_set<T>::key_equal,
+    std::pmr::polymorphic_allocator<T>>;
+
+template <typename K, typename V>
+using ArenaHashMap = absl::flat_hash_map<
+    K, V, typename absl::flat_hash_map<K, V>::hasher,
+    typename absl::flat_hash_map<K, V>::key_equal,
+    std::pmr::polymorphic_allocator<std::pair<const K, V>>>;
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_TRANSACTION_ARENA_H_
@@ -0,0 +1,16 @@
+#include "src/cohort/vote_aggregator.h"
+
+#include <utility>
+
+namespace cohort {
+
+absl::Status VoteAggregator::Vote(const std::string& transaction_id,
+                                  int cohort_id, blockchain::Ballot ballot) {
+  blockchain::VoteRequest vote;
+  vote.set_transaction_id(transaction_id);
+  vote.set_cohort_id(cohort_id);
+  vote.set_ballot(ballot);
+  return batcher_.Add(std::move(vote));
+}
+
+}  // namespace cohort
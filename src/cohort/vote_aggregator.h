@@ -0,0 +1,38 @@
+#ifndef SRC_COHORT_VOTE_AGGREGATOR_H_
+
+#define SRC_COHORT_VOTE_AGGREGATOR_H_
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "src/blockchain/two_phase_commit.h"
+#include "src/utils/batcher.h"
+
+namespace cohort {
+
+// Combines the votes of concurrent transactions into VoteBatch calls, so the
+// cohort sends one blockchain transaction per batch instead of one per vote.
+// Thread-safe.
+class VoteAggregator {
+ public:
+  VoteAggregator(
+      blockchain::TwoPhaseCommit* blockchain,
+      const utils::BatcherOptions& options = utils::BatcherOptions())
+      : batcher_(
+            [blockchain](absl::Span<const blockchain::VoteRequest> votes) {
+              return blockchain->VoteBatch(votes);
+            },
+            options) {}
+
+  // Blocks until the batch with the vote has been sent and returns the status
+  // of sending it.
+  absl::Status Vote(const std::string& transaction_id, int cohort_id,
+                    blockchain::Ballot ballot);
+
+ private:
+  utils::Batcher<blockchain::VoteRequest> batcher_;
+};
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_VOTE_AGGREGATOR_H_
@@ -0,0 +1,112 @@
+#include "src/cohort/vote_aggregator.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/blockchain/proto/two_phase_commit_adapter_mock.grpc.pb.h"
+
+namespace cohort {
+
+namespace {
+
+using ::blockchain::Ballot;
+using ::blockchain::MockTwoPhaseCommitAdapterStub;
+using ::blockchain::VoteBatchRequest;
+using ::blockchain::VoteBatchResponse;
+using ::testing::_;
+
+// Records the size of every batch the stub receives and returns |status|.
+class RecordingStub {
+ public:
+  explicit RecordingStub(grpc::Status status = grpc::Status::OK)
+      : stub_(new MockTwoPhaseCommitAdapterStub()) {
+    EXPECT_CALL(*stub_, VoteBatch(_, _, _))
+        .WillRepeatedly([this, status](grpc::ClientContext*,
+                                       const VoteBatchRequest& request,
+                                       VoteBatchResponse*) {
+          absl::MutexLock lock(&mutex_);
+          batch_sizes_.push_back(request.votes_size());
+          return status;
+        });
+  }
+
+  std::unique_ptr<MockTwoPhaseCommitAdapterStub> Release() {
+    return std::unique_ptr<MockTwoPhaseCommitAdapterStub>(stub_);
+  }
+
+  std::vector<int> batch_sizes() {
+    absl::MutexLock lock(&mutex_);
+    return batch_sizes_;
+  }
+
+ private:
+  MockTwoPhaseCommitAdapterStub* stub_;
+  absl::Mutex mutex_;
+  std::vector<int> batch_sizes_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Votes commit for transactions "0" to "|num_votes| - 1" from separate
+// threads and returns how many votes succeeded.
+int VoteConcurrently(VoteAggregator& aggregator, int num_votes) {
+  std::atomic<int> succeeded = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_votes; ++i) {
+    threads.emplace_back([&aggregator, &succeeded, i]() {
+      if (aggregator.Vote(absl::StrCat(i), 0, Ballot::BALLOT_COMMIT).ok()) {
+        ++succeeded;
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return succeeded;
+}
+
+TEST(VoteAggregatorTest, SendsFullBatchesWithoutWaiting) {
+  RecordingStub stub;
+  blockchain::TwoPhaseCommit blockchain(stub.Release());
+  utils::BatcherOptions options;
+  options.max_batch_size = 4;
+  options.max_delay = absl::Hours(1);
+  VoteAggregator aggregator(&blockchain, options);
+
+  EXPECT_EQ(VoteConcurrently(aggregator, 8), 8);
+  EXPECT_THAT(stub.batch_sizes(), ::testing::ElementsAre(4, 4));
+}
+
+TEST(VoteAggregatorTest, SendsPartialBatchAfterTheDelay) {
+  RecordingStub stub;
+  blockchain::TwoPhaseCommit blockchain(stub.Release());
+  utils::BatcherOptions options;
+  options.max_batch_size = 100;
+  options.max_delay = absl::Milliseconds(50);
+  VoteAggregator aggregator(&blockchain, options);
+
+  const absl::Time start = absl::Now();
+  EXPECT_TRUE(aggregator.Vote("t1", 0, Ballot::BALLOT_COMMIT).ok());
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(50));
+  EXPECT_THAT(stub.batch_sizes(), ::testing::ElementsAre(1));
+}
+
+TEST(VoteAggregatorTest, EveryVoterGetsTheBatchError) {
+  RecordingStub stub(grpc::Status(grpc::UNAVAILABLE, "down"));
+  blockchain::TwoPhaseCommit blockchain(stub.Release());
+  utils::BatcherOptions options;
+  options.max_batch_size = 3;
+  options.max_delay = absl::Hours(1);
+  VoteAggregator aggregator(&blockchain, options);
+
+  EXPECT_EQ(VoteConcurrently(aggregator, 3), 0);
+  EXPECT_THAT(stub.batch_sizes(), ::testing::ElementsAre(3));
+}
+
+}  // namespace
+
+}  // namespace cohort
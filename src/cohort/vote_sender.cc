@@ -0,0 +1,98 @@
+#include "src/cohort/vote_sender.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+
+namespace cohort {
+
+absl::Status VoteSender::Vote(const std::string& transaction_id,
+                              int cohort_index, blockchain::Ballot ballot,
+                              absl::Time deadline) {
+  absl::Duration backoff = options_.initial_backoff;
+  for (int attempt = 1;; ++attempt) {
+    absl::Time retry_time;
+    while (!TryAcquire(retry_time)) {
+      if (retry_time >= deadline) {
+        return absl::UnavailableError(absl::StrCat(
+            "Circuit breaker is open, not voting for ", transaction_id));
+      }
+      absl::SleepFor(retry_time - absl::Now());
+    }
+    const absl::Status status =
+        vote_(transaction_id, cohort_index, ballot,
+              std::min(absl::Now() + options_.attempt_timeout, deadline));
+    const bool transient = IsTransient(status);
+    RecordResult(transient);
+    if (!transient || attempt >= options_.max_attempts) {
+      return status;
+    }
+    const absl::Duration wait = Jitter(backoff);
+    if (absl::Now() + wait >= deadline) {
+      return status;
+    }
+    absl::SleepFor(wait);
+    backoff = std::min(backoff * 2, options_.max_backoff);
+  }
+}
+
+bool VoteSender::IsTransient(const absl::Status& status) {
+  switch (status.code()) {
+    case absl::StatusCode::kUnavailable:
+    case absl::StatusCode::kDeadlineExceeded:
+    case absl::StatusCode::kResourceExhausted:
+    case absl::StatusCode::kAborted:
+    case absl::StatusCode::kInternal:
+    case absl::StatusCode::kUnknown:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool VoteSender::TryAcquire(absl::Time& retry_time) {
+  if (options_.circuit_breaker_failures <= 0) {
+    return true;
+  }
+  absl::MutexLock lock(&mutex_);
+  if (consecutive_failures_ < options_.circuit_breaker_failures) {
+    return true;
+  }
+  // Once the cooldown is over, a single vote probes whether the adapter is
+  // back while the others keep waiting.
+  const absl::Time now = absl::Now();
+  if (now < open_until_) {
+    retry_time = open_until_;
+    return false;
+  }
+  if (probing_) {
+    retry_time = now + options_.initial_backoff;
+    return false;
+  }
+  probing_ = true;
+  return true;
+}
+
+void VoteSender::RecordResult(bool transient_failure) {
+  if (options_.circuit_breaker_failures <= 0) {
+    return;
+  }
+  absl::MutexLock lock(&mutex_);
+  probing_ = false;
+  if (!transient_failure) {
+    consecutive_failures_ = 0;
+    return;
+  }
+  ++consecutive_failures_;
+  if (consecutive_failures_ >= options_.circuit_breaker_failures) {
+    open_until_ = absl::Now() + options_.circuit_breaker_cooldown;
+  }
+}
+
+absl::Duration VoteSender::Jitter(absl::Duration backoff) {
+  absl::MutexLock lock(&mutex_);
+  return backoff * absl::Uniform(random_, 0.5, 1.0);
+}
+
+}  // namespace cohort
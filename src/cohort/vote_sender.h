@@ -0,0 +1,90 @@
+#ifndef SRC_COHORT_VOTE_SENDER_H_
+
+#define SRC_COHORT_VOTE_SENDER_H_
+
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "src/blockchain/proto/two_phase_commit_adapter.pb.h"
+
+namespace cohort {
+
+struct VoteSenderOptions {
+  // Maximum number of times a vote is sent, including the first. One disables
+  // retries.
+  int max_attempts = 5;
+  // Wait before the first retry, doubled for each later one up to
+  // max_backoff. Each wait is randomized between half and all of it so votes
+  // that failed together don't retry together.
+  absl::Duration initial_backoff = absl::Milliseconds(10);
+  absl::Duration max_backoff = absl::Seconds(1);
+  // How long each attempt may take before it's given up and retried, so a
+  // call that never returns doesn't use up the vote's whole deadline.
+  absl::Duration attempt_timeout = absl::Seconds(30);
+  // Number of consecutive transient failures, across all votes, that opens
+  // the circuit breaker. Zero disables it.
+  int circuit_breaker_failures = 20;
+  // How long the open circuit breaker holds votes back before letting one
+  // through to probe the adapter.
+  absl::Duration circuit_breaker_cooldown = absl::Seconds(1);
+};
+
+// Sends votes to the blockchain, retrying transient failures (e.g. a dropped
+// adapter call) with bounded exponential backoff instead of leaving the
+// transaction to abort at its presumed abort time. Resending a vote is safe
+// even if an earlier attempt took effect, since the contract counts a
+// cohort's ballot once. Failures the contract returns (e.g. the vote timed
+// out) aren't retried.
+//
+// A circuit breaker shared by all votes stops sending them while the adapter
+// keeps failing, so an outage isn't made worse by every transaction retrying.
+// While it's open, votes wait for it to let them through, and fail with
+// Unavailable error without being sent if that's past their deadline.
+// Thread-safe.
+class VoteSender {
+ public:
+  // Sends one attempt, giving up at |attempt_deadline|.
+  using VoteFunction = std::function<absl::Status(
+      const std::string& transaction_id, int cohort_index,
+      blockchain::Ballot ballot, absl::Time attempt_deadline)>;
+
+  VoteSender(VoteFunction vote,
+             const VoteSenderOptions& options = VoteSenderOptions())
+      : vote_(std::move(vote)), options_(options) {}
+
+  // Blocks until the vote is accepted, fails with a non-transient error, or
+  // can't be retried before |deadline| or within max_attempts, returning the
+  // last attempt's status. Waiting for the circuit breaker doesn't use up
+  // attempts.
+  absl::Status Vote(const std::string& transaction_id, int cohort_index,
+                    blockchain::Ballot ballot, absl::Time deadline);
+
+  // Whether |status| may succeed if the same call is made again.
+  static bool IsTransient(const absl::Status& status);
+
+ private:
+  // Returns whether the circuit breaker lets a vote be sent now. Otherwise
+  // sets |retry_time| to when it may.
+  bool TryAcquire(absl::Time& retry_time);
+  void RecordResult(bool transient_failure);
+  absl::Duration Jitter(absl::Duration backoff);
+
+  const VoteFunction vote_;
+  const VoteSenderOptions options_;
+  absl::Mutex mutex_;
+  int consecutive_failures_ ABSL_GUARDED_BY(mutex_) = 0;
+  // The breaker is open until this time, then half-open.
+  absl::Time open_until_ ABSL_GUARDED_BY(mutex_) = absl::InfinitePast();
+  // Whether a vote is probing the adapter while the breaker is half-open.
+  bool probing_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::BitGen random_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace cohort
+
+#endif  // SRC_COHORT_VOTE_SENDER_H_
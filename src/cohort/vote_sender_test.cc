@@ -0,0 +1,203 @@
+#include "src/cohort/vote_sender.h"
+
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace cohort {
+
+namespace {
+
+using ::blockchain::Ballot;
+
+// Returns the queued statuses in order, then OK, and counts the calls.
+class FakeVote {
+ public:
+  explicit FakeVote(std::deque<absl::Status> statuses = {})
+      : statuses_(std::move(statuses)) {}
+
+  VoteSender::VoteFunction Function() {
+    return [this](const std::string& /*transaction_id*/, int /*cohort_index*/,
+                  Ballot /*ballot*/, absl::Time attempt_deadline) {
+      absl::MutexLock lock(&mutex_);
+      ++calls_;
+      attempt_deadline_ = attempt_deadline;
+      if (statuses_.empty()) {
+        return absl::OkStatus();
+      }
+      absl::Status status = statuses_.front();
+      statuses_.pop_front();
+      return status;
+    };
+  }
+
+  int calls() {
+    absl::MutexLock lock(&mutex_);
+    return calls_;
+  }
+
+  absl::Time attempt_deadline() {
+    absl::MutexLock lock(&mutex_);
+    return attempt_deadline_;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::deque<absl::Status> statuses_ ABSL_GUARDED_BY(mutex_);
+  int calls_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Time attempt_deadline_ ABSL_GUARDED_BY(mutex_);
+};
+
+VoteSenderOptions FastOptions() {
+  VoteSenderOptions options;
+  options.initial_backoff = absl::Milliseconds(1);
+  options.max_backoff = absl::Milliseconds(4);
+  return options;
+}
+
+absl::Time Deadline() { return absl::Now() + absl::Seconds(10); }
+
+TEST(VoteSenderTest, RetriesTransientFailures) {
+  FakeVote fake({absl::UnavailableError("dropped"),
+                 absl::DeadlineExceededError("slow")});
+  VoteSender sender(fake.Function(), FastOptions());
+
+  EXPECT_TRUE(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_EQ(fake.calls(), 3);
+}
+
+TEST(VoteSenderTest, DoesNotRetryRejectedVotes) {
+  FakeVote fake({absl::FailedPreconditionError("timed out")});
+  VoteSender sender(fake.Function(), FastOptions());
+
+  EXPECT_EQ(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(fake.calls(), 1);
+}
+
+TEST(VoteSenderTest, StopsAfterMaxAttempts) {
+  FakeVote fake({absl::UnavailableError("1"), absl::UnavailableError("2"),
+                 absl::UnavailableError("3")});
+  VoteSenderOptions options = FastOptions();
+  options.max_attempts = 2;
+  VoteSender sender(fake.Function(), options);
+
+  EXPECT_EQ(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).message(),
+            "2");
+  EXPECT_EQ(fake.calls(), 2);
+}
+
+TEST(VoteSenderTest, DoesNotRetryPastDeadline) {
+  FakeVote fake({absl::UnavailableError("dropped")});
+  VoteSenderOptions options = FastOptions();
+  options.initial_backoff = absl::Seconds(10);
+  VoteSender sender(fake.Function(), options);
+
+  EXPECT_EQ(sender
+                .Vote("t1", 0, Ballot::BALLOT_COMMIT,
+                      absl::Now() + absl::Seconds(1))
+                .code(),
+            absl::StatusCode::kUnavailable);
+  EXPECT_EQ(fake.calls(), 1);
+}
+
+TEST(VoteSenderTest, GivesEachAttemptItsOwnDeadline) {
+  FakeVote fake;
+  VoteSenderOptions options = FastOptions();
+  options.attempt_timeout = absl::Seconds(1);
+  VoteSender sender(fake.Function(), options);
+
+  const absl::Time start = absl::Now();
+  EXPECT_TRUE(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_GE(fake.attempt_deadline(), start + absl::Seconds(1));
+  EXPECT_LE(fake.attempt_deadline(), absl::Now() + absl::Seconds(1));
+
+  // The attempt never outlives the vote.
+  const absl::Time deadline = absl::Now() + absl::Milliseconds(500);
+  EXPECT_TRUE(sender.Vote("t2", 0, Ballot::BALLOT_COMMIT, deadline).ok());
+  EXPECT_EQ(fake.attempt_deadline(), deadline);
+}
+
+TEST(VoteSenderTest, CircuitBreakerHoldsVotesUntilCooldownEnds) {
+  FakeVote fake({absl::UnavailableError("1"), absl::UnavailableError("2")});
+  VoteSenderOptions options = FastOptions();
+  options.max_attempts = 1;
+  options.circuit_breaker_failures = 2;
+  options.circuit_breaker_cooldown = absl::Milliseconds(100);
+  VoteSender sender(fake.Function(), options);
+
+  EXPECT_FALSE(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  const absl::Time opened = absl::Now();
+  EXPECT_FALSE(sender.Vote("t2", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  // The breaker is open, so the vote waits for the cooldown, then probes the
+  // adapter, and its success closes the breaker.
+  EXPECT_TRUE(sender.Vote("t3", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_GE(absl::Now() - opened, absl::Milliseconds(100));
+  EXPECT_TRUE(sender.Vote("t4", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_EQ(fake.calls(), 4);
+}
+
+TEST(VoteSenderTest, CircuitBreakerFailsVotesDueBeforeCooldownEnds) {
+  FakeVote fake({absl::UnavailableError("1")});
+  VoteSenderOptions options = FastOptions();
+  options.max_attempts = 1;
+  options.circuit_breaker_failures = 1;
+  options.circuit_breaker_cooldown = absl::Seconds(10);
+  VoteSender sender(fake.Function(), options);
+
+  EXPECT_FALSE(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_EQ(sender
+                .Vote("t2", 0, Ballot::BALLOT_COMMIT,
+                      absl::Now() + absl::Seconds(1))
+                .code(),
+            absl::StatusCode::kUnavailable);
+  EXPECT_EQ(fake.calls(), 1);
+}
+
+TEST(VoteSenderTest, FailedProbeReopensCircuitBreaker) {
+  FakeVote fake({absl::UnavailableError("1"), absl::UnavailableError("2")});
+  VoteSenderOptions options = FastOptions();
+  options.max_attempts = 1;
+  options.circuit_breaker_failures = 1;
+  options.circuit_breaker_cooldown = absl::Milliseconds(100);
+  VoteSender sender(fake.Function(), options);
+
+  EXPECT_FALSE(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  absl::SleepFor(absl::Milliseconds(150));
+  EXPECT_FALSE(sender.Vote("t2", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  // The failed probe restarted the cooldown, which outlasts this vote.
+  EXPECT_EQ(sender
+                .Vote("t3", 0, Ballot::BALLOT_COMMIT,
+                      absl::Now() + absl::Milliseconds(50))
+                .code(),
+            absl::StatusCode::kUnavailable);
+  EXPECT_EQ(fake.calls(), 2);
+}
+
+TEST(VoteSenderTest, RejectedVotesResetCircuitBreaker) {
+  FakeVote fake({absl::UnavailableError("1"),
+                 absl::FailedPreconditionError("timed out"),
+                 absl::UnavailableError("2")});
+  VoteSenderOptions options = FastOptions();
+  options.max_attempts = 1;
+  options.circuit_breaker_failures = 2;
+  VoteSender sender(fake.Function(), options);
+
+  EXPECT_FALSE(sender.Vote("t1", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_FALSE(sender.Vote("t2", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_FALSE(sender.Vote("t3", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  // The adapter answered the second vote, so only one failure is
+  // consecutive and the breaker stays closed.
+  EXPECT_TRUE(sender.Vote("t4", 0, Ballot::BALLOT_COMMIT, Deadline()).ok());
+  EXPECT_EQ(fake.calls(), 4);
+}
+
+}  // namespace
+
+}  // namespace cohort
@@ -3,9 +3,11 @@
 #include <future>
 #include <sstream>
 #include <string>
+#include <utility>
 
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
 #include "glog/logging.h"
 #include "grpc/grpc.h"
 #include "grpcpp/create_channel.h"
@@ -24,15 +26,29 @@ namespace {
 
 using CohortStub = ::cohort::Cohort::StubInterface;
 using ::common::Namespace;
+using ::coordinator::internal::SignedCommit;
 using ::coordinator::internal::SubTransaction;
 using ::coordinator::internal::TransactionMetadata;
 using ::grpc::ClientContext;
 using ::grpc::ServerContext;
 
+// Longest the background thread waits for a cohort's signed commit vote, so
+// an unresponsive cohort doesn't hold up the other transactions.
+constexpr absl::Duration kSignedVoteFetchTimeout = absl::Seconds(1);
+
 bool RequiresBlockchain(const std::vector<SubTransaction> &sub_transactions) {
   return sub_transactions.size() > 1;
 }
 
+absl::Time ToAbslTime(const google::protobuf::Timestamp &timestamp) {
+  return absl::FromUnixSeconds(timestamp.seconds()) +
+         absl::Nanoseconds(timestamp.nanos());
+}
+
+std::time_t ToTimeT(const google::protobuf::Timestamp &timestamp) {
+  return absl::ToTimeT(ToAbslTime(timestamp));
+}
+
 bool HashSha256(absl::string_view input, unsigned char *md) {
   SHA256_CTX context;
   if (SHA256_Init(&context) == 0) {
@@ -112,6 +128,31 @@ std::vector<SubTransaction> SplitClientTransaction(
 }
 }  // namespace
 
+namespace internal {
+
+void AppendCommittedChunk(cohort::GetTransactionResultResponse &chunk,
+                          cohort::GetTransactionResultResponse &response) {
+  auto &get_responses =
+      *chunk.mutable_committed_response()->mutable_get_responses();
+  common::CommittedResponse &committed = *response.mutable_committed_response();
+  auto it = get_responses.begin();
+  if (chunk.continues_get_response() && it != get_responses.end() &&
+      !committed.get_responses().empty()) {
+    auto &key_values =
+        *committed.mutable_get_responses(committed.get_responses_size() - 1)
+             ->mutable_key_values();
+    for (common::KeyValue &key_value : *it->mutable_key_values()) {
+      key_values.Add()->Swap(&key_value);
+    }
+    ++it;
+  }
+  for (; it != get_responses.end(); ++it) {
+    committed.add_get_responses()->Swap(&*it);
+  }
+}
+
+}  // namespace internal
+
 grpc::Status CoordinatorServer::CommitAtomicTransaction(
     ServerContext *context, const CommitAtomicTransactionRequest *request,
     CommitAtomicTransactionResponse *response) {
@@ -147,26 +188,43 @@ grpc::Status CoordinatorServer::CommitAtomicTransaction(
   if (sub_transactions.empty()) {
     return grpc::Status::OK;
   }
+  std::vector<std::string> signers;
   if (RequiresBlockchain(sub_transactions)) {
-    absl::Status blockchain_status = StartVoting(
-        transaction_id, config.presumed_abort_time(), sub_transactions.size());
+    signers = GetSigners(sub_transactions);
+    absl::Status blockchain_status =
+        signers.empty()
+            ? StartVoting(transaction_id, config.presumed_abort_time(),
+                          sub_transactions.size())
+            : StartVotingWithSigners(transaction_id,
+                                     config.presumed_abort_time(), signers);
     if (!blockchain_status.ok()) {
       return utils::FromAbslStatus(blockchain_status,
                                    "Failed to start voting in blockchain");
     }
   }
-  SendCohortPrepareRequests(transaction_id, sub_transactions, *context);
+  SendCohortPrepareRequests(transaction_id, sub_transactions,
+                            !signers.empty(), *context);
+  if (!signers.empty()) {
+    SignedCommit commit;
+    commit.cohort_namespaces = metadata.cohort_namespaces;
+    commit.signatures.assign(signers.size(), "");
+    commit.signers = std::move(signers);
+    commit.presumed_abort_time = ToAbslTime(config.presumed_abort_time());
+    absl::MutexLock lock(&signed_commits_mutex_);
+    signed_commits_.emplace(transaction_id, std::move(commit));
+  }
   return grpc::Status::OK;
 }
 
 void CoordinatorServer::SendCohortPrepareRequests(
     const std::string &transaction_id,
     const std::vector<SubTransaction> &sub_transactions,
-    const ServerContext &context) {
+    bool sign_commit_votes, const ServerContext &context) {
   TransactionMetadata &metadata = metadata_by_transaction_[transaction_id];
   cohort::PrepareTransactionRequest prepare_request;
   prepare_request.set_transaction_id(transaction_id);
   *prepare_request.mutable_config() = metadata.config;
+  prepare_request.set_sign_commit_vote(sign_commit_votes);
   if (sub_transactions.size() == 1) {
     prepare_request.set_only_cohort(true);
     metadata.single_cohort_namespace = sub_transactions[0].namespace_;
@@ -193,10 +251,26 @@ absl::Status CoordinatorServer::StartVoting(
     const std::string &transaction_id,
     const google::protobuf::Timestamp &presumed_abort_time,
     size_t num_cohorts) {
-  const time_t abort_time =
-      absl::ToTimeT(absl::FromUnixSeconds(presumed_abort_time.seconds()) +
-                    absl::Nanoseconds(presumed_abort_time.nanos()));
-  return blockchain_->StartVoting(transaction_id, abort_time, num_cohorts);
+  if (start_voting_aggregator_ != nullptr) {
+    return start_voting_aggregator_->StartVoting(
+        transaction_id, presumed_abort_time, num_cohorts);
+  }
+  return blockchain_->StartVoting(transaction_id,
+                                  ToTimeT(presumed_abort_time), num_cohorts);
+}
+
+absl::Status CoordinatorServer::StartVotingWithSigners(
+    const std::string &transaction_id,
+    const google::protobuf::Timestamp &presumed_abort_time,
+    const std::vector<std::string> &signers) {
+  return blockchain_->StartVotingWithSigners(
+      transaction_id, ToTimeT(presumed_abort_time), signers);
+}
+
+absl::Status CoordinatorServer::CommitWithVotes(
+    const std::string &transaction_id, const std::vector<std::string> &signers,
+    const std::vector<std::string> &signatures) {
+  return blockchain_->CommitWithVotes(transaction_id, signers, signatures);
 }
 
 absl::StatusOr<blockchain::VotingDecision> CoordinatorServer::GetVotingDecision(
@@ -224,11 +298,27 @@ grpc::Status CoordinatorServer::GetResultsFromCohort(
     const cohort::GetTransactionResultRequest &request,
     grpc::ClientContext &context,
     cohort::GetTransactionResultResponse &response) {
-  return GetCohortStub(namespace_)
-      .GetTransactionResult(&context, request, &response);
+  // Streamed so large committed responses (e.g. from range gets) don't have to
+  // fit in a single message.
+  cohort::StreamTransactionResultRequest stream_request;
+  stream_request.set_transaction_id(request.transaction_id());
+  std::unique_ptr<
+      grpc::ClientReaderInterface<cohort::GetTransactionResultResponse>>
+      reader = GetCohortStub(namespace_).StreamTransactionResult(
+          &context, stream_request);
+  cohort::GetTransactionResultResponse chunk;
+  while (reader->Read(&chunk)) {
+    if (chunk.has_committed_response()) {
+      internal::AppendCommittedChunk(chunk, response);
+    } else {
+      response.Swap(&chunk);
+    }
+  }
+  return reader->Finish();
 }
 
 CohortStub &CoordinatorServer::GetCohortStub(const Namespace &namespace_) {
+  absl::MutexLock lock(&cohort_stubs_mutex_);
   std::unique_ptr<CohortStub> &cohort_stub =
       cohort_by_namespace_[namespace_.address()];
   if (!cohort_stub) {
@@ -238,6 +328,95 @@ CohortStub &CoordinatorServer::GetCohortStub(const Namespace &namespace_) {
   return *cohort_stub;
 }
 
+std::vector<std::string> CoordinatorServer::GetSigners(
+    const std::vector<SubTransaction> &sub_transactions) const {
+  std::vector<std::string> signers;
+  for (const SubTransaction &sub_transaction : sub_transactions) {
+    const auto it = cohort_signers_.find(sub_transaction.namespace_.address());
+    if (it == cohort_signers_.end()) {
+      return {};
+    }
+    signers.push_back(it->second);
+  }
+  return signers;
+}
+
+void CoordinatorServer::StopBackgroundThreads() {
+  {
+    absl::MutexLock lock(&signed_commits_mutex_);
+    stopped_ = true;
+  }
+  if (signed_commit_thread_.joinable()) {
+    signed_commit_thread_.join();
+  }
+}
+
+void CoordinatorServer::CommitSignedVotesUntilStopped() {
+  absl::flat_hash_map<std::string, SignedCommit> commits;
+  absl::MutexLock lock(&signed_commits_mutex_);
+  while (!signed_commits_mutex_.AwaitWithTimeout(absl::Condition(&stopped_),
+                                                 signed_vote_poll_interval_)) {
+    // The cohorts are asked without holding the lock, so new transactions
+    // aren't held up by them.
+    commits.swap(signed_commits_);
+    signed_commits_mutex_.Unlock();
+    for (auto it = commits.begin(); it != commits.end();) {
+      if (TryCommitWithSignedVotes(it->first, it->second)) {
+        commits.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    signed_commits_mutex_.Lock();
+    for (auto &commit : commits) {
+      signed_commits_.insert(std::move(commit));
+    }
+    commits.clear();
+  }
+}
+
+bool CoordinatorServer::TryCommitWithSignedVotes(
+    const std::string &transaction_id, SignedCommit &commit) {
+  if (Now() >= commit.presumed_abort_time) {
+    LOG(WARNING) << "Not every cohort signed its commit vote for "
+                 << transaction_id << " before its presumed abort time";
+    return true;
+  }
+  cohort::GetTransactionResultRequest cohort_request;
+  cohort_request.set_transaction_id(transaction_id);
+  for (size_t i = 0; i < commit.cohort_namespaces.size(); ++i) {
+    if (!commit.signatures[i].empty()) {
+      continue;
+    }
+    ClientContext cohort_context;
+    cohort_context.set_deadline(
+        absl::ToChronoTime(absl::Now() + kSignedVoteFetchTimeout));
+    cohort::GetTransactionResultResponse cohort_response;
+    const grpc::Status cohort_status =
+        GetResultsFromCohort(commit.cohort_namespaces[i], cohort_request,
+                             cohort_context, cohort_response);
+    // The cohort voted to abort, which aborts the transaction on its own.
+    if (cohort_status.ok() && cohort_response.has_aborted_response()) {
+      return true;
+    }
+    // The cohort hasn't prepared the transaction yet.
+    if (!cohort_status.ok() || cohort_response.commit_signature().empty()) {
+      return false;
+    }
+    commit.signatures[i] = cohort_response.commit_signature();
+  }
+  const absl::Status status =
+      CommitWithVotes(transaction_id, commit.signers, commit.signatures);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to commit " << transaction_id
+                 << " with signed votes: " << status;
+    // The contract rejected the votes, e.g. because the transaction timed
+    // out, so resending them won't help.
+    return absl::IsFailedPrecondition(status);
+  }
+  return true;
+}
+
 grpc::Status CoordinatorServer::UpdateResponseForSingleCohortTransaction(
     const std::string &transaction_id, const ServerContext &context) {
   GetTransactionResultResponse &response =
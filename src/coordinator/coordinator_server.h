@@ -2,10 +2,15 @@
 
 #define SRC_COORDINATOR_COORDINATOR_SERVER_H_
 
+#include <thread>
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "grpcpp/server_context.h"
 #include "src/blockchain/two_phase_commit.h"
+#include "src/coordinator/start_voting_aggregator.h"
 #include "src/proto/cohort.grpc.pb.h"
 #include "src/proto/common.pb.h"
 #include "src/proto/coordinator.grpc.pb.h"
@@ -30,6 +35,19 @@ struct TransactionMetadata {
   // at once.
 };
 
+// A transaction the coordinator commits with the cohorts' signed votes once
+// all of them are in.
+struct SignedCommit {
+  std::vector<common::Namespace> cohort_namespaces;
+  // Addresses the cohorts sign their commit votes with, in cohort index
+  // order.
+  std::vector<std::string> signers;
+  // Signed commit votes fetched from the cohorts so far, in cohort index
+  // order. Empty strings for the ones not fetched yet.
+  std::vector<std::string> signatures;
+  absl::Time presumed_abort_time;
+};
+
 struct TransactionResponse {
   bool complete;
   GetTransactionResultResponse response;
@@ -40,25 +58,75 @@ struct SubTransaction {
   common::Transaction transaction;
 };
 
+// Moves the get responses of a chunk streamed by a cohort to the end of
+// |response|. The key values of a range get the cohort split over several
+// chunks are joined back into one get response, so clients get one get
+// response per get op.
+void AppendCommittedChunk(cohort::GetTransactionResultResponse &chunk,
+                          cohort::GetTransactionResultResponse &response);
+
 }  // namespace internal
 
+struct CoordinatorServerOptions {
+  // Longest a client transaction waits for its voting to be started in one
+  // blockchain transaction with other client transactions. Zero starts each
+  // transaction's voting in its own blockchain transaction.
+  absl::Duration start_voting_batch_window = absl::ZeroDuration();
+  // Maximum number of transactions whose voting is started in one blockchain
+  // transaction.
+  size_t max_start_voting_batch_size = 64;
+  // Address each cohort (keyed by namespace address) signs its commit votes
+  // with. Transactions whose cohorts all have one commit with one blockchain
+  // transaction holding every signed vote, instead of one vote per cohort.
+  // Their voting isn't batched, since the contract only starts voting with
+  // signers one transaction at a time.
+  absl::flat_hash_map<std::string, std::string> cohort_signers;
+  // How often a background thread asks the cohorts of such transactions for
+  // their signed commit votes, and commits the ones whose votes are all in.
+  absl::Duration signed_vote_poll_interval = absl::Milliseconds(100);
+};
+
 class CoordinatorServer : public Coordinator::Service {
  public:
   explicit CoordinatorServer(
       absl::Duration default_presumed_abort_duration,
-      std::unique_ptr<blockchain::TwoPhaseCommit> blockchain)
+      std::unique_ptr<blockchain::TwoPhaseCommit> blockchain,
+      const CoordinatorServerOptions &options = CoordinatorServerOptions())
       : default_presumed_abort_duration_(default_presumed_abort_duration),
-        blockchain_(blockchain.release()) {}
+        cohort_signers_(options.cohort_signers),
+        signed_vote_poll_interval_(options.signed_vote_poll_interval),
+        blockchain_(blockchain.release()) {
+    if (options.start_voting_batch_window > absl::ZeroDuration()) {
+      utils::BatcherOptions batcher_options;
+      batcher_options.max_batch_size = options.max_start_voting_batch_size;
+      batcher_options.max_delay = options.start_voting_batch_window;
+      start_voting_aggregator_ = std::make_unique<StartVotingAggregator>(
+          blockchain_.get(), batcher_options);
+    }
+    if (!cohort_signers_.empty()) {
+      signed_commit_thread_ =
+          std::thread([this]() { CommitSignedVotesUntilStopped(); });
+    }
+  }
+
+  ~CoordinatorServer() override { StopBackgroundThreads(); }
 
   grpc::Status CommitAtomicTransaction(
       grpc::ServerContext *context,
       const CommitAtomicTransactionRequest *request,
       CommitAtomicTransactionResponse *response) override;
 
+  // Only reads the blockchain decision and the cohorts' results. Signed
+  // commit votes are committed by a background thread instead.
   grpc::Status GetTransactionResult(
       grpc::ServerContext *context, const GetTransactionResultRequest *request,
       GetTransactionResultResponse *response) override;
 
+ protected:
+  // Stops the background threads, which call the virtual methods below.
+  // Subclasses overriding them must call it in their destructor. Idempotent.
+  void StopBackgroundThreads();
+
  private:
   // The virtual methods are so that they can be mocked out for testing.
   virtual void PrepareCohortTransaction(
@@ -75,6 +143,14 @@ class CoordinatorServer : public Coordinator::Service {
       const std::string &transaction_id,
       const google::protobuf::Timestamp &presumed_abort_time,
       size_t num_cohorts);
+  virtual absl::Status StartVotingWithSigners(
+      const std::string &transaction_id,
+      const google::protobuf::Timestamp &presumed_abort_time,
+      const std::vector<std::string> &signers);
+  virtual absl::Status CommitWithVotes(
+      const std::string &transaction_id,
+      const std::vector<std::string> &signers,
+      const std::vector<std::string> &signatures);
   virtual absl::StatusOr<blockchain::VotingDecision> GetVotingDecision(
       const std::string &transaction_id);
   virtual cohort::Cohort::StubInterface &GetCohortStub(
@@ -84,7 +160,17 @@ class CoordinatorServer : public Coordinator::Service {
   void SendCohortPrepareRequests(
       const std::string &transaction_id,
       const std::vector<internal::SubTransaction> &sub_transactions,
-      const grpc::ServerContext &context);
+      bool sign_commit_votes, const grpc::ServerContext &context);
+  // Returns the signer of each cohort, or an empty vector unless every
+  // cohort has one.
+  std::vector<std::string> GetSigners(
+      const std::vector<internal::SubTransaction> &sub_transactions) const;
+  void CommitSignedVotesUntilStopped();
+  // Fetches the cohorts' missing signed commit votes and, once all of them
+  // are in, commits the transaction with them. Returns whether it's done
+  // with the transaction, i.e. committed it or gave up on committing it.
+  bool TryCommitWithSignedVotes(const std::string &transaction_id,
+                                internal::SignedCommit &commit);
   grpc::Status UpdateResponseForSingleCohortTransaction(
       const std::string &transaction_id, const grpc::ServerContext &context);
   // Updates response to client when the blockchain says the transaction
@@ -99,15 +185,29 @@ class CoordinatorServer : public Coordinator::Service {
   // known.
   void CleanUpTransactionMetadata(const std::string &transaction_id);
 
+  // Guards cohort_by_namespace_, which the background thread also uses.
+  absl::Mutex cohort_stubs_mutex_;
   absl::flat_hash_map<std::string,
                       std::unique_ptr<cohort::Cohort::StubInterface>>
-      cohort_by_namespace_;
+      cohort_by_namespace_ ABSL_GUARDED_BY(cohort_stubs_mutex_);
   absl::flat_hash_map<std::string, internal::TransactionMetadata>
       metadata_by_transaction_;
   absl::flat_hash_map<std::string, internal::TransactionResponse>
       response_by_transaction_;
   absl::Duration default_presumed_abort_duration_;
+  const absl::flat_hash_map<std::string, std::string> cohort_signers_;
+  const absl::Duration signed_vote_poll_interval_;
   std::unique_ptr<blockchain::TwoPhaseCommit> blockchain_;
+  // Null if starting votes isn't batched.
+  std::unique_ptr<StartVotingAggregator> start_voting_aggregator_;
+  absl::Mutex signed_commits_mutex_;
+  // Transactions waiting for signed commit votes, except the ones the
+  // background thread is working on.
+  absl::flat_hash_map<std::string, internal::SignedCommit> signed_commits_
+      ABSL_GUARDED_BY(signed_commits_mutex_);
+  bool stopped_ ABSL_GUARDED_BY(signed_commits_mutex_) = false;
+  // Not started unless some cohort has a signer.
+  std::thread signed_commit_thread_;
 };
 
 }  // namespace coordinator
@@ -1,10 +1,14 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "absl/time/time.h"
 #include "grpc/grpc.h"
 #include "grpcpp/create_channel.h"
@@ -12,6 +16,8 @@
 #include "grpcpp/security/server_credentials.h"
 #include "grpcpp/server.h"
 #include "grpcpp/server_builder.h"
+#include "src/blockchain/ethereum_blockchain.h"
+#include "src/blockchain/json_rpc_client.h"
 #include "src/blockchain/two_phase_commit.h"
 #include "src/coordinator/coordinator_server.h"
 
@@ -22,18 +28,89 @@ ABSL_FLAG(
     std::string, default_presumed_abort_duration, "1m",
     "Default duration for the presumed abort time relative to the current "
     "time. Only used if the client does not specify the timestamp.");
+ABSL_FLAG(absl::Duration, start_voting_batch_window, absl::ZeroDuration(),
+          "Longest a transaction waits for its voting to be started in one "
+          "blockchain transaction with other transactions. 0 starts each "
+          "one on its own");
+ABSL_FLAG(size_t, max_start_voting_batch_size, 64,
+          "Maximum number of transactions whose voting is started in one "
+          "blockchain transaction");
+ABSL_FLAG(std::vector<std::string>, cohort_signers, {},
+          "Comma-separated <cohort address>=<signer address> pairs. "
+          "Transactions whose cohorts all have a signer commit with their "
+          "signed votes in one blockchain transaction");
+ABSL_FLAG(std::string, ethereum_rpc_address, "",
+          "<host>:<port> of an Ethereum JSON-RPC endpoint, e.g. Ganache's, to "
+          "call the TwoPhaseCommit contract through directly instead of the "
+          "blockchain adapter server. Empty uses the adapter server");
+ABSL_FLAG(std::string, contract_address, "",
+          "Address of the TwoPhaseCommit contract. Only used with "
+          "--ethereum_rpc_address");
+ABSL_FLAG(std::vector<std::string>, ethereum_accounts, {},
+          "Comma-separated unlocked accounts to send blockchain transactions "
+          "from. Only used with --ethereum_rpc_address");
+ABSL_FLAG(int, ethereum_rpc_connections, 8,
+          "Maximum number of concurrent requests to the Ethereum JSON-RPC "
+          "endpoint");
+ABSL_FLAG(int, decision_confirmations, 0,
+          "Blocks to wait for on top of the one deciding a transaction before "
+          "acting on the decision");
+
+// Calls the contract through the Ethereum JSON-RPC endpoint if one is set,
+// or else through the blockchain adapter server.
+std::unique_ptr<blockchain::TwoPhaseCommit> CreateTwoPhaseCommit(
+    const std::string& blockchain_adapter_address) {
+  blockchain::TwoPhaseCommitOptions two_phase_commit_options;
+  two_phase_commit_options.confirmations =
+      absl::GetFlag(FLAGS_decision_confirmations);
+  const std::string rpc_address = absl::GetFlag(FLAGS_ethereum_rpc_address);
+  if (rpc_address.empty()) {
+    return std::make_unique<blockchain::TwoPhaseCommit>(
+        grpc::CreateChannel(blockchain_adapter_address,
+                            grpc::InsecureChannelCredentials()),
+        two_phase_commit_options);
+  }
+  const size_t port_start = rpc_address.rfind(':');
+  int port = 0;
+  if (port_start == std::string::npos ||
+      !absl::SimpleAtoi(rpc_address.substr(port_start + 1), &port)) {
+    std::cerr << "Invalid --ethereum_rpc_address: " << rpc_address
+              << std::endl;
+    return nullptr;
+  }
+  blockchain::EthereumBlockchainOptions options;
+  options.contract_address = absl::GetFlag(FLAGS_contract_address);
+  options.accounts = absl::GetFlag(FLAGS_ethereum_accounts);
+  options.num_threads = absl::GetFlag(FLAGS_ethereum_rpc_connections);
+  if (options.contract_address.empty() || options.accounts.empty()) {
+    std::cerr << "--ethereum_rpc_address needs --contract_address and "
+                 "--ethereum_accounts"
+              << std::endl;
+    return nullptr;
+  }
+  return std::make_unique<blockchain::TwoPhaseCommit>(
+      std::make_unique<blockchain::EthereumBlockchain>(
+          std::make_unique<blockchain::HttpJsonRpcTransport>(
+              rpc_address.substr(0, port_start), port, options.num_threads),
+          options),
+      two_phase_commit_options);
+}
 
 void RunServer(const std::string& port,
                const std::string& blockchain_adapter_port,
-               absl::Duration default_presumed_abort_duration) {
+               absl::Duration default_presumed_abort_duration,
+               const coordinator::CoordinatorServerOptions& options) {
   std::string server_address = absl::StrCat("0.0.0.0:", port);
   std::string blockchain_adapter_address =
       absl::StrCat("0.0.0.0:", blockchain_adapter_port);
 
-  coordinator::CoordinatorServer service(
-      default_presumed_abort_duration,
-      std::make_unique<blockchain::TwoPhaseCommit>(grpc::CreateChannel(
-          blockchain_adapter_address, grpc::InsecureChannelCredentials())));
+  std::unique_ptr<blockchain::TwoPhaseCommit> two_phase_commit =
+      CreateTwoPhaseCommit(blockchain_adapter_address);
+  if (two_phase_commit == nullptr) {
+    return;
+  }
+  coordinator::CoordinatorServer service(default_presumed_abort_duration,
+                                         std::move(two_phase_commit), options);
 
   grpc::ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -49,8 +126,20 @@ int main(int argc, char** argv) {
   std::string error;
   if (absl::ParseFlag(absl::GetFlag(FLAGS_default_presumed_abort_duration),
                       &duration, &error)) {
+    coordinator::CoordinatorServerOptions options;
+    options.start_voting_batch_window =
+        absl::GetFlag(FLAGS_start_voting_batch_window);
+    options.max_start_voting_batch_size =
+        absl::GetFlag(FLAGS_max_start_voting_batch_size);
+    for (const std::string& cohort_signer :
+         absl::GetFlag(FLAGS_cohort_signers)) {
+      std::pair<std::string, std::string> address_and_signer =
+          absl::StrSplit(cohort_signer, absl::MaxSplits('=', 1));
+      options.cohort_signers[address_and_signer.first] =
+          address_and_signer.second;
+    }
     RunServer(absl::GetFlag(FLAGS_port),
-              absl::GetFlag(FLAGS_blockchain_adapter_port), duration);
+              absl::GetFlag(FLAGS_blockchain_adapter_port), duration, options);
   } else {
     std::fprintf(
         stderr,
@@ -1,5 +1,7 @@
 #include "src/coordinator/coordinator_server.h"
 
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "gmock/gmock.h"
 #include "grpcpp/server_context.h"
@@ -14,21 +16,27 @@ namespace {
 using ::protobuf_matchers::EquivToProto;
 using ::testing::_;
 using ::testing::DoAll;
+using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::IsEmpty;
 using ::testing::Not;
 using ::testing::Return;
+using ::testing::Property;
 using ::testing::SetArgReferee;
 
 class CoordinatorWithMockCohorts : public coordinator::CoordinatorServer {
  public:
   explicit CoordinatorWithMockCohorts(
-      absl::Duration default_presumed_abort_duration)
+      absl::Duration default_presumed_abort_duration,
+      const coordinator::CoordinatorServerOptions& options =
+          coordinator::CoordinatorServerOptions())
       : coordinator::CoordinatorServer(
             default_presumed_abort_duration,
             std::make_unique<blockchain::TwoPhaseCommit>(
-                std::make_unique<
-                    blockchain::MockTwoPhaseCommitAdapterStub>())) {}
+                std::make_unique<blockchain::MockTwoPhaseCommitAdapterStub>()),
+            options) {}
+
+  ~CoordinatorWithMockCohorts() override { StopBackgroundThreads(); }
 
   MOCK_METHOD4(MockPrepareCohortTransaction,
                void(const std::string& transaction_id,
@@ -45,6 +53,15 @@ class CoordinatorWithMockCohorts : public coordinator::CoordinatorServer {
       absl::Status(const std::string& transaction_id,
                    const google::protobuf::Timestamp& presumed_abort_time,
                    size_t num_cohorts));
+  MOCK_METHOD3(
+      MockStartVotingWithSigners,
+      absl::Status(const std::string& transaction_id,
+                   const google::protobuf::Timestamp& presumed_abort_time,
+                   const std::vector<std::string>& signers));
+  MOCK_METHOD3(MockCommitWithVotes,
+               absl::Status(const std::string& transaction_id,
+                            const std::vector<std::string>& signers,
+                            const std::vector<std::string>& signatures));
   MOCK_METHOD1(MockGetVotingDecision,
                absl::StatusOr<blockchain::VotingDecision>(
                    const std::string& transaction_id));
@@ -72,6 +89,19 @@ class CoordinatorWithMockCohorts : public coordinator::CoordinatorServer {
       size_t num_cohorts) override {
     return MockStartVoting(transaction_id, presumed_abort_time, num_cohorts);
   }
+  absl::Status StartVotingWithSigners(
+      const std::string& transaction_id,
+      const google::protobuf::Timestamp& presumed_abort_time,
+      const std::vector<std::string>& signers) override {
+    return MockStartVotingWithSigners(transaction_id, presumed_abort_time,
+                                      signers);
+  }
+  absl::Status CommitWithVotes(
+      const std::string& transaction_id,
+      const std::vector<std::string>& signers,
+      const std::vector<std::string>& signatures) override {
+    return MockCommitWithVotes(transaction_id, signers, signatures);
+  }
   absl::StatusOr<blockchain::VotingDecision> GetVotingDecision(
       const std::string& transaction_id) override {
     return MockGetVotingDecision(transaction_id);
@@ -582,4 +612,157 @@ TEST(CoordinatorServerTest, GetsResultsWhenAborted) {
   EXPECT_THAT(get_response, EquivToProto(R"pb(aborted_response {})pb"));
 }
 
-}  // namespace
\ No newline at end of file
+void AddRangeGetResponse(const std::string& prefix, const std::string& key,
+                         cohort::GetTransactionResultResponse& chunk) {
+  common::GetResponse* get_response =
+      chunk.mutable_committed_response()->add_get_responses();
+  get_response->mutable_get()->set_prefix(prefix);
+  get_response->add_key_values()->set_key(key);
+}
+
+TEST(CoordinatorServerTest, AppendCommittedChunkJoinsSplitRangeGets) {
+  cohort::GetTransactionResultResponse chunk1;
+  chunk1.mutable_committed_response()
+      ->add_get_responses()
+      ->mutable_get()
+      ->set_key("a");
+  AddRangeGetResponse("p", "p1", chunk1);
+  cohort::GetTransactionResultResponse chunk2;
+  chunk2.set_continues_get_response(true);
+  AddRangeGetResponse("p", "p2", chunk2);
+  AddRangeGetResponse("p", "p3", chunk2);
+
+  cohort::GetTransactionResultResponse response;
+  coordinator::internal::AppendCommittedChunk(chunk1, response);
+  coordinator::internal::AppendCommittedChunk(chunk2, response);
+  // The second range get is a separate op with the same prefix.
+  EXPECT_THAT(response, EquivToProto(R"pb(committed_response {
+                                            get_responses { get { key: "a" } }
+                                            get_responses {
+                                              get { prefix: "p" }
+                                              key_values { key: "p1" }
+                                              key_values { key: "p2" }
+                                            }
+                                            get_responses {
+                                              get { prefix: "p" }
+                                              key_values { key: "p3" }
+                                            }
+                                          })pb"));
+}
+
+TEST(CoordinatorServerTest, CommitsWithSignedVotesWhenAllCohortsHaveSigners) {
+  absl::Time start_time = absl::FromUnixSeconds(10);
+  grpc::ServerContext context;
+  coordinator::CommitAtomicTransactionRequest commit_request;
+  coordinator::CommitAtomicTransactionResponse commit_response;
+  commit_request.set_client_transaction_id("id");
+  *commit_request.mutable_transaction() = TwoNamespaceReadWriteTransaction();
+
+  coordinator::CoordinatorServerOptions options;
+  options.cohort_signers = {{"namespace1", "signer1"},
+                            {"namespace2", "signer2"}};
+  options.signed_vote_poll_interval = absl::Milliseconds(1);
+  CoordinatorWithMockCohorts server(absl::Minutes(1), options);
+  EXPECT_CALL(server, MockNow()).WillRepeatedly(Return(start_time));
+  EXPECT_CALL(server, MockStartVoting(_, _, _)).Times(0);
+  EXPECT_CALL(server, MockStartVotingWithSigners(
+                          _, _, ElementsAre("signer1", "signer2")))
+      .WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(server, MockPrepareCohortTransaction(
+                          _, _,
+                          Property(&cohort::PrepareTransactionRequest::
+                                       sign_commit_vote,
+                                   true),
+                          _))
+      .Times(2);
+
+  // The second cohort hasn't signed its vote the first time it's asked, so
+  // only its signature is fetched again. Then the transaction commits with
+  // both, and the cohorts return their committed responses.
+  cohort::GetTransactionResultResponse signed_response1;
+  signed_response1.mutable_pending_response();
+  signed_response1.set_commit_signature("signature1");
+  cohort::GetTransactionResultResponse signed_response2 = signed_response1;
+  signed_response2.set_commit_signature("signature2");
+  cohort::GetTransactionResultResponse unsigned_response;
+  unsigned_response.mutable_pending_response();
+  cohort::GetTransactionResultResponse committed_response;
+  committed_response.mutable_committed_response();
+  EXPECT_CALL(server, MockGetResultsFromCohort(
+                          Property(&common::Namespace::address, "namespace1"),
+                          _, _, _))
+      .WillOnce(DoAll(SetArgReferee<3>(signed_response1),
+                      Return(grpc::Status::OK)))
+      .WillRepeatedly(DoAll(SetArgReferee<3>(committed_response),
+                            Return(grpc::Status::OK)));
+  EXPECT_CALL(server, MockGetResultsFromCohort(
+                          Property(&common::Namespace::address, "namespace2"),
+                          _, _, _))
+      .WillOnce(DoAll(SetArgReferee<3>(unsigned_response),
+                      Return(grpc::Status::OK)))
+      .WillOnce(DoAll(SetArgReferee<3>(signed_response2),
+                      Return(grpc::Status::OK)))
+      .WillRepeatedly(DoAll(SetArgReferee<3>(committed_response),
+                            Return(grpc::Status::OK)));
+  absl::Notification committed;
+  EXPECT_CALL(server,
+              MockCommitWithVotes(_, ElementsAre("signer1", "signer2"),
+                                  ElementsAre("signature1", "signature2")))
+      .WillOnce([&committed]() {
+        committed.Notify();
+        return absl::OkStatus();
+      });
+  EXPECT_OK(server.CommitAtomicTransaction(&context, &commit_request,
+                                           &commit_response));
+  // The votes are committed without any client asking for the result.
+  committed.WaitForNotification();
+
+  coordinator::GetTransactionResultRequest get_request;
+  get_request.set_global_transaction_id(
+      commit_response.global_transaction_id());
+  coordinator::GetTransactionResultResponse get_response;
+  EXPECT_CALL(server, MockGetVotingDecision(_))
+      .WillOnce(Return(blockchain::VotingDecision::VOTING_DECISION_COMMIT));
+  EXPECT_OK(server.GetTransactionResult(&context, &get_request, &get_response));
+  EXPECT_TRUE(get_response.has_committed_response());
+}
+
+TEST(CoordinatorServerTest, DoesNotCommitSignedVotesOfAbortedCohorts) {
+  grpc::ServerContext context;
+  coordinator::CommitAtomicTransactionRequest commit_request;
+  coordinator::CommitAtomicTransactionResponse commit_response;
+  commit_request.set_client_transaction_id("id");
+  *commit_request.mutable_transaction() = TwoNamespaceReadWriteTransaction();
+
+  coordinator::CoordinatorServerOptions options;
+  options.cohort_signers = {{"namespace1", "signer1"},
+                            {"namespace2", "signer2"}};
+  options.signed_vote_poll_interval = absl::Milliseconds(1);
+  CoordinatorWithMockCohorts server(absl::Minutes(1), options);
+  EXPECT_CALL(server, MockNow())
+      .WillRepeatedly(Return(absl::FromUnixSeconds(10)));
+  EXPECT_CALL(server, MockStartVotingWithSigners(_, _, _))
+      .WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(server, MockPrepareCohortTransaction(_, _, _, _)).Times(2);
+  cohort::GetTransactionResultResponse aborted_response;
+  aborted_response.set_aborted_response(common::ABORT_REASON_RESOURCE_LOCKED);
+  absl::Notification asked;
+  EXPECT_CALL(server, MockGetResultsFromCohort(_, _, _, _))
+      .WillOnce([&asked, &aborted_response](
+                    const common::Namespace& /*namespace_*/,
+                    const cohort::GetTransactionResultRequest& /*request*/,
+                    grpc::ClientContext& /*context*/,
+                    cohort::GetTransactionResultResponse& response) {
+        response = aborted_response;
+        asked.Notify();
+        return grpc::Status::OK;
+      });
+  EXPECT_CALL(server, MockCommitWithVotes(_, _, _)).Times(0);
+  EXPECT_OK(server.CommitAtomicTransaction(&context, &commit_request,
+                                           &commit_response));
+  asked.WaitForNotification();
+  // Later polls don't ask the cohorts of the given up transaction again.
+  absl::SleepFor(absl::Milliseconds(20));
+}
+
+}  // namespace
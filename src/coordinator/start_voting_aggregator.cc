@@ -0,0 +1,43 @@
+#include "src/coordinator/start_voting_aggregator.h"
+
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace coordinator {
+
+absl::Status StartVotingAggregator::StartVoting(
+    const std::string &transaction_id,
+    const google::protobuf::Timestamp &timeout_time, size_t num_cohorts) {
+  blockchain::StartVotingRequest request;
+  request.set_transaction_id(transaction_id);
+  *request.mutable_timeout_time() = timeout_time;
+  request.set_cohorts(num_cohorts);
+  return batcher_.Add(std::move(request));
+}
+
+absl::Status StartVotingAggregator::SendBatch(
+    blockchain::TwoPhaseCommit *blockchain,
+    absl::Span<const blockchain::StartVotingRequest> requests,
+    absl::Span<absl::Status> statuses) {
+  absl::StatusOr<std::vector<int>> skipped_indices =
+      blockchain->StartVotingBatch(requests);
+  if (!skipped_indices.ok()) {
+    return skipped_indices.status();
+  }
+  for (const int index : *skipped_indices) {
+    if (index < 0 || index >= static_cast<int>(requests.size())) {
+      return absl::InternalError(
+          absl::StrCat("The contract skipped unknown batch index ", index));
+    }
+    statuses[index] = absl::FailedPreconditionError(
+        absl::StrCat("The contract skipped starting the voting of ",
+                     requests[index].transaction_id(),
+                     ", e.g. because its timeout passed"));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace coordinator
@@ -0,0 +1,52 @@
+#ifndef SRC_COORDINATOR_START_VOTING_AGGREGATOR_H_
+
+#define SRC_COORDINATOR_START_VOTING_AGGREGATOR_H_
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "google/protobuf/timestamp.pb.h"
+#include "src/blockchain/two_phase_commit.h"
+#include "src/utils/batcher.h"
+
+namespace coordinator {
+
+// Combines the StartVoting calls of concurrent client transactions into
+// StartVotingBatch calls, so the coordinator sends one blockchain transaction
+// per batch instead of one per client transaction. Thread-safe.
+class StartVotingAggregator {
+ public:
+  StartVotingAggregator(
+      blockchain::TwoPhaseCommit *blockchain,
+      const utils::BatcherOptions &options = utils::BatcherOptions())
+      : batcher_(
+            [blockchain](
+                absl::Span<const blockchain::StartVotingRequest> requests,
+                absl::Span<absl::Status> statuses) {
+              return SendBatch(blockchain, requests, statuses);
+            },
+            options) {}
+
+  // Blocks until the batch with the transaction has been sent and returns the
+  // status of sending it. Fails with FailedPrecondition error if the contract
+  // skipped starting the transaction's voting because its timeout passed or
+  // its number of cohorts is zero or above the contract's limit. The contract
+  // doesn't check whether the voting already started, and restarting it
+  // discards its votes.
+  absl::Status StartVoting(const std::string &transaction_id,
+                           const google::protobuf::Timestamp &timeout_time,
+                           size_t num_cohorts);
+
+ private:
+  // Starts the votings of |requests|, failing the ones the contract skipped.
+  static absl::Status SendBatch(
+      blockchain::TwoPhaseCommit *blockchain,
+      absl::Span<const blockchain::StartVotingRequest> requests,
+      absl::Span<absl::Status> statuses);
+
+  utils::Batcher<blockchain::StartVotingRequest> batcher_;
+};
+
+}  // namespace coordinator
+
+#endif  // SRC_COORDINATOR_START_VOTING_AGGREGATOR_H_
@@ -0,0 +1,104 @@
+#include "src/coordinator/start_voting_aggregator.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/blockchain/proto/two_phase_commit_adapter_mock.grpc.pb.h"
+
+namespace {
+
+using ::blockchain::MockTwoPhaseCommitAdapterStub;
+using ::blockchain::StartVotingBatchRequest;
+using ::blockchain::StartVotingBatchResponse;
+using ::testing::_;
+
+TEST(StartVotingAggregatorTest, StartsConcurrentTransactionsInOneBatch) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  StartVotingBatchRequest sent_request;
+  EXPECT_CALL(*stub, StartVotingBatch(_, _, _))
+      .WillOnce([&sent_request](grpc::ClientContext *,
+                                const StartVotingBatchRequest &request,
+                                StartVotingBatchResponse *) {
+        sent_request = request;
+        return grpc::Status::OK;
+      });
+  blockchain::TwoPhaseCommit blockchain(std::move(stub));
+  utils::BatcherOptions options;
+  options.max_batch_size = 3;
+  options.max_delay = absl::Hours(1);
+  coordinator::StartVotingAggregator aggregator(&blockchain, options);
+
+  google::protobuf::Timestamp timeout_time;
+  timeout_time.set_seconds(1672560000);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back([&aggregator, &timeout_time, i]() {
+      EXPECT_TRUE(
+          aggregator.StartVoting(absl::StrCat("t", i), timeout_time, 2).ok());
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(sent_request.transactions_size(), 3);
+  for (const blockchain::StartVotingRequest &request :
+       sent_request.transactions()) {
+    EXPECT_EQ(request.cohorts(), 2);
+    EXPECT_EQ(request.timeout_time().seconds(), 1672560000);
+  }
+}
+
+TEST(StartVotingAggregatorTest, ReturnsBatchErrors) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, StartVotingBatch(_, _, _))
+      .WillOnce(::testing::Return(grpc::Status(grpc::UNAVAILABLE, "down")));
+  blockchain::TwoPhaseCommit blockchain(std::move(stub));
+  utils::BatcherOptions options;
+  options.max_delay = absl::Milliseconds(1);
+  coordinator::StartVotingAggregator aggregator(&blockchain, options);
+
+  EXPECT_EQ(aggregator
+                .StartVoting("t1", google::protobuf::Timestamp(),
+                             /*num_cohorts=*/2)
+                .code(),
+            absl::StatusCode::kUnavailable);
+}
+
+TEST(StartVotingAggregatorTest, FailsTransactionsTheContractSkipped) {
+  auto stub = std::make_unique<MockTwoPhaseCommitAdapterStub>();
+  EXPECT_CALL(*stub, StartVotingBatch(_, _, _))
+      .WillOnce([](grpc::ClientContext *,
+                   const StartVotingBatchRequest &request,
+                   StartVotingBatchResponse *response) {
+        for (int i = 0; i < request.transactions_size(); ++i) {
+          if (request.transactions(i).transaction_id() == "t1") {
+            response->add_skipped_indices(i);
+          }
+        }
+        return grpc::Status::OK;
+      });
+  blockchain::TwoPhaseCommit blockchain(std::move(stub));
+  utils::BatcherOptions options;
+  options.max_batch_size = 2;
+  options.max_delay = absl::Hours(1);
+  coordinator::StartVotingAggregator aggregator(&blockchain, options);
+
+  google::protobuf::Timestamp timeout_time;
+  absl::Status started_status;
+  std::thread started([&aggregator, &timeout_time, &started_status]() {
+    started_status = aggregator.StartVoting("t0", timeout_time, 2);
+  });
+  const absl::Status skipped_status =
+      aggregator.StartVoting("t1", timeout_time, 2);
+  started.join();
+
+  EXPECT_TRUE(started_status.ok());
+  EXPECT_EQ(skipped_status.code(), absl::StatusCode::kFailedPrecondition);
+}
+
+}  // namespace
@@ -0,0 +1,165 @@
+// Loads key/value rows into a new cohort db.
+//
+// Reads one row per line from --input, with the key and value separated by a
+// tab. Values are parsed as --value_type and stored as serialized
+// common::ConstantValue, like the cohort stores them. Pass the same
+// --lmdb_shards to the cohort when serving the db.
+// Example cmd:
+//   bazel run //src/db:bulk_load_main -- --input=/tmp/rows.tsv \
+//       --db_dir=/tmp/cohort_db --lmdb_shards=4
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "src/db/bulk_loader.h"
+#include "src/db/lmdb_database_transaction_adapter.h"
+#include "src/db/sharded_lmdb_database_transaction_adapter.h"
+#include "src/proto/common.pb.h"
+
+ABSL_FLAG(std::string, input, "-",
+          "File with a key<TAB>value row per line, or - for stdin");
+ABSL_FLAG(std::string, db_dir, "/tmp/cohort_db",
+          "Directory of the db to load. Created if it doesn't exist. Loaded "
+          "keys must sort after any keys already in it.");
+ABSL_FLAG(int, lmdb_shards, 1,
+          "Number of LMDB environments to split the db into. Must match the "
+          "cohort's --lmdb_shards.");
+ABSL_FLAG(bool, sorted, false,
+          "Whether the input is sorted by key, which skips the external sort");
+ABSL_FLAG(std::string, value_type, "string",
+          "Type of the values: int64, double or string");
+ABSL_FLAG(int, rows_per_txn, 100000,
+          "Number of rows each shard commits per transaction");
+ABSL_FLAG(int64_t, sort_buffer_bytes, 256 << 20,
+          "Size of the rows sorted in memory before spilling to a run file");
+ABSL_FLAG(std::string, temp_dir, "/tmp",
+          "Directory for the external sort's run files");
+
+namespace {
+
+absl::StatusOr<std::string> EncodeValue(const std::string& text) {
+  common::ConstantValue value;
+  const std::string& value_type = absl::GetFlag(FLAGS_value_type);
+  if (value_type == "int64") {
+    int64_t int64_value;
+    if (!absl::SimpleAtoi(text, &int64_value)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid int64 value: ", text));
+    }
+    value.set_int64_value(int64_value);
+  } else if (value_type == "double") {
+    double double_value;
+    if (!absl::SimpleAtod(text, &double_value)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid double value: ", text));
+    }
+    value.set_double_value(double_value);
+  } else if (value_type == "string") {
+    value.set_string_value(text);
+  } else {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown value type: ", value_type));
+  }
+  return value.SerializeAsString();
+}
+
+absl::StatusOr<std::vector<std::shared_ptr<db::LMDBEnvironment>>> OpenShards(
+    const std::string& db_dir, int num_shards, const db::LMDBOptions& options) {
+  if (num_shards > 1) {
+    return db::OpenLMDBShards(db_dir, num_shards, options);
+  }
+  std::filesystem::create_directories(db_dir);
+  absl::StatusOr<std::shared_ptr<db::LMDBEnvironment>> env =
+      db::LMDBEnvironment::Open(db_dir, options);
+  if (!env.ok()) {
+    return env.status();
+  }
+  return std::vector<std::shared_ptr<db::LMDBEnvironment>>{*env};
+}
+
+void PrintStats(const db::BulkLoadStats& stats) {
+  std::cerr << absl::StrFormat(
+                   "%d rows read, %d rows written in %.1fs (%.0f rows/s)",
+                   stats.rows_read, stats.rows_written,
+                   absl::ToDoubleSeconds(stats.elapsed), stats.RowsPerSecond())
+            << std::endl;
+}
+
+absl::Status Load(std::istream& input) {
+  // The load is only useful once it completes, so commits don't wait for the
+  // disk. The environments sync when they close.
+  db::LMDBOptions lmdb_options;
+  lmdb_options.durability = db::LMDBDurability::kWriteMapAsyncFlush;
+  absl::StatusOr<std::vector<std::shared_ptr<db::LMDBEnvironment>>> shards =
+      OpenShards(absl::GetFlag(FLAGS_db_dir), absl::GetFlag(FLAGS_lmdb_shards),
+                 lmdb_options);
+  if (!shards.ok()) {
+    return shards.status();
+  }
+
+  db::BulkLoadOptions options;
+  options.sorted = absl::GetFlag(FLAGS_sorted);
+  options.sort_buffer_bytes = absl::GetFlag(FLAGS_sort_buffer_bytes);
+  options.temp_dir = absl::GetFlag(FLAGS_temp_dir);
+  options.rows_per_txn = absl::GetFlag(FLAGS_rows_per_txn);
+  db::BulkLoader loader(*std::move(shards), options, PrintStats);
+
+  std::string line;
+  for (int line_number = 1; std::getline(input, line); ++line_number) {
+    const size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Line ", line_number, " has no tab"));
+    }
+    absl::StatusOr<std::string> value = EncodeValue(line.substr(tab + 1));
+    if (!value.ok()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Line ", line_number, ": ", value.status().message()));
+    }
+    const absl::Status status =
+        loader.Add(line.substr(0, tab), *std::move(value));
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  const absl::StatusOr<db::BulkLoadStats> stats = loader.Finish();
+  if (!stats.ok()) {
+    return stats.status();
+  }
+  PrintStats(*stats);
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  absl::Status status;
+  const std::string input_path = absl::GetFlag(FLAGS_input);
+  if (input_path == "-") {
+    status = Load(std::cin);
+  } else {
+    std::ifstream input(input_path);
+    if (!input.is_open()) {
+      std::cerr << "Failed to open " << input_path << std::endl;
+      return 1;
+    }
+    status = Load(input);
+  }
+  if (!status.ok()) {
+    std::cerr << "Bulk load failed: " << status << std::endl;
+    return 1;
+  }
+  return 0;
+}
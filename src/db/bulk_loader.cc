@@ -0,0 +1,285 @@
+#include "src/db/bulk_loader.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <queue>
+#include <tuple>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "src/db/sharded_lmdb_database_transaction_adapter.h"
+
+namespace db {
+
+namespace {
+
+// Run files store each row as the key's size, the key, the value's size and
+// the value. Sizes are 32-bit in native byte order, since runs never leave the
+// machine.
+bool WriteField(std::ofstream& file, std::string_view field) {
+  const uint32_t size = field.size();
+  file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  file.write(field.data(), field.size());
+  return file.good();
+}
+
+bool ReadField(std::ifstream& file, std::string& field) {
+  uint32_t size;
+  if (!file.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  field.resize(size);
+  return static_cast<bool>(file.read(field.data(), size));
+}
+
+// Reads the rows of a run file in order.
+class RunReader {
+ public:
+  explicit RunReader(const std::string& path)
+      : file_(path, std::ios::binary) {}
+
+  bool ok() const { return file_.is_open(); }
+
+  // Reads the next row into key() and value(). Returns false at the end.
+  bool Next() { return ReadField(file_, key_) && ReadField(file_, value_); }
+
+  // Returns true if the run ended in the middle of a row.
+  bool Truncated() const { return !file_.eof(); }
+
+  std::string& key() { return key_; }
+  std::string& value() { return value_; }
+
+ private:
+  std::ifstream file_;
+  std::string key_;
+  std::string value_;
+};
+
+}  // namespace
+
+BulkLoader::BulkLoader(std::vector<std::shared_ptr<LMDBEnvironment>> shards,
+                       const BulkLoadOptions& options,
+                       BulkLoadProgressCallback progress)
+    : options_(options),
+      progress_(std::move(progress)),
+      start_(absl::Now()),
+      last_progress_(start_) {
+  shards_.reserve(shards.size());
+  for (std::shared_ptr<LMDBEnvironment>& env : shards) {
+    shards_.push_back(
+        {std::make_unique<LMDBDatabaseTransactionAdapter>(std::move(env))});
+  }
+}
+
+BulkLoader::~BulkLoader() {
+  for (const std::string& path : run_paths_) {
+    std::remove(path.c_str());
+  }
+}
+
+absl::Status BulkLoader::Add(std::string key, std::string value) {
+  if (finished_) {
+    return absl::FailedPreconditionError("Bulk load already finished.");
+  }
+  ++rows_read_;
+  if (options_.sorted) {
+    if (has_pending_ && key < pending_key_) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Rows aren't sorted: ", key, " comes after ", pending_key_));
+    }
+    return AddSorted(std::move(key), std::move(value));
+  }
+  buffer_bytes_ += key.size() + value.size();
+  buffer_.emplace_back(std::move(key), std::move(value));
+  if (buffer_bytes_ >= options_.sort_buffer_bytes) {
+    return SpillBuffer();
+  }
+  MaybeReportProgress();
+  return absl::OkStatus();
+}
+
+absl::Status BulkLoader::AddSorted(std::string key, std::string value) {
+  if (has_pending_ && key != pending_key_) {
+    const absl::Status status = WritePending();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  pending_key_ = std::move(key);
+  pending_value_ = std::move(value);
+  has_pending_ = true;
+  return absl::OkStatus();
+}
+
+absl::Status BulkLoader::WritePending() {
+  Shard& shard = shards_[GetLMDBShard(pending_key_, shards_.size())];
+  shard.rows.emplace_back(std::move(pending_key_), std::move(pending_value_));
+  has_pending_ = false;
+  if (shard.rows.size() >= options_.rows_per_txn) {
+    return FlushShard(shard);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status BulkLoader::FlushShard(Shard& shard) {
+  if (shard.rows.empty()) {
+    return absl::OkStatus();
+  }
+  absl::Status status = shard.db_txn_adapter->Begin();
+  for (size_t i = 0; i < shard.rows.size() && status.ok(); ++i) {
+    status = shard.db_txn_adapter->Append(shard.rows[i].first,
+                                          shard.rows[i].second);
+  }
+  if (status.ok()) {
+    status = shard.db_txn_adapter->Commit();
+  } else {
+    shard.db_txn_adapter->Abort().IgnoreError();
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  rows_written_ += shard.rows.size();
+  shard.rows.clear();
+  MaybeReportProgress();
+  return absl::OkStatus();
+}
+
+void BulkLoader::SortBuffer() {
+  // Stable, so the last of the rows with the same key is the last added.
+  std::stable_sort(
+      buffer_.begin(), buffer_.end(),
+      [](const auto& a, const auto& b) { return a.first < b.first; });
+  size_t kept = 0;
+  for (size_t i = 0; i < buffer_.size(); ++i) {
+    if (i + 1 < buffer_.size() && buffer_[i + 1].first == buffer_[i].first) {
+      continue;
+    }
+    if (kept != i) {
+      buffer_[kept] = std::move(buffer_[i]);
+    }
+    ++kept;
+  }
+  buffer_.resize(kept);
+}
+
+absl::Status BulkLoader::SpillBuffer() {
+  SortBuffer();
+  const std::string path =
+      absl::StrCat(options_.temp_dir, "/bulk_load_", getpid(), "_",
+                   reinterpret_cast<uintptr_t>(this), "_", run_paths_.size());
+  run_paths_.push_back(path);
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  for (const auto& [key, value] : buffer_) {
+    if (!WriteField(file, key) || !WriteField(file, value)) {
+      return absl::InternalError(
+          absl::StrCat("Failed to write run file ", path));
+    }
+  }
+  file.close();
+  if (file.fail()) {
+    return absl::InternalError(absl::StrCat("Failed to write run file ", path));
+  }
+  buffer_.clear();
+  buffer_bytes_ = 0;
+  MaybeReportProgress();
+  return absl::OkStatus();
+}
+
+absl::Status BulkLoader::MergeRuns() {
+  std::vector<std::unique_ptr<RunReader>> runs;
+  // Next row of each run, ordered by key and then by run so that the last
+  // added value of a key comes last.
+  using Head = std::tuple<std::string_view, size_t>;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  for (const std::string& path : run_paths_) {
+    runs.push_back(std::make_unique<RunReader>(path));
+    if (!runs.back()->ok()) {
+      return absl::InternalError(
+          absl::StrCat("Failed to open run file ", path));
+    }
+    if (runs.back()->Next()) {
+      heads.emplace(runs.back()->key(), runs.size() - 1);
+    }
+  }
+  while (!heads.empty()) {
+    const size_t run_index = std::get<1>(heads.top());
+    heads.pop();
+    RunReader& run = *runs[run_index];
+    const absl::Status status =
+        AddSorted(std::move(run.key()), std::move(run.value()));
+    if (!status.ok()) {
+      return status;
+    }
+    if (run.Next()) {
+      heads.emplace(run.key(), run_index);
+    } else if (run.Truncated()) {
+      return absl::InternalError(
+          absl::StrCat("Run file is truncated: ", run_paths_[run_index]));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<BulkLoadStats> BulkLoader::Finish() {
+  if (finished_) {
+    return absl::FailedPreconditionError("Bulk load already finished.");
+  }
+  finished_ = true;
+  absl::Status status;
+  if (!run_paths_.empty()) {
+    if (!buffer_.empty()) {
+      status = SpillBuffer();
+    }
+    if (status.ok()) {
+      status = MergeRuns();
+    }
+  } else if (!buffer_.empty()) {
+    // Everything fit in memory, so there is nothing to merge.
+    SortBuffer();
+    for (auto& [key, value] : buffer_) {
+      status = AddSorted(std::move(key), std::move(value));
+      if (!status.ok()) {
+        break;
+      }
+    }
+    buffer_.clear();
+  }
+  if (status.ok() && has_pending_) {
+    status = WritePending();
+  }
+  for (Shard& shard : shards_) {
+    if (!status.ok()) {
+      break;
+    }
+    status = FlushShard(shard);
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  return Stats();
+}
+
+void BulkLoader::MaybeReportProgress() {
+  if (progress_ == nullptr) {
+    return;
+  }
+  const absl::Time now = absl::Now();
+  if (now - last_progress_ < options_.progress_interval) {
+    return;
+  }
+  last_progress_ = now;
+  progress_(Stats());
+}
+
+BulkLoadStats BulkLoader::Stats() const {
+  BulkLoadStats stats;
+  stats.rows_read = rows_read_;
+  stats.rows_written = rows_written_;
+  stats.elapsed = absl::Now() - start_;
+  return stats;
+}
+
+}  // namespace db
@@ -0,0 +1,130 @@
+#ifndef SRC_DB_BULK_LOADER_H_
+
+#define SRC_DB_BULK_LOADER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "src/db/lmdb_database_transaction_adapter.h"
+
+namespace db {
+
+struct BulkLoadOptions {
+  // Whether rows are added in increasing key order. Sorted rows are written
+  // directly, other rows go through an external sort first.
+  bool sorted = false;
+  // Size of the rows to sort in memory before spilling them to a run file.
+  size_t sort_buffer_bytes = 256 << 20;
+  // Directory for the external sort's run files.
+  std::string temp_dir = "/tmp";
+  // Number of rows each shard commits per write transaction.
+  size_t rows_per_txn = 100000;
+  // How often the progress callback is called.
+  absl::Duration progress_interval = absl::Seconds(10);
+};
+
+struct BulkLoadStats {
+  uint64_t rows_read = 0;
+  // Less than |rows_read| if keys were repeated.
+  uint64_t rows_written = 0;
+  absl::Duration elapsed = absl::ZeroDuration();
+
+  double RowsPerSecond() const {
+    return elapsed <= absl::ZeroDuration()
+               ? 0
+               : rows_written / absl::ToDoubleSeconds(elapsed);
+  }
+};
+
+using BulkLoadProgressCallback = std::function<void(const BulkLoadStats&)>;
+
+// Loads rows into LMDB much faster than transactions of Puts would, to seed a
+// cohort's db. Rows are written in key order with MDB_APPEND, which skips the
+// B-tree search and leaves every page full, in large transactions.
+// Keys are assigned to |shards| the same way ShardedLMDBDatabaseTransaction
+// Adapter does, so the result can be opened by the cohort directly. The
+// shards must be empty or only contain keys smaller than the loaded ones.
+// If a key is added more than once, the last value wins.
+class BulkLoader {
+ public:
+  BulkLoader(std::vector<std::shared_ptr<LMDBEnvironment>> shards,
+             const BulkLoadOptions& options,
+             BulkLoadProgressCallback progress = nullptr);
+
+  BulkLoader(const BulkLoader&) = delete;
+  BulkLoader& operator=(const BulkLoader&) = delete;
+
+  // Deletes any run files left by an unfinished load.
+  ~BulkLoader();
+
+  // Adds a row. In sorted mode, returns InvalidArgument error if |key| is
+  // smaller than the previous key.
+  absl::Status Add(std::string key, std::string value);
+
+  // Writes the remaining rows and commits every shard.
+  absl::StatusOr<BulkLoadStats> Finish();
+
+ private:
+  struct Shard {
+    std::unique_ptr<LMDBDatabaseTransactionAdapter> db_txn_adapter;
+    // Rows for the shard's next transaction, in key order.
+    std::vector<std::pair<std::string, std::string>> rows;
+  };
+
+  // Writes rows in key order. A row with the same key as the previous one
+  // replaces it, so only the last value of each key is written.
+  absl::Status AddSorted(std::string key, std::string value);
+
+  // Moves the pending row to its shard's rows.
+  absl::Status WritePending();
+
+  // Appends the rows of |shard| in a single transaction. Only one shard has a
+  // transaction open at a time, so the loader never waits on one shard's
+  // writer lock while holding another's.
+  absl::Status FlushShard(Shard& shard);
+
+  // Sorts the buffered rows and writes them to a new run file.
+  absl::Status SpillBuffer();
+
+  // Sorts the buffered rows, keeping only the last value of each key.
+  void SortBuffer();
+
+  // Merges the run files in key order into AddSorted.
+  absl::Status MergeRuns();
+
+  void MaybeReportProgress();
+
+  BulkLoadStats Stats() const;
+
+  const BulkLoadOptions options_;
+  const BulkLoadProgressCallback progress_;
+  std::vector<Shard> shards_;
+  const absl::Time start_;
+  absl::Time last_progress_;
+  bool finished_ = false;
+
+  uint64_t rows_read_ = 0;
+  uint64_t rows_written_ = 0;
+
+  // Row waiting to be written until a larger key shows it is the last value.
+  bool has_pending_ = false;
+  std::string pending_key_;
+  std::string pending_value_;
+
+  // Unsorted rows not spilled yet.
+  std::vector<std::pair<std::string, std::string>> buffer_;
+  size_t buffer_bytes_ = 0;
+  std::vector<std::string> run_paths_;
+};
+
+}  // namespace db
+
+#endif  // SRC_DB_BULK_LOADER_H_
@@ -0,0 +1,130 @@
+#include "src/db/bulk_loader.h"
+
+#include <filesystem>
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/db/sharded_lmdb_database_transaction_adapter.h"
+
+namespace db {
+
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Optional;
+
+constexpr size_t kNumShards = 3;
+
+std::vector<std::shared_ptr<LMDBEnvironment>> OpenNewShards(
+    const std::string& test_name) {
+  const std::string dir = absl::StrCat("/tmp/bulk_loader_test_", test_name);
+  std::filesystem::remove_all(dir);
+  absl::StatusOr<std::vector<std::shared_ptr<LMDBEnvironment>>> shards =
+      OpenLMDBShards(dir, kNumShards);
+  EXPECT_TRUE(shards.ok()) << shards.status();
+  return *shards;
+}
+
+TEST(BulkLoaderTest, LoadsSortedRows) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("sorted");
+  BulkLoadOptions options;
+  options.sorted = true;
+  options.rows_per_txn = 7;
+  {
+    BulkLoader loader(shards, options);
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(
+          loader.Add(absl::StrCat("key_", 1000 + i), absl::StrCat(i)).ok());
+    }
+    const absl::StatusOr<BulkLoadStats> stats = loader.Finish();
+    ASSERT_TRUE(stats.ok()) << stats.status();
+    EXPECT_EQ(stats->rows_read, 100);
+    EXPECT_EQ(stats->rows_written, 100);
+  }
+
+  ShardedLMDBDatabaseTransactionAdapter db_txn_adapter(shards);
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::vector<absl::optional<std::string_view>> values;
+  EXPECT_EQ(
+      db_txn_adapter.MultiGet({"key_1000", "key_1042", "key_1099"}, values)
+          .code(),
+      absl::StatusCode::kOk);
+  EXPECT_THAT(values, ElementsAre(Optional(Eq("0")), Optional(Eq("42")),
+                                  Optional(Eq("99"))));
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(BulkLoaderTest, RejectsUnsortedRowsInSortedMode) {
+  BulkLoadOptions options;
+  options.sorted = true;
+  BulkLoader loader(OpenNewShards("rejects"), options);
+  EXPECT_TRUE(loader.Add("b", "1").ok());
+  EXPECT_EQ(loader.Add("a", "2").code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(BulkLoaderTest, SortsUnsortedRowsThroughRunFiles) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("unsorted");
+  BulkLoadOptions options;
+  // Spills a run every few rows.
+  options.sort_buffer_bytes = 64;
+  options.temp_dir = "/tmp";
+  {
+    BulkLoader loader(shards, options);
+    for (int i = 99; i >= 0; --i) {
+      ASSERT_TRUE(
+          loader.Add(absl::StrCat("key_", 1000 + i), absl::StrCat(i)).ok());
+    }
+    // Repeated keys keep the last value, even across runs.
+    ASSERT_TRUE(loader.Add("key_1099", "last").ok());
+    const absl::StatusOr<BulkLoadStats> stats = loader.Finish();
+    ASSERT_TRUE(stats.ok()) << stats.status();
+    EXPECT_EQ(stats->rows_read, 101);
+    EXPECT_EQ(stats->rows_written, 100);
+  }
+
+  ShardedLMDBDatabaseTransactionAdapter db_txn_adapter(shards);
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::vector<std::string> scanned;
+  EXPECT_EQ(db_txn_adapter
+                .Scan("", "", 0,
+                      [&scanned](std::string_view key, std::string_view) {
+                        scanned.emplace_back(key);
+                      })
+                .code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(scanned.size(), 100);
+  EXPECT_TRUE(std::is_sorted(scanned.begin(), scanned.end()));
+  std::string_view value;
+  EXPECT_EQ(db_txn_adapter.Get("key_1099", value).code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(value, "last");
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(BulkLoaderTest, AppendingBeforeExistingKeysFails) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("existing");
+  {
+    ShardedLMDBDatabaseTransactionAdapter db_txn_adapter(shards);
+    ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+    for (int i = 0; i < 10; ++i) {
+      ASSERT_EQ(db_txn_adapter.Put(absl::StrCat("z", i), "v").code(),
+                absl::StatusCode::kOk);
+    }
+    ASSERT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+  }
+  BulkLoader loader(shards, BulkLoadOptions());
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(loader.Add(absl::StrCat("a", i), "v").ok());
+  }
+  EXPECT_EQ(loader.Finish().status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+
+}  // namespace db
@@ -2,9 +2,14 @@
 
 #define SRC_DB_DATABASE_TRANSACTION_ADAPTER_H_
 
+#include <functional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
 
 namespace db {
 
@@ -12,16 +17,32 @@ namespace db {
 // It does not need to worry about locking keys. It is expected that the caller
 // ensures concurrent transactions do not modify keys used in other put/get
 // transactions.
+// Values are opaque bytes. Reads return views into memory owned by the
+// database (e.g. LMDB's memory map) so they don't copy the value. A view is
+// only valid until the transaction ends or the next write in the transaction,
+// so callers must copy anything they need to keep before then.
 class DatabaseTransactionAdapter {
  public:
   DatabaseTransactionAdapter() = default;
-  ~DatabaseTransactionAdapter() = default;
+  virtual ~DatabaseTransactionAdapter() = default;
 
   // Returns true if the underlying database supports multiple concurrent
   // writes. If it does not support concurrent writes, the caller must ensure
   // only one write transaction is in progress at any given time.
   [[nodiscard]] virtual /*static*/ bool SupportsConcurrentWrites() const = 0;
 
+  // Returns the number of independent partitions the keys are split over.
+  // If the database doesn't support concurrent writes, it still supports one
+  // write transaction per shard at a time, so the caller only needs to ensure
+  // write transactions don't use the same shards.
+  [[nodiscard]] virtual size_t NumShards() const { return 1; }
+
+  // Returns the shard, in [0, NumShards()), that |key| is stored in. Range
+  // scans may read from every shard.
+  [[nodiscard]] virtual size_t GetShard(const std::string& /*key*/) const {
+    return 0;
+  }
+
   // Begins a transaction.
   virtual absl::Status Begin() = 0;
 
@@ -36,13 +57,78 @@ class DatabaseTransactionAdapter {
 
   // Gets the value from the database with input |key|.
   // It assumes a transaction is already opened with Begin.
-  // Returns FailedPrecondition error if no transaction is valid.
-  virtual absl::Status Get(const std::string& key, int64_t& output_value) = 0;
+  // Returns FailedPrecondition error if no transaction is valid and NotFound
+  // error if the key doesn't exist.
+  virtual absl::Status Get(const std::string& key,
+                           std::string_view& output_value) = 0;
 
   // Put the |value| into the database with input |key|.
   // It assumes a transaction is already opened with Begin.
   // Returns FailedPrecondition error if no transaction is valid.
-  virtual absl::Status Put(const std::string& key, int64_t value) = 0;
+  virtual absl::Status Put(const std::string& key, std::string_view value) = 0;
+
+  // Gets the values for all |keys| into |output_values|, in the same order as
+  // |keys|. Keys that don't exist have no value. The values are views with the
+  // same lifetime as the ones returned by Get.
+  // It assumes a transaction is already opened with Begin.
+  // Returns FailedPrecondition error if no transaction is valid.
+  // The default implementation calls Get for each key. Databases that can
+  // share work between keys (e.g. B-tree page lookups) should override it.
+  virtual absl::Status MultiGet(
+      absl::Span<const std::string_view> keys,
+      std::vector<absl::optional<std::string_view>>& output_values) {
+    output_values.assign(keys.size(), absl::nullopt);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      std::string_view value;
+      const absl::Status status = Get(std::string(keys[i]), value);
+      if (absl::IsNotFound(status)) {
+        continue;
+      }
+      if (!status.ok()) {
+        return status;
+      }
+      output_values[i] = value;
+    }
+    return absl::OkStatus();
+  }
+
+  // Puts each of the |values| into the database with the key at the same
+  // index in |keys|.
+  // It assumes a transaction is already opened with Begin.
+  // Returns FailedPrecondition error if no transaction is valid.
+  // The default implementation calls Put for each key.
+  virtual absl::Status MultiPut(absl::Span<const std::string_view> keys,
+                                absl::Span<const std::string_view> values) {
+    if (keys.size() != values.size()) {
+      return absl::InvalidArgumentError(
+          "MultiPut needs the same number of keys and values.");
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const absl::Status status = Put(std::string(keys[i]), values[i]);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  // Called with each key and value found by Scan. Both are only valid during
+  // the call.
+  using ScanCallback =
+      std::function<void(std::string_view key, std::string_view value)>;
+
+  // Calls |callback| with every key in [|start_key|, |end_key|) and its value,
+  // in key order. An empty |end_key| means there is no upper bound. If |limit|
+  // is non-zero, stops after that many keys.
+  // It assumes a transaction is already opened with Begin.
+  // Returns FailedPrecondition error if no transaction is valid.
+  // The default implementation returns Unimplemented error since it can't be
+  // built from point lookups.
+  virtual absl::Status Scan(const std::string& /*start_key*/,
+                            const std::string& /*end_key*/, size_t /*limit*/,
+                            const ScanCallback& /*callback*/) {
+    return absl::UnimplementedError("Scan is not supported by this database.");
+  }
 
  private:
   // Connects to the database instance.
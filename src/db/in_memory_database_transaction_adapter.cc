@@ -0,0 +1,557 @@
+#include "src/db/in_memory_database_transaction_adapter.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <tuple>
+
+#include "absl/hash/hash.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+namespace db {
+
+namespace {
+
+// Initial number of slots in each shard. Must be a power of two.
+constexpr size_t kInitialSlots = 16;
+
+// Read & Write access as owner.
+constexpr mode_t kFileOpenMode = (S_IRUSR | S_IWUSR);
+
+absl::Status ErrnoError(const std::string& message) {
+  return absl::InternalError(absl::StrCat(message, ": ", std::strerror(errno)));
+}
+
+void AppendString(std::string_view value, std::string& output) {
+  const uint32_t size = value.size();
+  output.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  output.append(value.data(), value.size());
+}
+
+bool ConsumeString(std::string_view& input, std::string& output) {
+  uint32_t size;
+  if (input.size() < sizeof(size)) {
+    return false;
+  }
+  std::memcpy(&size, input.data(), sizeof(size));
+  input.remove_prefix(sizeof(size));
+  if (input.size() < size) {
+    return false;
+  }
+  output.assign(input.data(), size);
+  input.remove_prefix(size);
+  return true;
+}
+
+// A record is the number of entries followed by each key and value, all
+// prefixed by their size. The WAL has one record per commit and the snapshot
+// is a single record.
+std::string EncodeRecord(
+    const std::vector<std::pair<std::string, InMemoryStore::ValuePtr>>&
+        entries) {
+  std::string record;
+  const uint32_t num_entries = entries.size();
+  record.append(reinterpret_cast<const char*>(&num_entries),
+                sizeof(num_entries));
+  for (const auto& [key, value] : entries) {
+    AppendString(key, record);
+    AppendString(*value, record);
+  }
+  return record;
+}
+
+// Decodes the records in |data| into |entries|. Returns the number of bytes
+// used by complete records. A record cut short by a crash is ignored.
+size_t DecodeRecords(
+    std::string_view data,
+    std::vector<std::pair<std::string, std::string>>& entries) {
+  size_t valid_bytes = 0;
+  std::vector<std::pair<std::string, std::string>> record_entries;
+  while (true) {
+    std::string_view input = data.substr(valid_bytes);
+    uint32_t num_entries;
+    if (input.size() < sizeof(num_entries)) {
+      return valid_bytes;
+    }
+    std::memcpy(&num_entries, input.data(), sizeof(num_entries));
+    input.remove_prefix(sizeof(num_entries));
+    // Each entry has at least its two sizes, which also stops a corrupted
+    // count from allocating too much.
+    if (num_entries > input.size() / (2 * sizeof(uint32_t))) {
+      return valid_bytes;
+    }
+    record_entries.resize(num_entries);
+    for (auto& [key, value] : record_entries) {
+      if (!ConsumeString(input, key) || !ConsumeString(input, value)) {
+        return valid_bytes;
+      }
+    }
+    std::move(record_entries.begin(), record_entries.end(),
+              std::back_inserter(entries));
+    valid_bytes = data.size() - input.size();
+  }
+}
+
+absl::StatusOr<std::string> ReadFileIfExists(const std::string& path) {
+  if (!std::filesystem::exists(path)) {
+    return std::string();
+  }
+  std::ifstream input(path, std::ios::in | std::ios::binary);
+  if (!input.is_open()) {
+    return ErrnoError(absl::StrCat("Failed to open ", path));
+  }
+  std::stringstream contents;
+  contents << input.rdbuf();
+  return contents.str();
+}
+
+absl::Status WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoError("Failed to write");
+    }
+    data.remove_prefix(written);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::shared_ptr<InMemoryStore>> InMemoryStore::Open(
+    const InMemoryStoreOptions& options) {
+  std::shared_ptr<InMemoryStore> store(new InMemoryStore(options));
+  const absl::Status status = store->Recover();
+  if (!status.ok()) {
+    return status;
+  }
+  if (!options.snapshot_path.empty() &&
+      (options.checkpoint_interval > absl::ZeroDuration() ||
+       (!options.wal_path.empty() && options.checkpoint_wal_bytes > 0))) {
+    InMemoryStore* store_ptr = store.get();
+    store->checkpoint_thread_ =
+        std::thread([store_ptr]() { store_ptr->CheckpointUntilStopped(); });
+  }
+  return store;
+}
+
+void InMemoryStore::CheckpointUntilStopped() {
+  const absl::Duration interval =
+      options_.checkpoint_interval > absl::ZeroDuration()
+          ? options_.checkpoint_interval
+          : absl::InfiniteDuration();
+  const auto woken = [this]() {
+    checkpoint_thread_mutex_.AssertReaderHeld();
+    return checkpoint_requested_ || stop_checkpoints_;
+  };
+  while (true) {
+    {
+      absl::MutexLock lock(&checkpoint_thread_mutex_);
+      checkpoint_thread_mutex_.AwaitWithTimeout(absl::Condition(&woken),
+                                                interval);
+      if (stop_checkpoints_) {
+        return;
+      }
+      checkpoint_requested_ = false;
+    }
+    const absl::Status status = Checkpoint();
+    if (!status.ok()) {
+      LOG(WARNING) << "Checkpoint failed: " << status;
+    }
+  }
+}
+
+InMemoryStore::InMemoryStore(const InMemoryStoreOptions& options)
+    : options_(options) {}
+
+InMemoryStore::~InMemoryStore() {
+  {
+    absl::MutexLock lock(&checkpoint_thread_mutex_);
+    stop_checkpoints_ = true;
+  }
+  if (checkpoint_thread_.joinable()) {
+    checkpoint_thread_.join();
+  }
+  absl::MutexLock lock(&wal_mutex_);
+  if (wal_fd_ >= 0) {
+    close(wal_fd_);
+  }
+}
+
+absl::Status InMemoryStore::Recover() {
+  std::vector<std::pair<std::string, std::string>> entries;
+  if (!options_.snapshot_path.empty()) {
+    absl::StatusOr<std::string> snapshot =
+        ReadFileIfExists(options_.snapshot_path);
+    if (!snapshot.ok()) {
+      return snapshot.status();
+    }
+    if (DecodeRecords(*snapshot, entries) != snapshot->size()) {
+      return absl::DataLossError(
+          absl::StrCat("Snapshot is corrupted: ", options_.snapshot_path));
+    }
+  }
+  if (!options_.wal_path.empty()) {
+    absl::StatusOr<std::string> wal = ReadFileIfExists(options_.wal_path);
+    if (!wal.ok()) {
+      return wal.status();
+    }
+    const size_t valid_bytes = DecodeRecords(*wal, entries);
+    absl::MutexLock lock(&wal_mutex_);
+    wal_fd_ = open(options_.wal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND,
+                   kFileOpenMode);
+    if (wal_fd_ < 0) {
+      return ErrnoError(absl::StrCat("Failed to open ", options_.wal_path));
+    }
+    // Drops a partially written record so new records can be read after it.
+    if (valid_bytes != wal->size() && ftruncate(wal_fd_, valid_bytes) != 0) {
+      return ErrnoError("Failed to truncate the WAL");
+    }
+    wal_bytes_ = valid_bytes;
+  }
+  for (auto& [key, value] : entries) {
+    Insert(std::move(key),
+           std::make_shared<const std::string>(std::move(value)));
+  }
+  return absl::OkStatus();
+}
+
+size_t InMemoryStore::Hash(std::string_view key) {
+  return absl::Hash<std::string_view>{}(key);
+}
+
+// The top bits pick the shard so the bottom bits can pick the slot.
+InMemoryStore::Shard& InMemoryStore::GetShard(size_t hash) {
+  return shards_[hash >> (sizeof(size_t) * 8 - kShardBits)];
+}
+
+const InMemoryStore::Shard& InMemoryStore::GetShard(size_t hash) const {
+  return shards_[hash >> (sizeof(size_t) * 8 - kShardBits)];
+}
+
+size_t InMemoryStore::FindSlot(const std::vector<Slot>& slots,
+                               std::string_view key, size_t hash) {
+  const size_t mask = slots.size() - 1;
+  for (size_t index = hash & mask;; index = (index + 1) & mask) {
+    const Slot& slot = slots[index];
+    if (slot.value == nullptr || (slot.hash == hash && slot.key == key)) {
+      return index;
+    }
+  }
+}
+
+void InMemoryStore::Grow(Shard& shard) {
+  std::vector<Slot> slots(shard.slots.size() * 2);
+  for (Slot& slot : shard.slots) {
+    if (slot.value != nullptr) {
+      slots[FindSlot(slots, slot.key, slot.hash)] = std::move(slot);
+    }
+  }
+  shard.slots.swap(slots);
+}
+
+void InMemoryStore::Insert(std::string key, ValuePtr value) {
+  const size_t hash = Hash(key);
+  Shard& shard = GetShard(hash);
+  absl::MutexLock lock(&shard.mutex);
+  if (shard.slots.empty()) {
+    shard.slots.resize(kInitialSlots);
+  }
+  // Keeps the load factor at most 3/4 so probe sequences stay short.
+  if ((shard.num_keys + 1) * 4 > shard.slots.size() * 3) {
+    Grow(shard);
+  }
+  Slot& slot = shard.slots[FindSlot(shard.slots, key, hash)];
+  if (slot.value == nullptr) {
+    shard.ordered_keys.insert(key);
+    slot.hash = hash;
+    slot.key = std::move(key);
+    ++shard.num_keys;
+  }
+  slot.value = std::move(value);
+}
+
+InMemoryStore::ValuePtr InMemoryStore::Get(std::string_view key) const {
+  const size_t hash = Hash(key);
+  const Shard& shard = GetShard(hash);
+  absl::ReaderMutexLock lock(&shard.mutex);
+  if (shard.slots.empty()) {
+    return nullptr;
+  }
+  return shard.slots[FindSlot(shard.slots, key, hash)].value;
+}
+
+absl::Status InMemoryStore::Apply(
+    const std::vector<std::pair<std::string, ValuePtr>>& writes) {
+  absl::ReaderMutexLock checkpoint_lock(&checkpoint_mutex_);
+  if (!options_.wal_path.empty()) {
+    const std::string record = EncodeRecord(writes);
+    bool request_checkpoint = false;
+    {
+      absl::MutexLock lock(&wal_mutex_);
+      absl::Status status = WriteAll(wal_fd_, record);
+      if (status.ok() && options_.sync_wal && fdatasync(wal_fd_) != 0) {
+        status = ErrnoError("Failed to sync the WAL");
+      }
+      if (!status.ok()) {
+        return status;
+      }
+      wal_bytes_ += record.size();
+      request_checkpoint = options_.checkpoint_wal_bytes > 0 &&
+                           wal_bytes_ >= options_.checkpoint_wal_bytes;
+    }
+    // The checkpoint runs in the background, since it waits for this commit.
+    if (request_checkpoint) {
+      absl::MutexLock lock(&checkpoint_thread_mutex_);
+      checkpoint_requested_ = true;
+    }
+  }
+  for (const auto& [key, value] : writes) {
+    Insert(key, value);
+  }
+  return absl::OkStatus();
+}
+
+void InMemoryStore::CollectRange(
+    const std::string& start_key, const std::string& end_key, size_t limit,
+    std::vector<std::pair<std::string, ValuePtr>>& output) const {
+  // Locked in shard order. Writers only lock one shard at a time, so this
+  // can't deadlock.
+  for (const Shard& shard : shards_) {
+    shard.mutex.ReaderLock();
+  }
+  std::array<absl::btree_set<std::string>::const_iterator, kNumShards> next;
+  // Next key in the range of each shard, ordered by key.
+  using Head = std::tuple<std::string_view, size_t>;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  const auto push_next = [&](size_t index) {
+    if (next[index] != shards_[index].ordered_keys.end() &&
+        (end_key.empty() || *next[index] < end_key)) {
+      heads.emplace(*next[index], index);
+    }
+  };
+  for (size_t index = 0; index < kNumShards; ++index) {
+    next[index] = shards_[index].ordered_keys.lower_bound(start_key);
+    push_next(index);
+  }
+  for (size_t count = 0; !heads.empty() && (limit == 0 || count < limit);
+       ++count) {
+    const size_t index = std::get<1>(heads.top());
+    heads.pop();
+    const Shard& shard = shards_[index];
+    const std::string& key = *next[index];
+    output.emplace_back(
+        key, shard.slots[FindSlot(shard.slots, key, Hash(key))].value);
+    ++next[index];
+    push_next(index);
+  }
+  for (const Shard& shard : shards_) {
+    shard.mutex.ReaderUnlock();
+  }
+}
+
+absl::Status InMemoryStore::Checkpoint() {
+  if (options_.snapshot_path.empty()) {
+    return absl::FailedPreconditionError("Snapshots are not enabled.");
+  }
+  absl::MutexLock checkpoint_lock(&checkpoint_mutex_);
+  std::vector<std::pair<std::string, ValuePtr>> entries;
+  for (const Shard& shard : shards_) {
+    absl::ReaderMutexLock lock(&shard.mutex);
+    for (const Slot& slot : shard.slots) {
+      if (slot.value != nullptr) {
+        entries.emplace_back(slot.key, slot.value);
+      }
+    }
+  }
+  // Writes to a temporary file first so a crash never leaves a partial
+  // snapshot.
+  const std::string temp_path = absl::StrCat(options_.snapshot_path, ".tmp");
+  const int fd =
+      open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, kFileOpenMode);
+  if (fd < 0) {
+    return ErrnoError(absl::StrCat("Failed to open ", temp_path));
+  }
+  absl::Status status = WriteAll(fd, EncodeRecord(entries));
+  if (status.ok() && fsync(fd) != 0) {
+    status = ErrnoError("Failed to sync the snapshot");
+  }
+  close(fd);
+  if (!status.ok()) {
+    return status;
+  }
+  if (std::rename(temp_path.c_str(), options_.snapshot_path.c_str()) != 0) {
+    return ErrnoError("Failed to replace the snapshot");
+  }
+  absl::MutexLock lock(&wal_mutex_);
+  if (wal_fd_ >= 0 && ftruncate(wal_fd_, 0) != 0) {
+    return ErrnoError("Failed to truncate the WAL");
+  }
+  wal_bytes_ = 0;
+  return absl::OkStatus();
+}
+
+size_t InMemoryStore::size() const {
+  size_t total = 0;
+  for (const Shard& shard : shards_) {
+    absl::ReaderMutexLock lock(&shard.mutex);
+    total += shard.num_keys;
+  }
+  return total;
+}
+
+InMemoryDatabaseTransactionAdapter::InMemoryDatabaseTransactionAdapter(
+    std::shared_ptr<InMemoryStore> store)
+    : store_(std::move(store)) {}
+
+absl::Status InMemoryDatabaseTransactionAdapter::CheckInTransaction() const {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  return absl::OkStatus();
+}
+
+void InMemoryDatabaseTransactionAdapter::EndTransaction() {
+  in_txn_ = false;
+  writes_.clear();
+  read_values_.clear();
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::Begin() {
+  if (in_txn_) {
+    return absl::FailedPreconditionError(
+        "Cannot open another transaction while a transaction hasn't "
+        "commited or aborted yet.");
+  }
+  in_txn_ = true;
+  is_readonly_ = false;
+  return absl::OkStatus();
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::BeginReadOnly() {
+  const absl::Status status = Begin();
+  if (status.ok()) {
+    is_readonly_ = true;
+  }
+  return status;
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::Commit() {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction to Commit. Please Begin() first.");
+  }
+  if (!writes_.empty()) {
+    const absl::Status status = store_->Apply(
+        std::vector<std::pair<std::string, InMemoryStore::ValuePtr>>(
+            writes_.begin(), writes_.end()));
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  EndTransaction();
+  return absl::OkStatus();
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::Abort() {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction to Abort. Please Begin() first.");
+  }
+  EndTransaction();
+  return absl::OkStatus();
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::Get(
+    const std::string& key, std::string_view& output_value) {
+  const absl::Status status = CheckInTransaction();
+  if (!status.ok()) {
+    return status;
+  }
+  InMemoryStore::ValuePtr value;
+  if (auto it = writes_.find(key); it != writes_.end()) {
+    value = it->second;
+  } else {
+    value = store_->Get(key);
+  }
+  if (value == nullptr) {
+    return absl::NotFoundError(absl::StrCat("Key could not be found: ", key));
+  }
+  output_value = *value;
+  read_values_.push_back(std::move(value));
+  return absl::OkStatus();
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::Put(const std::string& key,
+                                                     std::string_view value) {
+  const absl::Status status = CheckInTransaction();
+  if (!status.ok()) {
+    return status;
+  }
+  if (is_readonly_) {
+    return absl::FailedPreconditionError(
+        "Cannot call Put with read only transaction. "
+        "Please Abort() or Commit() the current transaction "
+        "and call Begin() instead.");
+  }
+  writes_[key] = std::make_shared<const std::string>(value);
+  return absl::OkStatus();
+}
+
+absl::Status InMemoryDatabaseTransactionAdapter::Scan(
+    const std::string& start_key, const std::string& end_key, size_t limit,
+    const ScanCallback& callback) {
+  const absl::Status status = CheckInTransaction();
+  if (!status.ok()) {
+    return status;
+  }
+  // The first |limit| keys of the scan can only come from the first |limit|
+  // stored keys and the transaction's own writes in the range.
+  std::vector<std::pair<std::string, InMemoryStore::ValuePtr>> stored;
+  store_->CollectRange(start_key, end_key, limit, stored);
+  std::vector<std::pair<std::string_view, const InMemoryStore::ValuePtr*>>
+      written;
+  for (const auto& [key, value] : writes_) {
+    if (key >= start_key && (end_key.empty() || key < end_key)) {
+      written.emplace_back(key, &value);
+    }
+  }
+  std::sort(written.begin(), written.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  auto stored_it = stored.begin();
+  auto written_it = written.begin();
+  for (size_t count = 0;
+       (stored_it != stored.end() || written_it != written.end()) &&
+       (limit == 0 || count < limit);
+       ++count) {
+    if (written_it == written.end() ||
+        (stored_it != stored.end() && stored_it->first < written_it->first)) {
+      callback(stored_it->first, *stored_it->second);
+      ++stored_it;
+      continue;
+    }
+    // The transaction's write replaces the stored value.
+    if (stored_it != stored.end() && stored_it->first == written_it->first) {
+      ++stored_it;
+    }
+    callback(written_it->first, **written_it->second);
+    ++written_it;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace db
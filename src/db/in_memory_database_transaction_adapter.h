@@ -0,0 +1,206 @@
+#ifndef SRC_DB_IN_MEMORY_DATABASE_TRANSACTION_ADAPTER_H_
+
+#define SRC_DB_IN_MEMORY_DATABASE_TRANSACTION_ADAPTER_H_
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_set.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "src/db/database_transaction_adapter.h"
+
+namespace db {
+
+struct InMemoryStoreOptions {
+  // File that committed writes are appended to so they survive restarts.
+  // Empty disables the WAL.
+  std::string wal_path;
+  // Whether each commit waits for its WAL record to reach the disk. Otherwise
+  // records are only handed to the OS, so a process crash loses nothing but a
+  // machine crash can lose the latest commits.
+  bool sync_wal = false;
+  // File holding a snapshot of every key, written by Checkpoint. Opening the
+  // store loads the snapshot before replaying the WAL. Empty disables
+  // snapshots.
+  std::string snapshot_path;
+  // How often to checkpoint in a background thread. Zero disables periodic
+  // checkpoints. Ignored if there is no snapshot path.
+  absl::Duration checkpoint_interval = absl::ZeroDuration();
+  // Checkpoints in a background thread once the WAL grows past this many
+  // bytes, so it doesn't grow (and take longer to replay) without bound. Zero
+  // disables it. Ignored if there is no WAL or snapshot path.
+  size_t checkpoint_wal_bytes = 0;
+};
+
+// Concurrent in-memory key value store shared by every
+// InMemoryDatabaseTransactionAdapter of a cohort.
+// Keys are split over shards that are each an open addressing (linear probing)
+// hash table behind a reader/writer lock, so transactions on different shards
+// never contend and lookups only touch a few adjacent slots. Each shard also
+// keeps its keys in order for range scans.
+// Values are immutable and reference counted, so reads can return views into
+// them without copying while other transactions replace them.
+class InMemoryStore {
+ public:
+  using ValuePtr = std::shared_ptr<const std::string>;
+
+  // Creates a store, loading the snapshot and replaying the WAL if they are
+  // enabled and exist.
+  static absl::StatusOr<std::shared_ptr<InMemoryStore>> Open(
+      const InMemoryStoreOptions& options = InMemoryStoreOptions());
+
+  InMemoryStore(const InMemoryStore&) = delete;
+  InMemoryStore& operator=(const InMemoryStore&) = delete;
+  ~InMemoryStore();
+
+  // Returns the value for |key| or nullptr if there isn't one.
+  ValuePtr Get(std::string_view key) const;
+
+  // Logs |writes| to the WAL (if enabled) and then applies them. Concurrent
+  // readers may see some of the writes before others, so callers must lock
+  // the keys (as the cohort does).
+  absl::Status Apply(
+      const std::vector<std::pair<std::string, ValuePtr>>& writes);
+
+  // Appends the keys in [|start_key|, |end_key|) to |output| in key order with
+  // their values, stopping after |limit| keys unless it is zero. An empty
+  // |end_key| means there is no upper bound. The shards' ordered keys are
+  // merged with a heap, so it takes O(S log N + K log S) time for S shards,
+  // N keys in the store and K keys returned. Every shard stays locked in
+  // shared mode until it returns.
+  void CollectRange(const std::string& start_key, const std::string& end_key,
+                    size_t limit,
+                    std::vector<std::pair<std::string, ValuePtr>>& output) const
+      ABSL_NO_THREAD_SAFETY_ANALYSIS;
+
+  // Atomically writes a snapshot of every key and then empties the WAL.
+  // Commits wait while the checkpoint runs.
+  absl::Status Checkpoint();
+
+  // Number of keys in the store.
+  size_t size() const;
+
+ private:
+  static constexpr size_t kShardBits = 6;
+  static constexpr size_t kNumShards = 1 << kShardBits;
+
+  struct Slot {
+    size_t hash = 0;
+    std::string key;
+    // Null for empty slots.
+    ValuePtr value;
+  };
+
+  struct Shard {
+    mutable absl::Mutex mutex;
+    // The size is always a power of two.
+    std::vector<Slot> slots ABSL_GUARDED_BY(mutex);
+    size_t num_keys ABSL_GUARDED_BY(mutex) = 0;
+    // The keys of |slots| in order. Keys are never removed, so only inserting
+    // a new key updates it.
+    absl::btree_set<std::string> ordered_keys ABSL_GUARDED_BY(mutex);
+  };
+
+  explicit InMemoryStore(const InMemoryStoreOptions& options);
+
+  // Loads the snapshot and WAL, and opens the WAL for appending.
+  absl::Status Recover();
+
+  // Checkpoints every checkpoint_interval, and whenever Apply requests it,
+  // until the store is destroyed.
+  void CheckpointUntilStopped();
+
+  static size_t Hash(std::string_view key);
+  Shard& GetShard(size_t hash);
+  const Shard& GetShard(size_t hash) const;
+
+  // Returns the index of the slot holding |key| or of the empty slot where it
+  // would be inserted.
+  static size_t FindSlot(const std::vector<Slot>& slots, std::string_view key,
+                         size_t hash);
+
+  void Insert(std::string key, ValuePtr value);
+
+  // Doubles the number of slots in |shard|.
+  static void Grow(Shard& shard) ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mutex);
+
+  const InMemoryStoreOptions options_;
+  std::array<Shard, kNumShards> shards_;
+
+  // Held in shared mode by commits and exclusively by checkpoints, so a
+  // snapshot never misses a commit that was already removed from the WAL.
+  absl::Mutex checkpoint_mutex_;
+  absl::Mutex wal_mutex_;
+  int wal_fd_ ABSL_GUARDED_BY(wal_mutex_) = -1;
+  // Size of the WAL since the last checkpoint.
+  size_t wal_bytes_ ABSL_GUARDED_BY(wal_mutex_) = 0;
+
+  absl::Mutex checkpoint_thread_mutex_;
+  // Whether the WAL outgrew checkpoint_wal_bytes.
+  bool checkpoint_requested_ ABSL_GUARDED_BY(checkpoint_thread_mutex_) = false;
+  bool stop_checkpoints_ ABSL_GUARDED_BY(checkpoint_thread_mutex_) = false;
+  std::thread checkpoint_thread_;
+};
+
+// Database Interface that supports transaction operations on an
+// InMemoryStore. Unlike LMDB, any number of write transactions can run
+// concurrently (the cohort locks the keys they use) and commits never wait on
+// the disk unless the store syncs its WAL.
+// Writes are buffered in the transaction and applied to the store on Commit.
+class InMemoryDatabaseTransactionAdapter : public DatabaseTransactionAdapter {
+ public:
+  explicit InMemoryDatabaseTransactionAdapter(
+      std::shared_ptr<InMemoryStore> store);
+
+  ~InMemoryDatabaseTransactionAdapter() = default;
+
+  [[nodiscard]] bool SupportsConcurrentWrites() const final { return true; }
+
+  absl::Status Begin() final;
+
+  absl::Status BeginReadOnly() final;
+
+  // Applies the buffered writes to the store.
+  absl::Status Commit() final;
+
+  // Discards the buffered writes.
+  absl::Status Abort() final;
+
+  // The value is a view into the store's copy, which the transaction keeps
+  // alive until it ends (even if another transaction replaces it).
+  absl::Status Get(const std::string& key,
+                   std::string_view& output_value) final;
+
+  absl::Status Put(const std::string& key, std::string_view value) final;
+
+  absl::Status Scan(const std::string& start_key, const std::string& end_key,
+                    size_t limit, const ScanCallback& callback) final;
+
+ private:
+  void Connect() final {}
+
+  absl::Status CheckInTransaction() const;
+
+  void EndTransaction();
+
+  std::shared_ptr<InMemoryStore> store_;
+  bool in_txn_ = false;
+  bool is_readonly_ = false;
+  // Latest value of each key written in the transaction.
+  absl::flat_hash_map<std::string, InMemoryStore::ValuePtr> writes_;
+  // Keeps the values returned by Get alive until the transaction ends.
+  std::vector<InMemoryStore::ValuePtr> read_values_;
+};
+
+}  // namespace db
+
+#endif  // SRC_DB_IN_MEMORY_DATABASE_TRANSACTION_ADAPTER_H_
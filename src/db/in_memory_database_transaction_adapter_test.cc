@@ -0,0 +1,287 @@
+#include "src/db/in_memory_database_transaction_adapter.h"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace db {
+
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Pair;
+
+std::shared_ptr<InMemoryStore> OpenStore(
+    const InMemoryStoreOptions& options = InMemoryStoreOptions()) {
+  absl::StatusOr<std::shared_ptr<InMemoryStore>> store =
+      InMemoryStore::Open(options);
+  EXPECT_TRUE(store.ok()) << store.status();
+  return *store;
+}
+
+// Returns options with a WAL and snapshot in a new empty directory.
+InMemoryStoreOptions PersistentOptions(const std::string& test_name) {
+  const std::string dir = absl::StrCat("/tmp/in_memory_db_test_", test_name);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  InMemoryStoreOptions options;
+  options.wal_path = absl::StrCat(dir, "/wal");
+  options.snapshot_path = absl::StrCat(dir, "/snapshot");
+  return options;
+}
+
+absl::Status PutAndCommit(const std::shared_ptr<InMemoryStore>& store,
+                          const std::string& key, const std::string& value) {
+  InMemoryDatabaseTransactionAdapter db_txn_adapter(store);
+  absl::Status status = db_txn_adapter.Begin();
+  if (status.ok()) {
+    status = db_txn_adapter.Put(key, value);
+  }
+  if (status.ok()) {
+    status = db_txn_adapter.Commit();
+  }
+  return status;
+}
+
+std::string GetCommitted(const std::shared_ptr<InMemoryStore>& store,
+                         const std::string& key) {
+  InMemoryStore::ValuePtr value = store->Get(key);
+  return value == nullptr ? "<missing>" : *value;
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, SupportsConcurrentWrites) {
+  InMemoryDatabaseTransactionAdapter db_txn_adapter(OpenStore());
+  EXPECT_TRUE(db_txn_adapter.SupportsConcurrentWrites());
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, TransactionOps) {
+  InMemoryDatabaseTransactionAdapter db_txn_adapter(OpenStore());
+
+  EXPECT_EQ(db_txn_adapter.Commit().code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(db_txn_adapter.Abort().code(),
+            absl::StatusCode::kFailedPrecondition);
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Begin().code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Put("key", "value").code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(db_txn_adapter.Abort().code(), absl::StatusCode::kOk);
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, WritesOnlyVisibleToOthersAfterCommit) {
+  std::shared_ptr<InMemoryStore> store = OpenStore();
+  InMemoryDatabaseTransactionAdapter writer(store);
+  InMemoryDatabaseTransactionAdapter reader(store);
+
+  ASSERT_EQ(writer.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(writer.Put("key", "value").code(), absl::StatusCode::kOk);
+  std::string_view value;
+  EXPECT_EQ(writer.Get("key", value).code(), absl::StatusCode::kOk);
+  EXPECT_EQ(value, "value");
+
+  ASSERT_EQ(reader.BeginReadOnly().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(reader.Get("key", value).code(), absl::StatusCode::kNotFound);
+  EXPECT_EQ(reader.Commit().code(), absl::StatusCode::kOk);
+
+  EXPECT_EQ(writer.Commit().code(), absl::StatusCode::kOk);
+  ASSERT_EQ(reader.BeginReadOnly().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(reader.Get("key", value).code(), absl::StatusCode::kOk);
+  EXPECT_EQ(value, "value");
+  EXPECT_EQ(reader.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, AbortDiscardsWrites) {
+  std::shared_ptr<InMemoryStore> store = OpenStore();
+  InMemoryDatabaseTransactionAdapter db_txn_adapter(store);
+
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Put("key", "value").code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Abort().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(GetCommitted(store, "key"), "<missing>");
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, ReadViewOutlivesConcurrentReplace) {
+  std::shared_ptr<InMemoryStore> store = OpenStore();
+  ASSERT_TRUE(PutAndCommit(store, "key", std::string(100, 'a')).ok());
+
+  InMemoryDatabaseTransactionAdapter reader(store);
+  ASSERT_EQ(reader.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::string_view value;
+  ASSERT_EQ(reader.Get("key", value).code(), absl::StatusCode::kOk);
+  ASSERT_TRUE(PutAndCommit(store, "key", std::string(100, 'b')).ok());
+  EXPECT_EQ(value, std::string(100, 'a'));
+  EXPECT_EQ(reader.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, ScanMergesOwnWritesInKeyOrder) {
+  std::shared_ptr<InMemoryStore> store = OpenStore();
+  ASSERT_TRUE(PutAndCommit(store, "scan_c", "3").ok());
+  ASSERT_TRUE(PutAndCommit(store, "scan_a", "1").ok());
+  ASSERT_TRUE(PutAndCommit(store, "other", "0").ok());
+
+  InMemoryDatabaseTransactionAdapter db_txn_adapter(store);
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Put("scan_b", "2").code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Put("scan_c", "30").code(), absl::StatusCode::kOk);
+  std::vector<std::pair<std::string, std::string>> scanned;
+  const auto append = [&scanned](std::string_view key,
+                                 std::string_view value) {
+    scanned.emplace_back(key, value);
+  };
+  EXPECT_EQ(db_txn_adapter.Scan("scan_", "scan_d", 0, append).code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(scanned, ElementsAre(Pair("scan_a", "1"), Pair("scan_b", "2"),
+                                   Pair("scan_c", "30")));
+  scanned.clear();
+  EXPECT_EQ(db_txn_adapter.Scan("scan_b", "", 1, append).code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(scanned, ElementsAre(Pair("scan_b", "2")));
+  EXPECT_EQ(db_txn_adapter.Abort().code(), absl::StatusCode::kOk);
+}
+
+TEST(InMemoryDatabaseTransactionAdapter, ConcurrentWritersOnDifferentKeys) {
+  std::shared_ptr<InMemoryStore> store = OpenStore();
+  constexpr int kNumThreads = 8;
+  constexpr int kKeysPerThread = 1000;
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kNumThreads; ++thread) {
+    threads.emplace_back([&store, thread]() {
+      for (int i = 0; i < kKeysPerThread; ++i) {
+        const std::string key = absl::StrCat(thread, "_", i);
+        EXPECT_TRUE(PutAndCommit(store, key, key).ok());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(store->size(), kNumThreads * kKeysPerThread);
+  for (int thread = 0; thread < kNumThreads; ++thread) {
+    for (int i = 0; i < kKeysPerThread; ++i) {
+      const std::string key = absl::StrCat(thread, "_", i);
+      EXPECT_EQ(GetCommitted(store, key), key);
+    }
+  }
+}
+
+TEST(InMemoryStore, RecoversFromWal) {
+  const InMemoryStoreOptions options = PersistentOptions("wal");
+  {
+    std::shared_ptr<InMemoryStore> store = OpenStore(options);
+    ASSERT_TRUE(PutAndCommit(store, "a", "1").ok());
+    ASSERT_TRUE(PutAndCommit(store, "b", "2").ok());
+    ASSERT_TRUE(PutAndCommit(store, "a", "3").ok());
+  }
+  // Simulates a crash in the middle of writing a record.
+  {
+    std::ofstream wal(options.wal_path, std::ios::app | std::ios::binary);
+    wal.write("\x01\x00\x00\x00\x05", 5);
+  }
+  std::shared_ptr<InMemoryStore> store = OpenStore(options);
+  EXPECT_EQ(store->size(), 2);
+  EXPECT_EQ(GetCommitted(store, "a"), "3");
+  EXPECT_EQ(GetCommitted(store, "b"), "2");
+
+  // Records written after the partial one can still be recovered.
+  ASSERT_TRUE(PutAndCommit(store, "c", "4").ok());
+  store.reset();
+  store = OpenStore(options);
+  EXPECT_EQ(GetCommitted(store, "c"), "4");
+}
+
+TEST(InMemoryStore, RecoversFromSnapshotAndWal) {
+  const InMemoryStoreOptions options = PersistentOptions("snapshot");
+  {
+    std::shared_ptr<InMemoryStore> store = OpenStore(options);
+    ASSERT_TRUE(PutAndCommit(store, "a", "1").ok());
+    ASSERT_TRUE(PutAndCommit(store, "b", "2").ok());
+    ASSERT_TRUE(store->Checkpoint().ok());
+    EXPECT_EQ(std::filesystem::file_size(options.wal_path), 0);
+    ASSERT_TRUE(PutAndCommit(store, "b", "3").ok());
+  }
+  std::shared_ptr<InMemoryStore> store = OpenStore(options);
+  EXPECT_EQ(store->size(), 2);
+  EXPECT_EQ(GetCommitted(store, "a"), "1");
+  EXPECT_EQ(GetCommitted(store, "b"), "3");
+}
+
+TEST(InMemoryStore, CollectRangeReturnsOnlyTheRangeInKeyOrder) {
+  std::shared_ptr<InMemoryStore> store = OpenStore();
+  // Enough keys to be spread over every shard.
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(PutAndCommit(store, absl::StrCat("k", 1000 + i),
+                             absl::StrCat(i))
+                    .ok());
+  }
+  // Replacing a value doesn't add its key again.
+  ASSERT_TRUE(PutAndCommit(store, "k1500", "replaced").ok());
+
+  std::vector<std::pair<std::string, InMemoryStore::ValuePtr>> range;
+  store->CollectRange("k1498", "k1502", 0, range);
+  std::vector<std::pair<std::string, std::string>> values;
+  for (const auto& [key, value] : range) {
+    values.emplace_back(key, *value);
+  }
+  EXPECT_THAT(values,
+              ElementsAre(Pair("k1498", "498"), Pair("k1499", "499"),
+                          Pair("k1500", "replaced"), Pair("k1501", "501")));
+  range.clear();
+  store->CollectRange("k1998", "", 0, range);
+  EXPECT_EQ(range.size(), 2);
+  range.clear();
+  // Stops at the limit, even though the range covers most keys.
+  store->CollectRange("k1100", "", 3, range);
+  values.clear();
+  for (const auto& [key, value] : range) {
+    values.emplace_back(key, *value);
+  }
+  EXPECT_THAT(values, ElementsAre(Pair("k1100", "100"), Pair("k1101", "101"),
+                                  Pair("k1102", "102")));
+}
+
+TEST(InMemoryStore, CheckpointsOnceTheWalOutgrowsTheLimit) {
+  InMemoryStoreOptions options = PersistentOptions("wal_bytes");
+  options.checkpoint_wal_bytes = 1000;
+  {
+    std::shared_ptr<InMemoryStore> store = OpenStore(options);
+    for (int i = 0; i < 10; ++i) {
+      ASSERT_TRUE(
+          PutAndCommit(store, absl::StrCat("key", i), std::string(200, 'a'))
+              .ok());
+    }
+    // The checkpoint runs in the background.
+    const auto checkpointed = [&options]() {
+      return std::filesystem::exists(options.snapshot_path) &&
+             std::filesystem::file_size(options.wal_path) <
+                 options.checkpoint_wal_bytes;
+    };
+    const absl::Time deadline = absl::Now() + absl::Seconds(10);
+    while (!checkpointed() && absl::Now() < deadline) {
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+    EXPECT_TRUE(checkpointed());
+  }
+  std::shared_ptr<InMemoryStore> store = OpenStore(options);
+  EXPECT_EQ(store->size(), 10);
+}
+
+TEST(InMemoryStore, CheckpointWithoutSnapshotPathFails) {
+  EXPECT_EQ(OpenStore()->Checkpoint().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+}  // namespace
+
+}  // namespace db
@@ -2,30 +2,239 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <numeric>
+
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "glog/logging.h"
 
 namespace db {
 
 namespace {
 
-// Maximum size of the db in memory.
-constexpr uint64_t k1GbMapsize = 1UL * 1024UL * 1024UL * 1024UL;
+std::string_view ToStringView(const lmdb::val &val) {
+  return std::string_view(val.data(), val.size());
+}
 
 // Read & Write access as owner.
 constexpr mdb_mode_t kFileOpenMode = (S_IRUSR | S_IWUSR);
 
+// Returns the indices of |keys| in sorted key order.
+std::vector<size_t> SortedKeyOrder(absl::Span<const std::string_view> keys) {
+  std::vector<size_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+  return order;
+}
+
+unsigned int EnvFlags(LMDBDurability durability) {
+  switch (durability) {
+    case LMDBDurability::kSync:
+      return 0;
+    case LMDBDurability::kNoMetaSync:
+      return MDB_NOMETASYNC;
+    case LMDBDurability::kWriteMapAsyncFlush:
+      return MDB_WRITEMAP | MDB_MAPASYNC;
+  }
+  return 0;
+}
+
+constexpr LMDBDurability kDurabilities[] = {
+    LMDBDurability::kSync, LMDBDurability::kNoMetaSync,
+    LMDBDurability::kWriteMapAsyncFlush};
+
 }  // namespace
 
+absl::StatusOr<LMDBDurability> ParseLMDBDurability(std::string_view name) {
+  for (const LMDBDurability durability : kDurabilities) {
+    if (name == LMDBDurabilityName(durability)) {
+      return durability;
+    }
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown LMDB durability: ", std::string(name)));
+}
+
+std::string_view LMDBDurabilityName(LMDBDurability durability) {
+  switch (durability) {
+    case LMDBDurability::kSync:
+      return "sync";
+    case LMDBDurability::kNoMetaSync:
+      return "nometasync";
+    case LMDBDurability::kWriteMapAsyncFlush:
+      return "writemap+async-flush";
+  }
+  return "unknown";
+}
+
+LMDBEnvironment::LMDBEnvironment(std::string_view db_path,
+                                 const LMDBOptions& options)
+    : options_(options),
+      env_(lmdb::env::create()),
+      map_size_(options.initial_map_size) {
+  env_.set_mapsize(map_size_);
+  env_.open(std::string(db_path).c_str(), EnvFlags(options_.durability),
+            kFileOpenMode);
+  // LMDB keeps the map at least as large as an existing db, so the map may be
+  // larger than requested.
+  MDB_envinfo info;
+  const int rc = mdb_env_info(env_, &info);
+  if (rc != MDB_SUCCESS) {
+    lmdb::error::raise("mdb_env_info", rc);
+  }
+  map_size_ = info.me_mapsize;
+  if (options_.durability == LMDBDurability::kWriteMapAsyncFlush) {
+    flush_thread_ = std::thread([this]() {
+      while (!stop_flushing_.WaitForNotificationWithTimeout(
+          options_.flush_interval)) {
+        absl::ReaderMutexLock lock(&resize_mutex_);
+        const int rc = mdb_env_sync(env_, /*force=*/1);
+        if (rc != MDB_SUCCESS) {
+          LOG(WARNING) << "Syncing LMDB failed: " << mdb_strerror(rc);
+        }
+      }
+    });
+  }
+}
+
+absl::StatusOr<std::shared_ptr<LMDBEnvironment>> LMDBEnvironment::Open(
+    std::string_view db_path, const LMDBOptions& options) {
+  try {
+    return std::make_shared<LMDBEnvironment>(db_path, options);
+  } catch (const lmdb::error& error) {
+    return absl::InternalError(absl::StrCat("Failed to open LMDB in ",
+                                            std::string(db_path), ": ",
+                                            mdb_strerror(error.code())));
+  }
+}
+
+LMDBEnvironment::~LMDBEnvironment() {
+  stop_flushing_.Notify();
+  if (flush_thread_.joinable()) {
+    flush_thread_.join();
+  }
+  if (options_.durability == LMDBDurability::kWriteMapAsyncFlush) {
+    mdb_env_sync(env_, /*force=*/1);
+  }
+}
+
+absl::StatusOr<lmdb::txn> LMDBEnvironment::BeginTransaction(
+    unsigned int flags) {
+  resize_mutex_.ReaderLock();
+  MDB_txn* handle = nullptr;
+  const int rc = mdb_txn_begin(env_, nullptr, flags, &handle);
+  if (rc != MDB_SUCCESS) {
+    resize_mutex_.ReaderUnlock();
+    const std::string message = absl::StrCat(
+        "Beginning an LMDB transaction failed: ", mdb_strerror(rc));
+    if (rc == MDB_READERS_FULL) {
+      return absl::ResourceExhaustedError(message);
+    }
+    return absl::InternalError(message);
+  }
+  return lmdb::txn(handle);
+}
+
+void LMDBEnvironment::EndTransaction() { resize_mutex_.ReaderUnlock(); }
+
+absl::Status LMDBEnvironment::TryGrowMap(size_t full_map_size) {
+  // Waiting for the open transactions would also keep new ones from starting
+  // until the longest one ends, which can take as long as a blockchain vote.
+  if (!resize_mutex_.TryLock()) {
+    return absl::UnavailableError(
+        "LMDB map is full and can't grow while other transactions are open");
+  }
+  absl::Status status = absl::OkStatus();
+  if (map_size_ <= full_map_size) {
+    status = GrowMapLocked();
+  }
+  resize_mutex_.Unlock();
+  return status;
+}
+
+void LMDBEnvironment::MaybeGrowMap() {
+  MDB_envinfo info;
+  MDB_stat stat;
+  if (mdb_env_info(env_, &info) != MDB_SUCCESS ||
+      mdb_env_stat(env_, &stat) != MDB_SUCCESS) {
+    return;
+  }
+  const size_t used_bytes = (info.me_last_pgno + 1) * stat.ms_psize;
+  if (used_bytes * 100 < info.me_mapsize * kGrowThresholdPercent ||
+      !resize_mutex_.TryLock()) {
+    return;
+  }
+  absl::Status status = absl::OkStatus();
+  // Another commit may have grown the map since it was checked.
+  if (used_bytes * 100 >= map_size_ * kGrowThresholdPercent) {
+    status = GrowMapLocked();
+  }
+  resize_mutex_.Unlock();
+  if (!status.ok() && !absl::IsResourceExhausted(status)) {
+    LOG(WARNING) << status;
+  }
+}
+
+absl::Status LMDBEnvironment::GrowMapLocked() {
+  if (options_.max_map_size != 0 && map_size_ >= options_.max_map_size) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "LMDB map is full at its maximum size of ", map_size_, " bytes"));
+  }
+  size_t new_map_size = map_size_ * 2;
+  if (options_.max_map_size != 0) {
+    new_map_size = std::min(new_map_size, options_.max_map_size);
+  }
+  const int rc = mdb_env_set_mapsize(env_, new_map_size);
+  if (rc != MDB_SUCCESS) {
+    return absl::InternalError(
+        absl::StrCat("Growing the LMDB map failed: ", mdb_strerror(rc)));
+  }
+  LOG(INFO) << "Grew the LMDB map from " << map_size_ << " to "
+            << new_map_size << " bytes";
+  map_size_ = new_map_size;
+  return absl::OkStatus();
+}
+
+absl::Status LMDBEnvironment::CopyTo(const std::string& dir) {
+  absl::ReaderMutexLock lock(&resize_mutex_);
+  const int rc = mdb_env_copy2(env_, dir.c_str(), MDB_CP_COMPACT);
+  if (rc != MDB_SUCCESS) {
+    return absl::InternalError(absl::StrCat("Copying the LMDB env to ", dir,
+                                            " failed: ", mdb_strerror(rc)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LMDBEnvironment::CopyToFd(int fd) {
+  absl::ReaderMutexLock lock(&resize_mutex_);
+  const int rc = mdb_env_copyfd2(env_, fd, MDB_CP_COMPACT);
+  if (rc != MDB_SUCCESS) {
+    return absl::InternalError(
+        absl::StrCat("Copying the LMDB env failed: ", mdb_strerror(rc)));
+  }
+  return absl::OkStatus();
+}
+
 LMDBDatabaseTransactionAdapter::LMDBDatabaseTransactionAdapter(
     std::string_view db_path)
     : db_path_(db_path) {
   Connect();
 }
 
+LMDBDatabaseTransactionAdapter::LMDBDatabaseTransactionAdapter(
+    std::shared_ptr<LMDBEnvironment> env)
+    : env_(std::move(env)) {}
+
+LMDBDatabaseTransactionAdapter::~LMDBDatabaseTransactionAdapter() {
+  if (txn_ != nullptr) {
+    ReleaseTransaction();
+  }
+}
+
 void LMDBDatabaseTransactionAdapter::Connect() {
-  env_ = std::make_unique<lmdb::env>(lmdb::env::create());
-  env_->set_mapsize(k1GbMapsize);
-  env_->open(db_path_.c_str(), 0, kFileOpenMode);
+  env_ = std::make_shared<LMDBEnvironment>(db_path_);
 }
 
 absl::Status LMDBDatabaseTransactionAdapter::Begin() {
@@ -35,9 +244,8 @@ absl::Status LMDBDatabaseTransactionAdapter::Begin() {
         "commited or aborted yet.");
   }
   is_readonly_ = false;
-  txn_ = std::make_unique<lmdb::txn>(lmdb::txn::begin(*env_));
-  dbi_ = std::make_unique<lmdb::dbi>(lmdb::dbi::open(*txn_, nullptr));
-  return absl::OkStatus();
+  txn_writes_.clear();
+  return StartTransaction(0);
 }
 
 absl::Status LMDBDatabaseTransactionAdapter::BeginReadOnly() {
@@ -47,10 +255,7 @@ absl::Status LMDBDatabaseTransactionAdapter::BeginReadOnly() {
         "commited or aborted yet.");
   }
   is_readonly_ = true;
-  txn_ =
-      std::make_unique<lmdb::txn>(lmdb::txn::begin(*env_, nullptr, MDB_RDONLY));
-  dbi_ = std::make_unique<lmdb::dbi>(lmdb::dbi::open(*txn_, nullptr));
-  return absl::OkStatus();
+  return StartTransaction(MDB_RDONLY);
 }
 
 absl::Status LMDBDatabaseTransactionAdapter::Commit() {
@@ -58,8 +263,28 @@ absl::Status LMDBDatabaseTransactionAdapter::Commit() {
     return absl::FailedPreconditionError(
         "No valid transaction to Commit. Please Begin() first.");
   }
-  txn_->commit();
+  while (true) {
+    // Not lmdb::txn::commit, which keeps the handle if the commit fails, so
+    // that releasing the transaction would abort it after LMDB freed it.
+    const int rc = mdb_txn_commit(txn_->handle());
+    txn_->DropFreedHandle();
+    if (rc == MDB_SUCCESS) {
+      break;
+    }
+    if (rc != MDB_MAP_FULL) {
+      ReleaseTransaction();
+      return absl::InternalError(
+          absl::StrCat("Commit failed: ", mdb_strerror(rc)));
+    }
+    const absl::Status status = GrowMapAndReplay();
+    if (!status.ok()) {
+      return status;
+    }
+  }
   ReleaseTransaction();
+  if (!is_readonly_) {
+    env_->MaybeGrowMap();
+  }
   return absl::OkStatus();
 }
 
@@ -73,8 +298,8 @@ absl::Status LMDBDatabaseTransactionAdapter::Abort() {
   return absl::OkStatus();
 }
 
-absl::Status LMDBDatabaseTransactionAdapter::Get(const std::string &key,
-                                                 int64_t &output_value) {
+absl::Status LMDBDatabaseTransactionAdapter::Get(
+    const std::string &key, std::string_view &output_value) {
   if (txn_ == nullptr) {
     return absl::FailedPreconditionError(
         "No valid transaction available. Please Begin() first.");
@@ -84,14 +309,14 @@ absl::Status LMDBDatabaseTransactionAdapter::Get(const std::string &key,
   // method.
   lmdb::val val;
   if (!dbi_->get(*txn_, lmdb::val(key), val)) {
-    return absl::InternalError("Get failed.");
+    return absl::NotFoundError(absl::StrCat("Key could not be found: ", key));
   }
-  output_value = *val.data<int64_t>();
+  output_value = ToStringView(val);
   return absl::OkStatus();
 }
 
 absl::Status LMDBDatabaseTransactionAdapter::Put(const std::string &key,
-                                                 int64_t value) {
+                                                 std::string_view value) {
   if (txn_ == nullptr) {
     return absl::FailedPreconditionError(
         "No valid transaction available. Please Begin() first.");
@@ -105,16 +330,184 @@ absl::Status LMDBDatabaseTransactionAdapter::Put(const std::string &key,
   // Need to use lmdb::val for the key to make it able to match the get.
   // Need to use ldmb::val for the value to make it use the right dbi.put
   // method.
-  lmdb::val val{&value, sizeof(int64_t)};
-  if (!dbi_->put(*txn_, lmdb::val(key), val)) {
-    return absl::InternalError("Put failed.");
+  txn_writes_.emplace_back(key, value);
+  lmdb::val val{value.data(), value.size()};
+  const int rc = mdb_put(*txn_, *dbi_, lmdb::val(key), val, 0);
+  if (rc == MDB_MAP_FULL) {
+    return GrowMapAndReplay();
+  }
+  if (rc != MDB_SUCCESS) {
+    return absl::InternalError(absl::StrCat("Put failed: ", mdb_strerror(rc)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LMDBDatabaseTransactionAdapter::Append(const std::string &key,
+                                                    std::string_view value) {
+  if (txn_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  if (is_readonly_) {
+    return absl::FailedPreconditionError(
+        "Cannot call Append with read only transaction. "
+        "Please Abort() or Commit() the current transaction "
+        "and call Begin() instead.");
+  }
+  txn_writes_.emplace_back(key, value);
+  lmdb::val val{value.data(), value.size()};
+  const int rc = mdb_put(*txn_, *dbi_, lmdb::val(key), val, MDB_APPEND);
+  if (rc == MDB_MAP_FULL) {
+    return GrowMapAndReplay();
+  }
+  if (rc == MDB_KEYEXIST) {
+    txn_writes_.pop_back();
+    return absl::InvalidArgumentError(
+        absl::StrCat("Appended key doesn't sort last: ", key));
+  }
+  if (rc != MDB_SUCCESS) {
+    return absl::InternalError(
+        absl::StrCat("Append failed: ", mdb_strerror(rc)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LMDBDatabaseTransactionAdapter::MultiGet(
+    absl::Span<const std::string_view> keys,
+    std::vector<absl::optional<std::string_view>> &output_values) {
+  if (txn_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  output_values.assign(keys.size(), absl::nullopt);
+  lmdb::cursor cursor = lmdb::cursor::open(*txn_, *dbi_);
+  for (const size_t index : SortedKeyOrder(keys)) {
+    lmdb::val key{keys[index].data(), keys[index].size()};
+    lmdb::val val;
+    if (cursor.get(key, val, MDB_SET_KEY)) {
+      output_values[index] = ToStringView(val);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LMDBDatabaseTransactionAdapter::MultiPut(
+    absl::Span<const std::string_view> keys,
+    absl::Span<const std::string_view> values) {
+  if (txn_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  if (is_readonly_) {
+    return absl::FailedPreconditionError(
+        "Cannot call MultiPut with read only transaction. "
+        "Please Abort() or Commit() the current transaction "
+        "and call Begin() instead.");
+  }
+  if (keys.size() != values.size()) {
+    return absl::InvalidArgumentError(
+        "MultiPut needs the same number of keys and values.");
+  }
+  const std::vector<size_t> order = SortedKeyOrder(keys);
+  for (const size_t index : order) {
+    txn_writes_.emplace_back(keys[index], values[index]);
+  }
+  lmdb::cursor cursor = lmdb::cursor::open(*txn_, *dbi_);
+  for (const size_t index : order) {
+    lmdb::val key{keys[index].data(), keys[index].size()};
+    lmdb::val val{values[index].data(), values[index].size()};
+    const int rc = mdb_cursor_put(cursor.handle(), key, val, 0);
+    if (rc == MDB_MAP_FULL) {
+      // Replays the rest of the batch too.
+      cursor.close();
+      return GrowMapAndReplay();
+    }
+    if (rc != MDB_SUCCESS) {
+      return absl::InternalError(
+          absl::StrCat("MultiPut failed: ", mdb_strerror(rc)));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LMDBDatabaseTransactionAdapter::Scan(
+    const std::string &start_key, const std::string &end_key, size_t limit,
+    const ScanCallback &callback) {
+  if (txn_ == nullptr) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  lmdb::cursor cursor = lmdb::cursor::open(*txn_, *dbi_);
+  lmdb::val key(start_key);
+  lmdb::val val;
+  // LMDB rejects empty keys, so an empty start key has to start from the
+  // first key instead.
+  bool found =
+      cursor.get(key, val, start_key.empty() ? MDB_FIRST : MDB_SET_RANGE);
+  for (size_t count = 0; found && (limit == 0 || count < limit); ++count) {
+    const std::string_view key_view = ToStringView(key);
+    if (!end_key.empty() && key_view >= end_key) {
+      break;
+    }
+    callback(key_view, ToStringView(val));
+    found = cursor.get(key, val, MDB_NEXT);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LMDBDatabaseTransactionAdapter::GrowMapAndReplay() {
+  while (true) {
+    const size_t full_map_size = env_->map_size();
+    ReleaseTransaction();
+    absl::Status status = env_->TryGrowMap(full_map_size);
+    if (!status.ok()) {
+      return status;
+    }
+    status = StartTransaction(0);
+    if (!status.ok()) {
+      return status;
+    }
+    int rc = MDB_SUCCESS;
+    for (const auto& [key, value] : txn_writes_) {
+      lmdb::val val(value);
+      rc = mdb_put(*txn_, *dbi_, lmdb::val(key), val, 0);
+      if (rc != MDB_SUCCESS) {
+        break;
+      }
+    }
+    if (rc == MDB_SUCCESS) {
+      return absl::OkStatus();
+    }
+    if (rc != MDB_MAP_FULL) {
+      return absl::InternalError(absl::StrCat(
+          "Replaying writes after growing the map failed: ",
+          mdb_strerror(rc)));
+    }
+  }
+}
+
+absl::Status LMDBDatabaseTransactionAdapter::StartTransaction(
+    unsigned int flags) {
+  absl::StatusOr<lmdb::txn> txn = env_->BeginTransaction(flags);
+  if (!txn.ok()) {
+    return txn.status();
+  }
+  txn_ = std::make_unique<Transaction>(*std::move(txn));
+  try {
+    dbi_ = std::make_unique<lmdb::dbi>(lmdb::dbi::open(*txn_, nullptr));
+  } catch (const lmdb::error& error) {
+    ReleaseTransaction();
+    return absl::InternalError(absl::StrCat("Opening the LMDB db failed: ",
+                                            mdb_strerror(error.code())));
   }
   return absl::OkStatus();
 }
 
 void LMDBDatabaseTransactionAdapter::ReleaseTransaction() {
+  // Aborts the transaction if it wasn't committed.
   txn_.reset(nullptr);
   dbi_.reset(nullptr);
+  env_->EndTransaction();
 }
 
 }  // namespace db
\ No newline at end of file
@@ -4,22 +4,157 @@
 
 #include <memory>
 #include <string>
-
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
 #include "lmdbxx/lmdb++.h"
 #include "src/db/database_transaction_adapter.h"
 
 namespace db {
 
+// How commits reach the disk, from safest to fastest.
+enum class LMDBDurability {
+  // "sync": every commit flushes its data and meta pages, so committed
+  // transactions survive a machine crash.
+  kSync,
+  // "nometasync": commits flush data pages but not the meta page, so a machine
+  // crash can lose the last commit but never corrupts the db.
+  kNoMetaSync,
+  // "writemap+async-flush": pages are written through a writable memory map
+  // and commits only start an asynchronous flush. A background thread syncs
+  // the map every flush interval, bounding the commits a machine crash loses.
+  kWriteMapAsyncFlush,
+};
+
+// Parses the name of a durability tier, as listed above.
+absl::StatusOr<LMDBDurability> ParseLMDBDurability(std::string_view name);
+
+std::string_view LMDBDurabilityName(LMDBDurability durability);
+
+struct LMDBOptions {
+  // Size of the memory map when the environment is opened. It is grown when
+  // no transaction is open, so a busy db should start with a map large enough
+  // for its data. LMDB maps lazily, so a large map only reserves address
+  // space.
+  size_t initial_map_size = 1UL << 30;
+  // The map is never grown beyond this size. Zero means there is no limit.
+  size_t max_map_size = 0;
+  LMDBDurability durability = LMDBDurability::kSync;
+  // How often to sync the map for LMDBDurability::kWriteMapAsyncFlush.
+  absl::Duration flush_interval = absl::Seconds(1);
+};
+
+// An LMDB environment shared by every transaction on a db directory. LMDB
+// doesn't allow opening the same environment more than once per process.
+// Every transaction holds the resize lock in shared mode. LMDB only allows
+// growing the map while no transaction is active, and transactions can stay
+// open for a long time (e.g. a cohort waiting for the blockchain's decision),
+// so the map is only grown when the lock is free and growing never waits.
+class LMDBEnvironment {
+ public:
+  // Opens the environment in the existing directory |db_path|.
+  // Raises expection if it fails.
+  explicit LMDBEnvironment(std::string_view db_path,
+                           const LMDBOptions& options = LMDBOptions());
+
+  // Same as the constructor, but returns an error instead of raising.
+  static absl::StatusOr<std::shared_ptr<LMDBEnvironment>> Open(
+      std::string_view db_path, const LMDBOptions& options = LMDBOptions());
+
+  LMDBEnvironment(const LMDBEnvironment&) = delete;
+  LMDBEnvironment& operator=(const LMDBEnvironment&) = delete;
+  ~LMDBEnvironment();
+
+  // Begins a transaction, waiting while the map is being grown. Each
+  // successful call must be matched by EndTransaction once the transaction is
+  // committed or aborted. Returns ResourceExhausted if LMDB has no reader slot
+  // left.
+  absl::StatusOr<lmdb::txn> BeginTransaction(unsigned int flags);
+
+  void EndTransaction();
+
+  // Doubles the size of the map if no transaction is active. The caller must
+  // not have a transaction. Does nothing if the map is already larger than
+  // |full_map_size|, the size that was found to be full. Returns Unavailable
+  // if other transactions are open and ResourceExhausted if the map can't
+  // grow beyond the maximum size.
+  absl::Status TryGrowMap(size_t full_map_size);
+
+  // Grows the map ahead of need once the db uses more than
+  // kGrowThresholdPercent of it, if no transaction is active. Called after
+  // each write commit, so the map rarely fills while transactions are open.
+  void MaybeGrowMap();
+
+  static constexpr size_t kGrowThresholdPercent = 75;
+
+  // Only valid while a transaction is active. Starts at the size the
+  // environment was opened with, which is larger than initial_map_size if
+  // the db already was.
+  size_t map_size() const { return map_size_; }
+
+  // Writes a compacted copy of the db (without free pages) into the existing
+  // empty directory |dir| with mdb_env_copy2. The copy is done in a read
+  // transaction, so writers keep running, but the map can't grow until the
+  // copy finishes.
+  absl::Status CopyTo(const std::string& dir);
+
+  // Same as CopyTo, but writes the data file to |fd|, which may be a pipe,
+  // with mdb_env_copyfd2. The read transaction is open before the first byte
+  // is written.
+  absl::Status CopyToFd(int fd);
+
+  // Held in shared mode while a ShardedLMDBDatabaseTransactionAdapter commits
+  // to the environment, and exclusively by CopyLMDBShards until its copies
+  // have started, so a snapshot never holds part of a commit.
+  absl::Mutex* commit_mutex() ABSL_LOCK_RETURNED(commit_mutex_) {
+    return &commit_mutex_;
+  }
+
+ private:
+  // Doubles the map, up to the maximum size. resize_mutex_ must be held
+  // exclusively.
+  absl::Status GrowMapLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(resize_mutex_);
+
+  const LMDBOptions options_;
+  lmdb::env env_;
+  // Held in shared mode by transactions and flushes and exclusively while
+  // growing the map.
+  absl::Mutex resize_mutex_;
+  // Only changed while resize_mutex_ is held exclusively.
+  size_t map_size_;
+  absl::Mutex commit_mutex_;
+
+  absl::Notification stop_flushing_;
+  std::thread flush_thread_;
+};
+
 // Database Interface that supports transaction operations based on
 // LMDB primitives.
 // NOTICE:
 //   LMDB only support 1 open read-write txn and 0+ read-only txns.
 //   Two 2+ read-write txn will block the process from proceeding.
+// When a write fills the map, the write transaction is aborted, the map is
+// grown and the transaction's writes are replayed in a new one, so callers
+// only see the (already documented) invalidation of earlier read values. If
+// other transactions keep the map from growing, the write fails with
+// Unavailable and the transaction is left aborted.
 class LMDBDatabaseTransactionAdapter : public DatabaseTransactionAdapter {
  public:
+  // Opens its own environment in |db_path|. Use the other constructor when
+  // several adapters use the same db in one process.
   explicit LMDBDatabaseTransactionAdapter(std::string_view db_path);
 
-  ~LMDBDatabaseTransactionAdapter() = default;
+  explicit LMDBDatabaseTransactionAdapter(std::shared_ptr<LMDBEnvironment> env);
+
+  // Aborts the transaction if there is one.
+  ~LMDBDatabaseTransactionAdapter();
 
   [[nodiscard]] bool SupportsConcurrentWrites() const final { return false; }
 
@@ -37,27 +172,72 @@ class LMDBDatabaseTransactionAdapter : public DatabaseTransactionAdapter {
 
   // Gets the value from the database with input |key|.
   // It assumes a transaction is already opened with Begin.
-  // Returns FailedPrecondition error if no transaction is valid.
-  absl::Status Get(const std::string& key, int64_t& output_value) final;
+  // Returns FailedPrecondition error if no transaction is valid and NotFound
+  // error if the key doesn't exist.
+  // The value points into LMDB's memory map, so it's not copied.
+  absl::Status Get(const std::string& key,
+                   std::string_view& output_value) final;
 
   // Puts the |value| into the database with input |key|.
   // It assumes a transaction is already opened with Begin.
   // Returns FailedPrecondition error if no transaction is valid.
-  absl::Status Put(const std::string& key, int64_t value) final;
+  absl::Status Put(const std::string& key, std::string_view value) final;
+
+  // Puts a |key| that sorts after every key already in the database with
+  // MDB_APPEND, which skips the B-tree search and fills pages completely.
+  // Used to bulk load sorted data. Returns InvalidArgument error if |key|
+  // doesn't sort last.
+  absl::Status Append(const std::string& key, std::string_view value);
+
+  // Gets the values for all |keys| with a single cursor, visiting the keys in
+  // sorted order so consecutive lookups reuse the B-tree pages already found.
+  absl::Status MultiGet(
+      absl::Span<const std::string_view> keys,
+      std::vector<absl::optional<std::string_view>>& output_values) final;
+
+  // Puts all |values| with a single cursor, in sorted key order.
+  absl::Status MultiPut(absl::Span<const std::string_view> keys,
+                        absl::Span<const std::string_view> values) final;
+
+  // Scans the range with a cursor positioned at |start_key| (MDB_SET_RANGE)
+  // and advanced with MDB_NEXT.
+  absl::Status Scan(const std::string& start_key, const std::string& end_key,
+                    size_t limit, const ScanCallback& callback) final;
 
  private:
+  // An lmdb::txn whose handle can be dropped without aborting it, once LMDB
+  // has freed the transaction, which mdb_txn_commit does even when it fails.
+  class Transaction : public lmdb::txn {
+   public:
+    explicit Transaction(lmdb::txn&& txn) : lmdb::txn(std::move(txn)) {}
+
+    void DropFreedHandle() { _handle = nullptr; }
+  };
+
   // Connects to the database instance in the class construnctor.
   // Raises expection if it fails. E.g. directory represented by
   // |db_path_| doesn't exist.
   void Connect() final;
 
+  // Begins txn_ and opens dbi_ in it.
+  absl::Status StartTransaction(unsigned int flags);
+
   // Releases the txn_ and db_ objects held by unique_ptr.
   void ReleaseTransaction();
 
+  // Aborts the write transaction after it filled the map (unless its commit
+  // already freed it), grows the map and replays txn_writes_ in a new
+  // transaction, until they fit. If growing
+  // fails, the transaction is left aborted.
+  absl::Status GrowMapAndReplay();
+
   const std::string db_path_;
   bool is_readonly_ = false;
-  std::unique_ptr<lmdb::env> env_ = nullptr;
-  std::unique_ptr<lmdb::txn> txn_ = nullptr;
+  std::shared_ptr<LMDBEnvironment> env_ = nullptr;
+  // Every write of the current write transaction, in order, to replay after
+  // growing the map.
+  std::vector<std::pair<std::string, std::string>> txn_writes_;
+  std::unique_ptr<Transaction> txn_ = nullptr;
   std::unique_ptr<lmdb::dbi> dbi_ = nullptr;
 };
 
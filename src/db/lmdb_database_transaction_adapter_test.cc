@@ -1,7 +1,11 @@
 #include "src/db/lmdb_database_transaction_adapter.h"
 
 #include <ctime>
+#include <filesystem>
+#include <thread>
 
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -10,6 +14,12 @@ namespace db {
 
 namespace {
 
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Optional;
+using ::testing::Pair;
+
 TEST(LMDBDatabaseTransactionAdapter, ConnectSuccessValidPath) {
   EXPECT_NO_THROW(LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp"));
 }
@@ -43,7 +53,8 @@ TEST(LMDBDatabaseTransactionAdapter, SingleTxnPutThenGet) {
   LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp");
 
   const std::string key = "key";
-  const int64_t put_value = 123;
+  // Includes a null byte to check values are treated as raw bytes.
+  const std::string put_value("12\0" "3", 4);
 
   // Test: Put value succeed.
   absl::Status status = db_txn_adapter.Begin();
@@ -58,12 +69,348 @@ TEST(LMDBDatabaseTransactionAdapter, SingleTxnPutThenGet) {
   status = db_txn_adapter.Begin();
   ASSERT_EQ(status.code(), absl::StatusCode::kOk) << status.ToString();
 
-  int64_t got_value;
+  std::string_view got_value;
   EXPECT_EQ(db_txn_adapter.Get(key, got_value).code(), absl::StatusCode::kOk);
+  // The view is only valid until the transaction ends.
+  EXPECT_EQ(got_value, put_value);
 
   status = db_txn_adapter.Commit();
   EXPECT_EQ(status.code(), absl::StatusCode::kOk) << status.ToString();
-  EXPECT_EQ(got_value, put_value);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, GetMissingKeyIsNotFound) {
+  LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp");
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::string_view got_value;
+  EXPECT_EQ(db_txn_adapter.Get("missing key", got_value).code(),
+            absl::StatusCode::kNotFound);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, MultiPutThenMultiGet) {
+  LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp");
+
+  // Keys are deliberately unsorted to check values keep the input order.
+  const std::vector<std::string_view> keys = {"multi_c", "multi_a",
+                                              "multi_b"};
+  const std::vector<std::string_view> values = {"3", "1", "2"};
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.MultiPut(keys, values).code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::vector<absl::optional<std::string_view>> got_values;
+  EXPECT_EQ(db_txn_adapter
+                .MultiGet({"multi_b", "multi_missing", "multi_c", "multi_a"},
+                          got_values)
+                .code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(got_values, ElementsAre(Optional(Eq("2")), Eq(absl::nullopt),
+                                      Optional(Eq("3")), Optional(Eq("1"))));
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, MultiPutWithReadOnlyTxnFails) {
+  LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp");
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.MultiPut({"multi_a"}, {"1"}).code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(db_txn_adapter.Abort().code(), absl::StatusCode::kOk);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, ScanReturnsKeysInRangeInOrder) {
+  LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp");
+
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter
+                .MultiPut({"scan_c", "scan_a", "scan_b", "scan_d", "scao"},
+                          {"3", "1", "2", "4", "5"})
+                .code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::vector<std::pair<std::string, std::string>> scanned;
+  const auto append = [&scanned](std::string_view key,
+                                 std::string_view value) {
+    scanned.emplace_back(key, value);
+  };
+  EXPECT_EQ(db_txn_adapter.Scan("scan_b", "scan_d", 0, append).code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(scanned, ElementsAre(Pair("scan_b", "2"), Pair("scan_c", "3")));
+
+  scanned.clear();
+  EXPECT_EQ(db_txn_adapter.Scan("scan_", "", 3, append).code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(scanned, ElementsAre(Pair("scan_a", "1"), Pair("scan_b", "2"),
+                                   Pair("scan_c", "3")));
+
+  scanned.clear();
+  EXPECT_EQ(db_txn_adapter.Scan("scan_e", "scan_z", 0, append).code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(scanned, IsEmpty());
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, ScanWithoutTxnFails) {
+  LMDBDatabaseTransactionAdapter db_txn_adapter("/tmp");
+
+  EXPECT_EQ(db_txn_adapter
+                .Scan("a", "b", 0, [](std::string_view, std::string_view) {})
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+// Returns a new empty directory for an environment.
+std::string NewDbDir(const std::string& test_name) {
+  const std::string dir = absl::StrCat("/tmp/lmdb_test_", test_name);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+std::shared_ptr<LMDBEnvironment> OpenEnv(const std::string& test_name,
+                                         const LMDBOptions& options) {
+  absl::StatusOr<std::shared_ptr<LMDBEnvironment>> env =
+      LMDBEnvironment::Open(NewDbDir(test_name), options);
+  EXPECT_TRUE(env.ok()) << env.status();
+  return *env;
+}
+
+LMDBOptions SmallMapOptions() {
+  LMDBOptions options;
+  options.initial_map_size = 64 * 1024;
+  return options;
+}
+
+TEST(LMDBDatabaseTransactionAdapter, MapGrowsWhenFull) {
+  std::shared_ptr<LMDBEnvironment> env = OpenEnv("grow", SmallMapOptions());
+  LMDBDatabaseTransactionAdapter db_txn_adapter(env);
+
+  const std::string value(1024, 'v');
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(db_txn_adapter.Put(absl::StrCat("put_", i), value).code(),
+              absl::StatusCode::kOk);
+  }
+  std::vector<std::string> keys;
+  std::vector<std::string_view> values;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back(absl::StrCat("multi_put_", i));
+    values.push_back(value);
+  }
+  ASSERT_EQ(db_txn_adapter
+                .MultiPut(std::vector<std::string_view>(keys.begin(),
+                                                        keys.end()),
+                          values)
+                .code(),
+            absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+  EXPECT_GT(env->map_size(), SmallMapOptions().initial_map_size);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::string_view got_value;
+  EXPECT_EQ(db_txn_adapter.Get("put_0", got_value).code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(got_value, value);
+  EXPECT_EQ(db_txn_adapter.Get("multi_put_99", got_value).code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(got_value, value);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+// Commits write meta and free pages besides the data, so a commit can fill
+// the map even though every write fit. LMDB frees the transaction when its
+// commit fails, so it must not be aborted again before growing the map.
+TEST(LMDBDatabaseTransactionAdapter, MapGrowsWhenCommitFillsIt) {
+  std::shared_ptr<LMDBEnvironment> env =
+      OpenEnv("grow_on_commit", SmallMapOptions());
+  LMDBDatabaseTransactionAdapter db_txn_adapter(env);
+
+  // One small transaction at a time, so that eventually a transaction's
+  // write fits in the map but its commit doesn't.
+  const std::string value(1024, 'v');
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+    ASSERT_EQ(db_txn_adapter.Put(absl::StrCat("key_", i), value).code(),
+              absl::StatusCode::kOk);
+    ASSERT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+  }
+  EXPECT_GT(env->map_size(), SmallMapOptions().initial_map_size);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  for (int i = 0; i < 200; ++i) {
+    std::string_view got_value;
+    EXPECT_EQ(db_txn_adapter.Get(absl::StrCat("key_", i), got_value).code(),
+              absl::StatusCode::kOk);
+    EXPECT_EQ(got_value, value);
+  }
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, ReopenedMapIsAtLeastTheDbSize) {
+  const std::string dir = NewDbDir("reopen");
+  const std::string value(1024, 'v');
+  {
+    absl::StatusOr<std::shared_ptr<LMDBEnvironment>> env =
+        LMDBEnvironment::Open(dir, SmallMapOptions());
+    ASSERT_TRUE(env.ok()) << env.status();
+    LMDBDatabaseTransactionAdapter db_txn_adapter(*env);
+    ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+    for (int i = 0; i < 200; ++i) {
+      ASSERT_EQ(db_txn_adapter.Put(absl::StrCat("key_", i), value).code(),
+                absl::StatusCode::kOk);
+    }
+    ASSERT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+  }
+
+  absl::StatusOr<std::shared_ptr<LMDBEnvironment>> env =
+      LMDBEnvironment::Open(dir, SmallMapOptions());
+  ASSERT_TRUE(env.ok()) << env.status();
+  EXPECT_GT((*env)->map_size(), 200 * value.size());
+}
+
+TEST(LMDBDatabaseTransactionAdapter, MapGrowthStopsAtMaxSize) {
+  LMDBOptions options = SmallMapOptions();
+  options.max_map_size = 2 * options.initial_map_size;
+  LMDBDatabaseTransactionAdapter db_txn_adapter(OpenEnv("max_size", options));
+
+  absl::Status status = db_txn_adapter.Begin();
+  ASSERT_EQ(status.code(), absl::StatusCode::kOk);
+  const std::string value(1024, 'v');
+  for (int i = 0; i < 1000 && status.ok(); ++i) {
+    status = db_txn_adapter.Put(absl::StrCat("key_", i), value);
+  }
+  EXPECT_EQ(status.code(), absl::StatusCode::kResourceExhausted);
+  // The transaction was aborted.
+  EXPECT_EQ(db_txn_adapter.Abort().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, FullMapFailsInsteadOfWaitingForOtherTxns) {
+  std::shared_ptr<LMDBEnvironment> env =
+      OpenEnv("full_with_reader", SmallMapOptions());
+  LMDBDatabaseTransactionAdapter reader(env);
+  ASSERT_EQ(reader.BeginReadOnly().code(), absl::StatusCode::kOk);
+
+  const std::string value(1024, 'v');
+  absl::Status status;
+  std::thread writer_thread([&env, &value, &status]() {
+    LMDBDatabaseTransactionAdapter writer(env);
+    status = writer.Begin();
+    for (int i = 0; i < 1000 && status.ok(); ++i) {
+      status = writer.Put(absl::StrCat("key_", i), value);
+    }
+    // The transaction was aborted.
+    EXPECT_EQ(writer.Abort().code(), absl::StatusCode::kFailedPrecondition);
+  });
+  writer_thread.join();
+  EXPECT_EQ(status.code(), absl::StatusCode::kUnavailable);
+  EXPECT_EQ(reader.Commit().code(), absl::StatusCode::kOk);
+
+  // Without the reader the map can grow.
+  LMDBDatabaseTransactionAdapter writer(env);
+  ASSERT_EQ(writer.Begin().code(), absl::StatusCode::kOk);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(writer.Put(absl::StrCat("key_", i), value).code(),
+              absl::StatusCode::kOk);
+  }
+  EXPECT_EQ(writer.Commit().code(), absl::StatusCode::kOk);
+  EXPECT_GT(env->map_size(), SmallMapOptions().initial_map_size);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, MapGrowsAheadOfNeedBetweenTxns) {
+  std::shared_ptr<LMDBEnvironment> env =
+      OpenEnv("grow_ahead", SmallMapOptions());
+  LMDBDatabaseTransactionAdapter writer(env);
+
+  // A reader is open during every write transaction, so the map can only
+  // grow between them.
+  const std::string value(1024, 'v');
+  for (int i = 0; i < 200; ++i) {
+    absl::Notification reader_open;
+    absl::Notification writer_done;
+    std::thread reader_thread([&env, &reader_open, &writer_done]() {
+      LMDBDatabaseTransactionAdapter reader(env);
+      EXPECT_EQ(reader.BeginReadOnly().code(), absl::StatusCode::kOk);
+      reader_open.Notify();
+      writer_done.WaitForNotification();
+      EXPECT_EQ(reader.Commit().code(), absl::StatusCode::kOk);
+    });
+    reader_open.WaitForNotification();
+    absl::Status status = writer.Begin();
+    if (status.ok()) {
+      status = writer.Put(absl::StrCat("key_", i), value);
+    }
+    if (status.ok()) {
+      status = writer.Commit();
+    }
+    writer_done.Notify();
+    reader_thread.join();
+    ASSERT_EQ(status.code(), absl::StatusCode::kOk) << "txn " << i;
+    env->MaybeGrowMap();
+  }
+  EXPECT_GT(env->map_size(), SmallMapOptions().initial_map_size);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, EveryDurabilityCommits) {
+  for (const std::string name :
+       {"sync", "nometasync", "writemap+async-flush"}) {
+    absl::StatusOr<LMDBDurability> durability = ParseLMDBDurability(name);
+    ASSERT_TRUE(durability.ok()) << durability.status();
+    EXPECT_EQ(LMDBDurabilityName(*durability), name);
+
+    LMDBOptions options;
+    options.durability = *durability;
+    options.flush_interval = absl::Milliseconds(1);
+    LMDBDatabaseTransactionAdapter db_txn_adapter(
+        OpenEnv(absl::StrCat("durability_", static_cast<int>(*durability)),
+                options));
+    ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+    EXPECT_EQ(db_txn_adapter.Put("key", name).code(), absl::StatusCode::kOk);
+    EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+    ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+    std::string_view got_value;
+    EXPECT_EQ(db_txn_adapter.Get("key", got_value).code(),
+              absl::StatusCode::kOk);
+    EXPECT_EQ(got_value, name);
+    EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+  }
+  EXPECT_EQ(ParseLMDBDurability("nosync").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(LMDBDatabaseTransactionAdapter, CopyToWhileAWriterIsOpen) {
+  std::shared_ptr<LMDBEnvironment> env = OpenEnv("copy_source", LMDBOptions());
+  LMDBDatabaseTransactionAdapter db_txn_adapter(env);
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter.Put("committed", "1").code(),
+            absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter.Put("uncommitted", "2").code(),
+            absl::StatusCode::kOk);
+
+  // Copies on another thread, like a snapshot request would.
+  const std::string copy_dir = NewDbDir("copy");
+  std::thread copy_thread([&env, &copy_dir]() {
+    EXPECT_EQ(env->CopyTo(copy_dir).code(), absl::StatusCode::kOk);
+  });
+  copy_thread.join();
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+  LMDBDatabaseTransactionAdapter copy(copy_dir);
+  ASSERT_EQ(copy.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::string_view value;
+  EXPECT_EQ(copy.Get("committed", value).code(), absl::StatusCode::kOk);
+  EXPECT_EQ(value, "1");
+  EXPECT_EQ(copy.Get("uncommitted", value).code(),
+            absl::StatusCode::kNotFound);
+  EXPECT_EQ(copy.Commit().code(), absl::StatusCode::kOk);
 }
 
 TEST(LMDBDatabaseTransactionAdapter, ParallelTxnsPutAndGet) {
@@ -78,8 +425,8 @@ TEST(LMDBDatabaseTransactionAdapter, ParallelTxnsPutAndGet) {
   LOG(INFO) << "LOG: Start initialzing values with txn1. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
   ASSERT_EQ(db_txn_adapter1.Begin().code(), absl::StatusCode::kOk);
-  ASSERT_EQ(db_txn_adapter1.Put(key1, 1).code(), absl::StatusCode::kOk);
-  ASSERT_EQ(db_txn_adapter1.Put(key2, 2).code(), absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter1.Put(key1, "1").code(), absl::StatusCode::kOk);
+  ASSERT_EQ(db_txn_adapter1.Put(key2, "2").code(), absl::StatusCode::kOk);
   ASSERT_EQ(db_txn_adapter1.Commit().code(), absl::StatusCode::kOk);
   LOG(INFO) << "LOG: Initialzation commited with txn1. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
@@ -97,20 +444,23 @@ TEST(LMDBDatabaseTransactionAdapter, ParallelTxnsPutAndGet) {
 
   // db_txn_adapter2 Gets key2 then Puts key2 by adding 3 on the value.
   // db_txn_adapter3 Gets key2 before db_txn_adapter2 commits.
-  int64_t txn2_got_value;
-  int64_t txn3_got_value;
+  std::string_view txn2_got_value;
+  std::string_view txn3_got_value;
   LOG(INFO) << "LOG: txn 2 gets key2. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
   EXPECT_EQ(db_txn_adapter2.Get(key2, txn2_got_value).code(),
             absl::StatusCode::kOk);
   LOG(INFO) << "LOG: txn 2 puts key2. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
-  EXPECT_EQ(db_txn_adapter2.Put(key2, txn2_got_value + 3).code(),
+  const int64_t txn2_number = std::stoll(std::string(txn2_got_value));
+  EXPECT_EQ(db_txn_adapter2.Put(key2, absl::StrCat(txn2_number + 3)).code(),
             absl::StatusCode::kOk);
   LOG(INFO) << "LOG: txn 3 gets key2. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
   EXPECT_EQ(db_txn_adapter3.Get(key2, txn3_got_value).code(),
             absl::StatusCode::kOk);
+  // Expect read-only txn3 doesn't see uncommited value.
+  EXPECT_EQ(txn3_got_value, "2");
 
   // Both Commmits are OK.
   LOG(INFO) << "LOG: Commiting txn 2. Duration: "
@@ -122,23 +472,21 @@ TEST(LMDBDatabaseTransactionAdapter, ParallelTxnsPutAndGet) {
   LOG(INFO) << "LOG: txn 2 & 3 commited. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
 
-  // Expect read-only txn3 doesn't see uncommited value.
-  EXPECT_EQ(txn2_got_value, 2);
-  EXPECT_EQ(txn3_got_value, 2);
+  EXPECT_EQ(txn2_number, 2);
 
   // Read the current value of key1 and key2
   LOG(INFO) << "LOG: Starting txn 4 to read commited values. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
   ASSERT_EQ(db_txn_adapter1.Begin().code(), absl::StatusCode::kOk);
-  int64_t key1_val;
-  int64_t key2_val;
+  std::string_view key1_val;
+  std::string_view key2_val;
   ASSERT_EQ(db_txn_adapter1.Get(key1, key1_val).code(), absl::StatusCode::kOk);
   ASSERT_EQ(db_txn_adapter1.Get(key2, key2_val).code(), absl::StatusCode::kOk);
-  ASSERT_EQ(db_txn_adapter1.Commit().code(), absl::StatusCode::kOk);
   // Final value depends on the order of commit.
   // Expect value of key1 remains unchanged and value key2 updated.
-  EXPECT_EQ(key1_val, 1);
-  EXPECT_EQ(key2_val, 5);
+  EXPECT_EQ(key1_val, "1");
+  EXPECT_EQ(key2_val, "5");
+  ASSERT_EQ(db_txn_adapter1.Commit().code(), absl::StatusCode::kOk);
   LOG(INFO) << "LOG: txn 4 commited. Duration: "
             << float(clock() - begin_time) / CLOCKS_PER_SEC;
 }
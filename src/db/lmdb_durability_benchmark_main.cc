@@ -0,0 +1,126 @@
+// Benchmark of the commit latency of each LMDB durability tier.
+//
+// Each tier commits --num_commits write transactions of --puts_per_commit
+// random keys into its own subdirectory of --db_dir, and prints a row of the
+// table below. Run it on the disk the cohorts use, since the differences come
+// from how often commits wait for it.
+// Example cmd:
+//   bazel run //src/db:lmdb_durability_benchmark_main -- --db_dir=/tmp/bench
+//
+// Example output format:
+//   | durability | commits | mean (us) | p50 (us) | p99 (us) | commits/s |
+//   |---|---|---|---|---|---|
+//   | sync | 1000 | ... | ... | ... | ... |
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "src/db/lmdb_database_transaction_adapter.h"
+
+ABSL_FLAG(std::string, db_dir, "/tmp/lmdb_durability_benchmark",
+          "Directory to create a db for each durability tier in. Anything "
+          "already in it is deleted.");
+ABSL_FLAG(int, num_commits, 1000, "Number of transactions to commit per tier");
+ABSL_FLAG(int, puts_per_commit, 1, "Number of keys each transaction writes");
+ABSL_FLAG(int, value_size, 100, "Size in bytes of each value");
+ABSL_FLAG(absl::Duration, flush_interval, absl::Seconds(1),
+          "Flush interval for writemap+async-flush");
+
+namespace {
+
+absl::Duration Percentile(const std::vector<absl::Duration>& sorted_latencies,
+                          double percentile) {
+  const size_t index = std::min(
+      sorted_latencies.size() - 1,
+      static_cast<size_t>(percentile * sorted_latencies.size()));
+  return sorted_latencies[index];
+}
+
+absl::Status RunBenchmark(db::LMDBDurability durability) {
+  const std::string name(db::LMDBDurabilityName(durability));
+  const std::string db_dir =
+      absl::StrCat(absl::GetFlag(FLAGS_db_dir), "/", name);
+  std::filesystem::remove_all(db_dir);
+  std::filesystem::create_directories(db_dir);
+  db::LMDBOptions options;
+  options.durability = durability;
+  options.flush_interval = absl::GetFlag(FLAGS_flush_interval);
+  absl::StatusOr<std::shared_ptr<db::LMDBEnvironment>> env =
+      db::LMDBEnvironment::Open(db_dir, options);
+  if (!env.ok()) {
+    return env.status();
+  }
+  db::LMDBDatabaseTransactionAdapter db_txn_adapter(*env);
+
+  std::mt19937_64 random;
+  const std::string value(absl::GetFlag(FLAGS_value_size), 'v');
+  std::vector<absl::Duration> latencies;
+  const absl::Time benchmark_start = absl::Now();
+  for (int i = 0; i < absl::GetFlag(FLAGS_num_commits); ++i) {
+    const absl::Time start = absl::Now();
+    absl::Status status = db_txn_adapter.Begin();
+    for (int j = 0; j < absl::GetFlag(FLAGS_puts_per_commit) && status.ok();
+         ++j) {
+      status = db_txn_adapter.Put(absl::StrCat(random()), value);
+    }
+    if (status.ok()) {
+      status = db_txn_adapter.Commit();
+    }
+    if (!status.ok()) {
+      return status;
+    }
+    latencies.push_back(absl::Now() - start);
+  }
+  const absl::Duration total = absl::Now() - benchmark_start;
+  if (latencies.empty()) {
+    return absl::InvalidArgumentError("num_commits must be positive");
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  absl::Duration sum = absl::ZeroDuration();
+  for (const absl::Duration latency : latencies) {
+    sum += latency;
+  }
+  std::cout << absl::StrFormat(
+                   "| %s | %d | %.1f | %.1f | %.1f | %.0f |", name,
+                   latencies.size(),
+                   absl::ToDoubleMicroseconds(sum / latencies.size()),
+                   absl::ToDoubleMicroseconds(Percentile(latencies, 0.5)),
+                   absl::ToDoubleMicroseconds(Percentile(latencies, 0.99)),
+                   latencies.size() / absl::ToDoubleSeconds(total))
+            << std::endl;
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  std::cout << "| durability | commits | mean (us) | p50 (us) | p99 (us) | "
+               "commits/s |"
+            << std::endl
+            << "|---|---|---|---|---|---|" << std::endl;
+  for (const db::LMDBDurability durability :
+       {db::LMDBDurability::kSync, db::LMDBDurability::kNoMetaSync,
+        db::LMDBDurability::kWriteMapAsyncFlush}) {
+    const absl::Status status = RunBenchmark(durability);
+    if (!status.ok()) {
+      std::cerr << "Benchmark of " << db::LMDBDurabilityName(durability)
+                << " failed: " << status << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,535 @@
+#include "src/db/sharded_lmdb_database_transaction_adapter.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <thread>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace db {
+
+namespace {
+
+constexpr char kNumShardsFile[] = "num_shards";
+// Name of the data file in an LMDB environment's directory.
+constexpr char kDataFile[] = "data.mdb";
+constexpr size_t kCopyChunkBytes = 1 << 20;
+
+// FNV-1a, which unlike absl::Hash gives the same result in every process, so
+// keys stay in the same shard across restarts.
+uint64_t StableHash(std::string_view key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char c : key) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Records the number of shards the first time the db is opened and checks it
+// matches afterwards.
+absl::Status CheckNumShards(const std::string& db_path, size_t num_shards) {
+  const std::string path = absl::StrCat(db_path, "/", kNumShardsFile);
+  std::ifstream input(path);
+  if (input) {
+    size_t existing_num_shards = 0;
+    if (!(input >> existing_num_shards)) {
+      return absl::DataLossError(absl::StrCat("Could not parse ", path));
+    }
+    if (existing_num_shards != num_shards) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("The db in ", db_path, " has ", existing_num_shards,
+                       " shards, not ", num_shards));
+    }
+    return absl::OkStatus();
+  }
+  std::ofstream output(path, std::ios::trunc);
+  if (!(output << num_shards) || !output.flush()) {
+    return absl::InternalError(absl::StrCat("Could not write ", path));
+  }
+  return absl::OkStatus();
+}
+
+// Sleeps as needed to keep the bytes written under a rate.
+class Throttle {
+ public:
+  explicit Throttle(uint64_t max_bytes_per_second)
+      : max_bytes_per_second_(max_bytes_per_second), start_(absl::Now()) {}
+
+  void Add(size_t bytes) {
+    bytes_ += bytes;
+    if (max_bytes_per_second_ > 0) {
+      absl::SleepFor(start_ +
+                     absl::Seconds(static_cast<double>(bytes_) /
+                                   max_bytes_per_second_) -
+                     absl::Now());
+    }
+  }
+
+ private:
+  const uint64_t max_bytes_per_second_;
+  const absl::Time start_;
+  uint64_t bytes_ = 0;
+};
+
+absl::Status ErrnoError(const std::string& action) {
+  return absl::InternalError(absl::StrCat(action, ": ", std::strerror(errno)));
+}
+
+// Copies a shard into a file through a pipe, so that writing the copy can be
+// throttled and its read transaction is known to be open once the first bytes
+// arrive.
+class ShardCopy {
+ public:
+  ShardCopy(std::shared_ptr<LMDBEnvironment> env, std::string path)
+      : env_(std::move(env)), path_(std::move(path)) {}
+
+  ShardCopy(const ShardCopy&) = delete;
+  ShardCopy& operator=(const ShardCopy&) = delete;
+
+  // Discards the rest of an unfinished copy rather than closing the pipe on
+  // the copying thread.
+  ~ShardCopy() {
+    if (thread_.joinable()) {
+      std::vector<char> buffer(kCopyChunkBytes);
+      while (true) {
+        const ssize_t size = read(read_fd_, buffer.data(), buffer.size());
+        if (size == 0 || (size < 0 && errno != EINTR)) {
+          break;
+        }
+      }
+      thread_.join();
+    }
+    if (read_fd_ >= 0) {
+      close(read_fd_);
+    }
+    if (file_fd_ >= 0) {
+      close(file_fd_);
+    }
+  }
+
+  // Starts copying on a background thread and waits until its read
+  // transaction is open.
+  absl::Status Start() {
+    file_fd_ = open(path_.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    if (file_fd_ < 0) {
+      return ErrnoError(absl::StrCat("Could not create ", path_));
+    }
+    int fds[2];
+    if (pipe(fds) != 0) {
+      return ErrnoError("Could not create a pipe");
+    }
+    read_fd_ = fds[0];
+    thread_ = std::thread([this, write_fd = fds[1]]() {
+      copy_status_ = env_->CopyToFd(write_fd);
+      close(write_fd);
+    });
+    // LMDB writes nothing before the transaction is open.
+    return Transfer(/*throttle=*/nullptr, /*first_chunk_only=*/true);
+  }
+
+  // Writes the rest of the copy into the file.
+  absl::Status Finish(Throttle& throttle) {
+    throttle.Add(first_chunk_bytes_);
+    absl::Status status = Transfer(&throttle, /*first_chunk_only=*/false);
+    if (!status.ok()) {
+      return status;
+    }
+    thread_.join();
+    return copy_status_;
+  }
+
+ private:
+  absl::Status Transfer(Throttle* throttle, bool first_chunk_only) {
+    std::vector<char> buffer(kCopyChunkBytes);
+    while (true) {
+      const ssize_t size = read(read_fd_, buffer.data(), buffer.size());
+      if (size < 0 && errno == EINTR) {
+        continue;
+      }
+      if (size < 0) {
+        return ErrnoError("Could not read the LMDB copy");
+      }
+      if (size == 0) {
+        return absl::OkStatus();
+      }
+      for (ssize_t written = 0; written < size;) {
+        const ssize_t result =
+            write(file_fd_, buffer.data() + written, size - written);
+        if (result < 0 && errno != EINTR) {
+          return ErrnoError(absl::StrCat("Could not write ", path_));
+        }
+        written += std::max<ssize_t>(result, 0);
+      }
+      if (first_chunk_only) {
+        first_chunk_bytes_ = size;
+        return absl::OkStatus();
+      }
+      throttle->Add(size);
+    }
+  }
+
+  const std::shared_ptr<LMDBEnvironment> env_;
+  const std::string path_;
+  int file_fd_ = -1;
+  int read_fd_ = -1;
+  size_t first_chunk_bytes_ = 0;
+  std::thread thread_;
+  // Set by thread_ before it ends.
+  absl::Status copy_status_;
+};
+
+}  // namespace
+
+size_t GetLMDBShard(std::string_view key, size_t num_shards) {
+  return StableHash(key) % num_shards;
+}
+
+absl::StatusOr<std::vector<std::shared_ptr<LMDBEnvironment>>> OpenLMDBShards(
+    std::string_view db_path, size_t num_shards, const LMDBOptions& options) {
+  if (num_shards == 0) {
+    return absl::InvalidArgumentError("There must be at least one shard");
+  }
+  const std::string db_path_string(db_path);
+  std::error_code error;
+  std::filesystem::create_directories(db_path_string, error);
+  if (error) {
+    return absl::InternalError(absl::StrCat(
+        "Could not create ", db_path_string, ": ", error.message()));
+  }
+  const absl::Status status = CheckNumShards(db_path_string, num_shards);
+  if (!status.ok()) {
+    return status;
+  }
+  std::vector<std::shared_ptr<LMDBEnvironment>> shards;
+  for (size_t i = 0; i < num_shards; ++i) {
+    const std::string shard_path = absl::StrCat(db_path_string, "/shard_", i);
+    std::filesystem::create_directories(shard_path, error);
+    if (error) {
+      return absl::InternalError(absl::StrCat(
+          "Could not create ", shard_path, ": ", error.message()));
+    }
+    absl::StatusOr<std::shared_ptr<LMDBEnvironment>> shard =
+        LMDBEnvironment::Open(shard_path, options);
+    if (!shard.ok()) {
+      return shard.status();
+    }
+    shards.push_back(*std::move(shard));
+  }
+  return shards;
+}
+
+absl::Status CopyLMDBShards(
+    const std::vector<std::shared_ptr<LMDBEnvironment>>& shards,
+    std::string_view snapshot_dir, uint64_t max_bytes_per_second) {
+  const std::string snapshot_dir_string(snapshot_dir);
+  std::error_code error;
+  std::filesystem::create_directories(snapshot_dir_string, error);
+  if (error) {
+    return absl::InternalError(absl::StrCat(
+        "Could not create ", snapshot_dir_string, ": ", error.message()));
+  }
+  std::vector<std::string> shard_paths;
+  if (shards.size() == 1) {
+    shard_paths.push_back(snapshot_dir_string);
+  } else {
+    const absl::Status status =
+        CheckNumShards(snapshot_dir_string, shards.size());
+    if (!status.ok()) {
+      return status;
+    }
+    for (size_t i = 0; i < shards.size(); ++i) {
+      shard_paths.push_back(absl::StrCat(snapshot_dir_string, "/shard_", i));
+      std::filesystem::create_directories(shard_paths.back(), error);
+      if (error) {
+        return absl::InternalError(absl::StrCat(
+            "Could not create ", shard_paths.back(), ": ", error.message()));
+      }
+    }
+  }
+  // The commit locks are only held until every copy's read transaction is
+  // open, so commits aren't held up while the copies are written.
+  std::vector<std::unique_ptr<ShardCopy>> copies;
+  absl::Status status;
+  for (const std::shared_ptr<LMDBEnvironment>& shard : shards) {
+    shard->commit_mutex()->Lock();
+  }
+  for (size_t i = 0; i < shards.size() && status.ok(); ++i) {
+    copies.push_back(std::make_unique<ShardCopy>(
+        shards[i], absl::StrCat(shard_paths[i], "/", kDataFile)));
+    status = copies.back()->Start();
+  }
+  for (const std::shared_ptr<LMDBEnvironment>& shard : shards) {
+    shard->commit_mutex()->Unlock();
+  }
+  Throttle throttle(max_bytes_per_second);
+  for (size_t i = 0; i < copies.size() && status.ok(); ++i) {
+    status = copies[i]->Finish(throttle);
+  }
+  return status;
+}
+
+ShardedLMDBDatabaseTransactionAdapter::ShardedLMDBDatabaseTransactionAdapter(
+    const std::vector<std::shared_ptr<LMDBEnvironment>>& shards)
+    : envs_(shards),
+      shard_transactions_(shards.size(), ShardTransaction::kNone) {
+  for (const std::shared_ptr<LMDBEnvironment>& shard : shards) {
+    shards_.push_back(std::make_unique<LMDBDatabaseTransactionAdapter>(shard));
+  }
+}
+
+size_t ShardedLMDBDatabaseTransactionAdapter::GetShard(
+    const std::string& key) const {
+  return GetLMDBShard(key, shards_.size());
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::Begin() {
+  if (in_txn_) {
+    return absl::FailedPreconditionError(
+        "Cannot open another transaction while a transaction hasn't "
+        "commited or aborted yet.");
+  }
+  in_txn_ = true;
+  is_readonly_ = false;
+  return absl::OkStatus();
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::BeginReadOnly() {
+  if (in_txn_) {
+    return absl::FailedPreconditionError(
+        "Cannot open another transaction while a transaction hasn't "
+        "commited or aborted yet.");
+  }
+  in_txn_ = true;
+  is_readonly_ = true;
+  return absl::OkStatus();
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::Commit() {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction to Commit. Please Begin() first.");
+  }
+  // Locked in shard order, like CopyLMDBShards does.
+  std::vector<absl::Mutex*> commit_mutexes;
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    if (shard_transactions_[shard] == ShardTransaction::kReadWrite) {
+      commit_mutexes.push_back(envs_[shard]->commit_mutex());
+      commit_mutexes.back()->ReaderLock();
+    }
+  }
+  absl::Status status;
+  for (size_t shard = 0; shard < shards_.size() && status.ok(); ++shard) {
+    if (shard_transactions_[shard] == ShardTransaction::kNone) {
+      continue;
+    }
+    status = shards_[shard]->Commit();
+    if (status.ok()) {
+      shard_transactions_[shard] = ShardTransaction::kNone;
+    }
+  }
+  for (absl::Mutex* commit_mutex : commit_mutexes) {
+    commit_mutex->ReaderUnlock();
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  in_txn_ = false;
+  return absl::OkStatus();
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::Abort() {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction to Abort. Please Begin() first.");
+  }
+  absl::Status status;
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    if (shard_transactions_[shard] != ShardTransaction::kNone) {
+      status.Update(shards_[shard]->Abort());
+      shard_transactions_[shard] = ShardTransaction::kNone;
+    }
+  }
+  in_txn_ = false;
+  return status;
+}
+
+absl::StatusOr<LMDBDatabaseTransactionAdapter*>
+ShardedLMDBDatabaseTransactionAdapter::ForRead(size_t shard) {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  if (shard_transactions_[shard] == ShardTransaction::kNone) {
+    const absl::Status status = shards_[shard]->BeginReadOnly();
+    if (!status.ok()) {
+      return status;
+    }
+    shard_transactions_[shard] = ShardTransaction::kReadOnly;
+  }
+  return shards_[shard].get();
+}
+
+absl::StatusOr<LMDBDatabaseTransactionAdapter*>
+ShardedLMDBDatabaseTransactionAdapter::ForWrite(size_t shard) {
+  if (!in_txn_) {
+    return absl::FailedPreconditionError(
+        "No valid transaction available. Please Begin() first.");
+  }
+  if (is_readonly_) {
+    return absl::FailedPreconditionError(
+        "Cannot write with read only transaction. "
+        "Please Abort() or Commit() the current transaction "
+        "and call Begin() instead.");
+  }
+  if (shard_transactions_[shard] == ShardTransaction::kReadWrite) {
+    return shards_[shard].get();
+  }
+  // The caller locks the shard before writing to it, so nothing can have
+  // changed since the read-only transaction began.
+  if (shard_transactions_[shard] == ShardTransaction::kReadOnly) {
+    shard_transactions_[shard] = ShardTransaction::kNone;
+    const absl::Status status = shards_[shard]->Abort();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  const absl::Status status = shards_[shard]->Begin();
+  if (!status.ok()) {
+    return status;
+  }
+  shard_transactions_[shard] = ShardTransaction::kReadWrite;
+  return shards_[shard].get();
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::Get(
+    const std::string& key, std::string_view& output_value) {
+  absl::StatusOr<LMDBDatabaseTransactionAdapter*> shard =
+      ForRead(GetShard(key));
+  if (!shard.ok()) {
+    return shard.status();
+  }
+  return (*shard)->Get(key, output_value);
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::Put(
+    const std::string& key, std::string_view value) {
+  absl::StatusOr<LMDBDatabaseTransactionAdapter*> shard =
+      ForWrite(GetShard(key));
+  if (!shard.ok()) {
+    return shard.status();
+  }
+  return (*shard)->Put(key, value);
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::MultiGet(
+    absl::Span<const std::string_view> keys,
+    std::vector<absl::optional<std::string_view>>& output_values) {
+  output_values.assign(keys.size(), absl::nullopt);
+  std::vector<std::vector<size_t>> indices_by_shard(shards_.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    indices_by_shard[GetLMDBShard(keys[i], shards_.size())].push_back(i);
+  }
+  std::vector<std::string_view> shard_keys;
+  std::vector<absl::optional<std::string_view>> shard_values;
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    const std::vector<size_t>& indices = indices_by_shard[shard];
+    if (indices.empty()) {
+      continue;
+    }
+    absl::StatusOr<LMDBDatabaseTransactionAdapter*> db = ForRead(shard);
+    if (!db.ok()) {
+      return db.status();
+    }
+    shard_keys.clear();
+    for (const size_t index : indices) {
+      shard_keys.push_back(keys[index]);
+    }
+    const absl::Status status = (*db)->MultiGet(shard_keys, shard_values);
+    if (!status.ok()) {
+      return status;
+    }
+    for (size_t i = 0; i < indices.size(); ++i) {
+      output_values[indices[i]] = shard_values[i];
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::MultiPut(
+    absl::Span<const std::string_view> keys,
+    absl::Span<const std::string_view> values) {
+  if (keys.size() != values.size()) {
+    return absl::InvalidArgumentError(
+        "MultiPut needs the same number of keys and values.");
+  }
+  std::vector<std::vector<size_t>> indices_by_shard(shards_.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    indices_by_shard[GetLMDBShard(keys[i], shards_.size())].push_back(i);
+  }
+  std::vector<std::string_view> shard_keys;
+  std::vector<std::string_view> shard_values;
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    const std::vector<size_t>& indices = indices_by_shard[shard];
+    if (indices.empty()) {
+      continue;
+    }
+    absl::StatusOr<LMDBDatabaseTransactionAdapter*> db = ForWrite(shard);
+    if (!db.ok()) {
+      return db.status();
+    }
+    shard_keys.clear();
+    shard_values.clear();
+    for (const size_t index : indices) {
+      shard_keys.push_back(keys[index]);
+      shard_values.push_back(values[index]);
+    }
+    const absl::Status status = (*db)->MultiPut(shard_keys, shard_values);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ShardedLMDBDatabaseTransactionAdapter::Scan(
+    const std::string& start_key, const std::string& end_key, size_t limit,
+    const ScanCallback& callback) {
+  // Each shard returns at most |limit| keys, so the first |limit| merged keys
+  // are the first |limit| keys overall.
+  std::map<std::string, std::string> merged;
+  for (size_t shard = 0; shard < shards_.size(); ++shard) {
+    absl::StatusOr<LMDBDatabaseTransactionAdapter*> db = ForRead(shard);
+    if (!db.ok()) {
+      return db.status();
+    }
+    const absl::Status status = (*db)->Scan(
+        start_key, end_key, limit,
+        [&merged](std::string_view key, std::string_view value) {
+          merged.emplace(key, value);
+        });
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  size_t count = 0;
+  for (const auto& [key, value] : merged) {
+    if (limit != 0 && count++ == limit) {
+      break;
+    }
+    callback(key, value);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace db
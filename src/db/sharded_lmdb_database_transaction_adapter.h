@@ -0,0 +1,112 @@
+#ifndef SRC_DB_SHARDED_LMDB_DATABASE_TRANSACTION_ADAPTER_H_
+
+#define SRC_DB_SHARDED_LMDB_DATABASE_TRANSACTION_ADAPTER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "src/db/database_transaction_adapter.h"
+#include "src/db/lmdb_database_transaction_adapter.h"
+
+namespace db {
+
+// Opens |num_shards| LMDB environments in the subdirectories shard_0,
+// shard_1, ... of |db_path|, creating them if needed. Keys are assigned to
+// shards by hash, so a db can't be reopened with a different number of shards.
+absl::StatusOr<std::vector<std::shared_ptr<LMDBEnvironment>>> OpenLMDBShards(
+    std::string_view db_path, size_t num_shards,
+    const LMDBOptions& options = LMDBOptions());
+
+// Writes a compacted copy of |shards| into |snapshot_dir| while they keep
+// serving transactions. The copy has the layout the cohort opens: a single
+// shard is copied into |snapshot_dir| itself, and several shards use the
+// layout of OpenLMDBShards. Commits of ShardedLMDBDatabaseTransactionAdapter
+// wait until every shard's copy has started, so the copies are consistent
+// with each other. Writing the copy is throttled to |max_bytes_per_second|,
+// 0 meaning no limit.
+absl::Status CopyLMDBShards(
+    const std::vector<std::shared_ptr<LMDBEnvironment>>& shards,
+    std::string_view snapshot_dir, uint64_t max_bytes_per_second = 0);
+
+// Returns the shard |key| is stored in. The hash is stable across processes,
+// so tools like the bulk loader can place keys where the adapter finds them.
+size_t GetLMDBShard(std::string_view key, size_t num_shards);
+
+// Database Interface that hash-partitions keys over several LMDB environments.
+// Each environment still allows only one write transaction at a time, but
+// transactions writing to different shards run (and sync to disk) in parallel.
+// A transaction lazily begins an LMDB transaction on each shard it uses. Shards
+// that are only read use read-only transactions so they don't block writers.
+// Commit commits the shards one by one. If one fails, its writes are lost like
+// with a single LMDB environment, while the shards before it stay committed,
+// so callers holding the shards' locks redo all the writes in a new
+// transaction to never expose a partial commit. Commit holds the commit locks
+// of the shards it writes, so CopyLMDBShards never sees part of it.
+class ShardedLMDBDatabaseTransactionAdapter
+    : public DatabaseTransactionAdapter {
+ public:
+  explicit ShardedLMDBDatabaseTransactionAdapter(
+      const std::vector<std::shared_ptr<LMDBEnvironment>>& shards);
+
+  ~ShardedLMDBDatabaseTransactionAdapter() = default;
+
+  [[nodiscard]] bool SupportsConcurrentWrites() const final { return false; }
+
+  [[nodiscard]] size_t NumShards() const final { return shards_.size(); }
+
+  [[nodiscard]] size_t GetShard(const std::string& key) const final;
+
+  absl::Status Begin() final;
+
+  absl::Status BeginReadOnly() final;
+
+  absl::Status Commit() final;
+
+  absl::Status Abort() final;
+
+  // Writing to a shard that was only read so far invalidates the values read
+  // from it.
+  absl::Status Get(const std::string& key,
+                   std::string_view& output_value) final;
+
+  absl::Status Put(const std::string& key, std::string_view value) final;
+
+  // Does one batched lookup per shard.
+  absl::Status MultiGet(
+      absl::Span<const std::string_view> keys,
+      std::vector<absl::optional<std::string_view>>& output_values) final;
+
+  // Does one batched write per shard.
+  absl::Status MultiPut(absl::Span<const std::string_view> keys,
+                        absl::Span<const std::string_view> values) final;
+
+  // Scans every shard and merges the results in key order.
+  absl::Status Scan(const std::string& start_key, const std::string& end_key,
+                    size_t limit, const ScanCallback& callback) final;
+
+ private:
+  enum class ShardTransaction { kNone, kReadOnly, kReadWrite };
+
+  void Connect() final {}
+
+  // Returns the adapter of |shard| with a transaction that can read it.
+  absl::StatusOr<LMDBDatabaseTransactionAdapter*> ForRead(size_t shard);
+
+  // Returns the adapter of |shard| with a read-write transaction.
+  absl::StatusOr<LMDBDatabaseTransactionAdapter*> ForWrite(size_t shard);
+
+  const std::vector<std::shared_ptr<LMDBEnvironment>> envs_;
+  std::vector<std::unique_ptr<LMDBDatabaseTransactionAdapter>> shards_;
+  std::vector<ShardTransaction> shard_transactions_;
+  bool in_txn_ = false;
+  bool is_readonly_ = false;
+};
+
+}  // namespace db
+
+#endif  // SRC_DB_SHARDED_LMDB_DATABASE_TRANSACTION_ADAPTER_H_
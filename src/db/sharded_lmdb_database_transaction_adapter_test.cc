@@ -0,0 +1,253 @@
+#include "src/db/sharded_lmdb_database_transaction_adapter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace db {
+
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Optional;
+
+constexpr size_t kNumShards = 4;
+
+// Returns the shards of a new db in an empty directory.
+std::vector<std::shared_ptr<LMDBEnvironment>> OpenNewShards(
+    const std::string& test_name, size_t num_shards = kNumShards) {
+  const std::string dir = absl::StrCat("/tmp/sharded_lmdb_test_", test_name);
+  std::filesystem::remove_all(dir);
+  absl::StatusOr<std::vector<std::shared_ptr<LMDBEnvironment>>> shards =
+      OpenLMDBShards(dir, num_shards);
+  EXPECT_TRUE(shards.ok()) << shards.status();
+  return *shards;
+}
+
+// Returns a key in each shard, in shard order.
+std::vector<std::string> KeyPerShard(
+    const ShardedLMDBDatabaseTransactionAdapter& db_txn_adapter) {
+  std::vector<std::string> keys(db_txn_adapter.NumShards());
+  size_t found = 0;
+  for (int i = 0; found < keys.size(); ++i) {
+    const std::string key = absl::StrCat("key_", i);
+    std::string& shard_key = keys[db_txn_adapter.GetShard(key)];
+    if (shard_key.empty()) {
+      shard_key = key;
+      ++found;
+    }
+  }
+  return keys;
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, PutThenGetAcrossShards) {
+  ShardedLMDBDatabaseTransactionAdapter db_txn_adapter(
+      OpenNewShards("put_get"));
+  EXPECT_EQ(db_txn_adapter.NumShards(), kNumShards);
+  const std::vector<std::string> keys = KeyPerShard(db_txn_adapter);
+
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  for (const std::string& key : keys) {
+    EXPECT_EQ(db_txn_adapter.Put(key, key).code(), absl::StatusCode::kOk);
+  }
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  for (const std::string& key : keys) {
+    std::string_view value;
+    EXPECT_EQ(db_txn_adapter.Get(key, value).code(), absl::StatusCode::kOk);
+    EXPECT_EQ(value, key);
+  }
+  EXPECT_EQ(db_txn_adapter.Put(keys[0], "value").code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, MultiPutThenMultiGet) {
+  ShardedLMDBDatabaseTransactionAdapter db_txn_adapter(OpenNewShards("multi"));
+  const std::vector<std::string> key_per_shard = KeyPerShard(db_txn_adapter);
+  const std::vector<std::string_view> keys(key_per_shard.rbegin(),
+                                           key_per_shard.rend());
+  const std::vector<std::string_view> values = {"3", "2", "1", "0"};
+
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.MultiPut(keys, values).code(),
+            absl::StatusCode::kOk);
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+
+  ASSERT_EQ(db_txn_adapter.BeginReadOnly().code(), absl::StatusCode::kOk);
+  std::vector<absl::optional<std::string_view>> got_values;
+  EXPECT_EQ(
+      db_txn_adapter.MultiGet({keys[1], "missing", keys[3]}, got_values).code(),
+      absl::StatusCode::kOk);
+  EXPECT_THAT(got_values, ElementsAre(Optional(Eq("2")), Eq(absl::nullopt),
+                                      Optional(Eq("0"))));
+  EXPECT_EQ(db_txn_adapter.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, ScanMergesShardsInKeyOrder) {
+  ShardedLMDBDatabaseTransactionAdapter db_txn_adapter(OpenNewShards("scan"));
+
+  ASSERT_EQ(db_txn_adapter.Begin().code(), absl::StatusCode::kOk);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(db_txn_adapter.Put(absl::StrCat("scan_", i), "v").code(),
+              absl::StatusCode::kOk);
+  }
+  EXPECT_EQ(db_txn_adapter.Put("other", "v").code(), absl::StatusCode::kOk);
+  std::vector<std::string> scanned;
+  EXPECT_EQ(db_txn_adapter
+                .Scan("scan_2", "scan_z", 3,
+                      [&scanned](std::string_view key, std::string_view) {
+                        scanned.emplace_back(key);
+                      })
+                .code(),
+            absl::StatusCode::kOk);
+  EXPECT_THAT(scanned, ElementsAre("scan_2", "scan_3", "scan_4"));
+  EXPECT_EQ(db_txn_adapter.Abort().code(), absl::StatusCode::kOk);
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, WritersOnDifferentShardsOverlap) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("overlap");
+  ShardedLMDBDatabaseTransactionAdapter writer1(shards);
+  const std::vector<std::string> keys = KeyPerShard(writer1);
+
+  ASSERT_EQ(writer1.Begin().code(), absl::StatusCode::kOk);
+  EXPECT_EQ(writer1.Put(keys[0], "1").code(), absl::StatusCode::kOk);
+  // Would block until writer1 commits if both used the same LMDB environment.
+  std::thread writer2_thread([&shards, &keys]() {
+    ShardedLMDBDatabaseTransactionAdapter writer2(shards);
+    ASSERT_EQ(writer2.Begin().code(), absl::StatusCode::kOk);
+    EXPECT_EQ(writer2.Put(keys[1], "2").code(), absl::StatusCode::kOk);
+    // Reading a shard another transaction is writing doesn't block either.
+    std::string_view value;
+    EXPECT_EQ(writer2.Get(keys[0], value).code(), absl::StatusCode::kNotFound);
+    EXPECT_EQ(writer2.Commit().code(), absl::StatusCode::kOk);
+  });
+  writer2_thread.join();
+  EXPECT_EQ(writer1.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, ReopenWithOtherShardCountFails) {
+  OpenNewShards("reopen");
+  EXPECT_EQ(OpenLMDBShards("/tmp/sharded_lmdb_test_reopen", kNumShards + 1)
+                .status()
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_TRUE(OpenLMDBShards("/tmp/sharded_lmdb_test_reopen", kNumShards).ok());
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, CopyOpensWithTheSameShards) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("copy_source");
+  ShardedLMDBDatabaseTransactionAdapter source(shards);
+  const std::vector<std::string> keys = KeyPerShard(source);
+  ASSERT_EQ(source.Begin().code(), absl::StatusCode::kOk);
+  for (const std::string& key : keys) {
+    EXPECT_EQ(source.Put(key, key).code(), absl::StatusCode::kOk);
+  }
+  EXPECT_EQ(source.Commit().code(), absl::StatusCode::kOk);
+
+  const std::string copy_dir = "/tmp/sharded_lmdb_test_copy";
+  std::filesystem::remove_all(copy_dir);
+  ASSERT_EQ(CopyLMDBShards(shards, copy_dir).code(), absl::StatusCode::kOk);
+  EXPECT_EQ(OpenLMDBShards(copy_dir, kNumShards + 1).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+  absl::StatusOr<std::vector<std::shared_ptr<LMDBEnvironment>>> copy_shards =
+      OpenLMDBShards(copy_dir, kNumShards);
+  ASSERT_TRUE(copy_shards.ok()) << copy_shards.status();
+  ShardedLMDBDatabaseTransactionAdapter copy(*copy_shards);
+  ASSERT_EQ(copy.BeginReadOnly().code(), absl::StatusCode::kOk);
+  for (const std::string& key : keys) {
+    std::string_view value;
+    EXPECT_EQ(copy.Get(key, value).code(), absl::StatusCode::kOk);
+    EXPECT_EQ(value, key);
+  }
+  EXPECT_EQ(copy.Commit().code(), absl::StatusCode::kOk);
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, CopyHoldsWholeCommits) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("copy_while_writing");
+  ShardedLMDBDatabaseTransactionAdapter source(shards);
+  const std::vector<std::string> keys = KeyPerShard(source);
+
+  // Every commit writes the same value to all the shards.
+  std::atomic<bool> stop = false;
+  std::thread writer_thread([&source, &keys, &stop]() {
+    for (int i = 0; !stop; ++i) {
+      ASSERT_EQ(source.Begin().code(), absl::StatusCode::kOk);
+      for (const std::string& key : keys) {
+        ASSERT_EQ(source.Put(key, absl::StrCat(i)).code(),
+                  absl::StatusCode::kOk);
+      }
+      ASSERT_EQ(source.Commit().code(), absl::StatusCode::kOk);
+    }
+  });
+  for (int i = 0; i < 20; ++i) {
+    const std::string copy_dir =
+        absl::StrCat("/tmp/sharded_lmdb_test_consistent_copy_", i);
+    std::filesystem::remove_all(copy_dir);
+    ASSERT_EQ(CopyLMDBShards(shards, copy_dir).code(), absl::StatusCode::kOk);
+    absl::StatusOr<std::vector<std::shared_ptr<LMDBEnvironment>>> copy_shards =
+        OpenLMDBShards(copy_dir, kNumShards);
+    ASSERT_TRUE(copy_shards.ok()) << copy_shards.status();
+    ShardedLMDBDatabaseTransactionAdapter copy(*copy_shards);
+    ASSERT_EQ(copy.BeginReadOnly().code(), absl::StatusCode::kOk);
+    std::vector<absl::optional<std::string_view>> values;
+    ASSERT_EQ(copy.MultiGet(std::vector<std::string_view>(keys.begin(),
+                                                          keys.end()),
+                            values)
+                  .code(),
+              absl::StatusCode::kOk);
+    for (const absl::optional<std::string_view>& value : values) {
+      EXPECT_EQ(value, values[0]);
+    }
+    EXPECT_EQ(copy.Commit().code(), absl::StatusCode::kOk);
+  }
+  stop = true;
+  writer_thread.join();
+}
+
+TEST(ShardedLMDBDatabaseTransactionAdapter, CopyIsThrottled) {
+  const std::vector<std::shared_ptr<LMDBEnvironment>> shards =
+      OpenNewShards("throttled_copy");
+  ShardedLMDBDatabaseTransactionAdapter source(shards);
+  ASSERT_EQ(source.Begin().code(), absl::StatusCode::kOk);
+  const std::string value(1024, 'v');
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_EQ(source.Put(absl::StrCat("key_", i), value).code(),
+              absl::StatusCode::kOk);
+  }
+  ASSERT_EQ(source.Commit().code(), absl::StatusCode::kOk);
+
+  const std::string copy_dir = "/tmp/sharded_lmdb_test_throttled_copy";
+  std::filesystem::remove_all(copy_dir);
+  const absl::Time start = absl::Now();
+  ASSERT_EQ(CopyLMDBShards(shards, copy_dir,
+                           /*max_bytes_per_second=*/1 << 20)
+                .code(),
+            absl::StatusCode::kOk);
+  uint64_t bytes = 0;
+  for (const auto& entry :
+       std::filesystem::recursive_directory_iterator(copy_dir)) {
+    if (entry.is_regular_file()) {
+      bytes += entry.file_size();
+    }
+  }
+  EXPECT_GE(absl::Now() - start,
+            absl::Seconds(static_cast<double>(bytes) / (1 << 20)) -
+                absl::Milliseconds(10));
+}
+
+}  // namespace
+
+}  // namespace db
@@ -0,0 +1,115 @@
+#ifndef SRC_UTILS_BATCHER_H_
+
+#define SRC_UTILS_BATCHER_H_
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+
+namespace utils {
+
+struct BatcherOptions {
+  // Maximum number of items sent together.
+  size_t max_batch_size = 64;
+  // Longest the first item of a batch waits for others to join it.
+  absl::Duration max_delay = absl::Milliseconds(50);
+};
+
+// Combines the items that concurrent callers add into batches, so an expensive
+// call (e.g. a blockchain transaction) is made once per batch rather than once
+// per item. A batch is sent once it's full or its first item has waited
+// max_delay, while the next batch fills up. Thread-safe.
+template <typename T>
+class Batcher {
+ public:
+  using SendFunction = std::function<absl::Status(absl::Span<const T>)>;
+  // Like SendFunction, but may also fail single items of a batch it sent by
+  // setting their entries in |item_statuses|, which start out OK.
+  using PartialSendFunction = std::function<absl::Status(
+      absl::Span<const T> items, absl::Span<absl::Status> item_statuses)>;
+
+  Batcher(SendFunction send, const BatcherOptions& options = BatcherOptions())
+      : Batcher(
+            [send = std::move(send)](absl::Span<const T> items,
+                                     absl::Span<absl::Status>) {
+              return send(items);
+            },
+            options) {}
+
+  Batcher(PartialSendFunction send,
+          const BatcherOptions& options = BatcherOptions())
+      : send_(std::move(send)), options_(options) {}
+
+  Batcher(const Batcher&) = delete;
+  Batcher& operator=(const Batcher&) = delete;
+
+  // Blocks until the batch with |item| has been sent and returns the status
+  // of sending it, or of |item| if the batch was sent.
+  absl::Status Add(T item) {
+    absl::MutexLock lock(&mutex_);
+    if (open_batch_ == nullptr) {
+      open_batch_ = std::make_shared<Batch>();
+    }
+    const std::shared_ptr<Batch> batch = open_batch_;
+    const size_t index = batch->items.size();
+    batch->items.push_back(std::move(item));
+    if (batch->items.size() >= options_.max_batch_size) {
+      Send(batch);
+    } else if (batch->items.size() == 1) {
+      // The first caller sends the batch if it doesn't fill up in time.
+      const auto closed = [this, &batch]() {
+        mutex_.AssertReaderHeld();
+        return open_batch_ != batch;
+      };
+      if (!mutex_.AwaitWithDeadline(absl::Condition(&closed),
+                                    absl::Now() + options_.max_delay)) {
+        Send(batch);
+      }
+    }
+    mutex_.Await(absl::Condition(&batch->sent));
+    if (!batch->status.ok()) {
+      return batch->status;
+    }
+    return batch->item_statuses[index];
+  }
+
+ private:
+  struct Batch {
+    std::vector<T> items;
+    bool sent = false;
+    absl::Status status;
+    std::vector<absl::Status> item_statuses;
+  };
+
+  // Closes |batch| to new items and sends it. Releases mutex_ while sending.
+  void Send(const std::shared_ptr<Batch>& batch)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    open_batch_ = nullptr;
+    // No other thread touches a closed batch's items, and releasing the lock
+    // lets the next batch fill up while this one is sent.
+    mutex_.Unlock();
+    batch->item_statuses.resize(batch->items.size());
+    const absl::Status status =
+        send_(batch->items, absl::MakeSpan(batch->item_statuses));
+    mutex_.Lock();
+    batch->status = status;
+    batch->sent = true;
+  }
+
+  const PartialSendFunction send_;
+  const BatcherOptions options_;
+  absl::Mutex mutex_;
+  // Batch that new items join. Null until the next item starts one.
+  std::shared_ptr<Batch> open_batch_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace utils
+
+#endif  // SRC_UTILS_BATCHER_H_
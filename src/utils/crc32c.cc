@@ -0,0 +1,35 @@
+#include "src/utils/crc32c.h"
+
+#include <array>
+
+namespace utils {
+
+namespace {
+
+// Reversed Castagnoli polynomial.
+constexpr uint32_t kPolynomial = 0x82f63b78;
+
+std::array<uint32_t, 256> MakeTable() {
+  std::array<uint32_t, 256> table;
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (crc & 1 ? kPolynomial : 0);
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+}  // namespace
+
+uint32_t ExtendCrc32c(uint32_t crc, std::string_view data) {
+  static const std::array<uint32_t, 256> table = MakeTable();
+  crc = ~crc;
+  for (const char c : data) {
+    crc = (crc >> 8) ^ table[(crc ^ static_cast<uint8_t>(c)) & 0xff];
+  }
+  return ~crc;
+}
+
+}  // namespace utils
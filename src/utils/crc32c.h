@@ -0,0 +1,16 @@
+#ifndef SRC_UTILS_CRC32C_H_
+
+#define SRC_UTILS_CRC32C_H_
+
+#include <cstdint>
+#include <string_view>
+
+namespace utils {
+
+// Returns the CRC-32C (Castagnoli) checksum of the data that had checksum
+// |crc| followed by |data|. Start with a |crc| of 0.
+uint32_t ExtendCrc32c(uint32_t crc, std::string_view data);
+
+}  // namespace utils
+
+#endif  // SRC_UTILS_CRC32C_H_
@@ -0,0 +1,89 @@
+#ifndef SRC_UTILS_SHARDED_MAP_H_
+
+#define SRC_UTILS_SHARDED_MAP_H_
+
+#include <array>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/synchronization/mutex.h"
+
+namespace utils {
+
+// Thread-safe map from string keys to values, split into independently locked
+// shards so threads working on different keys rarely contend.
+// Values are heap allocated and never move, so a pointer returned by
+// TryEmplace or Find stays valid until that key is erased. The map only
+// synchronizes its own structure: callers must ensure a value is not accessed
+// by one thread while another thread erases it or mutates it.
+template <typename Value, size_t kNumShards = 16>
+class ShardedMap {
+ public:
+  ShardedMap() = default;
+  ShardedMap(const ShardedMap&) = delete;
+  ShardedMap& operator=(const ShardedMap&) = delete;
+
+  // Inserts a default constructed value for |key| if there isn't one already.
+  // Returns the value for |key| and whether it was inserted.
+  std::pair<Value*, bool> TryEmplace(const std::string& key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    std::unique_ptr<Value>& value = shard.values[key];
+    const bool inserted = value == nullptr;
+    if (inserted) {
+      value = std::make_unique<Value>();
+    }
+    return {value.get(), inserted};
+  }
+
+  // Returns the value for |key| or nullptr if there isn't one.
+  Value* Find(const std::string& key) const {
+    const Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    auto it = shard.values.find(key);
+    return it == shard.values.end() ? nullptr : it->second.get();
+  }
+
+  bool Contains(const std::string& key) const { return Find(key) != nullptr; }
+
+  // Removes the value for |key|. Returns false if there wasn't one.
+  bool Erase(const std::string& key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    return shard.values.erase(key) > 0;
+  }
+
+  // Number of values across all shards. Only a snapshot since other threads
+  // may be modifying the map concurrently.
+  size_t size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards_) {
+      absl::MutexLock lock(&shard.mutex);
+      total += shard.values.size();
+    }
+    return total;
+  }
+
+ private:
+  struct Shard {
+    mutable absl::Mutex mutex;
+    absl::flat_hash_map<std::string, std::unique_ptr<Value>> values
+        ABSL_GUARDED_BY(mutex);
+  };
+
+  Shard& GetShard(const std::string& key) {
+    return shards_[absl::Hash<std::string>{}(key) % kNumShards];
+  }
+  const Shard& GetShard(const std::string& key) const {
+    return shards_[absl::Hash<std::string>{}(key) % kNumShards];
+  }
+
+  std::array<Shard, kNumShards> shards_;
+};
+
+}  // namespace utils
+
+#endif  // SRC_UTILS_SHARDED_MAP_H_